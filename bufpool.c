@@ -0,0 +1,155 @@
+/*-
+ * bufpool.c - Budgeted pool of reusable buffers.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bufpool.h"
+#include "units.h"
+
+void bufpool_init(
+	struct bufpool *pool,
+	size_t budget)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->budget = budget ? budget : BUFPOOL_DEFAULT_BUDGET;
+	pthread_mutex_init(&pool->lock, NULL);
+}
+
+/**
+ * Returns the size class for @size, or -1 if it's too large to be pooled.
+ */
+static int bufpool_class(
+	size_t size)
+{
+	int shift = BUFPOOL_MIN_SHIFT;
+
+	while(((size_t) 1 << shift) < size) {
+		if(++shift > BUFPOOL_MAX_SHIFT) {
+			return -1;
+		}
+	}
+
+	return shift - BUFPOOL_MIN_SHIFT;
+}
+
+void* bufpool_get(
+	struct bufpool *pool,
+	size_t size,
+	size_t *out_capacity)
+{
+	const int class = bufpool_class(size);
+	const size_t capacity = (class < 0) ? size :
+		(size_t) 1 << (class + BUFPOOL_MIN_SHIFT);
+	void *buf = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	if(class >= 0 && pool->free_lists[class]) {
+		buf = pool->free_lists[class];
+		pool->free_lists[class] = pool->free_lists[class]->next;
+		pool->cached -= capacity;
+	}
+	pool->in_use += capacity;
+	pthread_mutex_unlock(&pool->lock);
+
+	if(!buf && !(buf = malloc(capacity))) {
+		pthread_mutex_lock(&pool->lock);
+		pool->in_use -= capacity;
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+
+	*out_capacity = capacity;
+
+	return buf;
+}
+
+void bufpool_put(
+	struct bufpool *pool,
+	void *buf,
+	size_t capacity)
+{
+	const int class = bufpool_class(capacity);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->in_use -= capacity;
+	if(class >= 0 && pool->cached + capacity <= pool->budget / 4) {
+		struct bufpool_free *entry = buf;
+
+		entry->next = pool->free_lists[class];
+		pool->free_lists[class] = entry;
+		pool->cached += capacity;
+		buf = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if(buf) {
+		free(buf);
+	}
+}
+
+int bufpool_over_budget(
+	struct bufpool *pool)
+{
+	int res;
+
+	pthread_mutex_lock(&pool->lock);
+	res = pool->in_use > pool->budget;
+	pthread_mutex_unlock(&pool->lock);
+
+	return res;
+}
+
+void bufpool_destroy(
+	struct bufpool *pool)
+{
+	size_t i;
+
+	for(i = 0; i < BUFPOOL_CLASSES; ++i) {
+		while(pool->free_lists[i]) {
+			struct bufpool_free *entry = pool->free_lists[i];
+
+			pool->free_lists[i] = entry->next;
+			free(entry);
+		}
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+}
+
+int bufpool_parse_size(
+	const char *s,
+	size_t *out_size)
+{
+	unsigned long long size;
+
+	if(units_parse(s, SIZE_MAX, &size)) {
+		return -1;
+	}
+
+	*out_size = (size_t) size;
+
+	return 0;
+}
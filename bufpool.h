@@ -0,0 +1,103 @@
+/*-
+ * bufpool.h - Budgeted pool of reusable buffers.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_BUFPOOL_H
+#define _XATTRPROGS_BUFPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Buffers are rounded up to a power of two between these sizes and kept on a
+ * free list per size when they are returned. Larger buffers are allocated
+ * and freed directly. */
+#define BUFPOOL_MIN_SHIFT 8
+#define BUFPOOL_MAX_SHIFT 24
+#define BUFPOOL_CLASSES (BUFPOOL_MAX_SHIFT - BUFPOOL_MIN_SHIFT + 1)
+
+/* Default budget when none is given. */
+#define BUFPOOL_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+struct bufpool_free {
+	struct bufpool_free *next;
+};
+
+/**
+ * A pool of buffers for data that is held in memory until it can be written
+ * out. The pool keeps count of the bytes handed out and lets the user hold
+ * back producers while that's above the budget. Returned buffers are reused,
+ * as long as the cached buffers stay within a quarter of the budget.
+ */
+struct bufpool {
+	pthread_mutex_t lock;
+	size_t budget;
+	size_t in_use;
+	size_t cached;
+	struct bufpool_free *free_lists[BUFPOOL_CLASSES];
+};
+
+/**
+ * Set up @pool with a budget of @budget bytes (0 means the default).
+ */
+void bufpool_init(
+	struct bufpool *pool,
+	size_t budget);
+
+/**
+ * Get a buffer of at least @size bytes. The capacity of the buffer, which
+ * must be passed back to bufpool_put, is stored in *@out_capacity. Never
+ * blocks; getting a buffer may take the pool over its budget.
+ *
+ * Returns NULL with errno set if the buffer couldn't be allocated.
+ */
+void* bufpool_get(
+	struct bufpool *pool,
+	size_t size,
+	size_t *out_capacity);
+
+/**
+ * Return a buffer obtained with bufpool_get.
+ */
+void bufpool_put(
+	struct bufpool *pool,
+	void *buf,
+	size_t capacity);
+
+/**
+ * Returns non-zero if the buffers handed out add up to more than the budget.
+ * Producers should wait for buffers to be returned before adding more data.
+ */
+int bufpool_over_budget(
+	struct bufpool *pool);
+
+/**
+ * Free all cached buffers. All handed out buffers must have been returned.
+ */
+void bufpool_destroy(
+	struct bufpool *pool);
+
+/**
+ * Parse a size like "64M" (suffixes K, M and G, powers of 1024). Returns 0 on
+ * success, -1 if @s isn't a valid size.
+ */
+int bufpool_parse_size(
+	const char *s,
+	size_t *out_size);
+
+#endif /* !defined(_XATTRPROGS_BUFPOOL_H) */
@@ -0,0 +1,428 @@
+/*-
+ * checkpoint.c - Checkpoints for resuming interrupted runs.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "dump.h"
+#include "outbuf.h"
+
+#define CHECKPOINT_MAGIC "# xattrprogs checkpoint\n"
+
+/* 64-bit FNV-1a, for the hash of the arguments. */
+#define CHECKPOINT_FNV_OFFSET 0xcbf29ce484222325ULL
+#define CHECKPOINT_FNV_PRIME 0x100000001b3ULL
+
+void checkpoint_init(
+	struct checkpoint *checkpoint,
+	const char *file,
+	const char *tool,
+	const char *mode)
+{
+	memset(checkpoint, 0, sizeof(*checkpoint));
+	checkpoint->file = file;
+	checkpoint->tool = tool;
+	checkpoint->mode = mode;
+	checkpoint->last_save = time(NULL);
+}
+
+static int checkpoint_parse_number(
+	const char *s,
+	unsigned long long *out_value)
+{
+	char *end = NULL;
+
+	if(*s < '0' || *s > '9') {
+		return -1;
+	}
+
+	errno = 0;
+	*out_value = strtoull(s, &end, 10);
+	if(errno || *end) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int checkpoint_parse_hash(
+	const char *s,
+	unsigned long long *out_value)
+{
+	char *end = NULL;
+
+	if(!((*s >= '0' && *s <= '9') || (*s >= 'a' && *s <= 'f'))) {
+		return -1;
+	}
+
+	errno = 0;
+	*out_value = strtoull(s, &end, 16);
+	if(errno || *end) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int checkpoint_load(
+	struct checkpoint *checkpoint,
+	const char *file)
+{
+	int ret = -1;
+	FILE *f = NULL;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t line_length;
+	unsigned long long lineno = 0;
+	int have_tool = 0;
+	int have_mode = 0;
+	int have_position = 0;
+
+	f = fopen(file, "r");
+	if(!f) {
+		fprintf(stderr, "Error while opening checkpoint \"%s\": %s "
+			"(errno=%d)\n", file, strerror(errno),
+			errno);
+		goto out;
+	}
+
+	while((line_length = getline(&line, &line_size, f)) >= 0) {
+		char *value;
+		const char *bad = NULL;
+
+		++lineno;
+		if(line_length && line[line_length - 1] == '\n') {
+			line[--line_length] = '\0';
+		}
+
+		if(!line_length || line[0] == '#') {
+			continue;
+		}
+
+		value = strchr(line, '=');
+		if(!value) {
+			bad = "Malformed line";
+			goto bad_line;
+		}
+		*value++ = '\0';
+
+		if(!strcmp(line, "tool")) {
+			if(strcmp(value, checkpoint->tool)) {
+				fprintf(stderr, "Error: Checkpoint \"%s\" was "
+					"written by %s, not %s.\n",
+					file, value,
+					checkpoint->tool);
+				goto out;
+			}
+			have_tool = 1;
+		}
+		else if(!strcmp(line, "mode")) {
+			if(strcmp(value, checkpoint->mode)) {
+				fprintf(stderr, "Error: Checkpoint \"%s\" is "
+					"for a different kind of operation "
+					"(%s, not %s).\n", file,
+					value, checkpoint->mode);
+				goto out;
+			}
+			have_mode = 1;
+		}
+		else if(!strcmp(line, "position")) {
+			if(checkpoint_parse_number(value,
+				&checkpoint->position))
+			{
+				bad = "Invalid position";
+				goto bad_line;
+			}
+			have_position = 1;
+		}
+		else if(!strcmp(line, "path")) {
+			size_t path_length;
+
+			path_length = dump_unescape(value, strlen(value));
+			value[path_length] = '\0';
+			if(checkpoint_set_path(checkpoint, value)) {
+				fprintf(stderr, "Error while allocating "
+					"memory: %s (errno=%d)\n",
+					strerror(errno), errno);
+				goto out;
+			}
+		}
+		else if(!strcmp(line, "args")) {
+			if(checkpoint_parse_hash(value,
+				&checkpoint->loaded_args))
+			{
+				bad = "Invalid argument hash";
+				goto bad_line;
+			}
+			checkpoint->have_loaded_args = 1;
+		}
+		else if(!strcmp(line, "done")) {
+			if(checkpoint_parse_number(value, &checkpoint->done)) {
+				bad = "Invalid node count";
+				goto bad_line;
+			}
+		}
+		else if(!strcmp(line, "errors")) {
+			if(checkpoint_parse_number(value,
+				&checkpoint->errors))
+			{
+				bad = "Invalid error count";
+				goto bad_line;
+			}
+		}
+
+		/* Unknown keys are ignored. */
+		continue;
+	bad_line:
+		fprintf(stderr, "Error: %s in checkpoint \"%s\" line %llu.\n",
+			bad, file, lineno);
+		goto out;
+	}
+
+	if(ferror(f)) {
+		fprintf(stderr, "Error while reading checkpoint \"%s\": %s "
+			"(errno=%d)\n", file, strerror(errno),
+			errno);
+		goto out;
+	}
+
+	if(!have_tool || !have_mode || !have_position) {
+		fprintf(stderr, "Error: Checkpoint \"%s\" is incomplete.\n",
+			file);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	free(line);
+	if(f) {
+		fclose(f);
+	}
+
+	return ret;
+}
+
+void checkpoint_hash_args(
+	struct checkpoint *checkpoint,
+	const void *data,
+	size_t size)
+{
+	const unsigned char *const bytes = data;
+	unsigned long long hash = checkpoint->have_args ?
+		checkpoint->args : CHECKPOINT_FNV_OFFSET;
+	unsigned long long length = size;
+	size_t i;
+
+	for(i = 0; i < sizeof(length); ++i) {
+		hash = (hash ^ ((length >> (8 * i)) & 0xff)) *
+			CHECKPOINT_FNV_PRIME;
+	}
+
+	for(i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * CHECKPOINT_FNV_PRIME;
+	}
+
+	checkpoint->args = hash;
+	checkpoint->have_args = 1;
+}
+
+void checkpoint_hash_arg_list(
+	struct checkpoint *checkpoint,
+	char *const *strings,
+	size_t count)
+{
+	size_t i;
+
+	for(i = 0; i < count; ++i) {
+		checkpoint_hash_args(checkpoint, strings[i],
+			strlen(strings[i]));
+	}
+}
+
+int checkpoint_check_args(
+	const struct checkpoint *checkpoint,
+	const char *file)
+{
+	if(checkpoint->have_loaded_args != checkpoint->have_args ||
+		checkpoint->loaded_args != checkpoint->args)
+	{
+		fprintf(stderr, "Error: Checkpoint \"%s\" was saved for "
+			"different attributes or files.\n", file);
+		return -1;
+	}
+
+	return 0;
+}
+
+int checkpoint_due(
+	const struct checkpoint *checkpoint)
+{
+	return time(NULL) - checkpoint->last_save >= CHECKPOINT_INTERVAL;
+}
+
+int checkpoint_set_path(
+	struct checkpoint *checkpoint,
+	const char *path)
+{
+	char *copy;
+
+	copy = strdup(path);
+	if(!copy) {
+		return -1;
+	}
+
+	free(checkpoint->path);
+	checkpoint->path = copy;
+	return 0;
+}
+
+int checkpoint_save(
+	struct checkpoint *checkpoint)
+{
+	int ret = -1;
+	struct outbuf out;
+	char *tmp_file = NULL;
+	char number[32];
+	size_t file_length;
+	int fd = -1;
+	size_t written = 0;
+	int res;
+
+	memset(&out, 0, sizeof(out));
+
+	outbuf_puts(&out, CHECKPOINT_MAGIC);
+	outbuf_puts(&out, "tool=");
+	outbuf_puts(&out, checkpoint->tool);
+	outbuf_puts(&out, "\nmode=");
+	outbuf_puts(&out, checkpoint->mode);
+	snprintf(number, sizeof(number), "%llu", checkpoint->position);
+	outbuf_puts(&out, "\nposition=");
+	outbuf_puts(&out, number);
+	outbuf_putc(&out, '\n');
+	if(checkpoint->path) {
+		/* '=' isn't escaped by the dump format, but only the first one
+		 * on a line separates the key from the value. */
+		outbuf_puts(&out, "path=");
+		dump_put_escaped(&out, checkpoint->path,
+			strlen(checkpoint->path));
+		outbuf_putc(&out, '\n');
+	}
+	if(checkpoint->have_args) {
+		snprintf(number, sizeof(number), "%016llx", checkpoint->args);
+		outbuf_puts(&out, "args=");
+		outbuf_puts(&out, number);
+		outbuf_putc(&out, '\n');
+	}
+	snprintf(number, sizeof(number), "%llu", checkpoint->done);
+	outbuf_puts(&out, "done=");
+	outbuf_puts(&out, number);
+	snprintf(number, sizeof(number), "%llu", checkpoint->errors);
+	outbuf_puts(&out, "\nerrors=");
+	outbuf_puts(&out, number);
+	outbuf_putc(&out, '\n');
+	if(out.failed) {
+		errno = ENOMEM;
+		goto error;
+	}
+
+	file_length = strlen(checkpoint->file);
+	tmp_file = malloc(file_length + 5);
+	if(!tmp_file) {
+		goto error;
+	}
+	memcpy(tmp_file, checkpoint->file, file_length);
+	memcpy(&tmp_file[file_length], ".tmp", 5);
+
+	fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd == -1) {
+		goto error;
+	}
+
+	while(written < out.len) {
+		ssize_t count;
+
+		count = write(fd, &out.data[written], out.len - written);
+		if(count < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			goto error;
+		}
+
+		written += (size_t) count;
+	}
+
+	if(fsync(fd)) {
+		goto error;
+	}
+
+	res = close(fd);
+	fd = -1;
+	if(res) {
+		goto error;
+	}
+
+	if(rename(tmp_file, checkpoint->file)) {
+		goto error;
+	}
+
+	checkpoint->last_save = time(NULL);
+	ret = 0;
+	goto out;
+error:
+	fprintf(stderr, "Error while writing checkpoint \"%s\": %s "
+		"(errno=%d)\n", checkpoint->file, strerror(errno), errno);
+	if(fd != -1) {
+		close(fd);
+	}
+	if(tmp_file) {
+		unlink(tmp_file);
+	}
+out:
+	free(tmp_file);
+	outbuf_free(&out);
+
+	return ret;
+}
+
+void checkpoint_finish(
+	struct checkpoint *checkpoint,
+	int completed)
+{
+	if(completed && unlink(checkpoint->file) && errno != ENOENT) {
+		fprintf(stderr, "Error while removing checkpoint \"%s\": %s "
+			"(errno=%d)\n", checkpoint->file, strerror(errno),
+			errno);
+	}
+
+	free(checkpoint->path);
+	checkpoint->path = NULL;
+}
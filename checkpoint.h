@@ -0,0 +1,152 @@
+/*-
+ * checkpoint.h - Checkpoints for resuming interrupted runs.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_CHECKPOINT_H
+#define _XATTRPROGS_CHECKPOINT_H
+
+#include <time.h>
+
+/* Minimum number of seconds between two checkpoints. */
+#define CHECKPOINT_INTERVAL 10
+
+/*
+ * A checkpoint records how far a long running operation has come, so that
+ * it can be resumed after an interruption without repeating the work that
+ * was done. It's a small text file that is replaced atomically:
+ *
+ *   # xattrprogs checkpoint
+ *   tool=<tool name>
+ *   mode=<scan|args|input>
+ *   position=<n>
+ *   path=<escaped path>
+ *   args=<hash>
+ *   done=<n>
+ *   errors=<n>
+ *
+ * The meaning of position depends on the mode: the index of the root being
+ * scanned (scan), the index of the next file argument (args) or the offset in
+ * the input of the next unprocessed byte (input). path is the last node of a
+ * scan whose output has been written (all nodes before it in the scan's
+ * sorted order have been too). args is a hash of the attribute names, value
+ * and file arguments of an args mode operation, as a position in the file
+ * list only means something for the same list. done and errors count nodes.
+ */
+struct checkpoint {
+	const char *file;
+	const char *tool;
+	const char *mode;
+	time_t last_save;
+
+	unsigned long long position;
+	char *path;
+	unsigned long long done;
+	unsigned long long errors;
+
+	/* The hash of the arguments built by checkpoint_hash_args, and the
+	 * one read by checkpoint_load if the checkpoint had one. */
+	unsigned long long args;
+	int have_args;
+	unsigned long long loaded_args;
+	int have_loaded_args;
+};
+
+/**
+ * Set up @checkpoint to be written to @file.
+ */
+void checkpoint_init(
+	struct checkpoint *checkpoint,
+	const char *file,
+	const char *tool,
+	const char *mode);
+
+/**
+ * Read the progress recorded in the checkpoint file @file. Fails if it was
+ * written by a different tool or for a different mode.
+ *
+ * Returns 0 on success, or -1 after reporting an error.
+ */
+int checkpoint_load(
+	struct checkpoint *checkpoint,
+	const char *file);
+
+/**
+ * Add @size bytes at @data (an attribute name, value or file name) to the
+ * hash of the arguments that is saved with the checkpoint. Each call is
+ * hashed along with its size, so consecutive arguments can't run into each
+ * other.
+ */
+void checkpoint_hash_args(
+	struct checkpoint *checkpoint,
+	const void *data,
+	size_t size);
+
+/**
+ * Add the @count strings @strings to the hash of the arguments, as with
+ * checkpoint_hash_args for each one.
+ */
+void checkpoint_hash_arg_list(
+	struct checkpoint *checkpoint,
+	char *const *strings,
+	size_t count);
+
+/**
+ * Check that the checkpoint read from @file by checkpoint_load was saved for
+ * the same arguments as those given to checkpoint_hash_args.
+ *
+ * Returns 0 if so, or -1 after reporting an error.
+ */
+int checkpoint_check_args(
+	const struct checkpoint *checkpoint,
+	const char *file);
+
+/**
+ * Returns non-zero if CHECKPOINT_INTERVAL seconds have passed since the last
+ * checkpoint was saved.
+ */
+int checkpoint_due(
+	const struct checkpoint *checkpoint);
+
+/**
+ * Replace the path of the last finished node.
+ *
+ * Returns 0 on success, or -1 with errno set if memory couldn't be allocated.
+ */
+int checkpoint_set_path(
+	struct checkpoint *checkpoint,
+	const char *path);
+
+/**
+ * Write the checkpoint file. The data is flushed to disk before the new file
+ * replaces the old one, so an interruption leaves either of them in place.
+ *
+ * Returns 0 on success, or -1 after reporting an error.
+ */
+int checkpoint_save(
+	struct checkpoint *checkpoint);
+
+/**
+ * Release @checkpoint. When @completed is set the operation finished and the
+ * checkpoint file is removed.
+ */
+void checkpoint_finish(
+	struct checkpoint *checkpoint,
+	int completed);
+
+#endif /* !defined(_XATTRPROGS_CHECKPOINT_H) */
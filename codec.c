@@ -0,0 +1,667 @@
+/*-
+ * codec.c - Hex and base64 encoding of attribute values.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include "codec.h"
+
+/*
+ * Encoding runs from the end of the value towards the start and decoding from
+ * the start towards the end. Each step reads its input before it writes its
+ * output, and the output of a step never lands before its input (encoding)
+ * or after it (decoding), so both work in place in the value buffer.
+ */
+
+static const char codec_hex_digits[] = "0123456789abcdef";
+
+static const char codec_base64_digits[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int codec_parse_encoding(
+	const char *s,
+	enum codec_encoding *out_encoding)
+{
+	if(!strcmp(s, "hex")) {
+		*out_encoding = CODEC_ENCODING_HEX;
+	}
+	else if(!strcmp(s, "base64")) {
+		*out_encoding = CODEC_ENCODING_BASE64;
+	}
+	else {
+		return -1;
+	}
+
+	return 0;
+}
+
+const char* codec_prefix(
+	enum codec_encoding encoding)
+{
+	switch(encoding) {
+	case CODEC_ENCODING_HEX:
+		return "0x";
+	case CODEC_ENCODING_BASE64:
+		return "0s";
+	default:
+		return "";
+	}
+}
+
+size_t codec_encoded_length(
+	enum codec_encoding encoding,
+	size_t len)
+{
+	switch(encoding) {
+	case CODEC_ENCODING_HEX:
+		return len * 2;
+	case CODEC_ENCODING_BASE64:
+		return (len + 2) / 3 * 4;
+	default:
+		return len;
+	}
+}
+
+static int codec_hex_value(
+	unsigned char c)
+{
+	if(c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	else if(c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	else if(c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+static int codec_base64_value(
+	unsigned char c)
+{
+	if(c >= 'A' && c <= 'Z') {
+		return c - 'A';
+	}
+	else if(c >= 'a' && c <= 'z') {
+		return c - 'a' + 26;
+	}
+	else if(c >= '0' && c <= '9') {
+		return c - '0' + 52;
+	}
+	else if(c == '+') {
+		return 62;
+	}
+	else if(c == '/') {
+		return 63;
+	}
+
+	return -1;
+}
+
+static void codec_hex_encode_scalar(
+	const unsigned char *src,
+	size_t len,
+	char *dst)
+{
+	size_t i = len;
+
+	while(i--) {
+		const unsigned char c = src[i];
+
+		dst[2 * i + 1] = codec_hex_digits[c & 0xf];
+		dst[2 * i] = codec_hex_digits[c >> 4];
+	}
+}
+
+/**
+ * Decode @len hex digit pairs. Returns the number of pairs decoded before an
+ * invalid digit was found.
+ */
+static size_t codec_hex_decode_scalar(
+	const unsigned char *src,
+	size_t len,
+	unsigned char *dst)
+{
+	size_t i;
+
+	for(i = 0; i < len; ++i) {
+		const int hi = codec_hex_value(src[2 * i]);
+		const int lo = codec_hex_value(src[2 * i + 1]);
+
+		if(hi < 0 || lo < 0) {
+			break;
+		}
+
+		dst[i] = (unsigned char) ((hi << 4) | lo);
+	}
+
+	return i;
+}
+
+static void codec_base64_encode_scalar(
+	const unsigned char *src,
+	size_t len,
+	char *dst)
+{
+	size_t groups = len / 3;
+
+	if(len % 3) {
+		const unsigned char b0 = src[groups * 3];
+		const unsigned char b1 =
+			(len % 3 == 2) ? src[groups * 3 + 1] : 0;
+		char *out = &dst[groups * 4];
+
+		out[0] = codec_base64_digits[b0 >> 2];
+		out[1] = codec_base64_digits[((b0 & 0x3) << 4) | (b1 >> 4)];
+		out[2] = (len % 3 == 2) ?
+			codec_base64_digits[(b1 & 0xf) << 2] : '=';
+		out[3] = '=';
+	}
+
+	while(groups--) {
+		const unsigned char *in = &src[groups * 3];
+		const unsigned long v = ((unsigned long) in[0] << 16) |
+			((unsigned long) in[1] << 8) | in[2];
+		char *out = &dst[groups * 4];
+
+		out[3] = codec_base64_digits[v & 0x3f];
+		out[2] = codec_base64_digits[(v >> 6) & 0x3f];
+		out[1] = codec_base64_digits[(v >> 12) & 0x3f];
+		out[0] = codec_base64_digits[v >> 18];
+	}
+}
+
+/**
+ * Decode the unpadded base64 data at @src. Returns the decoded length, or -1
+ * if the data is invalid.
+ */
+static ssize_t codec_base64_decode_scalar(
+	const unsigned char *src,
+	size_t len,
+	unsigned char *dst)
+{
+	size_t i;
+	size_t o = 0;
+
+	if(len % 4 == 1) {
+		return -1;
+	}
+
+	for(i = 0; i < len; i += 4) {
+		const size_t n = (len - i < 4) ? len - i : 4;
+		unsigned long v = 0;
+		size_t j;
+
+		for(j = 0; j < 4; ++j) {
+			const int c =
+				(j < n) ? codec_base64_value(src[i + j]) : 0;
+
+			if(c < 0) {
+				return -1;
+			}
+
+			v = (v << 6) | (unsigned long) c;
+		}
+
+		dst[o++] = (unsigned char) (v >> 16);
+		if(n > 2) {
+			dst[o++] = (unsigned char) (v >> 8);
+		}
+		if(n > 3) {
+			dst[o++] = (unsigned char) v;
+		}
+	}
+
+	return (ssize_t) o;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* Vectorized codecs. Each one handles the whole blocks at the start of the
+ * data and leaves the rest to the next narrower implementation. */
+
+__attribute__((target("sse2")))
+static __m128i codec_hex_digits_sse2(
+	__m128i nibbles)
+{
+	/* '0' + n, plus the distance from '9' + 1 to 'a' for n > 9. */
+	const __m128i letters = _mm_and_si128(
+		_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+		_mm_set1_epi8('a' - '9' - 1));
+
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+		letters);
+}
+
+__attribute__((target("sse2")))
+static void codec_hex_encode_sse2(
+	const unsigned char *src,
+	size_t len,
+	char *dst)
+{
+	const __m128i mask = _mm_set1_epi8(0xf);
+	size_t i = len / 16 * 16;
+
+	codec_hex_encode_scalar(&src[i], len - i, &dst[2 * i]);
+
+	while(i) {
+		__m128i v;
+		__m128i hi;
+		__m128i lo;
+
+		i -= 16;
+		v = _mm_loadu_si128((const __m128i*) &src[i]);
+		hi = codec_hex_digits_sse2(
+			_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		lo = codec_hex_digits_sse2(_mm_and_si128(v, mask));
+
+		_mm_storeu_si128((__m128i*) &dst[2 * i + 16],
+			_mm_unpackhi_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*) &dst[2 * i],
+			_mm_unpacklo_epi8(hi, lo));
+	}
+}
+
+__attribute__((target("avx2")))
+static __m256i codec_hex_digits_avx2(
+	__m256i nibbles)
+{
+	const __m256i letters = _mm256_and_si256(
+		_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)),
+		_mm256_set1_epi8('a' - '9' - 1));
+
+	return _mm256_add_epi8(_mm256_add_epi8(nibbles,
+		_mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+static void codec_hex_encode_avx2(
+	const unsigned char *src,
+	size_t len,
+	char *dst)
+{
+	const __m256i mask = _mm256_set1_epi8(0xf);
+	size_t i = len / 32 * 32;
+
+	codec_hex_encode_sse2(&src[i], len - i, &dst[2 * i]);
+
+	while(i) {
+		__m256i v;
+		__m256i hi;
+		__m256i lo;
+		__m256i first;
+		__m256i second;
+
+		i -= 32;
+		v = _mm256_loadu_si256((const __m256i*) &src[i]);
+		hi = codec_hex_digits_avx2(
+			_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		lo = codec_hex_digits_avx2(_mm256_and_si256(v, mask));
+
+		/* The unpack instructions work within 128-bit lanes, put
+		 * the lanes back in order. */
+		first = _mm256_unpacklo_epi8(hi, lo);
+		second = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i*) &dst[2 * i + 32],
+			_mm256_permute2x128_si256(first, second, 0x31));
+		_mm256_storeu_si256((__m256i*) &dst[2 * i],
+			_mm256_permute2x128_si256(first, second, 0x20));
+	}
+}
+
+/**
+ * Turn hex digits into their values. Lanes that aren't hex digits are
+ * flagged in *@invalid.
+ */
+__attribute__((target("sse2")))
+static __m128i codec_hex_values_sse2(
+	__m128i c,
+	__m128i *invalid)
+{
+	const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	const __m128i letter = _mm_sub_epi8(
+		_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	const __m128i is_digit = _mm_cmpeq_epi8(
+		_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	const __m128i is_letter = _mm_cmpeq_epi8(
+		_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+	*invalid = _mm_or_si128(*invalid, _mm_andnot_si128(
+		_mm_or_si128(is_digit, is_letter), _mm_set1_epi8(-1)));
+
+	return _mm_or_si128(_mm_and_si128(is_digit, digit),
+		_mm_and_si128(is_letter,
+		_mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+/**
+ * Combine the digit pairs in each 16-bit lane into a byte (in the low half of
+ * the lane).
+ */
+__attribute__((target("sse2")))
+static __m128i codec_hex_pairs_sse2(
+	__m128i values)
+{
+	return _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0xff)), 4),
+		_mm_srli_epi16(values, 8));
+}
+
+__attribute__((target("sse2")))
+static size_t codec_hex_decode_sse2(
+	const unsigned char *src,
+	size_t len,
+	unsigned char *dst)
+{
+	size_t i;
+
+	for(i = 0; i + 16 <= len; i += 16) {
+		__m128i invalid = _mm_setzero_si128();
+		const __m128i a = codec_hex_values_sse2(_mm_loadu_si128(
+			(const __m128i*) &src[2 * i]), &invalid);
+		const __m128i b = codec_hex_values_sse2(_mm_loadu_si128(
+			(const __m128i*) &src[2 * i + 16]), &invalid);
+
+		if(_mm_movemask_epi8(invalid)) {
+			break;
+		}
+
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_packus_epi16(
+			codec_hex_pairs_sse2(a), codec_hex_pairs_sse2(b)));
+	}
+
+	return i + codec_hex_decode_scalar(&src[2 * i], len - i, &dst[i]);
+}
+
+__attribute__((target("avx2")))
+static __m256i codec_hex_values_avx2(
+	__m256i c,
+	__m256i *invalid)
+{
+	const __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	const __m256i letter = _mm256_sub_epi8(
+		_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+		_mm256_set1_epi8('a'));
+	const __m256i is_digit = _mm256_cmpeq_epi8(
+		_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+	const __m256i is_letter = _mm256_cmpeq_epi8(
+		_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+
+	*invalid = _mm256_or_si256(*invalid, _mm256_andnot_si256(
+		_mm256_or_si256(is_digit, is_letter), _mm256_set1_epi8(-1)));
+
+	return _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+		_mm256_and_si256(is_letter,
+		_mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2")))
+static __m256i codec_hex_pairs_avx2(
+	__m256i values)
+{
+	return _mm256_or_si256(_mm256_slli_epi16(
+		_mm256_and_si256(values, _mm256_set1_epi16(0xff)), 4),
+		_mm256_srli_epi16(values, 8));
+}
+
+__attribute__((target("avx2")))
+static size_t codec_hex_decode_avx2(
+	const unsigned char *src,
+	size_t len,
+	unsigned char *dst)
+{
+	size_t i;
+
+	for(i = 0; i + 32 <= len; i += 32) {
+		__m256i invalid = _mm256_setzero_si256();
+		const __m256i a = codec_hex_values_avx2(_mm256_loadu_si256(
+			(const __m256i*) &src[2 * i]), &invalid);
+		const __m256i b = codec_hex_values_avx2(_mm256_loadu_si256(
+			(const __m256i*) &src[2 * i + 32]), &invalid);
+
+		if(_mm256_movemask_epi8(invalid)) {
+			break;
+		}
+
+		/* Packing works within 128-bit lanes, restore the order. */
+		_mm256_storeu_si256((__m256i*) &dst[i],
+			_mm256_permute4x64_epi64(_mm256_packus_epi16(
+			codec_hex_pairs_avx2(a), codec_hex_pairs_avx2(b)),
+			0xd8));
+	}
+
+	return i + codec_hex_decode_sse2(&src[2 * i], len - i, &dst[i]);
+}
+
+/* The base64 codecs below follow the SSSE3 algorithms by Wojciech Mula and
+ * Alfred Klomp. */
+
+__attribute__((target("ssse3")))
+static void codec_base64_encode_ssse3(
+	const unsigned char *src,
+	size_t len,
+	char *dst)
+{
+	/* Each block reads 16 bytes of which 12 are encoded. */
+	size_t blocks = (len >= 16) ? (len - 16) / 12 + 1 : 0;
+
+	codec_base64_encode_scalar(&src[blocks * 12], len - blocks * 12,
+		&dst[blocks * 16]);
+
+	while(blocks--) {
+		__m128i in;
+		__m128i t0;
+		__m128i t1;
+		__m128i t2;
+		__m128i t3;
+		__m128i indices;
+		__m128i offsets;
+
+		in = _mm_loadu_si128((const __m128i*) &src[blocks * 12]);
+
+		/* Spread each 3 byte group over a 32-bit lane and move the
+		 * four 6-bit fields to the low bits of one byte each. */
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+		t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+		t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		indices = _mm_or_si128(t1, t3);
+
+		/* Map 0..63 to the alphabet by adding a per-range offset. */
+		offsets = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		offsets = _mm_sub_epi8(offsets,
+			_mm_cmpgt_epi8(indices, _mm_set1_epi8(25)));
+		offsets = _mm_shuffle_epi8(_mm_setr_epi8(
+			65, 71, -4, -4, -4, -4, -4, -4,
+			-4, -4, -4, -4, -19, -16, 0, 0), offsets);
+
+		_mm_storeu_si128((__m128i*) &dst[blocks * 16],
+			_mm_add_epi8(indices, offsets));
+	}
+}
+
+__attribute__((target("ssse3")))
+static ssize_t codec_base64_decode_ssse3(
+	const unsigned char *src,
+	size_t len,
+	unsigned char *dst)
+{
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+	size_t i;
+	size_t o = 0;
+	ssize_t tail;
+
+	/* Each block writes 16 bytes of which 12 are decoded. Stay far enough
+	 * from the end that the extra bytes don't go past the output. */
+	for(i = 0; i + 24 <= len; i += 16, o += 12) {
+		const __m128i in = _mm_loadu_si128((const __m128i*) &src[i]);
+		const __m128i hi_nibbles =
+			_mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+		const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		const __m128i lo = _mm_shuffle_epi8(lut_lo,
+			_mm_and_si128(in, mask_2f));
+		__m128i values;
+
+		/* Every valid character has no bit in common between its
+		 * low and high nibble classes. */
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+			_mm_setzero_si128())) != 0xffff)
+		{
+			break;
+		}
+
+		values = _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll,
+			_mm_add_epi8(_mm_cmpeq_epi8(in, mask_2f),
+			hi_nibbles)));
+
+		/* Pack the 6-bit values, four per 32-bit lane, into three
+		 * bytes each. */
+		values = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		values = _mm_madd_epi16(values, _mm_set1_epi32(0x00011000));
+		values = _mm_shuffle_epi8(values, _mm_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+			-1, -1, -1, -1));
+
+		_mm_storeu_si128((__m128i*) &dst[o], values);
+	}
+
+	tail = codec_base64_decode_scalar(&src[i], len - i, &dst[o]);
+
+	return (tail < 0) ? -1 : (ssize_t) o + tail;
+}
+#endif /* defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) */
+
+size_t codec_encode(
+	enum codec_encoding encoding,
+	const char *src,
+	size_t len,
+	char *dst)
+{
+	const unsigned char *in = (const unsigned char*) src;
+
+	switch(encoding) {
+	case CODEC_ENCODING_HEX:
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		if(__builtin_cpu_supports("avx2")) {
+			codec_hex_encode_avx2(in, len, dst);
+			break;
+		}
+		else if(__builtin_cpu_supports("sse2")) {
+			codec_hex_encode_sse2(in, len, dst);
+			break;
+		}
+#endif
+		codec_hex_encode_scalar(in, len, dst);
+		break;
+	case CODEC_ENCODING_BASE64:
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		if(__builtin_cpu_supports("ssse3")) {
+			codec_base64_encode_ssse3(in, len, dst);
+			break;
+		}
+#endif
+		codec_base64_encode_scalar(in, len, dst);
+		break;
+	default:
+		memmove(dst, src, len);
+		break;
+	}
+
+	return codec_encoded_length(encoding, len);
+}
+
+ssize_t codec_decode(
+	enum codec_encoding encoding,
+	const char *src,
+	size_t len,
+	char *dst)
+{
+	const unsigned char *in = (const unsigned char*) src;
+	unsigned char *out = (unsigned char*) dst;
+	ssize_t res;
+
+	switch(encoding) {
+	case CODEC_ENCODING_HEX:
+		if(len % 2) {
+			res = -1;
+			break;
+		}
+
+		len /= 2;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		if(__builtin_cpu_supports("avx2")) {
+			res = (codec_hex_decode_avx2(in, len, out) == len) ?
+				(ssize_t) len : -1;
+			break;
+		}
+		else if(__builtin_cpu_supports("sse2")) {
+			res = (codec_hex_decode_sse2(in, len, out) == len) ?
+				(ssize_t) len : -1;
+			break;
+		}
+#endif
+		res = (codec_hex_decode_scalar(in, len, out) == len) ?
+			(ssize_t) len : -1;
+		break;
+	case CODEC_ENCODING_BASE64:
+		/* Padding is optional. */
+		if(len % 4 == 0 && len && in[len - 1] == '=') {
+			len -= (in[len - 2] == '=') ? 2 : 1;
+		}
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		if(__builtin_cpu_supports("ssse3")) {
+			res = codec_base64_decode_ssse3(in, len, out);
+			break;
+		}
+#endif
+		res = codec_base64_decode_scalar(in, len, out);
+		break;
+	default:
+		memmove(dst, src, len);
+		res = (ssize_t) len;
+		break;
+	}
+
+	if(res < 0) {
+		errno = EINVAL;
+	}
+
+	return res;
+}
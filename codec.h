@@ -0,0 +1,83 @@
+/*-
+ * codec.h - Hex and base64 encoding of attribute values.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_CODEC_H
+#define _XATTRPROGS_CODEC_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+enum codec_encoding {
+	CODEC_ENCODING_NONE,
+	CODEC_ENCODING_HEX,
+	CODEC_ENCODING_BASE64,
+};
+
+/**
+ * Parse an encoding name ("hex" or "base64"). Returns 0 on success, -1 if
+ * @s isn't a known encoding.
+ */
+int codec_parse_encoding(
+	const char *s,
+	enum codec_encoding *out_encoding);
+
+/**
+ * The prefix that marks a value in the encoding in the dump format ("0x" or
+ * "0s", as used by getfattr(1)).
+ */
+const char* codec_prefix(
+	enum codec_encoding encoding);
+
+/**
+ * Number of bytes needed for the encoding of @len bytes.
+ */
+size_t codec_encoded_length(
+	enum codec_encoding encoding,
+	size_t len);
+
+/**
+ * Encode @len bytes from @src into @dst, which must have room for
+ * codec_encoded_length(@encoding, @len) bytes. @dst may be the same buffer as
+ * @src, in which case the value is encoded in place (from the end towards
+ * the start).
+ *
+ * Returns the length of the encoded data.
+ */
+size_t codec_encode(
+	enum codec_encoding encoding,
+	const char *src,
+	size_t len,
+	char *dst);
+
+/**
+ * Decode @len bytes of encoded data from @src into @dst, which must have
+ * room for @len bytes. @dst may be the same buffer as @src, or point anywhere
+ * before it in the same buffer, in which case the value is decoded in place.
+ *
+ * Returns the length of the decoded data, or -1 with errno set to EINVAL if
+ * @src isn't validly encoded.
+ */
+ssize_t codec_decode(
+	enum codec_encoding encoding,
+	const char *src,
+	size_t len,
+	char *dst);
+
+#endif /* !defined(_XATTRPROGS_CODEC_H) */
@@ -0,0 +1,883 @@
+/*-
+ * compress.c - In-process compression of dump streams.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+
+/* Size of the buffers for compressed data on the compressor threads' side. */
+#define COMPRESS_IO_SIZE (256 * 1024)
+
+static const unsigned char compress_gzip_magic[2] = { 0x1f, 0x8b };
+static const unsigned char compress_zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+const char* compress_formats(void)
+{
+#if defined(HAVE_ZLIB) && defined(HAVE_ZSTD)
+	return "gzip, zstd";
+#elif defined(HAVE_ZLIB)
+	return "gzip";
+#elif defined(HAVE_ZSTD)
+	return "zstd";
+#else
+	return "none";
+#endif
+}
+
+int compress_parse(
+	const char *s,
+	enum compress_format *format,
+	int *level)
+{
+	const char *const colon = strchr(s, ':');
+	const size_t length = colon ? (size_t) (colon - s) : strlen(s);
+	int max_level;
+	long parsed = 0;
+
+	if(length == 4 && !memcmp(s, "gzip", 4)) {
+#ifdef HAVE_ZLIB
+		*format = COMPRESS_GZIP;
+		max_level = Z_BEST_COMPRESSION;
+#else
+		return -1;
+#endif
+	}
+	else if(length == 4 && !memcmp(s, "zstd", 4)) {
+#ifdef HAVE_ZSTD
+		*format = COMPRESS_ZSTD;
+		max_level = ZSTD_maxCLevel();
+#else
+		return -1;
+#endif
+	}
+	else {
+		return -1;
+	}
+
+	if(colon) {
+		char *endptr = NULL;
+
+		errno = 0;
+		parsed = strtol(&colon[1], &endptr, 10);
+		if(!colon[1] || *endptr || errno || parsed < 1 ||
+			parsed > max_level)
+		{
+			return -1;
+		}
+	}
+
+	*level = (int) parsed;
+	return 0;
+}
+
+static void compress_queue_init(
+	struct compress_queue *queue)
+{
+	memset(queue, 0, sizeof(*queue));
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->changed, NULL);
+}
+
+static void compress_queue_destroy(
+	struct compress_queue *queue)
+{
+	unsigned int i;
+
+	for(i = 0; i < COMPRESS_QUEUE_BLOCKS; ++i) {
+		outbuf_free(&queue->blocks[i]);
+	}
+
+	pthread_cond_destroy(&queue->changed);
+	pthread_mutex_destroy(&queue->lock);
+}
+
+/**
+ * Append the full block @fill to the queue, waiting for room if needed. @fill
+ * is swapped with an empty block, so no data is copied.
+ *
+ * Returns 0 on success, or -1 with errno set if the queue has failed.
+ */
+static int compress_queue_push(
+	struct compress_queue *queue,
+	struct outbuf *fill)
+{
+	struct outbuf empty;
+	struct outbuf *slot;
+	int err;
+
+	pthread_mutex_lock(&queue->lock);
+	while(queue->count == COMPRESS_QUEUE_BLOCKS && !queue->err) {
+		pthread_cond_wait(&queue->changed, &queue->lock);
+	}
+
+	err = queue->err;
+	if(!err) {
+		slot = &queue->blocks[(queue->head + queue->count) %
+			COMPRESS_QUEUE_BLOCKS];
+		empty = *slot;
+		*slot = *fill;
+		*fill = empty;
+		++queue->count;
+		pthread_cond_broadcast(&queue->changed);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	if(err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Wait for the next block in the queue. It stays in the queue until it's
+ * released with compress_queue_release.
+ *
+ * Returns the block, or NULL with errno set to 0 at the end of the queue or
+ * to the error that the queue failed with.
+ */
+static struct outbuf* compress_queue_pop(
+	struct compress_queue *queue)
+{
+	struct outbuf *block = NULL;
+	int err;
+
+	pthread_mutex_lock(&queue->lock);
+	while(!queue->count && !queue->done && !queue->err) {
+		pthread_cond_wait(&queue->changed, &queue->lock);
+	}
+
+	err = queue->err;
+	if(!err && queue->count) {
+		block = &queue->blocks[queue->head];
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	errno = err;
+	return block;
+}
+
+static void compress_queue_release(
+	struct compress_queue *queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	queue->blocks[queue->head].len = 0;
+	queue->head = (queue->head + 1) % COMPRESS_QUEUE_BLOCKS;
+	--queue->count;
+	pthread_cond_broadcast(&queue->changed);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Mark the queue as done, or as failed with @err if it's nonzero. The first
+ * error sticks.
+ */
+static void compress_queue_finish(
+	struct compress_queue *queue,
+	int err)
+{
+	pthread_mutex_lock(&queue->lock);
+	if(err && !queue->err) {
+		queue->err = err;
+	}
+
+	queue->done = 1;
+	pthread_cond_broadcast(&queue->changed);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+static int compress_write_all(
+	int fd,
+	const unsigned char *data,
+	size_t len)
+{
+	while(len) {
+		const ssize_t res = write(fd, data, len);
+
+		if(res < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			return -1;
+		}
+
+		data += res;
+		len -= (size_t) res;
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * Compress @len bytes of @data into the writer's stream and write out what
+ * the compressor produces. With @finish set the stream is ended.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+static int compress_writer_block(
+	struct compress_writer *writer,
+	const char *data,
+	size_t len,
+	int finish)
+{
+#ifdef HAVE_ZLIB
+	if(writer->format == COMPRESS_GZIP) {
+		z_stream *const zs = writer->stream;
+		int res;
+
+		zs->next_in = (Bytef*) data;
+		zs->avail_in = (uInt) len;
+		do {
+			zs->next_out = writer->out;
+			zs->avail_out = COMPRESS_IO_SIZE;
+			res = deflate(zs, finish ? Z_FINISH : Z_NO_FLUSH);
+			if(res == Z_STREAM_ERROR) {
+				errno = EIO;
+				return -1;
+			}
+
+			if(compress_write_all(writer->fd, writer->out,
+				COMPRESS_IO_SIZE - zs->avail_out))
+			{
+				return -1;
+			}
+		} while(finish ? res != Z_STREAM_END : !zs->avail_out);
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	if(writer->format == COMPRESS_ZSTD) {
+		ZSTD_inBuffer in = { data, len, 0 };
+		size_t remaining;
+
+		do {
+			ZSTD_outBuffer out = {
+				writer->out, COMPRESS_IO_SIZE, 0
+			};
+
+			remaining = ZSTD_compressStream2(writer->stream, &out,
+				&in, finish ? ZSTD_e_end : ZSTD_e_continue);
+			if(ZSTD_isError(remaining)) {
+				errno = EIO;
+				return -1;
+			}
+
+			if(compress_write_all(writer->fd, writer->out,
+				out.pos))
+			{
+				return -1;
+			}
+		} while(finish ? remaining != 0 : in.pos < in.size);
+	}
+#endif
+
+	return 0;
+}
+
+static void* compress_writer_thread(
+	void *arg)
+{
+	struct compress_writer *const writer = arg;
+	struct outbuf *block;
+	int err = 0;
+
+	while((block = compress_queue_pop(&writer->queue))) {
+		const int res = compress_writer_block(writer, block->data,
+			block->len, 0);
+
+		err = errno;
+		compress_queue_release(&writer->queue);
+		if(res) {
+			compress_queue_finish(&writer->queue, err ? err : EIO);
+			return NULL;
+		}
+	}
+
+	if(!errno && compress_writer_block(writer, NULL, 0, 1)) {
+		compress_queue_finish(&writer->queue, errno ? errno : EIO);
+	}
+
+	return NULL;
+}
+
+static void compress_writer_free_stream(
+	struct compress_writer *writer)
+{
+	if(!writer->stream) {
+		return;
+	}
+
+#ifdef HAVE_ZLIB
+	if(writer->format == COMPRESS_GZIP) {
+		deflateEnd(writer->stream);
+		free(writer->stream);
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	if(writer->format == COMPRESS_ZSTD) {
+		ZSTD_freeCCtx(writer->stream);
+	}
+#endif
+
+	writer->stream = NULL;
+}
+
+int compress_writer_open(
+	struct compress_writer *writer,
+	int fd,
+	enum compress_format format,
+	int level)
+{
+	int err;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->format = format;
+	writer->fd = fd;
+	compress_queue_init(&writer->queue);
+
+	writer->out = malloc(COMPRESS_IO_SIZE);
+	if(!writer->out) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto err_out;
+	}
+
+#ifdef HAVE_ZLIB
+	if(format == COMPRESS_GZIP) {
+		z_stream *const zs = calloc(1, sizeof(*zs));
+
+		/* 16 added to the window bits selects the gzip wrapper. */
+		if(!zs || deflateInit2(zs, level ? level :
+			Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			fprintf(stderr, "Error while initializing gzip "
+				"compression.\n");
+			free(zs);
+			goto err_out;
+		}
+
+		writer->stream = zs;
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	if(format == COMPRESS_ZSTD) {
+		writer->stream = ZSTD_createCCtx();
+		if(!writer->stream || (level && ZSTD_isError(
+			ZSTD_CCtx_setParameter(writer->stream,
+			ZSTD_c_compressionLevel, level))))
+		{
+			fprintf(stderr, "Error while initializing zstd "
+				"compression.\n");
+			goto err_out;
+		}
+	}
+#endif
+
+	if(!writer->stream) {
+		fprintf(stderr, "Error: Unsupported compression format.\n");
+		goto err_out;
+	}
+
+	err = pthread_create(&writer->thread, NULL, compress_writer_thread,
+		writer);
+	if(err) {
+		fprintf(stderr, "Error while creating compressor thread: %s "
+			"(errno=%d)\n",
+			strerror(err), err);
+		goto err_out;
+	}
+
+	return 0;
+err_out:
+	compress_writer_free_stream(writer);
+	free(writer->out);
+	compress_queue_destroy(&writer->queue);
+	return -1;
+}
+
+int compress_writer_flush(
+	struct compress_writer *writer,
+	struct outbuf *out)
+{
+	if(out->failed) {
+		errno = out->failed;
+		out->failed = 0;
+		out->len = 0;
+		return -1;
+	}
+
+	if(!writer->fill.len) {
+		/* Take over the buffer instead of copying it. */
+		const struct outbuf fill = writer->fill;
+
+		writer->fill = *out;
+		*out = fill;
+	}
+	else {
+		outbuf_append(&writer->fill, out->data, out->len);
+		out->len = 0;
+		if(writer->fill.failed) {
+			errno = writer->fill.failed;
+			writer->fill.failed = 0;
+			writer->fill.len = 0;
+			return -1;
+		}
+	}
+
+	if(writer->fill.len >= COMPRESS_BLOCK_SIZE) {
+		return compress_queue_push(&writer->queue, &writer->fill);
+	}
+
+	return 0;
+}
+
+int compress_writer_close(
+	struct compress_writer *writer)
+{
+	int err = 0;
+
+	if(writer->fill.len &&
+		compress_queue_push(&writer->queue, &writer->fill))
+	{
+		err = errno;
+	}
+
+	compress_queue_finish(&writer->queue, 0);
+	pthread_join(writer->thread, NULL);
+	if(!err) {
+		err = writer->queue.err;
+	}
+
+	compress_writer_free_stream(writer);
+	free(writer->out);
+	outbuf_free(&writer->fill);
+	compress_queue_destroy(&writer->queue);
+
+	if(err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Decompress the reader's input buffer into @fill, handing over each full
+ * block. *@ended tracks whether the input so far ends at the end of a
+ * compressed stream.
+ *
+ * Returns 0 on success, or -1 with errno set on error (after reporting errors
+ * in the input).
+ */
+static int compress_reader_input(
+	struct compress_reader *reader,
+	struct outbuf *fill,
+	int *ended)
+{
+	size_t pos = 0;
+#ifdef HAVE_ZLIB
+	z_stream *const zs = reader->stream;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_inBuffer zin = { reader->in, reader->in_length, 0 };
+#endif
+	int more = 1;
+
+#ifdef HAVE_ZLIB
+	if(reader->format == COMPRESS_GZIP) {
+		zs->next_in = reader->in;
+		zs->avail_in = (uInt) reader->in_length;
+	}
+#endif
+
+	while(more) {
+		const size_t avail = COMPRESS_BLOCK_SIZE - fill->len;
+		char *const dst = outbuf_reserve(fill, avail);
+		size_t produced = 0;
+
+		if(!dst) {
+			errno = fill->failed;
+			fprintf(stderr, "Error while allocating memory: %s "
+				"(errno=%d)\n",
+				strerror(errno), errno);
+			return -1;
+		}
+
+		if(reader->format == COMPRESS_NONE) {
+			produced = reader->in_length - pos;
+			if(produced > avail) {
+				produced = avail;
+			}
+
+			memcpy(dst, &reader->in[pos], produced);
+			pos += produced;
+			more = pos < reader->in_length;
+		}
+
+#ifdef HAVE_ZLIB
+		if(reader->format == COMPRESS_GZIP) {
+			int res;
+
+			if(*ended && !zs->avail_in) {
+				break;
+			}
+			else if(*ended) {
+				/* Another stream follows. */
+				inflateReset(zs);
+				*ended = 0;
+			}
+
+			zs->next_out = (Bytef*) dst;
+			zs->avail_out = (uInt) avail;
+			res = inflate(zs, Z_NO_FLUSH);
+			if(res != Z_OK && res != Z_STREAM_END &&
+				res != Z_BUF_ERROR)
+			{
+				fprintf(stderr, "Error while decompressing "
+					"\"%s\": %s\n",
+					reader->name,
+					zs->msg ? zs->msg : "Invalid data");
+				errno = EIO;
+				return -1;
+			}
+
+			produced = avail - zs->avail_out;
+			*ended = res == Z_STREAM_END;
+			more = zs->avail_in || !zs->avail_out;
+		}
+#endif
+
+#ifdef HAVE_ZSTD
+		if(reader->format == COMPRESS_ZSTD) {
+			ZSTD_outBuffer zout = { dst, avail, 0 };
+			const size_t res = ZSTD_decompressStream(
+				reader->stream, &zout, &zin);
+
+			if(ZSTD_isError(res)) {
+				fprintf(stderr, "Error while decompressing "
+					"\"%s\": %s\n",
+					reader->name, ZSTD_getErrorName(res));
+				errno = EIO;
+				return -1;
+			}
+
+			produced = zout.pos;
+			*ended = !res;
+			more = zin.pos < zin.size ||
+				(zout.pos == zout.size && res);
+		}
+#endif
+
+		outbuf_commit(fill, produced);
+		if(fill->len >= COMPRESS_BLOCK_SIZE &&
+			compress_queue_push(&reader->queue, fill))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void* compress_reader_thread(
+	void *arg)
+{
+	struct compress_reader *const reader = arg;
+	struct outbuf fill;
+	int ended = reader->format == COMPRESS_NONE;
+	int err = 0;
+
+	memset(&fill, 0, sizeof(fill));
+
+	/* The input starts with what was read to detect the format. */
+	while(reader->in_length) {
+		ssize_t res;
+
+		if(compress_reader_input(reader, &fill, &ended)) {
+			err = errno ? errno : EIO;
+			break;
+		}
+
+		do {
+			res = read(reader->fd, reader->in, COMPRESS_IO_SIZE);
+		} while(res < 0 && errno == EINTR);
+
+		if(res < 0) {
+			err = errno;
+			break;
+		}
+
+		reader->in_length = (size_t) res;
+	}
+
+	if(!err && !ended) {
+		fprintf(stderr, "Error while decompressing \"%s\": Unexpected "
+			"end of input.\n",
+			reader->name);
+		err = EIO;
+	}
+
+	if(!err && fill.len && compress_queue_push(&reader->queue, &fill)) {
+		err = errno;
+	}
+
+	compress_queue_finish(&reader->queue, err);
+	outbuf_free(&fill);
+
+	return NULL;
+}
+
+static void compress_reader_free_stream(
+	struct compress_reader *reader)
+{
+	if(!reader->stream) {
+		return;
+	}
+
+#ifdef HAVE_ZLIB
+	if(reader->format == COMPRESS_GZIP) {
+		inflateEnd(reader->stream);
+		free(reader->stream);
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	if(reader->format == COMPRESS_ZSTD) {
+		ZSTD_freeDCtx(reader->stream);
+	}
+#endif
+
+	reader->stream = NULL;
+}
+
+int compress_reader_open(
+	struct compress_reader *reader,
+	int fd,
+	const char *name)
+{
+	int err;
+
+	memset(reader, 0, sizeof(*reader));
+	reader->format = COMPRESS_NONE;
+	reader->fd = fd;
+	reader->name = name;
+	compress_queue_init(&reader->queue);
+
+	reader->in = malloc(COMPRESS_IO_SIZE);
+	if(!reader->in) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto err_out;
+	}
+
+	/* Read enough to recognize the format, without seeking so that the
+	 * input may be a pipe. */
+	while(reader->in_length < sizeof(compress_zstd_magic)) {
+		const ssize_t res = read(fd, &reader->in[reader->in_length],
+			sizeof(compress_zstd_magic) - reader->in_length);
+
+		if(res < 0 && errno == EINTR) {
+			continue;
+		}
+		else if(res < 0) {
+			fprintf(stderr, "Error while reading \"%s\": %s "
+				"(errno=%d)\n",
+				name, strerror(errno), errno);
+			goto err_out;
+		}
+		else if(!res) {
+			break;
+		}
+
+		reader->in_length += (size_t) res;
+	}
+
+	if(reader->in_length >= sizeof(compress_gzip_magic) &&
+		!memcmp(reader->in, compress_gzip_magic,
+		sizeof(compress_gzip_magic)))
+	{
+		reader->format = COMPRESS_GZIP;
+	}
+	else if(reader->in_length >= sizeof(compress_zstd_magic) &&
+		!memcmp(reader->in, compress_zstd_magic,
+		sizeof(compress_zstd_magic)))
+	{
+		reader->format = COMPRESS_ZSTD;
+	}
+
+#ifdef HAVE_ZLIB
+	if(reader->format == COMPRESS_GZIP) {
+		z_stream *const zs = calloc(1, sizeof(*zs));
+
+		/* 16 added to the window bits accepts only gzip streams. */
+		if(!zs || inflateInit2(zs, 15 + 16) != Z_OK) {
+			fprintf(stderr, "Error while initializing gzip "
+				"decompression.\n");
+			free(zs);
+			goto err_out;
+		}
+
+		reader->stream = zs;
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	if(reader->format == COMPRESS_ZSTD) {
+		reader->stream = ZSTD_createDCtx();
+		if(!reader->stream) {
+			fprintf(stderr, "Error while initializing zstd "
+				"decompression.\n");
+			goto err_out;
+		}
+	}
+#endif
+
+	if(reader->format != COMPRESS_NONE && !reader->stream) {
+		fprintf(stderr, "Error: \"%s\" is %s compressed, which this "
+			"build doesn't support (supported: %s).\n",
+			name, (reader->format == COMPRESS_GZIP) ? "gzip" :
+			"zstd", compress_formats());
+		goto err_out;
+	}
+
+	err = pthread_create(&reader->thread, NULL, compress_reader_thread,
+		reader);
+	if(err) {
+		fprintf(stderr, "Error while creating decompressor thread: "
+			"%s (errno=%d)\n",
+			strerror(err), err);
+		goto err_out;
+	}
+
+	return 0;
+err_out:
+	compress_reader_free_stream(reader);
+	free(reader->in);
+	compress_queue_destroy(&reader->queue);
+	return -1;
+}
+
+ssize_t compress_reader_getline(
+	struct compress_reader *reader,
+	char **line,
+	size_t *size)
+{
+	size_t length = 0;
+
+	for(;;) {
+		const char *start;
+		const char *newline;
+		size_t n;
+
+		if(reader->block && reader->pos == reader->block->len) {
+			compress_queue_release(&reader->queue);
+			reader->block = NULL;
+		}
+
+		if(!reader->block) {
+			reader->block = compress_queue_pop(&reader->queue);
+			reader->pos = 0;
+			if(!reader->block) {
+				if(errno || !length) {
+					return -1;
+				}
+
+				/* Last line without a newline. */
+				break;
+			}
+		}
+
+		start = &reader->block->data[reader->pos];
+		newline = memchr(start, '\n', reader->block->len -
+			reader->pos);
+		n = newline ? (size_t) (newline - start) + 1 :
+			reader->block->len - reader->pos;
+
+		if(*size < length + n + 1) {
+			size_t new_size = *size ? *size : 128;
+			char *new_line;
+
+			while(new_size < length + n + 1) {
+				new_size *= 2;
+			}
+
+			new_line = realloc(*line, new_size);
+			if(!new_line) {
+				return -1;
+			}
+
+			*line = new_line;
+			*size = new_size;
+		}
+
+		memcpy(&(*line)[length], start, n);
+		length += n;
+		reader->pos += n;
+		if(newline) {
+			break;
+		}
+	}
+
+	(*line)[length] = '\0';
+	return (ssize_t) length;
+}
+
+void compress_reader_close(
+	struct compress_reader *reader)
+{
+	if(reader->block) {
+		compress_queue_release(&reader->queue);
+		reader->block = NULL;
+	}
+
+	/* Makes a decompressor thread that waits for room give up. */
+	compress_queue_finish(&reader->queue, ECANCELED);
+	pthread_join(reader->thread, NULL);
+
+	compress_reader_free_stream(reader);
+	free(reader->in);
+	compress_queue_destroy(&reader->queue);
+}
@@ -0,0 +1,181 @@
+/*-
+ * compress.h - In-process compression of dump streams.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_COMPRESS_H
+#define _XATTRPROGS_COMPRESS_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "outbuf.h"
+
+/* Size of the blocks handed between a compressor thread and the rest of the
+ * program, and how many of them may be in flight. */
+#define COMPRESS_BLOCK_SIZE (1024 * 1024)
+#define COMPRESS_QUEUE_BLOCKS 4
+
+enum compress_format {
+	COMPRESS_NONE,
+	COMPRESS_GZIP,
+	COMPRESS_ZSTD,
+};
+
+/**
+ * Parse a compression argument "<format>[:<level>]", where format is "gzip"
+ * or "zstd". A level of 0 means the format's default.
+ *
+ * Returns 0 on success, or -1 if @s is invalid or names a format that this
+ * build has no support for (see compress_formats).
+ */
+int compress_parse(
+	const char *s,
+	enum compress_format *format,
+	int *level);
+
+/**
+ * The formats supported by this build, for messages: "gzip, zstd", "gzip",
+ * "zstd" or "none".
+ */
+const char* compress_formats(void);
+
+/**
+ * A ring of blocks passed from one thread to another. The blocks in
+ * [head, head + count) are full and waiting for the consumer; the one after
+ * them is being filled by the producer.
+ */
+struct compress_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	struct outbuf blocks[COMPRESS_QUEUE_BLOCKS];
+	unsigned int head;
+	unsigned int count;
+
+	/* Set by the producer when it's done, or by either side when it
+	 * failed (with the errno in @err). */
+	int done;
+	int err;
+};
+
+/**
+ * Output compressed by a separate thread on its way to a file descriptor, so
+ * that compression overlaps with producing the output.
+ *
+ * The output is collected into blocks of COMPRESS_BLOCK_SIZE. Full blocks are
+ * handed to the compressor thread, which compresses them as one stream and
+ * writes the result. Only the copy into the block is done by the caller.
+ */
+struct compress_writer {
+	enum compress_format format;
+	int fd;
+	struct compress_queue queue;
+	struct outbuf fill;
+	pthread_t thread;
+	void *stream;
+	unsigned char *out;
+};
+
+/**
+ * Start compressing to @fd, which stays owned by the caller.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int compress_writer_open(
+	struct compress_writer *writer,
+	int fd,
+	enum compress_format format,
+	int level);
+
+/**
+ * Add the contents of @out to the stream and empty the buffer. The output
+ * may be buffered until the next full block. Calls must be serialized by the
+ * caller.
+ *
+ * Returns 0 on success, or -1 with errno set if the buffer was marked as
+ * failed or writing the compressed output failed.
+ */
+int compress_writer_flush(
+	struct compress_writer *writer,
+	struct outbuf *out);
+
+/**
+ * Compress what's left, end the stream and stop the compressor thread.
+ *
+ * Returns 0 on success, or -1 with errno set if any of the output couldn't
+ * be written.
+ */
+int compress_writer_close(
+	struct compress_writer *writer);
+
+/**
+ * Input decompressed by a separate thread while the caller parses it.
+ *
+ * The format is detected from the first bytes of the input: gzip and zstd
+ * streams (as far as this build supports them) are decompressed, anything
+ * else is passed through as it is. Concatenated streams are read as one,
+ * like gzip -dc does.
+ */
+struct compress_reader {
+	enum compress_format format;
+	int fd;
+	const char *name;
+	struct compress_queue queue;
+	pthread_t thread;
+	void *stream;
+	unsigned char *in;
+	size_t in_length;
+
+	/* The block being read by the caller and the position in it. */
+	struct outbuf *block;
+	size_t pos;
+};
+
+/**
+ * Start reading from @fd, which stays owned by the caller. @name is used in
+ * error messages.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int compress_reader_open(
+	struct compress_reader *reader,
+	int fd,
+	const char *name);
+
+/**
+ * Read the next line from @reader like getline(3): the line, including its
+ * newline if any, is stored in *@line (which is grown as needed) and
+ * NUL-terminated.
+ *
+ * Returns the length of the line, or -1 at the end of the input or on error
+ * (with errno set to 0 at the end of the input). Errors in the input itself
+ * are reported by the reader.
+ */
+ssize_t compress_reader_getline(
+	struct compress_reader *reader,
+	char **line,
+	size_t *size);
+
+/**
+ * Stop the decompressor thread, even if the input hasn't been read to the
+ * end, and free the reader.
+ */
+void compress_reader_close(
+	struct compress_reader *reader);
+
+#endif /* !defined(_XATTRPROGS_COMPRESS_H) */
@@ -0,0 +1,145 @@
+/*-
+ * dump.c - Text dump format for extended attributes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "dump.h"
+
+static int dump_needs_escape(
+	unsigned char c)
+{
+	return c < 0x20 || c == 0x7f || c == '\\' || c == '"';
+}
+
+void dump_put_escaped(
+	struct outbuf *out,
+	const char *data,
+	size_t len)
+{
+	size_t i = 0;
+
+	while(i < len) {
+		size_t run = i;
+		char *dst;
+
+		/* Copy runs of bytes that don't need escaping in one go. */
+		while(run < len &&
+			!dump_needs_escape((unsigned char) data[run]))
+		{
+			++run;
+		}
+
+		outbuf_append(out, &data[i], run - i);
+		if(run == len) {
+			break;
+		}
+
+		dst = outbuf_reserve(out, 4);
+		if(!dst) {
+			return;
+		}
+
+		dst[0] = '\\';
+		dst[1] = '0' + (((unsigned char) data[run] >> 6) & 0x7);
+		dst[2] = '0' + (((unsigned char) data[run] >> 3) & 0x7);
+		dst[3] = '0' + ((unsigned char) data[run] & 0x7);
+		outbuf_commit(out, 4);
+
+		i = run + 1;
+	}
+}
+
+void dump_put_file(
+	struct outbuf *out,
+	const char *path)
+{
+	outbuf_append(out, "# file: ", 8);
+	dump_put_escaped(out, path, strlen(path));
+	outbuf_putc(out, '\n');
+}
+
+void dump_put_name(
+	struct outbuf *out,
+	const char *ns_prefix,
+	const char *name,
+	size_t name_length)
+{
+	outbuf_puts(out, ns_prefix);
+	dump_put_escaped(out, name, name_length);
+	outbuf_putc(out, '\n');
+}
+
+void dump_put_attr(
+	struct outbuf *out,
+	const char *ns_prefix,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length)
+{
+	outbuf_puts(out, ns_prefix);
+	dump_put_escaped(out, name, name_length);
+	outbuf_append(out, "=\"", 2);
+	dump_put_escaped(out, value, value_length);
+	outbuf_append(out, "\"\n", 2);
+}
+
+size_t dump_unescape(
+	char *data,
+	size_t len)
+{
+	const char *src;
+	const char *end = data + len;
+	char *dst;
+
+	src = memchr(data, '\\', len);
+	if(!src) {
+		return len;
+	}
+
+	dst = (char*) src;
+	while(src < end) {
+		if(*src != '\\') {
+			*dst++ = *src++;
+		}
+		else if(end - src >= 4 &&
+			src[1] >= '0' && src[1] <= '3' &&
+			src[2] >= '0' && src[2] <= '7' &&
+			src[3] >= '0' && src[3] <= '7')
+		{
+			*dst++ = (char) (((src[1] - '0') << 6) |
+				((src[2] - '0') << 3) | (src[3] - '0'));
+			src += 4;
+		}
+		else if(end - src >= 2 && src[1] == '\\') {
+			*dst++ = '\\';
+			src += 2;
+		}
+		else {
+			*dst++ = *src++;
+		}
+	}
+
+	return (size_t) (dst - data);
+}
@@ -0,0 +1,88 @@
+/*-
+ * dump.h - Text dump format for extended attributes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_DUMP_H
+#define _XATTRPROGS_DUMP_H
+
+#include <stddef.h>
+
+#include "outbuf.h"
+
+/*
+ * The dump format is the one used by getfattr(1) --dump and understood by
+ * setfattr(1) --restore:
+ *
+ *   # file: <path>
+ *   <name>="<value>"
+ *   ...
+ *   <empty line>
+ *
+ * Paths, names and values are written as text, with control characters,
+ * backslashes and double quotes escaped as \ooo octal sequences.
+ */
+
+/**
+ * Append the "# file:" header line for @path.
+ */
+void dump_put_file(
+	struct outbuf *out,
+	const char *path);
+
+/**
+ * Append a line with only the (escaped) name @name, used when listing names
+ * without values.
+ */
+void dump_put_name(
+	struct outbuf *out,
+	const char *ns_prefix,
+	const char *name,
+	size_t name_length);
+
+/**
+ * Append a name="value" line. @ns_prefix is prepended to the name (see
+ * xattrio_namespace_prefix).
+ */
+void dump_put_attr(
+	struct outbuf *out,
+	const char *ns_prefix,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length);
+
+/**
+ * Append @len bytes of @data with the dump format's escaping applied.
+ */
+void dump_put_escaped(
+	struct outbuf *out,
+	const char *data,
+	size_t len);
+
+/**
+ * Undo the escaping done by dump_put_escaped in place. Sequences that aren't
+ * valid escapes are left as they are.
+ *
+ * Returns the length of the unescaped data.
+ */
+size_t dump_unescape(
+	char *data,
+	size_t len);
+
+#endif /* !defined(_XATTRPROGS_DUMP_H) */
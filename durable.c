@@ -0,0 +1,347 @@
+/*-
+ * durable.c - Deferred flushing of metadata changes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "durable.h"
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+void durable_init(
+	struct durable *durable,
+	const char *progname,
+	unsigned long long interval)
+{
+	memset(durable, 0, sizeof(*durable));
+	durable->progname = progname;
+	durable->interval = interval;
+	pthread_mutex_init(&durable->lock, NULL);
+}
+
+/**
+ * Open a file on the same filesystem as @path. For directories and regular
+ * files that's the node itself (it might be the root of a mount or bind
+ * mounted on its own), for everything else its parent directory. Nodes of
+ * other types are never opened, as that has side effects for some devices.
+ */
+static int durable_open_fs(
+	const char *path,
+	const struct stat *st,
+	int follow_links)
+{
+	const int nofollow = follow_links ? 0 : O_NOFOLLOW;
+	const char *slash;
+	char *parent;
+	int fd;
+
+	if(S_ISDIR(st->st_mode)) {
+		return open(path, O_RDONLY | O_DIRECTORY | nofollow);
+	}
+	else if(S_ISREG(st->st_mode)) {
+		/* Fall back to the parent if the file can't be read. */
+		fd = open(path, O_RDONLY | nofollow);
+		if(fd != -1) {
+			return fd;
+		}
+	}
+
+	slash = strrchr(path, '/');
+	if(!slash) {
+		return open(".", O_RDONLY | O_DIRECTORY);
+	}
+	else if(slash == path) {
+		return open("/", O_RDONLY | O_DIRECTORY);
+	}
+
+	parent = strndup(path, (size_t) (slash - path));
+	if(!parent) {
+		return -1;
+	}
+
+	fd = open(parent, O_RDONLY | O_DIRECTORY);
+	free(parent);
+
+	return fd;
+}
+
+/**
+ * Make sure that the filesystem of @path, with status @st, is in the flush
+ * list. Called with the lock held.
+ */
+static void durable_add_fs(
+	struct durable *durable,
+	const char *path,
+	const struct stat *st,
+	int follow_links)
+{
+	struct stat fs_st;
+	size_t i;
+	int fd;
+
+	for(i = 0; i < durable->fs_count; ++i) {
+		if(durable->fs[i].dev == st->st_dev) {
+			return;
+		}
+	}
+
+	if(durable->fs_count == durable->fs_size) {
+		const size_t new_size =
+			durable->fs_size ? durable->fs_size * 2 : 8;
+		struct durable_fs *new_fs;
+
+		new_fs = realloc(durable->fs, new_size * sizeof(new_fs[0]));
+		if(!new_fs) {
+			durable->need_global_sync = 1;
+			return;
+		}
+
+		durable->fs = new_fs;
+		durable->fs_size = new_size;
+	}
+
+	fd = durable_open_fs(path, st, follow_links);
+	if(fd == -1 || fstat(fd, &fs_st) || fs_st.st_dev != st->st_dev) {
+		/* Can't get a handle on the filesystem, e.g. a special file
+		 * that is bind mounted somewhere else than its parent
+		 * directory, or the node was replaced since it was looked
+		 * up. */
+		if(fd != -1) {
+			close(fd);
+		}
+
+		durable->need_global_sync = 1;
+		return;
+	}
+
+	durable->fs[durable->fs_count].dev = st->st_dev;
+	durable->fs[durable->fs_count].fd = fd;
+	++durable->fs_count;
+}
+
+/**
+ * Flush the filesystems in the flush list. Called without the lock held, but
+ * with the flushing flag set so that only one thread at a time gets here.
+ */
+static int durable_sync(
+	struct durable *durable)
+{
+	int ret = 0;
+	int *fds = NULL;
+	size_t fds_count = 0;
+	int global_sync;
+	size_t i;
+
+	pthread_mutex_lock(&durable->lock);
+	global_sync = durable->need_global_sync;
+	if(durable->fs_count) {
+		fds = malloc(durable->fs_count * sizeof(fds[0]));
+		if(fds) {
+			for(i = 0; i < durable->fs_count; ++i) {
+				fds[i] = durable->fs[i].fd;
+			}
+
+			fds_count = durable->fs_count;
+		}
+		else {
+			global_sync = 1;
+		}
+	}
+	pthread_mutex_unlock(&durable->lock);
+
+#ifdef HAVE_SYNCFS
+	for(i = 0; !global_sync && i < fds_count; ++i) {
+		if(syncfs(fds[i])) {
+			fprintf(stderr, "%s: Error while flushing filesystem: "
+				"%s (errno=%d)\n",
+				durable->progname, strerror(errno), errno);
+			ret = -1;
+		}
+	}
+#else
+	/* No way to flush a single filesystem, flush everything. */
+	global_sync = global_sync || fds_count;
+#endif
+
+	if(global_sync) {
+		sync();
+	}
+
+	if(fds) {
+		free(fds);
+	}
+
+	return ret;
+}
+
+/**
+ * Flush and report how many operations are now on stable storage. Only
+ * operations that completed before the flush started are counted.
+ */
+static int durable_flush(
+	struct durable *durable,
+	unsigned long long target)
+{
+	int ret;
+
+	ret = durable_sync(durable);
+
+	pthread_mutex_lock(&durable->lock);
+	if(ret) {
+		durable->failed = 1;
+	}
+	durable->flushed = target;
+	durable->flushing = 0;
+	pthread_mutex_unlock(&durable->lock);
+
+	if(!ret) {
+		fprintf(stderr, "%s: %llu operations flushed to disk.\n",
+			durable->progname, target);
+	}
+
+	return ret;
+}
+
+/**
+ * Find the filesystem of the node at @path (or what it points to when
+ * following links) and make sure it's in the flush list.
+ */
+static void durable_note_fs(
+	struct durable *durable,
+	const char *path,
+	int follow_links)
+{
+	struct stat st;
+	int have_st;
+
+	have_st = !(follow_links ? stat(path, &st) : lstat(path, &st));
+
+	pthread_mutex_lock(&durable->lock);
+	if(have_st) {
+		durable_add_fs(durable, path, &st, follow_links);
+	}
+	else {
+		durable->need_global_sync = 1;
+	}
+	pthread_mutex_unlock(&durable->lock);
+}
+
+void durable_note(
+	struct durable *durable,
+	const char *path,
+	int follow_links)
+{
+	int flush = 0;
+	unsigned long long target = 0;
+
+	durable_note_fs(durable, path, follow_links);
+
+	pthread_mutex_lock(&durable->lock);
+	++durable->completed;
+	if(durable->interval && !durable->flushing &&
+		durable->completed - durable->flushed >= durable->interval)
+	{
+		durable->flushing = 1;
+		target = durable->completed;
+		flush = 1;
+	}
+	pthread_mutex_unlock(&durable->lock);
+
+	if(flush) {
+		durable_flush(durable, target);
+	}
+}
+
+int durable_flush_pending(
+	struct durable *durable)
+{
+	unsigned long long target;
+	int flush;
+
+	pthread_mutex_lock(&durable->lock);
+	flush = durable->completed != durable->flushed;
+	target = durable->completed;
+	pthread_mutex_unlock(&durable->lock);
+
+	return flush ? durable_flush(durable, target) : 0;
+}
+
+int durable_finish(
+	struct durable *durable)
+{
+	int ret = 0;
+	size_t i;
+
+	if(durable->completed != durable->flushed &&
+		durable_flush(durable, durable->completed))
+	{
+		ret = -1;
+	}
+
+	if(durable->failed) {
+		ret = -1;
+	}
+
+	for(i = 0; i < durable->fs_count; ++i) {
+		close(durable->fs[i].fd);
+	}
+
+	if(durable->fs) {
+		free(durable->fs);
+	}
+
+	pthread_mutex_destroy(&durable->lock);
+
+	return ret;
+}
+
+int durable_parse_interval(
+	const char *s,
+	unsigned long long *out_interval)
+{
+	char *endptr = NULL;
+	unsigned long long interval;
+
+	errno = 0;
+	interval = strtoull(s, &endptr, 10);
+	if(errno || !*s || *endptr || !interval || s[0] == '-') {
+		return -1;
+	}
+
+	*out_interval = interval;
+
+	return 0;
+}
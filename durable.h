@@ -0,0 +1,109 @@
+/*-
+ * durable.h - Deferred flushing of metadata changes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_DURABLE_H
+#define _XATTRPROGS_DURABLE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+struct durable_fs {
+	dev_t dev;
+	int fd;
+};
+
+/**
+ * Keeps track of the filesystems touched by a bulk operation so that they
+ * can all be flushed with one syncfs() each, at the end of the operation or
+ * every @interval operations, instead of flushing after every change.
+ */
+struct durable {
+	const char *progname;
+	unsigned long long interval;
+
+	pthread_mutex_t lock;
+	struct durable_fs *fs;
+	size_t fs_count;
+	size_t fs_size;
+	/* Set when a touched filesystem couldn't be identified, which makes
+	 * the flush fall back to a global sync(). */
+	int need_global_sync;
+
+	/* Number of operations recorded, and recorded before the last flush
+	 * started. A failed flush sets @failed. */
+	unsigned long long completed;
+	unsigned long long flushed;
+	int flushing;
+	int failed;
+};
+
+/**
+ * Set up @durable. @interval is the number of operations after which the
+ * touched filesystems are flushed, 0 means only at the end.
+ */
+void durable_init(
+	struct durable *durable,
+	const char *progname,
+	unsigned long long interval);
+
+/**
+ * Record that the node @path has been modified. May flush the touched
+ * filesystems if the flush interval has been reached. @follow_links tells
+ * whether the change was made to the node @path points to or to the symlink
+ * itself. Thread safe. Flush errors are reported right away and make
+ * durable_finish fail.
+ *
+ * The filesystem is that of the node itself, found with a status lookup of
+ * the node. Only the first node on each filesystem opens a file to flush it
+ * through.
+ */
+void durable_note(
+	struct durable *durable,
+	const char *path,
+	int follow_links);
+
+/**
+ * Flush all touched filesystems now, unless nothing happened since the last
+ * flush. Used to make the changes durable before recording progress. Must
+ * not be called while operations are still in progress.
+ *
+ * Returns 0 on success, or -1 if the flush failed.
+ */
+int durable_flush_pending(
+	struct durable *durable);
+
+/**
+ * Flush all touched filesystems (unless nothing happened since the last
+ * flush) and release resources.
+ *
+ * Returns 0 on success, or -1 if any flush failed.
+ */
+int durable_finish(
+	struct durable *durable);
+
+/**
+ * Parse the argument of a flush interval option. Returns 0 on success, -1 if
+ * @s is not a valid interval.
+ */
+int durable_parse_interval(
+	const char *s,
+	unsigned long long *out_interval);
+
+#endif /* !defined(_XATTRPROGS_DURABLE_H) */
@@ -0,0 +1,270 @@
+/*-
+ * fslimit.c - Per-filesystem adaptive concurrency limits.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <sys/vfs.h>
+#endif
+
+#include "fslimit.h"
+
+/* Minimum number of calls and duration of a measurement window. */
+#define FSLIMIT_WINDOW_CALLS 32
+#define FSLIMIT_WINDOW_TIME 0.1
+
+/* A limit is halved when the average latency of a window is above
+ * FSLIMIT_SLOW times the baseline, raised when it's below FSLIMIT_FAST times
+ * the baseline or the throughput grew by more than FSLIMIT_GAIN, and lowered
+ * by one otherwise. */
+#define FSLIMIT_SLOW 2.0
+#define FSLIMIT_FAST 1.25
+#define FSLIMIT_GAIN 1.1
+
+#if defined(__linux__)
+/* statfs(2) f_type of network, cluster and FUSE filesystems, from
+ * linux/magic.h and the filesystems' own headers. */
+static const unsigned long fslimit_remote_types[] = {
+	0x00006969UL, /* NFS */
+	0x0000517BUL, /* SMB */
+	0xFF534D42UL, /* CIFS */
+	0xFE534D42UL, /* SMB2 */
+	0x65735546UL, /* FUSE */
+	0x00C36400UL, /* Ceph */
+	0x01021997UL, /* 9P */
+	0x5346414FUL, /* AFS */
+	0x6B414653UL, /* kAFS */
+	0x73757245UL, /* Coda */
+	0x0BD00BD0UL, /* Lustre */
+	0x47504653UL, /* GPFS */
+	0x01161970UL, /* GFS2 */
+	0x7461636FUL, /* OCFS2 */
+};
+#endif /* defined(__linux__) */
+
+double fslimit_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+void fslimit_init(
+	struct fslimit *fslimit,
+	unsigned int max_active)
+{
+	memset(fslimit, 0, sizeof(*fslimit));
+	fslimit->max_active = max_active ? max_active : 1;
+}
+
+void fslimit_destroy(
+	struct fslimit *fslimit)
+{
+	free(fslimit->fs);
+	memset(fslimit, 0, sizeof(*fslimit));
+}
+
+int fslimit_find(
+	const struct fslimit *fslimit,
+	dev_t dev,
+	size_t *out_index)
+{
+	size_t i;
+
+	/* There are rarely more than a handful of filesystems. */
+	for(i = 0; i < fslimit->count; ++i) {
+		if(fslimit->fs[i].dev == dev) {
+			*out_index = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int fslimit_add(
+	struct fslimit *fslimit,
+	dev_t dev,
+	int remote,
+	size_t *out_index)
+{
+	struct fslimit_fs *fs;
+
+	if(!fslimit_find(fslimit, dev, out_index)) {
+		return 0;
+	}
+
+	if(fslimit->count == fslimit->capacity) {
+		const size_t new_capacity =
+			fslimit->capacity ? fslimit->capacity * 2 : 8;
+		struct fslimit_fs *new_fs;
+
+		new_fs = realloc(fslimit->fs, new_capacity * sizeof(new_fs[0]));
+		if(!new_fs) {
+			return -1;
+		}
+
+		fslimit->fs = new_fs;
+		fslimit->capacity = new_capacity;
+	}
+
+	fs = &fslimit->fs[fslimit->count];
+	memset(fs, 0, sizeof(*fs));
+	fs->dev = dev;
+	fs->limit = fslimit->max_active;
+	if(remote && fs->limit > FSLIMIT_REMOTE_START) {
+		fs->limit = FSLIMIT_REMOTE_START;
+	}
+	fs->slow_start = 1;
+
+	*out_index = fslimit->count++;
+
+	return 0;
+}
+
+int fslimit_is_remote(
+	int fd,
+	const char *path)
+{
+#if defined(__linux__)
+	struct statfs stfs;
+	size_t i;
+
+	if(fd != -1 ? fstatfs(fd, &stfs) : statfs(path, &stfs)) {
+		return 0;
+	}
+
+	for(i = 0; i < sizeof(fslimit_remote_types) /
+		sizeof(fslimit_remote_types[0]); ++i)
+	{
+		if((unsigned long) stfs.f_type == fslimit_remote_types[i]) {
+			return 1;
+		}
+	}
+#else
+	(void) fd;
+	(void) path;
+#endif
+
+	return 0;
+}
+
+int fslimit_may_start(
+	const struct fslimit *fslimit,
+	size_t index)
+{
+	return index == FSLIMIT_NONE ||
+		fslimit->fs[index].active < fslimit->fs[index].limit;
+}
+
+void fslimit_start(
+	struct fslimit *fslimit,
+	size_t index)
+{
+	if(index != FSLIMIT_NONE) {
+		++fslimit->fs[index].active;
+	}
+}
+
+/**
+ * Adjust the limit of @fs at the end of a measurement window.
+ */
+static void fslimit_adapt(
+	struct fslimit *fslimit,
+	struct fslimit_fs *fs,
+	double now)
+{
+	const double average = fs->window_latency / fs->window_calls;
+	const double elapsed = now - fs->window_start;
+	const double rate = (elapsed > 0) ? fs->window_calls / elapsed : 0;
+
+	if(!fs->baseline || average < fs->baseline) {
+		fs->baseline = average;
+	}
+	else {
+		/* Let the baseline follow slowly, so that a lasting change
+		 * of the storage doesn't keep the limit down forever. */
+		fs->baseline += (average - fs->baseline) / 1024;
+	}
+
+	if(average > FSLIMIT_SLOW * fs->baseline) {
+		fs->limit = (fs->limit > 1) ? fs->limit / 2 : 1;
+		fs->slow_start = 0;
+	}
+	else if(average < FSLIMIT_FAST * fs->baseline ||
+		rate > FSLIMIT_GAIN * fs->last_rate)
+	{
+		fs->limit += fs->slow_start ? fs->limit : 1;
+		if(fs->limit > fslimit->max_active) {
+			fs->limit = fslimit->max_active;
+		}
+	}
+	else if(fs->limit > 1) {
+		/* More calls in flight only made each of them slower. */
+		--fs->limit;
+		fs->slow_start = 0;
+	}
+
+	fs->last_rate = rate;
+	fs->window_calls = 0;
+	fs->window_latency = 0;
+	fs->window_start = now;
+}
+
+int fslimit_finish(
+	struct fslimit *fslimit,
+	size_t index,
+	unsigned int calls,
+	double seconds)
+{
+	struct fslimit_fs *fs;
+	const double now = fslimit_now();
+	int was_full;
+
+	if(index == FSLIMIT_NONE) {
+		return 0;
+	}
+
+	fs = &fslimit->fs[index];
+	was_full = fs->active >= fs->limit;
+	--fs->active;
+
+	if(!fs->window_start) {
+		fs->window_start = now - seconds;
+	}
+
+	fs->window_calls += calls;
+	fs->window_latency += seconds;
+	if(fs->window_calls >= FSLIMIT_WINDOW_CALLS &&
+		now - fs->window_start >= FSLIMIT_WINDOW_TIME)
+	{
+		fslimit_adapt(fslimit, fs, now);
+	}
+
+	return was_full && fs->active < fs->limit;
+}
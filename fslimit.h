@@ -0,0 +1,148 @@
+/*-
+ * fslimit.h - Per-filesystem adaptive concurrency limits.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_FSLIMIT_H
+#define _XATTRPROGS_FSLIMIT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Index of a node whose filesystem is unknown. Such nodes aren't limited. */
+#define FSLIMIT_NONE ((size_t) -1)
+
+/* Number of calls in flight that a network or FUSE filesystem starts out
+ * with. Its limit then doubles with every measurement window until the
+ * latency grows, so that the lowest latency is measured before the
+ * filesystem is loaded. Local filesystems start at the number of worker
+ * threads. */
+#define FSLIMIT_REMOTE_START 2
+
+struct fslimit_fs {
+	dev_t dev;
+
+	/* Calls in flight and their current limit. */
+	unsigned int active;
+	unsigned int limit;
+
+	/* Calls finished in the current measurement window, their total
+	 * latency and when the window started. */
+	unsigned int window_calls;
+	double window_latency;
+	double window_start;
+
+	/* Lowest window average latency seen (slowly following the average
+	 * upwards), and the throughput of the previous window in calls per
+	 * second. */
+	double baseline;
+	double last_rate;
+
+	/* Set until the limit is lowered for the first time. */
+	int slow_start;
+};
+
+/**
+ * Limits on the number of concurrent calls, kept separately for every
+ * filesystem (st_dev) that an operation touches, so that a slow mount
+ * neither holds up the workers that could be busy on a fast one nor gets
+ * more concurrent calls than it can serve.
+ *
+ * Each limit is tuned from the calls finished on its filesystem, in windows
+ * of at least a few dozen calls and a tenth of a second: it's halved when the
+ * average latency grows far beyond the lowest seen (the filesystem is
+ * overloaded), raised by one while the latency stays low or more calls in
+ * flight still buy throughput, and lowered by one when calls only get slower
+ * without getting more done.
+ *
+ * Not thread safe, the caller serializes all calls with its own lock.
+ */
+struct fslimit {
+	struct fslimit_fs *fs;
+	size_t count;
+	size_t capacity;
+	unsigned int max_active;
+};
+
+/**
+ * Set up @fslimit for @max_active worker threads.
+ */
+void fslimit_init(
+	struct fslimit *fslimit,
+	unsigned int max_active);
+
+void fslimit_destroy(
+	struct fslimit *fslimit);
+
+/**
+ * Find the filesystem @dev. Returns 0 and its index in @out_index if it's
+ * known, otherwise -1.
+ */
+int fslimit_find(
+	const struct fslimit *fslimit,
+	dev_t dev,
+	size_t *out_index);
+
+/**
+ * Find the filesystem @dev, or add it with the starting limit for a remote
+ * filesystem if @remote is set (see fslimit_is_remote). Returns 0 on
+ * success, -1 if out of memory.
+ */
+int fslimit_add(
+	struct fslimit *fslimit,
+	dev_t dev,
+	int remote,
+	size_t *out_index);
+
+/**
+ * Whether the filesystem of the open file @fd, or of @path if @fd is -1, is
+ * a network or FUSE filesystem, going by statfs(2) f_type. Only known on
+ * Linux, elsewhere and on errors every filesystem is taken as local.
+ */
+int fslimit_is_remote(
+	int fd,
+	const char *path);
+
+/**
+ * Whether another call may be started on filesystem @index.
+ */
+int fslimit_may_start(
+	const struct fslimit *fslimit,
+	size_t index);
+
+void fslimit_start(
+	struct fslimit *fslimit,
+	size_t index);
+
+/**
+ * Account for a unit of work started with fslimit_start, which made @calls
+ * calls in @seconds. Returns 1 if the filesystem has a free slot now but
+ * didn't before, i.e. if waiting workers should be woken up.
+ */
+int fslimit_finish(
+	struct fslimit *fslimit,
+	size_t index,
+	unsigned int calls,
+	double seconds);
+
+/**
+ * Monotonic time in seconds, for measuring the calls.
+ */
+double fslimit_now(void);
+
+#endif /* !defined(_XATTRPROGS_FSLIMIT_H) */
@@ -18,75 +18,513 @@
  * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-#include <fcntl.h>
-#include <unistd.h>
-#endif
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #include <sys/extattr.h>
 #endif
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-#include <sys/stat.h>
-#endif
-#if defined(__APPLE__) || defined(__DARWIN__) || defined(__linux__)
+#if defined(__APPLE__) || defined(__DARWIN__)
 #include <sys/xattr.h>
 #endif
 
-int main(int argc, char **argv)
-{
-	int ret = (EXIT_FAILURE);
-	int argp = 1;
+#include "checkpoint.h"
+#include "codec.h"
+#include "dump.h"
+#include "hooks.h"
+#include "json.h"
+#include "outbuf.h"
+#include "xattrio.h"
+#include "xattrprogs.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+/* Dump output is written out when this much has been collected. */
+#define GETXATTR_OUTPUT_CHUNK (64 * 1024)
+
+/* With --exists, this many names or more are looked up in the node's name
+ * list (one call) instead of with a size query each. */
+#define GETXATTR_EXISTS_LIST_NAMES 2
+
+/* Exit statuses with --exists, like grep(1). */
+#define GETXATTR_EXIT_ABSENT 1
+#define GETXATTR_EXIT_ERROR 2
+
+struct getxattr_options {
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	int namespace = EXTATTR_NAMESPACE_USER;
+	int namespace;
 #endif
-	int follow_links = 0;
-	const char *path = NULL;;
-	const char *attr_name = NULL;
+	int follow_links;
+	const char *attr_name;
 #if defined(__APPLE__) || defined(__DARWIN__)
-	const char *attr_offset_string = NULL;
-	unsigned long long attr_offset = 0;
+	unsigned long long attr_offset;
 #endif
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	int attrfd = -1;
-	struct stat attrstat = { 0 };
+	/* Write the value of each node in the dump format instead of as raw
+	 * data, used when more than one node is given. */
+	int dump;
+	/* Write the value as text in this encoding instead of as raw data. */
+	enum codec_encoding encoding;
+	/* Write one JSON object per node (see json.h). */
+	int json;
+	/* Only report whether each of the @names_count attributes @names
+	 * exists (with its size if @sizes is set), without reading values. */
+	int exists;
+	int sizes;
+	const char **names;
+	size_t names_count;
+};
+
+/**
+ * Get the attribute of a single node. The value is read into *@attr_data,
+ * which is reused (and grown when needed) between calls.
+ */
+static int getxattr_one(
+	const struct getxattr_options *options,
+	const char *path,
+	char **attr_data,
+	size_t *attr_data_alloc_size,
+	struct outbuf *out)
+{
+	int ret = -1;
+	const char *attr_name = options->attr_name;
+	const int follow_links = options->follow_links;
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	const int namespace = options->namespace;
+#else
+	const int namespace = XATTRIO_DEFAULT_NAMESPACE;
 #endif
 	ssize_t attr_size = 0;
-	char *attr_data = NULL;
+	size_t alloc_size;
 	ssize_t bytes_read;
 
+#if defined(__APPLE__) || defined(__DARWIN__)
+	if(options->attr_offset) {
+		/* Offsets into the resource fork are only supported by the
+		 * native backend. */
+		attr_size = getxattr(
+			path,
+			attr_name,
+			NULL,
+			0,
+			options->attr_offset,
+			follow_links ? 0 : XATTR_NOFOLLOW);
+	}
+	else
+#endif
+	{
+		attr_size = xattrio_get(path, follow_links, namespace,
+			attr_name, NULL, 0);
+	}
+
+	if(attr_size == -1) {
+		fprintf(stderr, "Error while getting size of extended "
+			"attribute for path \"%s\" and attribute name "
+			"\"%s\": %s (errno=%d)\n",
+			path, attr_name, strerror(errno), errno);
+		goto out;
+	}
+
+	/* A raw value is encoded in place, so make room for the encoded form
+	 * and a trailing newline. */
+	alloc_size = (options->dump || options->json) ? (size_t) attr_size :
+		codec_encoded_length(options->encoding, (size_t) attr_size);
+	++alloc_size;
+	if(!*attr_data || *attr_data_alloc_size < alloc_size) {
+		char *new_attr_data;
+
+		new_attr_data = realloc(*attr_data,
+			sizeof(char) * alloc_size);
+		if(new_attr_data == NULL) {
+			fprintf(stderr, "Error while allocating %zu bytes for "
+				"data buffer: %s (errno=%d)\n",
+				alloc_size, strerror(errno), errno);
+			goto out;
+		}
+
+		*attr_data = new_attr_data;
+		*attr_data_alloc_size = alloc_size;
+	}
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	if(options->attr_offset) {
+		bytes_read = getxattr(
+			path,
+			attr_name,
+			*attr_data,
+			attr_size,
+			options->attr_offset,
+			follow_links ? 0 : XATTR_NOFOLLOW);
+	}
+	else
+#endif
+	{
+		bytes_read = xattrio_get(path, follow_links, namespace,
+			attr_name, *attr_data, (size_t) attr_size);
+	}
+
+	if(bytes_read == -1) {
+		fprintf(stderr, "Error while getting extended attribute data "
+			"for path \"%s\" and attribute name \"%s\": %s "
+			"(errno=%d)\n",
+			path, attr_name, strerror(errno), errno);
+		goto out;
+	}
+	else if(bytes_read != attr_size) {
+		fprintf(stderr, "Partial read while getting extended attribute "
+			"data for path \"%s\" and attribute name \"%s\": "
+			"%zd/%zd bytes read\n",
+			path, attr_name, bytes_read, attr_size);
+		goto out;
+	}
+
+	if(options->json) {
+		json_begin_node(out, path);
+		json_put_attr(out, 1,
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+			xattrio_namespace_prefix(options->namespace),
+#else
+			xattrio_namespace_prefix(XATTRIO_DEFAULT_NAMESPACE),
+#endif
+			attr_name, strlen(attr_name), *attr_data,
+			(size_t) attr_size);
+		json_end_node(out);
+	}
+	else if(options->dump && options->encoding != CODEC_ENCODING_NONE) {
+		const size_t encoded_length = codec_encoded_length(
+			options->encoding, (size_t) attr_size);
+		char *dst;
+
+		/* name=0x... / name=0s... like getfattr(1) -e, encoded
+		 * straight into the output buffer. */
+		dump_put_file(out, path);
+		outbuf_puts(out,
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+			xattrio_namespace_prefix(options->namespace)
+#else
+			xattrio_namespace_prefix(XATTRIO_DEFAULT_NAMESPACE)
+#endif
+			);
+		dump_put_escaped(out, attr_name, strlen(attr_name));
+		outbuf_putc(out, '=');
+		outbuf_puts(out, codec_prefix(options->encoding));
+		dst = outbuf_reserve(out, encoded_length);
+		if(dst) {
+			codec_encode(options->encoding, *attr_data,
+				(size_t) attr_size, dst);
+			outbuf_commit(out, encoded_length);
+		}
+		outbuf_append(out, "\n\n", 2);
+	}
+	else if(options->dump) {
+		dump_put_file(out, path);
+		dump_put_attr(out,
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+			xattrio_namespace_prefix(options->namespace),
+#else
+			xattrio_namespace_prefix(XATTRIO_DEFAULT_NAMESPACE),
+#endif
+			attr_name, strlen(attr_name), *attr_data,
+			(size_t) attr_size);
+		outbuf_putc(out, '\n');
+	}
+	else if(options->encoding != CODEC_ENCODING_NONE) {
+		size_t encoded_length;
+
+		encoded_length = codec_encode(options->encoding, *attr_data,
+			(size_t) attr_size, *attr_data);
+		(*attr_data)[encoded_length++] = '\n';
+
+		if(fwrite(*attr_data, encoded_length, 1, stdout) != 1) {
+			fprintf(stderr, "Error while writing %zu bytes of "
+				"encoded attribute data to standard output: "
+				"%s (errno=%d)\n",
+				encoded_length, strerror(errno), errno);
+			goto out;
+		}
+	}
+	else if(attr_size &&
+		fwrite(*attr_data, attr_size, 1, stdout) != 1)
+	{
+		fprintf(stderr, "Error while writing %zd bytes of extended "
+			"attribute data to standard output: %s (errno=%d)\n",
+			attr_size, strerror(errno), errno);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	return ret;
+}
+
+/**
+ * Check whether the name list @list contains @name.
+ */
+static int getxattr_list_has(
+	const char *list,
+	size_t list_size,
+	const char *name)
+{
+	const size_t length = strlen(name);
+	const char *cur;
+	size_t cur_length;
+	size_t pos = 0;
+
+	while((cur = xattrio_list_next(list, list_size, &pos, NULL,
+		&cur_length)))
+	{
+		if(cur_length == length && !memcmp(cur, name, length)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Report whether a single node has each of the attributes in
+ * @options->names, as one line per name:
+ *
+ *   <+|->\t<name>[\t<size|->]\t<path>
+ *
+ * with the name and path escaped like in the dump format (so they never
+ * contain tabs or newlines). No values are read: each name costs a size
+ * query, or with several names the node's name list is read once instead
+ * (plus a size query for each present name if sizes are asked for).
+ *
+ * Returns 0 if all attributes exist, 1 if any doesn't, or -1 if an error
+ * was reported.
+ */
+static int getxattr_exists(
+	const struct getxattr_options *options,
+	const char *path,
+	struct xattrio_buf *list,
+	struct outbuf *out)
+{
+	int ret = -1;
+	const int follow_links = options->follow_links;
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	const int namespace = options->namespace;
+#else
+	const int namespace = XATTRIO_DEFAULT_NAMESPACE;
+#endif
+	ssize_t list_size = -1;
+	int absent = 0;
+	size_t i;
+
+	if(options->names_count >= GETXATTR_EXISTS_LIST_NAMES) {
+		list_size = xattrio_list_buf(path, follow_links, namespace,
+			list);
+		if(list_size < 0) {
+			fprintf(stderr, "Error while getting extended "
+				"attribute list for path \"%s\": %s "
+				"(errno=%d)\n",
+				path, strerror(errno), errno);
+			goto out;
+		}
+	}
+
+	for(i = 0; i < options->names_count; ++i) {
+		const char *const name = options->names[i];
+		ssize_t size = -1;
+		int present = 0;
+
+		if(list_size >= 0) {
+			present = getxattr_list_has(list->data,
+				(size_t) list_size, name);
+		}
+
+		if(list_size < 0 || (present && options->sizes)) {
+			size = xattrio_get(path, follow_links, namespace,
+				name, NULL, 0);
+			if(size < 0 && errno != ENOATTR) {
+				fprintf(stderr, "Error while getting size of "
+					"extended attribute for path \"%s\" "
+					"and attribute name \"%s\": %s "
+					"(errno=%d)\n",
+					path, name, strerror(errno), errno);
+				goto out;
+			}
+
+			present = size >= 0;
+		}
+
+		if(!present) {
+			absent = 1;
+		}
+
+		outbuf_putc(out, present ? '+' : '-');
+		outbuf_putc(out, '\t');
+		outbuf_puts(out, xattrio_namespace_prefix(namespace));
+		dump_put_escaped(out, name, strlen(name));
+		outbuf_putc(out, '\t');
+		if(options->sizes && present) {
+			char size_string[24];
+
+			snprintf(size_string, sizeof(size_string), "%zd",
+				size);
+			outbuf_puts(out, size_string);
+			outbuf_putc(out, '\t');
+		}
+		else if(options->sizes) {
+			outbuf_append(out, "-\t", 2);
+		}
+
+		dump_put_escaped(out, path, strlen(path));
+		outbuf_putc(out, '\n');
+	}
+
+	ret = absent;
+out:
+	return ret;
+}
+
+int getxattr_main(int argc, char **argv)
+{
+	int ret = (EXIT_FAILURE);
+	int argp = 1;
+	struct getxattr_options options;
+	const char *path = NULL;
+#if defined(__APPLE__) || defined(__DARWIN__)
+	const char *attr_offset_string = NULL;
+#endif
+	char *attr_data = NULL;
+	size_t attr_data_alloc_size = 0;
+	struct xattrio_buf list;
+	struct outbuf out;
+	const char *checkpoint_file = NULL;
+	const char *resume_file = NULL;
+	struct checkpoint checkpoint;
+	int have_checkpoint = 0;
+	struct hooks hooks;
+	int failed = 0;
+	int absent = 0;
+	int first;
+	size_t i;
+	int res;
+
+	hooks_init(&hooks);
+	memset(&options, 0, sizeof(options));
+	memset(&list, 0, sizeof(list));
+	memset(&out, 0, sizeof(out));
+	memset(&checkpoint, 0, sizeof(checkpoint));
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	options.namespace = EXTATTR_NAMESPACE_USER;
+#endif
+
+	/* Room for every -n, only --exists takes more than one. */
+	options.names = malloc(argc * sizeof(options.names[0]));
+	if(!options.names) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto out;
+	}
+
 	while(argp < argc) {
 		if(argv[argp][0] != '-') {
 			/* Not an option switch. Move on to the mandatory
 			 * arguments. */
 			break;
 		}
-		else if(argv[argp][1] == '-') {
+		else if(!strcmp(argv[argp], "--json")) {
+			options.json = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--exists")) {
+			options.exists = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--size")) {
+			options.sizes = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--checkpoint") ||
+			!strcmp(argv[argp], "--resume"))
+		{
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a file argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(argv[argp][2] == 'c') {
+				checkpoint_file = argv[argp + 1];
+			}
+			else {
+				resume_file = argv[argp + 1];
+			}
+
+			argp += 2;
+		}
+		else if((res = hooks_parse_option(&hooks, argc, argv,
+			&argp)))
+		{
+			if(res < 0) {
+				goto out;
+			}
+		}
+		else if(!strcmp(argv[argp], "--")) {
 			/* Stop parsing options when '--' is encountered. */
 			++argp;
 			break;
 		}
 		else if(argv[argp][1] == 'L') {
-			follow_links = 1;
+			options.follow_links = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'n') {
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			options.attr_name = argv[argp + 1];
+			options.names[options.names_count++] =
+				argv[argp + 1];
+			argp += 2;
+		}
+		else if(argv[argp][1] == 'q') {
+			options.exists = 1;
 			++argp;
 		}
+		else if(argv[argp][1] == 'E') {
+			if(argp + 1 >= argc || codec_parse_encoding(
+				argv[argp + 1], &options.encoding))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an encoding argument (hex or "
+					"base64).\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #if defined(EXTATTR_NAMESPACE_EMPTY)
 		else if(argv[argp][1] == 'e') {
-			namespace = EXTATTR_NAMESPACE_EMPTY;
+			options.namespace = EXTATTR_NAMESPACE_EMPTY;
 			++argp;
 		}
 #endif
 		else if(argv[argp][1] == 'u') {
-			namespace = EXTATTR_NAMESPACE_USER;
+			options.namespace = EXTATTR_NAMESPACE_USER;
 			++argp;
 		}
 		else if(argv[argp][1] == 's') {
-			namespace = EXTATTR_NAMESPACE_SYSTEM;
+			options.namespace = EXTATTR_NAMESPACE_SYSTEM;
 			++argp;
 		}
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
@@ -97,13 +535,22 @@ int main(int argc, char **argv)
 		}
 	}
 
-	path = (argp < argc) ? argv[argp++] : NULL;
-	attr_name = (argp < argc) ? argv[argp++] : NULL;
+	if(!options.attr_name) {
+		/* Traditional form: <filename> <attribute name> [<offset>] */
+		path = (argp < argc) ? argv[argp++] : NULL;
+		options.attr_name = (argp < argc) ? argv[argp++] : NULL;
 #if defined(__APPLE__) || defined(__DARWIN__)
-	attr_offset_string = (argp < argc) ? argv[argp++] : NULL;
+		attr_offset_string = (argp < argc) ? argv[argp++] : NULL;
 #endif
+		if(options.attr_name) {
+			options.names[options.names_count++] =
+				options.attr_name;
+		}
+	}
 
-	if(!path || !attr_name || argp < argc) {
+	if(!options.attr_name || (path && argp < argc) ||
+		(!path && argp >= argc))
+	{
 		fprintf(stderr, "usage: getxattr [-L"
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #if defined(EXTATTR_NAMESPACE_EMPTY)
@@ -111,21 +558,73 @@ int main(int argc, char **argv)
 #endif
 			"|-u|-s"
 #endif
-			"] <filename> <attribute name>"
+			"] [-E hex|base64|--json] <filename> <attribute name>"
 #if defined(__APPLE__) || defined(__DARWIN__)
 			" [<attribute offset>]"
 #endif
-			"\n");
+			"\n"
+			"       getxattr [-L"
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#if defined(EXTATTR_NAMESPACE_EMPTY)
+			"|-e"
+#endif
+			"|-u|-s"
+#endif
+			"] [-E hex|base64|--json] [--checkpoint <file>]\n"
+			"                [--resume <file>] [--background] "
+			"[--max-rate <calls>]\n"
+			"                [--max-bandwidth <bytes>] "
+			"[--trace <file>]\n"
+			"                -n <attribute name> <filename>...\n"
+			"       getxattr -q|--exists [-L"
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#if defined(EXTATTR_NAMESPACE_EMPTY)
+			"|-e"
+#endif
+			"|-u|-s"
+#endif
+			"] [--size] [--checkpoint <file>] "
+			"[--resume <file>]\n"
+			"                [--background] [--max-rate <calls>] "
+			"[--max-bandwidth <bytes>]\n"
+			"                [--trace <file>] "
+			"-n <attribute name> [-n ...] <filename>...\n");
 		goto out;
 	}
 
+	if(options.names_count > 1 && !options.exists) {
+		fprintf(stderr, "Error: Only --exists accepts more than one "
+			"-n.\n");
+		goto out;
+	}
+	else if(options.sizes && !options.exists) {
+		fprintf(stderr, "Error: Option '--size' requires --exists.\n");
+		goto out;
+	}
+	else if(options.exists && (options.json ||
+		options.encoding != CODEC_ENCODING_NONE
+#if defined(__APPLE__) || defined(__DARWIN__)
+		|| attr_offset_string
+#endif
+		))
+	{
+		fprintf(stderr, "Error: --exists can't be combined with "
+			"--json, -E or an offset.\n");
+		goto out;
+	}
+
+	if(options.exists) {
+		/* Tell errors apart from absent attributes, like grep(1). */
+		ret = (GETXATTR_EXIT_ERROR);
+	}
+
 #if defined(__APPLE__) || defined(__DARWIN__)
 	if(attr_offset_string) {
 		char *endptr = NULL;
 
 		errno = 0;
-		attr_offset = strtoull(attr_offset_string, &endptr, 0);
-		if(errno || ((*endptr || attr_offset > SIZE_MAX) &&
+		options.attr_offset = strtoull(attr_offset_string, &endptr, 0);
+		if(errno || ((*endptr || options.attr_offset > SIZE_MAX) &&
 			(errno = EILSEQ)))
 		{
 			fprintf(stderr, "Invalid offset: %s\n",
@@ -136,135 +635,178 @@ int main(int argc, char **argv)
 #endif
 
 #if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attr_name[0] == '/') {
+	if(options.attr_name[0] == '/') {
 		fprintf(stderr, "Invalid attribute name \"%s\" (cannot start "
-			"with '/').\n", attr_name);
+			"with '/').\n", options.attr_name);
 		goto out;
 	}
+#endif
 
-	attrfd = attropen(
-		path,
-		attr_name,
-		O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
-	if(attrfd == -1) {
-		fprintf(stderr, "Error while opening extended attribute \"%s\" "
-			"of file \"%s\": %s (%d)\n",
-			attr_name,
-			path,
-			strerror(errno),
-			errno);
+	if(options.json && options.encoding != CODEC_ENCODING_NONE) {
+		fprintf(stderr, "Error: --json writes binary values base64 "
+			"encoded and can't be combined with -E.\n");
 		goto out;
 	}
-#endif
 
-#if defined(__APPLE__) || defined(__DARWIN__)
-	attr_size = getxattr(
-		path,
-		attr_name,
-		NULL,
-		0,
-		attr_offset,
-		follow_links ? 0 : XATTR_NOFOLLOW);
-#elif defined(__linux__)
-	attr_size = (follow_links ? getxattr : lgetxattr)(
-		path,
-		attr_name,
-		NULL,
-		0);
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-	attr_size = (follow_links ? extattr_get_file : extattr_get_link)(
-		path,
-		namespace,
-		attr_name,
-		NULL,
-		0);
-#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(fstat(attrfd, &attrstat)) {
-		attr_size = -1;
-	}
-	else {
-		attr_size = attrstat.st_size;
-	}
-#else
-#error "Don't know how to handle extended attributes on this platform."
-#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
-	if(attr_size == -1) {
-		fprintf(stderr, "Error while getting size of extended "
-			"attribute for path \"%s\" and attribute name "
-			"\"%s\": %s (errno=%d)\n",
-			path, attr_name, strerror(errno), errno);
+	if(path && (checkpoint_file || resume_file)) {
+		fprintf(stderr, "Error: Checkpoints are only supported with "
+			"-n.\n");
 		goto out;
 	}
 
-	attr_data = calloc(1, sizeof(char) * (attr_size + 1));
-	if(attr_data == NULL) {
-		fprintf(stderr, "Error while allocating %zd bytes for data "
-			"buffer: %s (errno=%d)\n",
-			attr_size, strerror(errno), errno);
+	if(xattrio_backend_init()) {
 		goto out;
 	}
 
-#if defined(__APPLE__) || defined(__DARWIN__)
-	bytes_read = getxattr(
-		path,
-		attr_name,
-		attr_data,
-		attr_size,
-		attr_offset,
-		follow_links ? 0 : XATTR_NOFOLLOW);
-#elif defined(__linux__)
-	bytes_read = (follow_links ? getxattr : lgetxattr)(
-		path,
-		attr_name,
-		attr_data,
-		attr_size);
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-	bytes_read = (follow_links ? extattr_get_file : extattr_get_link)(
-		path,
-		namespace,
-		attr_name,
-		attr_data,
-		attr_size);
-#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	bytes_read = read(
-		attrfd,
-		attr_data,
-		attr_size);
-#else
-#error "Don't know how to handle extended attributes on this platform."
-#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
-	if(bytes_read == -1) {
-		fprintf(stderr, "Error while getting extended attribute data "
-			"for path \"%s\" and attribute name \"%s\": %s "
-			"(errno=%d)\n",
-			path, attr_name, strerror(errno), errno);
+	if(hooks_start(&hooks, "getxattr", 1)) {
 		goto out;
 	}
-	else if(bytes_read != attr_size) {
-		fprintf(stderr, "Partial read while getting extended attribute "
-			"data for path \"%s\" and attribute name \"%s\": "
-			"%zd/%zd bytes read\n",
-			path, attr_name, bytes_read, attr_size);
-		goto out;
+
+	if(path) {
+		if(options.exists) {
+			res = getxattr_exists(&options, path, &list, &out);
+			absent = res > 0;
+		}
+		else {
+			res = getxattr_one(&options, path, &attr_data,
+				&attr_data_alloc_size, &out);
+		}
+
+		if(res < 0) {
+			goto out;
+		}
+
+		if(outbuf_flush(&out, stdout)) {
+			fprintf(stderr, "Error while writing to standard "
+				"output: %s (errno=%d)\n",
+				strerror(errno), errno);
+			goto out;
+		}
 	}
+	else {
+		/* A raw value can only be told apart from the next one when
+		 * there's a single node, otherwise use the dump format. */
+		options.dump = !options.exists && (argc - argp > 1);
+		first = argp;
 
-	if(fwrite(attr_data, attr_size, 1, stdout) != 1) {
-		fprintf(stderr, "Error while writing %zd bytes of extended "
-			"attribute data to standard output: %s (errno=%d)\n",
-			attr_size, strerror(errno), errno);
-		goto out;
+		if(checkpoint_file || resume_file) {
+			/* A resumed run keeps updating the checkpoint it was
+			 * resumed from, unless told otherwise. */
+			checkpoint_init(&checkpoint,
+				checkpoint_file ? checkpoint_file : resume_file,
+				"getxattr", "args");
+			have_checkpoint = 1;
+			if(resume_file &&
+				checkpoint_load(&checkpoint, resume_file))
+			{
+				goto out;
+			}
+
+			for(i = 0; i < options.names_count; ++i) {
+				checkpoint_hash_args(&checkpoint,
+					options.names[i],
+					strlen(options.names[i]));
+			}
+			checkpoint_hash_arg_list(&checkpoint, &argv[first],
+				(size_t) (argc - first));
+			if(resume_file &&
+				checkpoint_check_args(&checkpoint, resume_file))
+			{
+				goto out;
+			}
+
+			if(checkpoint.position > (unsigned long long)
+				(argc - first))
+			{
+				fprintf(stderr, "Error: Checkpoint \"%s\" is "
+					"past the end of the file list.\n",
+					resume_file);
+				goto out;
+			}
+
+			argp = first + (int) checkpoint.position;
+		}
+
+		for(; argp < argc; ++argp) {
+			const int save = have_checkpoint && (argp + 1 == argc ||
+				checkpoint_due(&checkpoint));
+
+			if(options.exists) {
+				res = getxattr_exists(&options, argv[argp],
+					&list, &out);
+				if(res > 0) {
+					absent = 1;
+				}
+			}
+			else {
+				res = getxattr_one(&options, argv[argp],
+					&attr_data, &attr_data_alloc_size,
+					&out);
+			}
+
+			if(res < 0) {
+				failed = 1;
+				++checkpoint.errors;
+			}
+
+			if((out.len >= GETXATTR_OUTPUT_CHUNK || save) &&
+				(outbuf_flush(&out, stdout) ||
+				(save && fflush(stdout))))
+			{
+				fprintf(stderr, "Error while writing to "
+					"standard output: %s (errno=%d)\n",
+					strerror(errno), errno);
+				goto out;
+			}
+
+			/* The output up to this file has been written. */
+			++checkpoint.done;
+			checkpoint.position = (unsigned long long)
+				(argp + 1 - first);
+			if(save && checkpoint_save(&checkpoint)) {
+				goto out;
+			}
+		}
+
+		if(outbuf_flush(&out, stdout)) {
+			fprintf(stderr, "Error while writing to standard "
+				"output: %s (errno=%d)\n",
+				strerror(errno), errno);
+			goto out;
+		}
+
+		if(failed) {
+			goto out;
+		}
 	}
 
-	ret = (EXIT_SUCCESS);
+	ret = absent ? (GETXATTR_EXIT_ABSENT) : (EXIT_SUCCESS);
 out:
+	if(hooks_finish(&hooks)) {
+		ret = options.exists ? (GETXATTR_EXIT_ERROR) :
+			(EXIT_FAILURE);
+	}
+
+	if(have_checkpoint) {
+		checkpoint_finish(&checkpoint, ret == (EXIT_SUCCESS));
+	}
+
 	if(attr_data) {
 		free(attr_data);
 	}
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attrfd != -1) {
-		close(attrfd);
-	}
-#endif
+
+	free(options.names);
+	xattrio_buf_free(&list);
+	outbuf_free(&out);
+
+	xattrio_backend_cleanup();
 
 	return ret;
 }
+
+#ifndef XATTRPROGS_MULTICALL
+int main(int argc, char **argv)
+{
+	return getxattr_main(argc, argv);
+}
+#endif
@@ -0,0 +1,626 @@
+/*-
+ * grepxattr.c - Search the extended attribute values of a filesystem tree.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <regex.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include "hooks.h"
+#include "json.h"
+#include "pool.h"
+#include "scan.h"
+#include "xattrio.h"
+#include "xattrprogs.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+/* Exit statuses, same as grep(1). */
+#define GREPXATTR_EXIT_MATCH 0
+#define GREPXATTR_EXIT_NO_MATCH 1
+#define GREPXATTR_EXIT_ERROR 2
+
+struct grepxattr_options {
+	int follow_links;
+	int namespace;
+	int fixed_string;
+	int ignore_case;
+	int json;
+	const char *pattern;
+	size_t pattern_length;
+	struct xattrio_prefix name_prefix_filter;
+	const struct xattrio_prefix *name_prefix;
+
+	pthread_mutex_t lock;
+	unsigned long long matches;
+};
+
+struct grepxattr_worker {
+	/* Each worker has its own compiled copy of the pattern since regexec
+	 * serializes concurrent callers on a shared regex_t in some C
+	 * libraries. */
+	regex_t regex;
+	unsigned long long matches;
+};
+
+/* Generic substring search, used for the tail of the haystack and on
+ * platforms without a vectorized implementation. */
+static const char* grepxattr_memmem_scalar(
+	const char *haystack,
+	size_t haystack_length,
+	const char *needle,
+	size_t needle_length)
+{
+	const char *end = haystack + haystack_length - needle_length + 1;
+	const char *cur = haystack;
+
+	while(cur < end) {
+		cur = memchr(cur, needle[0], end - cur);
+		if(!cur) {
+			break;
+		}
+
+		if(!memcmp(cur + 1, needle + 1, needle_length - 1)) {
+			return cur;
+		}
+
+		++cur;
+	}
+
+	return NULL;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* Vectorized substring search: compare the first and the last byte of the
+ * needle against 16/32 candidate positions at once and only run the full
+ * comparison for the positions where both match. */
+
+__attribute__((target("sse2")))
+static const char* grepxattr_memmem_sse2(
+	const char *haystack,
+	size_t haystack_length,
+	const char *needle,
+	size_t needle_length)
+{
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+	size_t i = 0;
+
+	for(; i + needle_length - 1 + 16 <= haystack_length; i += 16) {
+		const __m128i block_first =
+			_mm_loadu_si128((const __m128i*) &haystack[i]);
+		const __m128i block_last = _mm_loadu_si128((const __m128i*)
+			&haystack[i + needle_length - 1]);
+		unsigned int mask = (unsigned int) _mm_movemask_epi8(
+			_mm_and_si128(
+				_mm_cmpeq_epi8(first, block_first),
+				_mm_cmpeq_epi8(last, block_last)));
+
+		while(mask) {
+			const unsigned int bit = __builtin_ctz(mask);
+
+			if(!memcmp(&haystack[i + bit + 1], needle + 1,
+				needle_length - 2))
+			{
+				return &haystack[i + bit];
+			}
+
+			mask &= mask - 1;
+		}
+	}
+
+	return grepxattr_memmem_scalar(&haystack[i], haystack_length - i,
+		needle, needle_length);
+}
+
+__attribute__((target("avx2")))
+static const char* grepxattr_memmem_avx2(
+	const char *haystack,
+	size_t haystack_length,
+	const char *needle,
+	size_t needle_length)
+{
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+	size_t i = 0;
+
+	for(; i + needle_length - 1 + 32 <= haystack_length; i += 32) {
+		const __m256i block_first =
+			_mm256_loadu_si256((const __m256i*) &haystack[i]);
+		const __m256i block_last = _mm256_loadu_si256((const __m256i*)
+			&haystack[i + needle_length - 1]);
+		unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+			_mm256_and_si256(
+				_mm256_cmpeq_epi8(first, block_first),
+				_mm256_cmpeq_epi8(last, block_last)));
+
+		while(mask) {
+			const unsigned int bit = __builtin_ctz(mask);
+
+			if(!memcmp(&haystack[i + bit + 1], needle + 1,
+				needle_length - 2))
+			{
+				return &haystack[i + bit];
+			}
+
+			mask &= mask - 1;
+		}
+	}
+
+	return grepxattr_memmem_sse2(&haystack[i], haystack_length - i,
+		needle, needle_length);
+}
+#endif /* defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) */
+
+static const char* grepxattr_memmem(
+	const char *haystack,
+	size_t haystack_length,
+	const char *needle,
+	size_t needle_length)
+{
+	if(!needle_length) {
+		return haystack;
+	}
+	else if(needle_length > haystack_length) {
+		return NULL;
+	}
+	else if(needle_length == 1) {
+		return memchr(haystack, needle[0], haystack_length);
+	}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if(__builtin_cpu_supports("avx2")) {
+		return grepxattr_memmem_avx2(haystack, haystack_length, needle,
+			needle_length);
+	}
+	else if(__builtin_cpu_supports("sse2")) {
+		return grepxattr_memmem_sse2(haystack, haystack_length, needle,
+			needle_length);
+	}
+#endif
+
+	return grepxattr_memmem_scalar(haystack, haystack_length, needle,
+		needle_length);
+}
+
+static int grepxattr_compile(
+	const struct grepxattr_options *options,
+	regex_t *regex)
+{
+	int err;
+
+	err = regcomp(regex, options->pattern,
+		REG_EXTENDED | REG_NOSUB |
+		(options->ignore_case ? REG_ICASE : 0));
+	if(err) {
+		char errbuf[256];
+
+		regerror(err, regex, errbuf, sizeof(errbuf));
+		fprintf(stderr, "Error: Invalid pattern '%s': %s\n",
+			options->pattern, errbuf);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int grepxattr_worker_init(
+	struct scan_worker *worker,
+	void *arg)
+{
+	const struct grepxattr_options *options = arg;
+	struct grepxattr_worker *priv;
+
+	priv = calloc(1, sizeof(*priv));
+	if(!priv) {
+		fprintf(stderr, "Error while allocating worker state: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		return -1;
+	}
+
+	if(!options->fixed_string && grepxattr_compile(options, &priv->regex))
+	{
+		free(priv);
+		return -1;
+	}
+
+	worker->priv = priv;
+
+	return 0;
+}
+
+static void grepxattr_worker_fini(
+	struct scan_worker *worker,
+	void *arg)
+{
+	struct grepxattr_options *options = arg;
+	struct grepxattr_worker *priv = worker->priv;
+
+	pthread_mutex_lock(&options->lock);
+	options->matches += priv->matches;
+	pthread_mutex_unlock(&options->lock);
+
+	if(!options->fixed_string) {
+		regfree(&priv->regex);
+	}
+
+	free(priv);
+	worker->priv = NULL;
+}
+
+static int grepxattr_match(
+	const struct grepxattr_options *options,
+	struct grepxattr_worker *priv,
+	const char *value,
+	size_t value_length)
+{
+	if(options->fixed_string) {
+		return grepxattr_memmem(value, value_length, options->pattern,
+			options->pattern_length) != NULL;
+	}
+	else {
+#ifdef REG_STARTEND
+		/* Values may contain NUL bytes, so tell regexec where the
+		 * value ends instead of relying on the terminator. */
+		regmatch_t match;
+
+		match.rm_so = 0;
+		match.rm_eo = (regoff_t) value_length;
+
+		return !regexec(&priv->regex, value, 1, &match, REG_STARTEND);
+#else
+		return !regexec(&priv->regex, value, 0, NULL, 0);
+#endif
+	}
+}
+
+static int grepxattr_visit(
+	struct scan_worker *worker,
+	const char *path,
+	enum scan_type type,
+	void *arg)
+{
+	const struct grepxattr_options *options = arg;
+	struct grepxattr_worker *priv = worker->priv;
+	ssize_t list_size;
+	size_t pos = 0;
+	const char *name;
+	size_t name_length;
+	int node_matches = 0;
+	int res = 0;
+
+	(void) type;
+
+	list_size = xattrio_list_buf(
+		path,
+		options->follow_links,
+		options->namespace,
+		&worker->list);
+	if(list_size < 0) {
+		if(errno == ENOENT || errno == ENOTSUP || errno == EPERM) {
+			/* Node disappeared or doesn't support extended
+			 * attributes (or, on FreeBSD/NetBSD, the namespace).
+			 * Nothing to search. */
+			return 0;
+		}
+
+		fprintf(stderr, "Error while getting extended attribute list "
+			"for path \"%s\": %s (errno=%d)\n",
+			path, strerror(errno), errno);
+		return -1;
+	}
+
+	while((name = xattrio_list_next(worker->list.data, (size_t) list_size,
+		&pos, options->name_prefix,
+		&name_length)))
+	{
+		ssize_t value_size;
+
+		value_size = xattrio_get_buf(
+			path,
+			options->follow_links,
+			options->namespace,
+			name,
+			&worker->value);
+		if(value_size < 0) {
+			if(errno == ENOATTR || errno == ENOENT) {
+				/* Removed since we listed it. */
+				continue;
+			}
+
+			fprintf(stderr, "Error while getting extended "
+				"attribute data for path \"%s\" and attribute "
+				"name \"%s\": %s (errno=%d)\n",
+				path, name, strerror(errno), errno);
+			res = -1;
+			continue;
+		}
+
+		if(!grepxattr_match(options, priv, worker->value.data,
+			(size_t) value_size))
+		{
+			continue;
+		}
+
+		++priv->matches;
+
+		if(options->json) {
+			/* One object per node with the matching attributes
+			 * and their values. */
+			if(!node_matches) {
+				json_begin_node(&worker->out, path);
+			}
+
+			json_put_attr(&worker->out, !node_matches,
+				xattrio_namespace_prefix(options->namespace),
+				name, name_length, worker->value.data,
+				(size_t) value_size);
+		}
+		else {
+			outbuf_puts(&worker->out, path);
+			outbuf_append(&worker->out, ": ", 2);
+			outbuf_append(&worker->out, name, name_length);
+			outbuf_putc(&worker->out, '\n');
+		}
+
+		++node_matches;
+	}
+
+	if(node_matches && options->json) {
+		json_end_node(&worker->out);
+	}
+
+	return res;
+}
+
+int grepxattr_main(int argc, char **argv)
+{
+	int ret = (GREPXATTR_EXIT_ERROR);
+	int argp = 1;
+	struct grepxattr_options options;
+	struct scan_options scan_options;
+	struct hooks hooks;
+	int scan_res;
+	int res;
+
+	hooks_init(&hooks);
+	memset(&options, 0, sizeof(options));
+	memset(&scan_options, 0, sizeof(scan_options));
+	options.namespace = XATTRIO_DEFAULT_NAMESPACE;
+	pthread_mutex_init(&options.lock, NULL);
+
+	while(argp < argc) {
+		if(argv[argp][0] != '-') {
+			/* Not an option switch. Move on to the mandatory
+			 * arguments. */
+			break;
+		}
+		else if(!strcmp(argv[argp], "--json")) {
+			options.json = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--skip-symlinks")) {
+			scan_options.skip_symlinks = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--skip-special")) {
+			scan_options.skip_special = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--xdev")) {
+			scan_options.one_filesystem = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--prefetch")) {
+			if(argp + 1 >= argc || scan_parse_prefetch(
+				argv[argp + 1], &scan_options.prefetch))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else if((res = hooks_parse_option(&hooks, argc, argv,
+			&argp)))
+		{
+			if(res < 0) {
+				goto out;
+			}
+		}
+		else if(!strcmp(argv[argp], "--")) {
+			/* Stop parsing options when '--' is encountered. */
+			++argp;
+			break;
+		}
+		else if(argv[argp][1] == 'L') {
+			options.follow_links = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'F') {
+			options.fixed_string = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'i') {
+			options.ignore_case = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'n') {
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(options.name_prefix) {
+				xattrio_prefix_free(
+					&options.name_prefix_filter);
+			}
+
+			if(xattrio_prefix_init(&options.name_prefix_filter,
+				argv[argp + 1]))
+			{
+				fprintf(stderr, "Error while allocating name "
+					"filter: %s (errno=%d)\n",
+					strerror(errno), errno);
+				goto out;
+			}
+
+			options.name_prefix = &options.name_prefix_filter;
+			argp += 2;
+		}
+		else if(argv[argp][1] == 'j') {
+			if(argp + 1 >= argc || pool_parse_threads(
+				argv[argp + 1], &scan_options.threads))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#ifdef EXTATTR_NAMESPACE_EMPTY
+		else if(argv[argp][1] == 'e') {
+			options.namespace = EXTATTR_NAMESPACE_EMPTY;
+			++argp;
+		}
+#endif
+		else if(argv[argp][1] == 'u') {
+			options.namespace = EXTATTR_NAMESPACE_USER;
+			++argp;
+		}
+		else if(argv[argp][1] == 's') {
+			options.namespace = EXTATTR_NAMESPACE_SYSTEM;
+			++argp;
+		}
+#endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
+		else {
+			fprintf(stderr, "Error: Unrecognized option '%s'.\n",
+				argv[argp]);
+			goto out;
+		}
+	}
+
+	options.pattern = (argp < argc) ? argv[argp++] : NULL;
+
+	if(!options.pattern || argp >= argc) {
+		fprintf(stderr, "usage: grepxattr [-L|-F|-i"
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#ifdef EXTATTR_NAMESPACE_EMPTY
+			"|-e"
+#endif
+			"|-u|-s"
+#endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
+			"] [--json] [-n <name prefix>] [-j <threads>]\n"
+			"                 [--background] [--max-rate <calls>] "
+			"[--max-bandwidth <bytes>]\n"
+			"                 [--skip-symlinks] [--skip-special] "
+			"[--xdev] [--trace <file>]\n"
+			"                 [--prefetch <threads>] <pattern> "
+			"<path>...\n");
+		goto out;
+	}
+
+	if(options.fixed_string && options.ignore_case) {
+		fprintf(stderr, "Error: -i can't be combined with -F.\n");
+		goto out;
+	}
+
+	options.pattern_length = strlen(options.pattern);
+
+	if(!options.fixed_string) {
+		regex_t regex;
+
+		/* Validate the pattern once up front so that a bad pattern is
+		 * only reported once and not by every worker. */
+		if(grepxattr_compile(&options, &regex)) {
+			goto out;
+		}
+
+		regfree(&regex);
+	}
+
+	if(xattrio_backend_init()) {
+		goto out;
+	}
+
+	if(hooks_start(&hooks, "grepxattr", scan_options.threads ?
+		scan_options.threads : pool_default_threads()))
+	{
+		goto out;
+	}
+
+	scan_options.worker_init = grepxattr_worker_init;
+	scan_options.worker_fini = grepxattr_worker_fini;
+	scan_options.visit = grepxattr_visit;
+	scan_options.arg = &options;
+
+	scan_res = scan_run(&scan_options, &argv[argp], argc - argp);
+	if(scan_res) {
+		ret = (GREPXATTR_EXIT_ERROR);
+	}
+	else if(options.matches) {
+		ret = (GREPXATTR_EXIT_MATCH);
+	}
+	else {
+		ret = (GREPXATTR_EXIT_NO_MATCH);
+	}
+out:
+	if(hooks_finish(&hooks)) {
+		ret = (GREPXATTR_EXIT_ERROR);
+	}
+
+	if(options.name_prefix) {
+		xattrio_prefix_free(&options.name_prefix_filter);
+	}
+
+	pthread_mutex_destroy(&options.lock);
+
+	xattrio_backend_cleanup();
+
+	return ret;
+}
+
+#ifndef XATTRPROGS_MULTICALL
+int main(int argc, char **argv)
+{
+	return grepxattr_main(argc, argv);
+}
+#endif
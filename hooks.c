@@ -0,0 +1,135 @@
+/*-
+ * hooks.c - Tracing and throttling of the xattr calls of a tool.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hooks.h"
+#include "xattrio.h"
+
+void hooks_init(
+	struct hooks *hooks)
+{
+	memset(hooks, 0, sizeof(*hooks));
+	hooks->max_rate = THROTTLE_DEFAULT_CALLS;
+	hooks->max_bandwidth = THROTTLE_DEFAULT_BYTES;
+}
+
+int hooks_parse_option(
+	struct hooks *hooks,
+	int argc,
+	char **argv,
+	int *argp)
+{
+	const char *const option = argv[*argp];
+
+	if(!strcmp(option, "--trace")) {
+		if(*argp + 1 >= argc) {
+			fprintf(stderr, "Error: Option '%s' requires a file "
+				"argument.\n",
+				option);
+			return -1;
+		}
+
+		hooks->trace_file = argv[*argp + 1];
+		*argp += 2;
+	}
+	else if(!strcmp(option, "--background")) {
+		hooks->background = 1;
+		++*argp;
+	}
+	else if(!strcmp(option, "--max-rate") ||
+		!strcmp(option, "--max-bandwidth"))
+	{
+		unsigned long long *const rate =
+			!strcmp(option, "--max-rate") ?
+			&hooks->max_rate : &hooks->max_bandwidth;
+
+		if(*argp + 1 >= argc ||
+			throttle_parse_rate(argv[*argp + 1], rate))
+		{
+			fprintf(stderr, "Error: Option '%s' requires a per "
+				"second rate argument.\n",
+				option);
+			return -1;
+		}
+
+		hooks->background = 1;
+		*argp += 2;
+	}
+	else {
+		return 0;
+	}
+
+	return 1;
+}
+
+int hooks_start(
+	struct hooks *hooks,
+	const char *progname,
+	unsigned int threads)
+{
+	if(hooks->trace_file) {
+		if(trace_open(&hooks->trace, hooks->trace_file, progname)) {
+			return -1;
+		}
+
+		xattrio_set_trace(&hooks->trace);
+		hooks->traced = 1;
+	}
+
+	if(hooks->background) {
+		/* Stay out of the way of other users of the storage. */
+		throttle_set_idle_io(progname);
+		throttle_init(&hooks->throttle, hooks->max_rate,
+			hooks->max_bandwidth, threads);
+		xattrio_set_throttle(&hooks->throttle);
+		hooks->throttled = 1;
+	}
+
+	return 0;
+}
+
+int hooks_finish(
+	struct hooks *hooks)
+{
+	int ret = 0;
+
+	if(hooks->traced) {
+		xattrio_set_trace(NULL);
+		if(trace_close(&hooks->trace)) {
+			ret = -1;
+		}
+
+		hooks->traced = 0;
+	}
+
+	if(hooks->throttled) {
+		xattrio_set_throttle(NULL);
+		throttle_destroy(&hooks->throttle);
+		hooks->throttled = 0;
+	}
+
+	return ret;
+}
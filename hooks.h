@@ -0,0 +1,86 @@
+/*-
+ * hooks.h - Tracing and throttling of the xattr calls of a tool.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_HOOKS_H
+#define _XATTRPROGS_HOOKS_H
+
+#include "throttle.h"
+#include "trace.h"
+
+/**
+ * The options that hook into every xattr call made through xattrio, shared by
+ * all tools: --trace <file> records the calls (see trace.h), --background,
+ * --max-rate <calls> and --max-bandwidth <bytes> throttle them (see
+ * throttle.h). Giving --max-rate or --max-bandwidth implies --background.
+ */
+struct hooks {
+	const char *trace_file;
+	int background;
+	unsigned long long max_rate;
+	unsigned long long max_bandwidth;
+
+	struct trace trace;
+	int traced;
+	struct throttle throttle;
+	int throttled;
+};
+
+/**
+ * Set up @hooks with the default options, hooking into nothing.
+ */
+void hooks_init(
+	struct hooks *hooks);
+
+/**
+ * Parse the option at argv[*argp] if it's one of the hook options, moving
+ * *argp past it and its argument.
+ *
+ * Returns 1 if the option was parsed, 0 if it's another option, or -1 after
+ * reporting an error.
+ */
+int hooks_parse_option(
+	struct hooks *hooks,
+	int argc,
+	char **argv,
+	int *argp);
+
+/**
+ * Start tracing and throttling the calls as asked by the options. @progname
+ * names the tool in messages and in the trace. @threads is the number of
+ * threads making calls, the most that the throttle lets be in flight.
+ *
+ * Returns 0 on success, or -1 after reporting an error.
+ */
+int hooks_start(
+	struct hooks *hooks,
+	const char *progname,
+	unsigned int threads);
+
+/**
+ * Stop tracing and throttling and write out the trace. May be called whether
+ * hooks_start was called or not.
+ *
+ * Returns 0 on success, or -1 after reporting that the trace couldn't be
+ * written.
+ */
+int hooks_finish(
+	struct hooks *hooks);
+
+#endif /* !defined(_XATTRPROGS_HOOKS_H) */
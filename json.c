@@ -0,0 +1,333 @@
+/*-
+ * json.c - Streaming NDJSON output.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include "codec.h"
+#include "json.h"
+
+static const char json_hex_digits[] = "0123456789abcdef";
+
+static int json_needs_escape(
+	unsigned char c)
+{
+	return c < 0x20 || c == '"' || c == '\\';
+}
+
+/**
+ * Returns the length of the run of bytes at the start of @data that need no
+ * escaping.
+ */
+static size_t json_plain_run_scalar(
+	const char *data,
+	size_t len)
+{
+	size_t i = 0;
+
+	while(i < len && !json_needs_escape((unsigned char) data[i])) {
+		++i;
+	}
+
+	return i;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("sse2")))
+static size_t json_plain_run_sse2(
+	const char *data,
+	size_t len)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+	size_t i;
+
+	for(i = 0; i + 16 <= len; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+		const unsigned int mask = (unsigned int) _mm_movemask_epi8(
+			_mm_or_si128(_mm_or_si128(
+				_mm_cmpeq_epi8(v, quote),
+				_mm_cmpeq_epi8(v, backslash)),
+				_mm_cmpeq_epi8(_mm_min_epu8(v, control), v)));
+
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	return i + json_plain_run_scalar(&data[i], len - i);
+}
+#endif /* defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) */
+
+static size_t json_plain_run(
+	const char *data,
+	size_t len)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if(__builtin_cpu_supports("sse2")) {
+		return json_plain_run_sse2(data, len);
+	}
+#endif
+
+	return json_plain_run_scalar(data, len);
+}
+
+void json_put_escaped(
+	struct outbuf *out,
+	const char *data,
+	size_t len)
+{
+	size_t i = 0;
+
+	while(i < len) {
+		const size_t run = i + json_plain_run(&data[i], len - i);
+		const unsigned char c = (unsigned char) data[run];
+		char *dst;
+
+		outbuf_append(out, &data[i], run - i);
+		if(run == len) {
+			break;
+		}
+
+		i = run + 1;
+		if(c == '"' || c == '\\') {
+			dst = outbuf_reserve(out, 2);
+			if(!dst) {
+				return;
+			}
+
+			dst[0] = '\\';
+			dst[1] = (char) c;
+			outbuf_commit(out, 2);
+			continue;
+		}
+		else if(c == '\n' || c == '\t' || c == '\r') {
+			dst = outbuf_reserve(out, 2);
+			if(!dst) {
+				return;
+			}
+
+			dst[0] = '\\';
+			dst[1] = (c == '\n') ? 'n' : (c == '\t') ? 't' : 'r';
+			outbuf_commit(out, 2);
+			continue;
+		}
+
+		dst = outbuf_reserve(out, 6);
+		if(!dst) {
+			return;
+		}
+
+		memcpy(dst, "\\u00", 4);
+		dst[4] = json_hex_digits[c >> 4];
+		dst[5] = json_hex_digits[c & 0xf];
+		outbuf_commit(out, 6);
+	}
+}
+
+int json_utf8_valid(
+	const char *data,
+	size_t len)
+{
+	const unsigned char *s = (const unsigned char*) data;
+	size_t i = 0;
+
+	while(i < len) {
+		unsigned char c;
+		size_t n;
+		unsigned char min = 0x80;
+		unsigned char max = 0xbf;
+		size_t j;
+
+		/* Skip ASCII a word at a time. */
+		while(i + 8 <= len) {
+			uint64_t word;
+
+			memcpy(&word, &s[i], 8);
+			if(word & UINT64_C(0x8080808080808080)) {
+				break;
+			}
+
+			i += 8;
+		}
+
+		if(i >= len) {
+			break;
+		}
+
+		c = s[i];
+		if(c < 0x80) {
+			++i;
+			continue;
+		}
+		else if(c < 0xc2) {
+			/* Continuation byte or overlong 2-byte form. */
+			return 0;
+		}
+		else if(c < 0xe0) {
+			n = 1;
+		}
+		else if(c < 0xf0) {
+			n = 2;
+			if(c == 0xe0) {
+				/* Overlong. */
+				min = 0xa0;
+			}
+			else if(c == 0xed) {
+				/* UTF-16 surrogates. */
+				max = 0x9f;
+			}
+		}
+		else if(c < 0xf5) {
+			n = 3;
+			if(c == 0xf0) {
+				/* Overlong. */
+				min = 0x90;
+			}
+			else if(c == 0xf4) {
+				/* Above U+10FFFF. */
+				max = 0x8f;
+			}
+		}
+		else {
+			return 0;
+		}
+
+		if(len - i <= n || s[i + 1] < min || s[i + 1] > max) {
+			return 0;
+		}
+
+		for(j = 2; j <= n; ++j) {
+			if((s[i + j] & 0xc0) != 0x80) {
+				return 0;
+			}
+		}
+
+		i += n + 1;
+	}
+
+	return 1;
+}
+
+void json_put_member(
+	struct outbuf *out,
+	const char *key,
+	const char *prefix,
+	const char *data,
+	size_t len)
+{
+	const size_t prefix_length = strlen(prefix);
+	char stack_buf[512];
+	char *joined = NULL;
+	const char *src = data;
+	size_t src_length = len;
+	size_t encoded_length;
+	char *dst;
+
+	outbuf_putc(out, '"');
+	outbuf_puts(out, key);
+
+	if(json_utf8_valid(data, len)) {
+		outbuf_append(out, "\":\"", 3);
+		outbuf_puts(out, prefix);
+		json_put_escaped(out, data, len);
+		outbuf_putc(out, '"');
+		return;
+	}
+
+	outbuf_append(out, "_base64\":\"", 10);
+
+	if(prefix_length) {
+		/* Encode the prefix and the data as one string. */
+		src_length = prefix_length + len;
+		joined = (src_length <= sizeof(stack_buf)) ?
+			stack_buf : malloc(src_length);
+		if(!joined) {
+			out->failed = ENOMEM;
+			return;
+		}
+
+		memcpy(joined, prefix, prefix_length);
+		memcpy(&joined[prefix_length], data, len);
+		src = joined;
+	}
+
+	encoded_length = codec_encoded_length(CODEC_ENCODING_BASE64,
+		src_length);
+	dst = outbuf_reserve(out, encoded_length);
+	if(dst) {
+		codec_encode(CODEC_ENCODING_BASE64, src, src_length, dst);
+		outbuf_commit(out, encoded_length);
+	}
+
+	outbuf_putc(out, '"');
+
+	if(joined && joined != stack_buf) {
+		free(joined);
+	}
+}
+
+void json_begin_node(
+	struct outbuf *out,
+	const char *path)
+{
+	outbuf_putc(out, '{');
+	json_put_member(out, "path", "", path, strlen(path));
+	outbuf_append(out, ",\"attrs\":[", 10);
+}
+
+void json_put_attr(
+	struct outbuf *out,
+	int first,
+	const char *ns_prefix,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length)
+{
+	if(!first) {
+		outbuf_putc(out, ',');
+	}
+
+	outbuf_putc(out, '{');
+	json_put_member(out, "name", ns_prefix, name, name_length);
+	if(value) {
+		outbuf_putc(out, ',');
+		json_put_member(out, "value", "", value, value_length);
+	}
+	outbuf_putc(out, '}');
+}
+
+void json_end_node(
+	struct outbuf *out)
+{
+	outbuf_append(out, "]}\n", 3);
+}
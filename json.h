@@ -0,0 +1,93 @@
+/*-
+ * json.h - Streaming NDJSON output.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_JSON_H
+#define _XATTRPROGS_JSON_H
+
+#include <stddef.h>
+
+#include "outbuf.h"
+
+/*
+ * The --json output is one JSON object per line (NDJSON) and node:
+ *
+ *   {"path":"<path>","attrs":[{"name":"<name>","value":"<value>"},...]}
+ *
+ * "value" is only present when values are written. Paths, names and values
+ * that aren't valid UTF-8 can't be carried in a JSON string, they are written
+ * base64 encoded in "path_base64", "name_base64" and "value_base64" instead.
+ */
+
+/**
+ * Start the object for the node @path.
+ */
+void json_begin_node(
+	struct outbuf *out,
+	const char *path);
+
+/**
+ * Append an attribute to the node started with json_begin_node. @first tells
+ * whether this is the first attribute of the node. @ns_prefix is prepended to
+ * the name (see xattrio_namespace_prefix). @value may be NULL to only write
+ * the name.
+ */
+void json_put_attr(
+	struct outbuf *out,
+	int first,
+	const char *ns_prefix,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length);
+
+/**
+ * End the object started with json_begin_node.
+ */
+void json_end_node(
+	struct outbuf *out);
+
+/**
+ * Append the member "<key>":"<data>", or "<key>_base64":"<encoded data>" if
+ * @data isn't valid UTF-8. @data is the concatenation of @prefix (which must
+ * be ASCII) and @len bytes at @data.
+ */
+void json_put_member(
+	struct outbuf *out,
+	const char *key,
+	const char *prefix,
+	const char *data,
+	size_t len);
+
+/**
+ * Append @len bytes of valid UTF-8 at @data with JSON string escaping.
+ */
+void json_put_escaped(
+	struct outbuf *out,
+	const char *data,
+	size_t len);
+
+/**
+ * Returns non-zero if @len bytes at @data are valid UTF-8.
+ */
+int json_utf8_valid(
+	const char *data,
+	size_t len);
+
+#endif /* !defined(_XATTRPROGS_JSON_H) */
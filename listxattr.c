@@ -18,49 +18,457 @@
  * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-#include <dirent.h>
-#include <fcntl.h>
 #include <unistd.h>
-#endif
+
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #include <sys/extattr.h>
 #endif
-#if defined(__APPLE__) || defined(__DARWIN__) || defined(__linux__)
-#include <sys/xattr.h>
+
+#include "bufpool.h"
+#include "checkpoint.h"
+#include "compress.h"
+#include "dump.h"
+#include "hooks.h"
+#include "json.h"
+#include "pool.h"
+#include "sample.h"
+#include "scan.h"
+#include "snapshot.h"
+#include "xattrio.h"
+#include "xattrprogs.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
 #endif
 
-int main(int argc, char **argv)
-{
+/* Output is written out when this much has been collected. */
+#define LISTXATTR_OUTPUT_CHUNK (64 * 1024)
+
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+static const int namespaces[] = {
+#ifdef EXTATTR_NAMESPACE_EMPTY
+	EXTATTR_NAMESPACE_EMPTY,
+#endif
+	EXTATTR_NAMESPACE_USER,
+	EXTATTR_NAMESPACE_SYSTEM,
+};
+#endif
+
+struct listxattr_options {
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	size_t namespaces_start_index;
+	size_t namespaces_end_index;
+#endif
+	int follow_links;
+	int recursive;
+	int values;
+	int multiple;
+	int json;
+	struct xattrio_prefix name_prefix_filter;
+	const struct xattrio_prefix *name_prefix;
+
+	/* Incremental listing: the snapshot of an earlier run whose records
+	 * are reused for unchanged nodes, and the snapshot being written for
+	 * the next run. Both optional. */
+	const struct snapshot *since;
+	struct snapshot_writer *snapshot;
+};
+
+/* Most files that --shards may split the output over. */
+#define LISTXATTR_MAX_SHARDS 65536
+
+/* Per worker state of a recursive listing that writes a snapshot. */
+struct listxattr_worker {
+	struct outbuf record;
+};
+
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	static const int namespaces[] = {
+static void listxattr_put_namespace(
+	struct outbuf *out,
+	int namespace)
+{
+	char namespace_string[] = "<namespace -XXXXXXXXXX>";
+	int namespace_string_length;
+
+	switch(namespace) {
 #ifdef EXTATTR_NAMESPACE_EMPTY
-		EXTATTR_NAMESPACE_EMPTY,
+	case EXTATTR_NAMESPACE_EMPTY:
+		namespace_string[0] = '\0';
+		break;
+#endif
+	case EXTATTR_NAMESPACE_USER:
+		strcpy(namespace_string, "<user>");
+		break;
+	case EXTATTR_NAMESPACE_SYSTEM:
+		strcpy(namespace_string, "<system>");
+		break;
+	default:
+		snprintf(namespace_string, sizeof(namespace_string),
+			"<namespace %d>", namespace);
+		break;
+	}
+
+	/* Pad to a fixed width column like the original "%-*s " format. */
+	namespace_string_length = (int) strlen(namespace_string);
+	outbuf_append(out, namespace_string, namespace_string_length);
+	while(namespace_string_length++ < (int) sizeof(namespace_string)) {
+		outbuf_putc(out, ' ');
+	}
+}
+#endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
+
+/**
+ * Append an attribute of the node at @path to @out in the dump or JSON
+ * format. @value is NULL when listing names only.
+ */
+static void listxattr_put_attr(
+	struct outbuf *out,
+	const struct listxattr_options *options,
+	const char *path,
+	int namespace,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length,
+	int *header_written)
+{
+	const char *ns_prefix = xattrio_namespace_prefix(namespace);
+
+	if(options->json) {
+		if(!*header_written) {
+			json_begin_node(out, path);
+		}
+
+		json_put_attr(out, !*header_written, ns_prefix, name,
+			name_length, value, value_length);
+	}
+	else {
+		if(!*header_written) {
+			dump_put_file(out, path);
+		}
+
+		if(value) {
+			dump_put_attr(out, ns_prefix, name, name_length, value,
+				value_length);
+		}
+		else {
+			dump_put_name(out, ns_prefix, name, name_length);
+		}
+	}
+
+	*header_written = 1;
+}
+
+static int listxattr_worker_init(
+	struct scan_worker *worker,
+	void *arg)
+{
+	(void) arg;
+
+	worker->priv = calloc(1, sizeof(struct listxattr_worker));
+	if(!worker->priv) {
+		fprintf(stderr, "Error while allocating worker state: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void listxattr_worker_fini(
+	struct scan_worker *worker,
+	void *arg)
+{
+	struct listxattr_worker *state = worker->priv;
+
+	(void) arg;
+
+	outbuf_free(&state->record);
+	free(state);
+	worker->priv = NULL;
+}
+
+static int listxattr_visit(
+	struct scan_worker *worker,
+	const char *path,
+	enum scan_type type,
+	void *arg)
+{
+	const struct listxattr_options *options = arg;
+	/* Recursive, value and multi-node listings use the getfattr style
+	 * dump format, the plain listing of a single node prints one name per
+	 * line. */
+	const int dump = options->recursive || options->values ||
+		options->multiple || options->json;
+	struct outbuf *record = NULL;
+	struct snapshot_key key;
+	int header_written = 0;
+	int complete = 1;
+	int res = 0;
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	size_t i;
+#endif
+
+	(void) type;
+
+	if(options->since || options->snapshot) {
+		const char *data;
+		size_t length;
+
+		if(snapshot_stat(path, options->follow_links, &key)) {
+			if(errno == ENOENT) {
+				/* Node disappeared during the scan. */
+				return 0;
+			}
+
+			fprintf(stderr, "Error while getting status of "
+				"\"%s\": %s (errno=%d)\n",
+				path, strerror(errno), errno);
+			return -1;
+		}
+
+		if(options->since &&
+			!snapshot_lookup(options->since, &key, &data, &length))
+		{
+			/* Unchanged since the earlier run, so are its
+			 * attributes. */
+			struct snapshot_attr attr;
+			size_t pos = 0;
+
+			while(snapshot_next_attr(data, length, &pos, &attr)) {
+				listxattr_put_attr(&worker->out, options, path,
+					attr.namespace, attr.name,
+					attr.name_length, attr.value,
+					attr.value_length, &header_written);
+			}
+
+			if(options->snapshot) {
+				snapshot_writer_add(options->snapshot, &key,
+					data, length);
+			}
+
+			goto out;
+		}
+
+		if(options->snapshot) {
+			record = &((struct listxattr_worker*) worker->priv)->
+				record;
+			record->len = 0;
+		}
+	}
+
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	for(i = options->namespaces_start_index;
+		i < options->namespaces_end_index; ++i)
+#else
+	do
+#endif
+	{
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+		const int namespace = namespaces[i];
+#else
+		const int namespace = XATTRIO_DEFAULT_NAMESPACE;
+#endif
+		ssize_t attrlist_size;
+		size_t pos = 0;
+		const char *name;
+		size_t name_length;
+
+		attrlist_size = xattrio_list_buf(
+			path,
+			options->follow_links,
+			namespace,
+			&worker->list);
+		if(attrlist_size == -1) {
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+			if(errno == EPERM) {
+				/* This is normal when a filesystem doesn't
+				 * support a namespace. Just move on... */
+				continue;
+			}
+#endif
+			if(options->recursive &&
+				(errno == ENOENT || errno == ENOTSUP))
+			{
+				/* Node disappeared during the scan or it's on
+				 * a filesystem without extended attributes. */
+				complete = (errno == ENOTSUP);
+				break;
+			}
+
+			fprintf(stderr, "Error while getting extended "
+				"attribute list "
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+				"of namespace %d "
 #endif
-		EXTATTR_NAMESPACE_USER,
-		EXTATTR_NAMESPACE_SYSTEM,
-	};
+				"for path \"%s\": %s "
+				"(errno=%d)\n",
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+				namespace,
+#endif
+				path, strerror(errno), errno);
+			res = -1;
+			break;
+		}
+		else if(attrlist_size == 0) {
+#ifdef DEBUG
+			fprintf(stderr, "INFO: No extended attributes found "
+				"for path \"%s\".\n", path);
+#endif
+			continue;
+		}
+
+		while((name = xattrio_list_next(worker->list.data,
+			(size_t) attrlist_size, &pos, options->name_prefix,
+			&name_length)))
+		{
+			ssize_t value_size;
+
+			if(!dump) {
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+				listxattr_put_namespace(&worker->out,
+					namespace);
+#endif
+				outbuf_append(&worker->out, name, name_length);
+				outbuf_putc(&worker->out, '\n');
+				continue;
+			}
+
+			if(!options->values) {
+				listxattr_put_attr(&worker->out, options, path,
+					namespace, name, name_length, NULL, 0,
+					&header_written);
+				if(record) {
+					snapshot_put_attr(record, namespace,
+						name, name_length, NULL, 0);
+				}
+				continue;
+			}
+
+			value_size = xattrio_get_buf(
+				path,
+				options->follow_links,
+				namespace,
+				name,
+				&worker->value);
+			if(value_size == -1) {
+				if(errno == ENOATTR) {
+					/* Removed since we listed it. */
+					continue;
+				}
+
+				fprintf(stderr, "Error while getting extended "
+					"attribute data for path \"%s\" and "
+					"attribute name \"%s\": %s "
+					"(errno=%d)\n",
+					path, name, strerror(errno), errno);
+				res = -1;
+				continue;
+			}
+
+			listxattr_put_attr(&worker->out, options, path,
+				namespace, name, name_length,
+				worker->value.data, (size_t) value_size,
+				&header_written);
+			if(record) {
+				snapshot_put_attr(record, namespace, name,
+					name_length, worker->value.data,
+					(size_t) value_size);
+			}
+		}
+	}
+#if !(defined(__FreeBSD__) || defined(__NetBSD__))
+	while(0);
 #endif
 
+	/* A node that changed in the second that it was looked at may change
+	 * again without its ctime moving, so it isn't recorded and will be
+	 * listed again next time. */
+	if(record && !res && complete && !record->failed &&
+		key.ctime_sec + 1 < (long long) time(NULL))
+	{
+		snapshot_writer_add(options->snapshot, &key, record->data,
+			record->len);
+	}
+out:
+	if(header_written && options->json) {
+		json_end_node(&worker->out);
+	}
+	else if(header_written) {
+		outbuf_putc(&worker->out, '\n');
+	}
+
+	return res;
+}
+
+/**
+ * Write out @out to standard output, through @compress if it's set.
+ */
+static int listxattr_flush(
+	struct outbuf *out,
+	struct compress_writer *compress)
+{
+	if(compress) {
+		return compress_writer_flush(compress, out);
+	}
+
+	return outbuf_flush(out, stdout);
+}
+
+int listxattr_main(int argc, char **argv)
+{
 	int ret = (EXIT_FAILURE);
 	int argp = 1;
+	struct listxattr_options options;
+	struct scan_options scan_options;
+	struct scan_worker worker;
+	const char *checkpoint_file = NULL;
+	const char *resume_file = NULL;
+	struct checkpoint checkpoint;
+	int have_checkpoint = 0;
+	const char *since_file = NULL;
+	const char *snapshot_file = NULL;
+	const char *name_prefix_arg = "";
+	struct outbuf snapshot_options;
+	struct snapshot since;
+	struct snapshot_writer snapshot_writer;
+	int have_since = 0;
+	int have_snapshot = 0;
+	int scanned = 0;
+	struct sample_options sample_options;
+	int sampling = 0;
+	struct hooks hooks;
+	enum compress_format compress_format = COMPRESS_NONE;
+	int compress_level = 0;
+	struct compress_writer compress;
+	int compressing = 0;
+	int failed = 0;
+	int first;
+	int res;
+
+	hooks_init(&hooks);
+	memset(&worker, 0, sizeof(worker));
+	memset(&checkpoint, 0, sizeof(checkpoint));
+	memset(&snapshot_options, 0, sizeof(snapshot_options));
+	memset(&sample_options, 0, sizeof(sample_options));
+	memset(&options, 0, sizeof(options));
+	memset(&scan_options, 0, sizeof(scan_options));
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	int namespaces_start_index = 0;
-	int namespaces_end_index = sizeof(namespaces) / sizeof(namespaces[0]);
-	size_t i = 0;
-#endif
-	int follow_links = 0;
-	const char *path = NULL;
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	int attrdirfd = -1;
+	options.namespaces_start_index = 0;
+	options.namespaces_end_index =
+		sizeof(namespaces) / sizeof(namespaces[0]);
 #endif
-	ssize_t attrlist_size = 0;
-	char *attrlist = NULL;
 
 	while(argp < argc) {
 		if(argv[argp][0] != '-') {
@@ -68,31 +476,230 @@ int main(int argc, char **argv)
 			 * arguments. */
 			break;
 		}
-		else if(argv[argp][1] == '-') {
+		else if(!strcmp(argv[argp], "--json")) {
+			options.json = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--sorted")) {
+			scan_options.sorted = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--max-memory")) {
+			if(argp + 1 >= argc || bufpool_parse_size(
+				argv[argp + 1], &scan_options.memory_budget))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a size argument (e.g. 64M).\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--shards")) {
+			char *endptr = NULL;
+			unsigned long count = 0;
+
+			if(argp + 1 < argc) {
+				errno = 0;
+				count = strtoul(argv[argp + 1], &endptr, 10);
+			}
+
+			if(!endptr || *endptr || errno || !count ||
+				count > LISTXATTR_MAX_SHARDS)
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a number of files (1-%u).\n",
+					argv[argp], LISTXATTR_MAX_SHARDS);
+				goto out;
+			}
+
+			scan_options.shards = (unsigned int) count;
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--output-prefix")) {
+			if(argp + 1 >= argc || !argv[argp + 1][0]) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a file name prefix.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			scan_options.output_prefix = argv[argp + 1];
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--compress")) {
+			if(argp + 1 >= argc || compress_parse(argv[argp + 1],
+				&compress_format, &compress_level))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a format argument with an optional "
+					"level (<format>[:<level>], supported "
+					"formats: %s).\n",
+					argv[argp], compress_formats());
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--checkpoint") ||
+			!strcmp(argv[argp], "--resume"))
+		{
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a file argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(argv[argp][2] == 'c') {
+				checkpoint_file = argv[argp + 1];
+			}
+			else {
+				resume_file = argv[argp + 1];
+			}
+
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--since") ||
+			!strcmp(argv[argp], "--snapshot"))
+		{
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a file argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(argv[argp][3] == 'i') {
+				since_file = argv[argp + 1];
+			}
+			else {
+				snapshot_file = argv[argp + 1];
+			}
+
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--sample")) {
+			if(argp + 1 >= argc || sample_parse(argv[argp + 1],
+				&sample_options.probes, &sample_options.rate))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a descent count or a rate argument "
+					"(e.g. 1000 or 1%%).\n",
+					argv[argp]);
+				goto out;
+			}
+
+			sampling = 1;
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--skip-symlinks")) {
+			scan_options.skip_symlinks = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--skip-special")) {
+			scan_options.skip_special = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--xdev")) {
+			scan_options.one_filesystem = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--prefetch")) {
+			if(argp + 1 >= argc || scan_parse_prefetch(
+				argv[argp + 1], &scan_options.prefetch))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else if((res = hooks_parse_option(&hooks, argc, argv,
+			&argp)))
+		{
+			if(res < 0) {
+				goto out;
+			}
+		}
+		else if(!strcmp(argv[argp], "--")) {
 			/* Stop parsing options when '--' is encountered. */
 			++argp;
 			break;
 		}
 		else if(argv[argp][1] == 'L') {
-			follow_links = 1;
+			options.follow_links = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'R') {
+			options.recursive = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'v') {
+			options.values = 1;
 			++argp;
 		}
+		else if(argv[argp][1] == 'n') {
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(options.name_prefix) {
+				xattrio_prefix_free(
+					&options.name_prefix_filter);
+			}
+
+			if(xattrio_prefix_init(&options.name_prefix_filter,
+				argv[argp + 1]))
+			{
+				fprintf(stderr, "Error while allocating name "
+					"filter: %s (errno=%d)\n",
+					strerror(errno), errno);
+				goto out;
+			}
+
+			options.name_prefix = &options.name_prefix_filter;
+			name_prefix_arg = argv[argp + 1];
+			argp += 2;
+		}
+		else if(argv[argp][1] == 'j') {
+			if(argp + 1 >= argc || pool_parse_threads(
+				argv[argp + 1], &scan_options.threads))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #ifdef EXTATTR_NAMESPACE_EMPTY
 		else if(argv[argp][1] == 'e') {
-			namespaces_start_index = 0;
-			namespaces_end_index = 1;
+			options.namespaces_start_index = 0;
+			options.namespaces_end_index = 1;
 			++argp;
 		}
 #endif
 		else if(argv[argp][1] == 'u') {
-			namespaces_start_index = 1;
-			namespaces_end_index = 2;
+			options.namespaces_start_index =
+				sizeof(namespaces) / sizeof(namespaces[0]) - 2;
+			options.namespaces_end_index =
+				options.namespaces_start_index + 1;
 			++argp;
 		}
 		else if(argv[argp][1] == 's') {
-			namespaces_start_index = 2;
-			namespaces_end_index = 3;
+			options.namespaces_start_index =
+				sizeof(namespaces) / sizeof(namespaces[0]) - 1;
+			options.namespaces_end_index =
+				options.namespaces_start_index + 1;
 			++argp;
 		}
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
@@ -103,339 +710,301 @@ int main(int argc, char **argv)
 		}
 	}
 
-	path = (argp < argc) ? argv[argp++] : NULL;
-
-	if(!path || (argp < argc)) {
-		fprintf(stderr, "usage: listxattr [-L"
+	if(argp >= argc) {
+		fprintf(stderr, "usage: listxattr [-L|-R|-v"
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #ifdef EXTATTR_NAMESPACE_EMPTY
 			"|-e"
 #endif
 			"|-u|-s"
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
-			"] <filename>\n");
+			"] [--json] [--sorted [--max-memory <size>]]\n"
+			"                 [--checkpoint <file>] "
+			"[--resume <file>] [--trace <file>]\n"
+			"                 [--background] [--max-rate <calls>] "
+			"[--max-bandwidth <bytes>]\n"
+			"                 [--skip-symlinks] [--skip-special] "
+			"[--xdev]\n"
+			"                 [--since <snapshot>] "
+			"[--snapshot <file>] [--sample <count|rate>]\n"
+			"                 [--shards <count> "
+			"--output-prefix <prefix>]\n"
+			"                 [--compress <format>[:<level>]] "
+			"[--prefetch <threads>]\n"
+			"                 [-n <name prefix>] [-j <threads>] "
+			"<filename>...\n");
+		goto out;
+	}
+
+	options.multiple = (argc - argp > 1);
+	first = argp;
+
+	if((since_file || snapshot_file) && !options.recursive) {
+		fprintf(stderr, "Error: Options '--since' and '--snapshot' "
+			"require -R.\n");
+		goto out;
+	}
+
+	if(!scan_options.shards != !scan_options.output_prefix) {
+		fprintf(stderr, "Error: Options '--shards' and "
+			"'--output-prefix' must be given together.\n");
 		goto out;
 	}
+	else if(scan_options.shards && (!options.recursive || sampling ||
+		scan_options.sorted || checkpoint_file || resume_file))
+	{
+		fprintf(stderr, "Error: Option '--shards' requires -R and "
+			"can't be combined with '--sorted', '--sample' or "
+			"checkpoints.\n");
+		goto out;
+	}
+
+	if(compress_format != COMPRESS_NONE && (sampling ||
+		scan_options.shards || checkpoint_file || resume_file))
+	{
+		fprintf(stderr, "Error: Option '--compress' can't be combined "
+			"with '--sample', '--shards' or checkpoints.\n");
+		goto out;
+	}
+
+	scan_options.output_format = options.json ? "json" :
+		options.values ? "dump" : "dump-names";
 
+	if(since_file || snapshot_file) {
+		/* Everything that decides what goes into a record. */
+		outbuf_puts(&snapshot_options, "listxattr values=");
+		outbuf_putc(&snapshot_options, options.values ? '1' : '0');
+		outbuf_puts(&snapshot_options, " follow=");
+		outbuf_putc(&snapshot_options,
+			options.follow_links ? '1' : '0');
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	for(i = namespaces_start_index; i < namespaces_end_index; ++i)
-#else
-	do
+		outbuf_puts(&snapshot_options, " namespaces=");
+		outbuf_putc(&snapshot_options,
+			'0' + (char) options.namespaces_start_index);
+		outbuf_putc(&snapshot_options,
+			'0' + (char) options.namespaces_end_index);
 #endif
-	{
-		ssize_t bytes_read = -1;
-		ssize_t ptr = 0;
+		outbuf_puts(&snapshot_options, " prefix=");
+		outbuf_puts(&snapshot_options, name_prefix_arg);
+		outbuf_putc(&snapshot_options, '\0');
+		if(snapshot_options.failed) {
+			fprintf(stderr, "Error while allocating memory: %s "
+				"(errno=%d)\n",
+				strerror(snapshot_options.failed),
+				snapshot_options.failed);
+			goto out;
+		}
+	}
 
-#if defined(__APPLE__) || defined(__DARWIN__)
-		attrlist_size = listxattr(
-			path,
-			NULL,
-			0,
-			follow_links ? 0 : XATTR_NOFOLLOW);
-#elif defined(__linux__)
-		attrlist_size = (follow_links ? listxattr : llistxattr)(
-			path,
-			NULL,
-			0);
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-		attrlist_size =
-			(follow_links ? extattr_list_file : extattr_list_link)(
-				path,
-				namespaces[i],
-				NULL,
-				0);
-#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-		int dup_fd = -1;
-		DIR *dirp = NULL;
-		struct dirent *de = NULL;
-		int err = 0;
-		int closedir_res = 0;
-
-		attrdirfd = attropen(
-			path,
-			".",
-			O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
-		if(attrdirfd == -1) {
-			fprintf(stderr, "Error while opening attribute "
-				"directory of \"%s\": %s (%d)\n",
-				path, strerror(errno), errno);
+	if(since_file) {
+		if(snapshot_open(&since, since_file, snapshot_options.data)) {
 			goto out;
 		}
 
-		dup_fd = dup(attrdirfd);
-		if(dup_fd == -1 || !(dirp = fdopendir(dup_fd))) {
-			fprintf(stderr, "Error while getting attribute "
-				"directory handle for \"%s\": %s (%d)\n",
-				path, strerror(errno), errno);
-			if(dup_fd != -1) {
-				close(dup_fd);
-			}
+		have_since = 1;
+		options.since = &since;
+	}
 
+	if(snapshot_file) {
+		if(snapshot_writer_open(&snapshot_writer, snapshot_file,
+			snapshot_options.data))
+		{
 			goto out;
 		}
 
-		errno = 0;
-		while((de = readdir(dirp))) {
-			if(de->d_name[0] == '.' && (!de->d_name[1] ||
-				(de->d_name[1] == '.' && !de->d_name[2])))
-			{
-				/* Ignore "." / "..". */
-				continue;
-			}
+		have_snapshot = 1;
+		options.snapshot = &snapshot_writer;
+		scan_options.worker_init = listxattr_worker_init;
+		scan_options.worker_fini = listxattr_worker_fini;
+	}
 
-			attrlist_size += strlen(de->d_name) + 1;
-			errno = 0;
+	if(checkpoint_file || resume_file) {
+		/* A resumed run keeps updating the checkpoint it was resumed
+		 * from, unless told otherwise. */
+		checkpoint_init(&checkpoint,
+			checkpoint_file ? checkpoint_file : resume_file,
+			"listxattr", options.recursive ? "scan" : "args");
+		have_checkpoint = 1;
+		if(resume_file && checkpoint_load(&checkpoint, resume_file)) {
+			goto out;
 		}
+	}
 
-		err = errno;
-		closedir_res = closedir(dirp);
+	if(xattrio_backend_init()) {
+		goto out;
+	}
+
+	if(hooks_start(&hooks, "listxattr", options.recursive ?
+		(scan_options.threads ? scan_options.threads :
+		pool_default_threads()) : 1))
+	{
+		goto out;
+	}
 
-		if(err) {
-			fprintf(stderr, "Error while reading attribute "
-				"directory of \"%s\": %s (%d)\n",
-				path, strerror(err), err);
+	if(compress_format != COMPRESS_NONE) {
+		if(compress_writer_open(&compress, STDOUT_FILENO,
+			compress_format, compress_level))
+		{
 			goto out;
 		}
-		else if(closedir_res) {
-			fprintf(stderr, "Error while closing attribute "
-				"directory of \"%s\": %s (%d)\n",
-				path, strerror(errno), errno);
+
+		scan_options.compress = &compress;
+		compressing = 1;
+	}
+
+	if(sampling) {
+		if(!options.recursive) {
+			fprintf(stderr, "Error: Option '--sample' requires "
+				"-R.\n");
 			goto out;
 		}
-#else
-#error "Don't know how to handle extended attributes on this platform."
-#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
-		if(attrlist_size == 0) {
-#ifdef DEBUG
-			fprintf(stderr, "INFO: No extended attributes found "
-				"for path \"%s\".\n", path);
-#endif
-			continue;
-		}
-		else if(attrlist_size == -1) {
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-			if(errno == EPERM) {
-				/* This is normal when a filesystem doesn't
-				 * support a namespace. Just move on... */
-				continue;
-			}
-#endif
 
-			fprintf(stderr, "Error while getting size of extended "
-				"attribute list "
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-				"of namespace %d "
-#endif
-				"for path \"%s\": %s "
-				"(errno=%d)\n",
+		/* Estimates only, nothing is listed. */
+		sample_options.threads = scan_options.threads;
+		sample_options.follow_links = options.follow_links;
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-				namespaces[i],
+		sample_options.namespace =
+			namespaces[options.namespaces_start_index];
+#else
+		sample_options.namespace = XATTRIO_DEFAULT_NAMESPACE;
 #endif
-				path, strerror(errno), errno);
-			goto out;
+		sample_options.name_prefix = options.name_prefix;
+		if(!sample_run(&sample_options, &argv[argp], argc - argp)) {
+			ret = (EXIT_SUCCESS);
 		}
 
-		if(attrlist) {
-			free(attrlist);
+		goto out;
+	}
+
+	if(options.recursive) {
+		scan_options.visit = listxattr_visit;
+		scan_options.arg = &options;
+		if(have_checkpoint) {
+			/* The checkpoint records a position in the sorted
+			 * order of the nodes. */
+			scan_options.checkpoint = &checkpoint;
+			scan_options.sorted = 1;
 		}
 
-		attrlist = calloc(1, sizeof(char) * (size_t) attrlist_size);
-		if(attrlist == NULL) {
-			fprintf(stderr, "Error while allocating %zd bytes for "
-				"extended attribute list: %s (errno=%d)\n",
-				attrlist_size, strerror(errno), errno);
+		res = scan_run(&scan_options, &argv[argp], argc - argp);
+		scanned = 1;
+		if(res) {
 			goto out;
 		}
-
-#if defined(__APPLE__) || defined(__DARWIN__)
-		bytes_read = listxattr(
-			path,
-			attrlist,
-			attrlist_size,
-			follow_links ? 0 : XATTR_NOFOLLOW);
-#elif defined(__linux__)
-		bytes_read = (follow_links ? listxattr : llistxattr)(
-			path,
-			attrlist,
-			attrlist_size);
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-		bytes_read =
-			(follow_links ? extattr_list_file : extattr_list_link)(
-				path,
-				namespaces[i],
-				attrlist,
-				attrlist_size);
-#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-		{
-			int dup_fd = -1;
-			DIR *dirp = NULL;
-			struct dirent *de = NULL;
-			int err = 0;
-			int closedir_res = 0;
-
-			if(lseek(attrdirfd, 0, SEEK_SET)) {
-				fprintf(stderr, "Error while seeking to start "
-					"of directory: %s (%d)\n",
-					strerror(errno), errno);
+	}
+	else {
+		if(have_checkpoint) {
+			checkpoint_hash_arg_list(&checkpoint, &argv[first],
+				(size_t) (argc - first));
+			if(resume_file &&
+				checkpoint_check_args(&checkpoint, resume_file))
+			{
 				goto out;
 			}
 
-			dup_fd = dup(attrdirfd);
-			if(dup_fd == -1 || !(dirp = fdopendir(dup_fd))) {
-				fprintf(stderr, "Error while getting attribute "
-					"directory handle for \"%s\": %s "
-					"(%d)\n",
-					path, strerror(errno), errno);
-				if(dup_fd != -1) {
-					close(dup_fd);
-				}
-
+			if(checkpoint.position > (unsigned long long)
+				(argc - first))
+			{
+				fprintf(stderr, "Error: Checkpoint \"%s\" is "
+					"past the end of the file list.\n",
+					resume_file);
 				goto out;
 			}
 
-			errno = 0;
-			while((de = readdir(dirp))) {
-				const size_t name_length = strlen(de->d_name);
-				const size_t attrlist_remaining =
-					attrlist_size - bytes_read;
-
-				if(de->d_name[0] == '.' && (!de->d_name[1] ||
-					(de->d_name[1] == '.' &&
-					!de->d_name[2])))
-				{
-					/* Ignore "." / "..". */
-					continue;
-				}
-
-				if(attrlist_remaining < name_length + 1) {
-					fprintf(stderr, "Not enough space for "
-						"all attributes in attribute "
-						"list. List may have been "
-						"modified behind our backs, "
-						"please try again.\n");
-					err = EINVAL;
-					break;
-				}
+			argp = first + (int) checkpoint.position;
+		}
 
-				strcpy(&attrlist[bytes_read], de->d_name);
-				bytes_read += name_length + 1;
-				errno = 0;
-			}
+		/* All nodes share the same list and value buffers. */
+		for(; argp < argc; ++argp) {
+			const int save = have_checkpoint && (argp + 1 == argc ||
+				checkpoint_due(&checkpoint));
 
-			if(!de) {
-				err = errno;
+			if(listxattr_visit(&worker, argv[argp],
+				SCAN_TYPE_UNKNOWN, &options))
+			{
+				failed = 1;
+				++checkpoint.errors;
 			}
 
-			closedir_res = closedir(dirp);
-
-			if(err) {
-				fprintf(stderr, "Error while reading attribute "
-					"directory of \"%s\": %s (%d)\n",
-					path, strerror(err), err);
+			if((worker.out.len >= LISTXATTR_OUTPUT_CHUNK || save) &&
+				(listxattr_flush(&worker.out,
+				scan_options.compress) ||
+				(save && fflush(stdout))))
+			{
+				fprintf(stderr, "Error while writing to "
+					"standard output: %s (errno=%d)\n",
+					strerror(errno), errno);
 				goto out;
 			}
-			else if(closedir_res) {
-				fprintf(stderr, "Error while closing attribute "
-					"directory of \"%s\": %s (%d)\n",
-					path, strerror(errno), errno);
+
+			/* The output up to this file has been written. */
+			++checkpoint.done;
+			checkpoint.position = (unsigned long long)
+				(argp + 1 - first);
+			if(save && checkpoint_save(&checkpoint)) {
 				goto out;
 			}
 		}
-#else
-#error "Don't know how to handle extended attributes on this platform."
-#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
-		if(bytes_read < 0) {
-			fprintf(stderr, "Error while reading extended "
-				"attribute list "
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-				"of namespace %d "
-#endif
-				"for path \"%s\": %s "
-				"(errno=%d)\n",
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-				namespaces[i],
-#endif
-				path, strerror(errno), errno);
+
+		if(listxattr_flush(&worker.out, scan_options.compress)) {
+			fprintf(stderr, "Error while writing to standard "
+				"output: %s (errno=%d)\n",
+				strerror(errno), errno);
 			goto out;
 		}
-		else if(bytes_read != attrlist_size) {
-			fprintf(stderr, "Partial read while reading extended "
-				"attribute list for path \"%s\": %zd/%zd bytes "
-				"read\n",
-				path, bytes_read, attrlist_size);
+
+		if(failed) {
 			goto out;
 		}
+	}
 
-		while(ptr < attrlist_size) {
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-			char unknown_namespace_string[] =
-				"<namespace -XXXXXXXXXX>";
-			const char *namespace_string;
-			char *cur = &attrlist[ptr + 1];
-			unsigned char cur_len =
-				*((unsigned char*) &attrlist[ptr]);
-#else
-			char *cur = &attrlist[ptr];
-			int cur_len = strlen(cur);
-#endif
-
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-			switch(namespaces[i]) {
-#ifdef EXTATTR_NAMESPACE_EMPTY
-			case EXTATTR_NAMESPACE_EMPTY:
-				namespace_string = "";
-				break;
-#endif
-			case EXTATTR_NAMESPACE_USER:
-				namespace_string = "<user>";
-				break;
-			case EXTATTR_NAMESPACE_SYSTEM:
-				namespace_string = "<system>";
-				break;
-			default:
-				snprintf(unknown_namespace_string,
-					sizeof(unknown_namespace_string),
-					"<namespace %d>", namespaces[i]);
-				namespace_string = unknown_namespace_string;
-				break;
-			}
-#endif
+	ret = (EXIT_SUCCESS);
+out:
+	if(compressing && compress_writer_close(&compress)) {
+		fprintf(stderr, "Error while writing to standard output: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		ret = (EXIT_FAILURE);
+	}
 
-			fprintf(stdout,
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-				"%-*s "
-#endif
-				"%.*s\n",
-#if defined(__FreeBSD__) || defined(__NetBSD__)
-				(int) sizeof(unknown_namespace_string) - 1,
-				namespace_string,
-#endif
-				cur_len, cur);
+	if(hooks_finish(&hooks)) {
+		ret = (EXIT_FAILURE);
+	}
 
-			ptr += cur_len + 1;
-		}
+	if(have_checkpoint) {
+		checkpoint_finish(&checkpoint, ret == (EXIT_SUCCESS));
+	}
 
-		if(ptr != attrlist_size) {
-			fprintf(stderr, "WARNING: ptr (%zd) != attrlist_size "
-				"(%zd)\n",
-				ptr, attrlist_size);
-		}
+	/* Even a scan that failed for some nodes leaves a usable snapshot,
+	 * the nodes that are missing from it are just listed again. */
+	if(have_snapshot &&
+		snapshot_writer_close(&snapshot_writer, scanned))
+	{
+		ret = (EXIT_FAILURE);
 	}
-#if !(defined(__FreeBSD__) || defined(__NetBSD__))
-	while(0);
-#endif
 
-	ret = (EXIT_SUCCESS);
-out:
-	if(attrlist) {
-		free(attrlist);
+	if(have_since) {
+		snapshot_close(&since);
 	}
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attrdirfd != -1) {
-		close(attrdirfd);
+	outbuf_free(&snapshot_options);
+
+	xattrio_buf_free(&worker.list);
+	xattrio_buf_free(&worker.value);
+	outbuf_free(&worker.out);
+
+	if(options.name_prefix) {
+		xattrio_prefix_free(&options.name_prefix_filter);
 	}
-#endif
+
+	xattrio_backend_cleanup();
 
 	return ret;
 }
+
+#ifndef XATTRPROGS_MULTICALL
+int main(int argc, char **argv)
+{
+	return listxattr_main(argc, argv);
+}
+#endif
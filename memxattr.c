@@ -0,0 +1,927 @@
+/*-
+ * memxattr.c - In-memory extended attribute backend.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dump.h"
+#include "memxattr.h"
+#include "outbuf.h"
+
+/* Number of separately locked parts of the table. A node's part is picked by
+ * its hash, so that threads working on different nodes rarely wait for each
+ * other. */
+#define MEMXATTR_SHARDS 64
+
+#define MEMXATTR_DEFAULT_FILL_SIZE 16
+
+#if defined(ENOATTR)
+#define MEMXATTR_ENOATTR ENOATTR
+#else
+#define MEMXATTR_ENOATTR ENODATA
+#endif
+
+struct memxattr_attr {
+	int namespace;
+	char *name;
+	char *value;
+	size_t value_length;
+};
+
+struct memxattr_node {
+	struct memxattr_node *next;
+	unsigned long long hash;
+	struct memxattr_attr *attrs;
+	size_t attrs_count;
+	size_t attrs_capacity;
+	char path[];
+};
+
+struct memxattr_shard {
+	pthread_mutex_t lock;
+
+	/* Hash table with chaining, the number of buckets is a power of two
+	 * and grows with the number of nodes. */
+	struct memxattr_node **buckets;
+	size_t buckets_count;
+	size_t nodes_count;
+
+	/* State of the generator deciding on injected ERANGE errors. */
+	unsigned long long random;
+};
+
+struct memxattr {
+	struct memxattr_shard shards[MEMXATTR_SHARDS];
+	struct xattrio_backend backend;
+	struct timespec latency;
+	double erange;
+	unsigned int fill_count;
+	size_t fill_size;
+
+	/* Dump that the store is loaded from and saved to, or NULL. */
+	char *file;
+};
+
+/**
+ * FNV-1a hash of @path.
+ */
+static unsigned long long memxattr_hash(
+	const char *path)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	while(*path) {
+		hash ^= (unsigned char) *path++;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Sleep for the configured latency, if any.
+ */
+static void memxattr_delay(
+	const struct memxattr *memxattr)
+{
+	struct timespec remaining = memxattr->latency;
+
+	if(!remaining.tv_sec && !remaining.tv_nsec) {
+		return;
+	}
+
+	while(nanosleep(&remaining, &remaining) && errno == EINTR) {
+		continue;
+	}
+}
+
+/**
+ * Decide whether to fail the current call with an injected ERANGE. Called
+ * with the shard locked.
+ */
+static int memxattr_race(
+	const struct memxattr *memxattr,
+	struct memxattr_shard *shard)
+{
+	if(memxattr->erange <= 0) {
+		return 0;
+	}
+
+	/* xorshift64* */
+	shard->random ^= shard->random >> 12;
+	shard->random ^= shard->random << 25;
+	shard->random ^= shard->random >> 27;
+
+	return (double) ((shard->random * 2685821657736338717ULL) >> 11) /
+		9007199254740992.0 < memxattr->erange;
+}
+
+static struct memxattr_attr* memxattr_find_attr(
+	struct memxattr_node *node,
+	int namespace,
+	const char *name)
+{
+	size_t i;
+
+	for(i = 0; i < node->attrs_count; ++i) {
+		if(node->attrs[i].namespace == namespace &&
+			!strcmp(node->attrs[i].name, name))
+		{
+			return &node->attrs[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Add an attribute to @node, taking over @name and @value.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+static int memxattr_add_attr(
+	struct memxattr_node *node,
+	int namespace,
+	char *name,
+	char *value,
+	size_t value_length)
+{
+	struct memxattr_attr *attr;
+
+	if(node->attrs_count == node->attrs_capacity) {
+		const size_t new_capacity =
+			node->attrs_capacity ? node->attrs_capacity * 2 : 4;
+		struct memxattr_attr *new_attrs;
+
+		new_attrs = realloc(node->attrs,
+			new_capacity * sizeof(node->attrs[0]));
+		if(!new_attrs) {
+			return -1;
+		}
+
+		node->attrs = new_attrs;
+		node->attrs_capacity = new_capacity;
+	}
+
+	attr = &node->attrs[node->attrs_count++];
+	attr->namespace = namespace;
+	attr->name = name;
+	attr->value = value;
+	attr->value_length = value_length;
+
+	return 0;
+}
+
+static void memxattr_free_node(
+	struct memxattr_node *node)
+{
+	size_t i;
+
+	for(i = 0; i < node->attrs_count; ++i) {
+		free(node->attrs[i].name);
+		free(node->attrs[i].value);
+	}
+
+	free(node->attrs);
+	free(node);
+}
+
+/**
+ * Give a new node the generated attributes configured with "fill".
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+static int memxattr_fill_node(
+	const struct memxattr *memxattr,
+	struct memxattr_node *node)
+{
+	unsigned int i;
+
+	for(i = 0; i < memxattr->fill_count; ++i) {
+		char name_buf[32];
+		char *name;
+		char *value;
+
+		snprintf(name_buf, sizeof(name_buf),
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+			"fake.%u",
+#else
+			"user.fake.%u",
+#endif
+			i);
+
+		name = strdup(name_buf);
+		value = malloc(memxattr->fill_size ? memxattr->fill_size : 1);
+		if(!name || !value) {
+			free(name);
+			free(value);
+			return -1;
+		}
+
+		memset(value, 'a' + (int) (i % 26), memxattr->fill_size);
+		if(memxattr_add_attr(node, XATTRIO_DEFAULT_NAMESPACE, name,
+			value, memxattr->fill_size))
+		{
+			free(name);
+			free(value);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Double the number of buckets in @shard. Failing to grow is not an error,
+ * the chains just get longer.
+ */
+static void memxattr_grow(
+	struct memxattr_shard *shard)
+{
+	const size_t new_count =
+		shard->buckets_count ? shard->buckets_count * 2 : 64;
+	struct memxattr_node **new_buckets;
+	size_t i;
+
+	new_buckets = calloc(new_count, sizeof(new_buckets[0]));
+	if(!new_buckets) {
+		return;
+	}
+
+	for(i = 0; i < shard->buckets_count; ++i) {
+		struct memxattr_node *node = shard->buckets[i];
+
+		while(node) {
+			struct memxattr_node *const next = node->next;
+			const size_t bucket =
+				(size_t) node->hash & (new_count - 1);
+
+			node->next = new_buckets[bucket];
+			new_buckets[bucket] = node;
+			node = next;
+		}
+	}
+
+	free(shard->buckets);
+	shard->buckets = new_buckets;
+	shard->buckets_count = new_count;
+}
+
+/**
+ * Find the node for @path in @shard, creating it if it doesn't exist. Called
+ * with the shard locked.
+ *
+ * Returns the node, or NULL with errno set on error.
+ */
+static struct memxattr_node* memxattr_lookup(
+	const struct memxattr *memxattr,
+	struct memxattr_shard *shard,
+	const char *path,
+	unsigned long long hash)
+{
+	struct memxattr_node *node;
+	size_t path_length;
+	size_t bucket;
+
+	if(shard->buckets_count) {
+		node = shard->buckets[(size_t) hash &
+			(shard->buckets_count - 1)];
+		while(node) {
+			if(node->hash == hash && !strcmp(node->path, path)) {
+				return node;
+			}
+
+			node = node->next;
+		}
+	}
+
+	if(shard->nodes_count >= shard->buckets_count) {
+		memxattr_grow(shard);
+		if(!shard->buckets_count) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	path_length = strlen(path);
+	node = calloc(1, sizeof(*node) + path_length + 1);
+	if(!node) {
+		return NULL;
+	}
+
+	node->hash = hash;
+	memcpy(node->path, path, path_length + 1);
+	if(memxattr_fill_node(memxattr, node)) {
+		memxattr_free_node(node);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	bucket = (size_t) hash & (shard->buckets_count - 1);
+	node->next = shard->buckets[bucket];
+	shard->buckets[bucket] = node;
+	++shard->nodes_count;
+
+	return node;
+}
+
+/**
+ * Delay, then lock the shard of @path and look up its node. On success the
+ * shard is returned in *@out_shard and must be unlocked by the caller.
+ *
+ * Returns the node, or NULL with errno set on error.
+ */
+static struct memxattr_node* memxattr_enter(
+	struct memxattr *memxattr,
+	const char *path,
+	struct memxattr_shard **out_shard)
+{
+	const unsigned long long hash = memxattr_hash(path);
+	struct memxattr_shard *const shard =
+		&memxattr->shards[(hash >> 32) % MEMXATTR_SHARDS];
+	struct memxattr_node *node;
+	int err;
+
+	memxattr_delay(memxattr);
+
+	pthread_mutex_lock(&shard->lock);
+	node = memxattr_lookup(memxattr, shard, path, hash);
+	if(!node) {
+		err = errno;
+		pthread_mutex_unlock(&shard->lock);
+		errno = err;
+		return NULL;
+	}
+
+	*out_shard = shard;
+
+	return node;
+}
+
+static ssize_t memxattr_list(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	char *list,
+	size_t size)
+{
+	struct memxattr *const memxattr = ctx;
+	struct memxattr_shard *shard;
+	struct memxattr_node *node;
+	size_t list_size = 0;
+	ssize_t res;
+	size_t i;
+
+	(void) follow_links;
+
+	node = memxattr_enter(memxattr, path, &shard);
+	if(!node) {
+		return -1;
+	}
+
+	for(i = 0; i < node->attrs_count; ++i) {
+		if(node->attrs[i].namespace == namespace) {
+			list_size += strlen(node->attrs[i].name) + 1;
+		}
+	}
+
+	if(!size) {
+		res = (ssize_t) list_size;
+	}
+	else if(size < list_size || memxattr_race(memxattr, shard)) {
+		errno = ERANGE;
+		res = -1;
+	}
+	else {
+		char *dst = list;
+
+		for(i = 0; i < node->attrs_count; ++i) {
+			size_t name_size;
+
+			if(node->attrs[i].namespace != namespace) {
+				continue;
+			}
+
+			name_size = strlen(node->attrs[i].name) + 1;
+			memcpy(dst, node->attrs[i].name, name_size);
+			dst += name_size;
+		}
+
+		res = (ssize_t) list_size;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return res;
+}
+
+static ssize_t memxattr_get(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size)
+{
+	struct memxattr *const memxattr = ctx;
+	struct memxattr_shard *shard;
+	struct memxattr_node *node;
+	struct memxattr_attr *attr;
+	ssize_t res;
+
+	(void) follow_links;
+
+	node = memxattr_enter(memxattr, path, &shard);
+	if(!node) {
+		return -1;
+	}
+
+	attr = memxattr_find_attr(node, namespace, name);
+	if(!attr) {
+		errno = MEMXATTR_ENOATTR;
+		res = -1;
+	}
+	else if(!size) {
+		res = (ssize_t) attr->value_length;
+	}
+	else if(size < attr->value_length || memxattr_race(memxattr, shard)) {
+		errno = ERANGE;
+		res = -1;
+	}
+	else {
+		memcpy(value, attr->value, attr->value_length);
+		res = (ssize_t) attr->value_length;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return res;
+}
+
+static int memxattr_set(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags)
+{
+	struct memxattr *const memxattr = ctx;
+	struct memxattr_shard *shard;
+	struct memxattr_node *node;
+	struct memxattr_attr *attr;
+	char *new_value;
+	int ret = -1;
+
+	(void) follow_links;
+
+	node = memxattr_enter(memxattr, path, &shard);
+	if(!node) {
+		return -1;
+	}
+
+	attr = memxattr_find_attr(node, namespace, name);
+	if(attr && (flags & XATTRIO_CREATE)) {
+		errno = EEXIST;
+		goto out;
+	}
+	else if(!attr && (flags & XATTRIO_REPLACE)) {
+		errno = MEMXATTR_ENOATTR;
+		goto out;
+	}
+
+	new_value = malloc(size ? size : 1);
+	if(!new_value) {
+		goto out;
+	}
+
+	memcpy(new_value, value, size);
+	if(attr) {
+		free(attr->value);
+		attr->value = new_value;
+		attr->value_length = size;
+	}
+	else {
+		char *const new_name = strdup(name);
+
+		if(!new_name || memxattr_add_attr(node, namespace, new_name,
+			new_value, size))
+		{
+			free(new_name);
+			free(new_value);
+			errno = ENOMEM;
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	pthread_mutex_unlock(&shard->lock);
+
+	return ret;
+}
+
+static int memxattr_remove(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name)
+{
+	struct memxattr *const memxattr = ctx;
+	struct memxattr_shard *shard;
+	struct memxattr_node *node;
+	struct memxattr_attr *attr;
+	int ret = -1;
+
+	(void) follow_links;
+
+	node = memxattr_enter(memxattr, path, &shard);
+	if(!node) {
+		return -1;
+	}
+
+	attr = memxattr_find_attr(node, namespace, name);
+	if(!attr) {
+		errno = MEMXATTR_ENOATTR;
+		goto out;
+	}
+
+	free(attr->name);
+	free(attr->value);
+
+	/* Keep the order of the remaining attributes, like a list on a real
+	 * filesystem would. */
+	memmove(attr, attr + 1, (size_t) (&node->attrs[node->attrs_count] -
+		(attr + 1)) * sizeof(*attr));
+	--node->attrs_count;
+
+	ret = 0;
+out:
+	pthread_mutex_unlock(&shard->lock);
+
+	return ret;
+}
+
+/**
+ * Set the attributes of the dump in memxattr->file, if it exists. Only the
+ * plain name="value" form that memxattr_save writes is understood.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+static int memxattr_load(
+	struct memxattr *memxattr)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t length;
+	char *path = NULL;
+	unsigned long long line_number = 0;
+	int ret = -1;
+
+	fp = fopen(memxattr->file, "r");
+	if(!fp) {
+		if(errno == ENOENT) {
+			return 0;
+		}
+
+		fprintf(stderr, "Error while opening \"%s\": %s (errno=%d)\n",
+			memxattr->file, strerror(errno), errno);
+		return -1;
+	}
+
+	while((length = getline(&line, &line_size, fp)) >= 0) {
+		char *eq;
+		const char *name;
+		size_t value_length;
+		int namespace;
+
+		++line_number;
+		if(length && line[length - 1] == '\n') {
+			line[--length] = '\0';
+		}
+
+		if(length >= 8 && !memcmp(line, "# file: ", 8)) {
+			free(path);
+			path = strdup(&line[8]);
+			if(!path) {
+				goto out;
+			}
+
+			path[dump_unescape(path, strlen(path))] = '\0';
+			continue;
+		}
+		else if(!length || line[0] == '#') {
+			continue;
+		}
+
+		eq = memchr(line, '=', (size_t) length);
+		if(!path || !eq || eq[1] != '"' || line[length - 1] != '"' ||
+			&line[length - 1] == &eq[1])
+		{
+			fprintf(stderr, "Error in \"%s\" line %llu: Expected "
+				"name=\"value\".\n",
+				memxattr->file, line_number);
+			errno = 0;
+			goto out;
+		}
+
+		line[dump_unescape(line, (size_t) (eq - line))] = '\0';
+		value_length = dump_unescape(&eq[2],
+			(size_t) (&line[length - 1] - &eq[2]));
+		name = xattrio_namespace_parse(line,
+			XATTRIO_DEFAULT_NAMESPACE, &namespace);
+		if(memxattr_set(memxattr, path, 0, namespace, name, &eq[2],
+			value_length, 0))
+		{
+			goto out;
+		}
+	}
+
+	if(ferror(fp)) {
+		goto out;
+	}
+
+	ret = 0;
+out:
+	if(ret && errno) {
+		fprintf(stderr, "Error while loading \"%s\": %s (errno=%d)\n",
+			memxattr->file, strerror(errno), errno);
+	}
+
+	free(path);
+	free(line);
+	fclose(fp);
+
+	return ret;
+}
+
+static int memxattr_compare_nodes(
+	const void *a,
+	const void *b)
+{
+	return strcmp((*(struct memxattr_node *const*) a)->path,
+		(*(struct memxattr_node *const*) b)->path);
+}
+
+/**
+ * Write the nodes that have attributes to memxattr->file as a dump, sorted
+ * by path.
+ */
+static void memxattr_save(
+	struct memxattr *memxattr)
+{
+	struct memxattr_node **nodes = NULL;
+	size_t count = 0;
+	struct outbuf out;
+	FILE *fp = NULL;
+	size_t i;
+	size_t j;
+	int err = 0;
+
+	memset(&out, 0, sizeof(out));
+
+	for(i = 0; i < MEMXATTR_SHARDS; ++i) {
+		count += memxattr->shards[i].nodes_count;
+	}
+
+	nodes = malloc((count ? count : 1) * sizeof(nodes[0]));
+	if(!nodes) {
+		err = errno;
+		goto out;
+	}
+
+	count = 0;
+	for(i = 0; i < MEMXATTR_SHARDS; ++i) {
+		const struct memxattr_shard *const shard =
+			&memxattr->shards[i];
+
+		for(j = 0; j < shard->buckets_count; ++j) {
+			struct memxattr_node *node;
+
+			for(node = shard->buckets[j]; node; node = node->next) {
+				if(node->attrs_count) {
+					nodes[count++] = node;
+				}
+			}
+		}
+	}
+
+	qsort(nodes, count, sizeof(nodes[0]), memxattr_compare_nodes);
+
+	fp = fopen(memxattr->file, "w");
+	if(!fp) {
+		err = errno;
+		goto out;
+	}
+
+	for(i = 0; i < count && !err; ++i) {
+		dump_put_file(&out, nodes[i]->path);
+		for(j = 0; j < nodes[i]->attrs_count; ++j) {
+			const struct memxattr_attr *const attr =
+				&nodes[i]->attrs[j];
+
+			dump_put_attr(&out,
+				xattrio_namespace_prefix(attr->namespace),
+				attr->name, strlen(attr->name), attr->value,
+				attr->value_length);
+		}
+
+		outbuf_putc(&out, '\n');
+		if(outbuf_flush(&out, fp)) {
+			err = errno;
+		}
+	}
+
+	if(fclose(fp) && !err) {
+		err = errno;
+	}
+out:
+	if(err) {
+		fprintf(stderr, "Error while saving \"%s\": %s (errno=%d)\n",
+			memxattr->file, strerror(err), err);
+	}
+
+	outbuf_free(&out);
+	free(nodes);
+}
+
+/**
+ * Parse the options string of memxattr_create into @memxattr.
+ */
+static int memxattr_parse_options(
+	struct memxattr *memxattr,
+	const char *options)
+{
+	while(*options) {
+		const char *const end = options + strcspn(options, ",");
+		const char *const eq = memchr(options, '=', (size_t) (end -
+			options));
+		const size_t key_length = eq ? (size_t) (eq - options) : 0;
+		const char *value = eq ? eq + 1 : NULL;
+		char *endptr = NULL;
+
+		errno = 0;
+		if(!eq) {
+			/* Reported below. */
+		}
+		else if(key_length == 7 && !memcmp(options, "latency", 7)) {
+			const unsigned long usec = strtoul(value, &endptr, 10);
+
+			memxattr->latency.tv_sec = (time_t) (usec / 1000000);
+			memxattr->latency.tv_nsec =
+				(long) (usec % 1000000) * 1000;
+		}
+		else if(key_length == 6 && !memcmp(options, "erange", 6)) {
+			memxattr->erange = strtod(value, &endptr);
+			if(memxattr->erange < 0 || memxattr->erange > 1) {
+				endptr = NULL;
+			}
+		}
+		else if(key_length == 4 && !memcmp(options, "file", 4)) {
+			free(memxattr->file);
+			memxattr->file = strndup(value, (size_t) (end - value));
+			endptr = memxattr->file ? (char*) end : NULL;
+		}
+		else if(key_length == 4 && !memcmp(options, "fill", 4)) {
+			memxattr->fill_count =
+				(unsigned int) strtoul(value, &endptr, 10);
+			if(endptr != value && *endptr == 'x') {
+				value = endptr + 1;
+				memxattr->fill_size =
+					(size_t) strtoul(value, &endptr, 10);
+			}
+		}
+
+		if(!eq || !endptr || endptr == value || endptr != end ||
+			errno)
+		{
+			fprintf(stderr, "Invalid memory backend option "
+				"\"%.*s\", expected latency=<usec>, "
+				"erange=<fraction>, fill=<count>[x<size>] or "
+				"file=<dump>.\n",
+				(int) (end - options), options);
+			return -1;
+		}
+
+		options = *end ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+int memxattr_create(
+	const char *options,
+	struct memxattr **out_memxattr)
+{
+	struct memxattr *memxattr;
+	size_t i;
+
+	memxattr = calloc(1, sizeof(*memxattr));
+	if(!memxattr) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		return -1;
+	}
+
+	memxattr->fill_size = MEMXATTR_DEFAULT_FILL_SIZE;
+	if(memxattr_parse_options(memxattr, options)) {
+		free(memxattr->file);
+		free(memxattr);
+		return -1;
+	}
+
+	for(i = 0; i < MEMXATTR_SHARDS; ++i) {
+		pthread_mutex_init(&memxattr->shards[i].lock, NULL);
+		memxattr->shards[i].random =
+			(unsigned long long) (i + 1) * 0x9E3779B97F4A7C15ULL;
+	}
+
+	memxattr->backend.name = "memory";
+	memxattr->backend.list = memxattr_list;
+	memxattr->backend.get = memxattr_get;
+	memxattr->backend.set = memxattr_set;
+	memxattr->backend.remove = memxattr_remove;
+	memxattr->backend.ctx = memxattr;
+
+	if(memxattr->file && memxattr_load(memxattr)) {
+		/* Don't overwrite the dump with what was loaded of it. */
+		free(memxattr->file);
+		memxattr->file = NULL;
+		memxattr_destroy(memxattr);
+		return -1;
+	}
+
+	*out_memxattr = memxattr;
+
+	return 0;
+}
+
+void memxattr_destroy(
+	struct memxattr *memxattr)
+{
+	size_t i;
+
+	if(memxattr->file) {
+		memxattr_save(memxattr);
+	}
+
+	for(i = 0; i < MEMXATTR_SHARDS; ++i) {
+		struct memxattr_shard *const shard = &memxattr->shards[i];
+		size_t j;
+
+		for(j = 0; j < shard->buckets_count; ++j) {
+			struct memxattr_node *node = shard->buckets[j];
+
+			while(node) {
+				struct memxattr_node *const next = node->next;
+
+				memxattr_free_node(node);
+				node = next;
+			}
+		}
+
+		free(shard->buckets);
+		pthread_mutex_destroy(&shard->lock);
+	}
+
+	free(memxattr->file);
+	free(memxattr);
+}
+
+const struct xattrio_backend* memxattr_backend(
+	struct memxattr *memxattr)
+{
+	return &memxattr->backend;
+}
@@ -0,0 +1,72 @@
+/*-
+ * memxattr.h - In-memory extended attribute backend.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_MEMXATTR_H
+#define _XATTRPROGS_MEMXATTR_H
+
+#include "xattrio.h"
+
+/**
+ * An extended attribute store kept in a hash table in memory, used in place
+ * of the filesystem to measure the tools' own overhead (parsing, buffering,
+ * output) without any system calls, and to test them against injected
+ * latency and races.
+ *
+ * Paths are only used as keys, nothing is looked up in the filesystem and
+ * symbolic links aren't followed. A path that was never seen is a node
+ * without attributes, or with the generated attributes set up with "fill".
+ * The store is dropped when the process exits, unless it's saved with "file".
+ */
+struct memxattr;
+
+/**
+ * Create a store configured by @options, a comma separated list of:
+ *
+ *   latency=<usec>  Sleep this many microseconds in every call.
+ *   erange=<p>      Fail this fraction of the list and get calls that read
+ *                   into a buffer with ERANGE, as if the list or value had
+ *                   grown since its size was queried.
+ *   fill=<n>[x<size>]
+ *                   Give each node n attributes named "user.fake.<i>" (no
+ *                   "user." on FreeBSD/NetBSD, where they go in the user
+ *                   namespace) with values of size bytes (default 16) when
+ *                   it's first used.
+ *   file=<dump>     Load the store from this dump (see dump.h) if it exists,
+ *                   and save it back there, sorted by path, when the store
+ *                   is destroyed, so that a series of tool runs can work on
+ *                   the same attributes.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int memxattr_create(
+	const char *options,
+	struct memxattr **out_memxattr);
+
+void memxattr_destroy(
+	struct memxattr *memxattr);
+
+/**
+ * Get the backend for passing to xattrio_set_backend. It stays valid until
+ * @memxattr is destroyed.
+ */
+const struct xattrio_backend* memxattr_backend(
+	struct memxattr *memxattr);
+
+#endif /* !defined(_XATTRPROGS_MEMXATTR_H) */
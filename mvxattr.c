@@ -0,0 +1,340 @@
+/*-
+ * mvxattr.c - Rename extended attributes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/stat.h>
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#include <sys/extattr.h>
+#endif
+
+#include "hooks.h"
+#include "pool.h"
+#include "scan.h"
+#include "xattrio.h"
+#include "xattrprogs.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+struct mvxattr_options {
+	int follow_links;
+	int recursive;
+	const char *old_name;
+	int old_namespace;
+	const char *new_name;
+	int new_namespace;
+};
+
+/**
+ * Find out the type of a node that the scan didn't know the type of, to
+ * decide whether it can be opened.
+ */
+static enum scan_type mvxattr_stat_type(
+	const char *path,
+	int follow_links)
+{
+	struct stat st;
+
+	if((follow_links ? stat : lstat)(path, &st)) {
+		return SCAN_TYPE_UNKNOWN;
+	}
+
+	return S_ISREG(st.st_mode) ? SCAN_TYPE_REG :
+		S_ISDIR(st.st_mode) ? SCAN_TYPE_DIR :
+		S_ISLNK(st.st_mode) ? SCAN_TYPE_LNK : SCAN_TYPE_OTHER;
+}
+
+/**
+ * Rename the attribute of a single node: read the old attribute, create the
+ * new one (failing if it already exists) and remove the old one, all through
+ * one file descriptor where the node can be opened.
+ */
+static int mvxattr_visit(
+	struct scan_worker *worker,
+	const char *path,
+	enum scan_type type,
+	void *arg)
+{
+	const struct mvxattr_options *options = arg;
+	struct xattrio_node node;
+	ssize_t value_size;
+	int res;
+	int ret = -1;
+
+	if(type == SCAN_TYPE_UNKNOWN ||
+		(type == SCAN_TYPE_LNK && options->follow_links))
+	{
+		type = mvxattr_stat_type(path, options->follow_links);
+	}
+
+	xattrio_node_open(&node, path, options->follow_links,
+		type == SCAN_TYPE_REG || type == SCAN_TYPE_DIR);
+
+	value_size = xattrio_node_get_buf(&node, options->old_namespace,
+		options->old_name, &worker->value);
+	if(value_size < 0) {
+		if(options->recursive && (errno == ENOATTR || errno == ENOENT ||
+			errno == ENOTSUP || errno == EPERM))
+		{
+			/* Most nodes in a tree don't have the attribute, or
+			 * don't support extended attributes at all. */
+			ret = 0;
+			goto out;
+		}
+
+		fprintf(stderr, "Error while getting extended attribute data "
+			"for path \"%s\" and attribute name \"%s\": %s "
+			"(errno=%d)\n",
+			path, options->old_name, strerror(errno), errno);
+		goto out;
+	}
+
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	/* The extattr API has no exclusive create. */
+	if(xattrio_node_get(&node, options->new_namespace, options->new_name,
+		NULL, 0) >= 0)
+	{
+		res = -1;
+		errno = EEXIST;
+	}
+	else
+#endif
+	{
+		res = xattrio_node_set(&node, options->new_namespace,
+			options->new_name, worker->value.data,
+			(size_t) value_size, XATTRIO_CREATE);
+	}
+
+	if(res && errno == EEXIST) {
+		fprintf(stderr, "Conflict: \"%s\" already has an extended "
+			"attribute \"%s\", \"%s\" was left as it is.\n",
+			path, options->new_name, options->old_name);
+		goto out;
+	}
+	else if(res) {
+		fprintf(stderr, "Error while setting extended attribute "
+			"\"%s\" of \"%s\": %s (errno=%d)\n",
+			options->new_name, path, strerror(errno), errno);
+		goto out;
+	}
+
+	/* If the old attribute went away in the meantime the rename has
+	 * still happened. */
+	if(xattrio_node_remove(&node, options->old_namespace,
+		options->old_name) && errno != ENOATTR)
+	{
+		fprintf(stderr, "Error while removing extended attribute "
+			"\"%s\" from \"%s\": %s (errno=%d)\n",
+			options->old_name, path, strerror(errno), errno);
+
+		/* Don't leave the node with both names. */
+		if(xattrio_node_remove(&node, options->new_namespace,
+			options->new_name))
+		{
+			fprintf(stderr, "Error while removing extended "
+				"attribute \"%s\" from \"%s\" again: %s "
+				"(errno=%d)\n",
+				options->new_name, path, strerror(errno),
+				errno);
+		}
+
+		goto out;
+	}
+
+	ret = 0;
+out:
+	xattrio_node_close(&node);
+
+	return ret;
+}
+
+int mvxattr_main(int argc, char **argv)
+{
+	int ret = (EXIT_FAILURE);
+	int argp = 1;
+	struct mvxattr_options options;
+	struct scan_options scan_options;
+	struct scan_worker worker;
+	struct hooks hooks;
+	int failed = 0;
+	int res;
+
+	hooks_init(&hooks);
+	memset(&options, 0, sizeof(options));
+	memset(&scan_options, 0, sizeof(scan_options));
+	memset(&worker, 0, sizeof(worker));
+
+	while(argp < argc) {
+		if(argv[argp][0] != '-') {
+			/* Not an option switch. Move on to the mandatory
+			 * arguments. */
+			break;
+		}
+		else if(!strcmp(argv[argp], "--skip-symlinks")) {
+			scan_options.skip_symlinks = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--skip-special")) {
+			scan_options.skip_special = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--xdev")) {
+			scan_options.one_filesystem = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--prefetch")) {
+			if(argp + 1 >= argc || scan_parse_prefetch(
+				argv[argp + 1], &scan_options.prefetch))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else if((res = hooks_parse_option(&hooks, argc, argv,
+			&argp)))
+		{
+			if(res < 0) {
+				goto out;
+			}
+		}
+		else if(!strcmp(argv[argp], "--")) {
+			/* Stop parsing options when '--' is encountered. */
+			++argp;
+			break;
+		}
+		else if(argv[argp][1] == 'L') {
+			options.follow_links = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'R') {
+			options.recursive = 1;
+			++argp;
+		}
+		else if(argv[argp][1] == 'j') {
+			if(argp + 1 >= argc || pool_parse_threads(
+				argv[argp + 1], &scan_options.threads))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else {
+			fprintf(stderr, "Error: Unrecognized option '%s'.\n",
+				argv[argp]);
+			goto out;
+		}
+	}
+
+	if(argc - argp < 3) {
+		fprintf(stderr, "usage: mvxattr [-L|-R] [-j <threads>] "
+			"[--trace <file>]\n"
+			"               [--background] [--max-rate <calls>] "
+			"[--max-bandwidth <bytes>]\n"
+			"               [--skip-symlinks] [--skip-special] "
+			"[--xdev]\n"
+			"               [--prefetch <threads>] <old name> "
+			"<new name> <filename>...\n");
+		goto out;
+	}
+
+	/* On FreeBSD/NetBSD the names may be qualified with "user." or
+	 * "system." to pick the namespace. */
+	options.old_name = xattrio_namespace_parse(argv[argp++],
+		XATTRIO_DEFAULT_NAMESPACE, &options.old_namespace);
+	options.new_name = xattrio_namespace_parse(argv[argp++],
+		XATTRIO_DEFAULT_NAMESPACE, &options.new_namespace);
+
+	if(options.old_namespace == options.new_namespace &&
+		!strcmp(options.old_name, options.new_name))
+	{
+		fprintf(stderr, "Error: The old and the new name are the "
+			"same.\n");
+		goto out;
+	}
+
+	if(xattrio_backend_init()) {
+		goto out;
+	}
+
+	if(hooks_start(&hooks, "mvxattr", options.recursive ?
+		(scan_options.threads ? scan_options.threads :
+		pool_default_threads()) : 1))
+	{
+		goto out;
+	}
+
+	if(options.recursive) {
+		scan_options.visit = mvxattr_visit;
+		scan_options.arg = &options;
+		if(scan_run(&scan_options, &argv[argp], argc - argp)) {
+			goto out;
+		}
+	}
+	else {
+		/* All nodes share the same value buffer. */
+		for(; argp < argc; ++argp) {
+			if(mvxattr_visit(&worker, argv[argp],
+				SCAN_TYPE_UNKNOWN, &options))
+			{
+				failed = 1;
+			}
+		}
+
+		if(failed) {
+			goto out;
+		}
+	}
+
+	ret = (EXIT_SUCCESS);
+out:
+	if(hooks_finish(&hooks)) {
+		ret = (EXIT_FAILURE);
+	}
+
+	xattrio_buf_free(&worker.value);
+
+	xattrio_backend_cleanup();
+
+	return ret;
+}
+
+#ifndef XATTRPROGS_MULTICALL
+int main(int argc, char **argv)
+{
+	return mvxattr_main(argc, argv);
+}
+#endif
@@ -0,0 +1,136 @@
+/*-
+ * outbuf.c - Growable output buffers.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "outbuf.h"
+
+char* outbuf_reserve(
+	struct outbuf *out,
+	size_t len)
+{
+	if(out->failed) {
+		return NULL;
+	}
+
+	if(out->size - out->len < len) {
+		size_t new_size = out->size ? out->size : 65536;
+		char *new_data;
+
+		while(new_size - out->len < len) {
+			new_size *= 2;
+		}
+
+		new_data = realloc(out->data, new_size);
+		if(!new_data) {
+			out->failed = errno ? errno : ENOMEM;
+			return NULL;
+		}
+
+		out->data = new_data;
+		out->size = new_size;
+	}
+
+	return &out->data[out->len];
+}
+
+void outbuf_commit(
+	struct outbuf *out,
+	size_t len)
+{
+	out->len += len;
+}
+
+void outbuf_append(
+	struct outbuf *out,
+	const void *data,
+	size_t len)
+{
+	char *dst;
+
+	if(!len || !(dst = outbuf_reserve(out, len))) {
+		return;
+	}
+
+	memcpy(dst, data, len);
+	out->len += len;
+}
+
+void outbuf_putc(
+	struct outbuf *out,
+	char c)
+{
+	char *dst;
+
+	if(!(dst = outbuf_reserve(out, 1))) {
+		return;
+	}
+
+	*dst = c;
+	out->len += 1;
+}
+
+void outbuf_puts(
+	struct outbuf *out,
+	const char *s)
+{
+	outbuf_append(out, s, strlen(s));
+}
+
+int outbuf_flush(
+	struct outbuf *out,
+	FILE *stream)
+{
+	int err = 0;
+
+	if(out->failed) {
+		err = out->failed;
+		out->failed = 0;
+	}
+	else if(out->len && fwrite(out->data, out->len, 1, stream) != 1) {
+		err = errno ? errno : EIO;
+	}
+
+	out->len = 0;
+
+	if(err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+void outbuf_free(
+	struct outbuf *out)
+{
+	if(out->data) {
+		free(out->data);
+	}
+
+	memset(out, 0, sizeof(*out));
+}
@@ -0,0 +1,77 @@
+/*-
+ * outbuf.h - Growable output buffers.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_OUTBUF_H
+#define _XATTRPROGS_OUTBUF_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Output is collected in an outbuf and written out in large chunks. Append
+ * operations never fail; on allocation failure the buffer is marked as failed
+ * and the error is reported when the buffer is written out.
+ */
+struct outbuf {
+	char *data;
+	size_t len;
+	size_t size;
+	int failed;
+};
+
+void outbuf_append(
+	struct outbuf *out,
+	const void *data,
+	size_t len);
+
+void outbuf_putc(
+	struct outbuf *out,
+	char c);
+
+void outbuf_puts(
+	struct outbuf *out,
+	const char *s);
+
+/**
+ * Reserve room for @len more bytes and return a pointer to it. The caller
+ * must commit the bytes that it actually used with outbuf_commit. Returns
+ * NULL if the buffer couldn't be grown.
+ */
+char* outbuf_reserve(
+	struct outbuf *out,
+	size_t len);
+
+void outbuf_commit(
+	struct outbuf *out,
+	size_t len);
+
+/**
+ * Write out the contents of @out to @stream and empty the buffer.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+int outbuf_flush(
+	struct outbuf *out,
+	FILE *stream);
+
+void outbuf_free(
+	struct outbuf *out);
+
+#endif /* !defined(_XATTRPROGS_OUTBUF_H) */
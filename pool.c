@@ -0,0 +1,135 @@
+/*-
+ * pool.c - Worker thread helpers.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+struct pool_thread {
+	pthread_t thread;
+	unsigned int index;
+	void (*fn)(unsigned int index, void *arg);
+	void *arg;
+};
+
+static void* pool_thread_main(
+	void *arg)
+{
+	struct pool_thread *thread = arg;
+
+	thread->fn(thread->index, thread->arg);
+
+	return NULL;
+}
+
+int pool_run(
+	unsigned int threads,
+	void (*fn)(unsigned int index, void *arg),
+	void *arg)
+{
+	struct pool_thread *pool;
+	unsigned int started = 0;
+	unsigned int i;
+
+	if(threads <= 1) {
+		fn(0, arg);
+		return 0;
+	}
+
+	pool = calloc(threads, sizeof(pool[0]));
+	if(!pool) {
+		fprintf(stderr, "Error while allocating worker state: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		return -1;
+	}
+
+	for(i = 0; i < threads; ++i) {
+		int err;
+
+		pool[i].index = i;
+		pool[i].fn = fn;
+		pool[i].arg = arg;
+
+		err = pthread_create(&pool[i].thread, NULL, pool_thread_main,
+			&pool[i]);
+		if(err) {
+			fprintf(stderr, "Error while creating worker thread: "
+				"%s (errno=%d)\n",
+				strerror(err), err);
+			break;
+		}
+
+		++started;
+	}
+
+	for(i = 0; i < started; ++i) {
+		pthread_join(pool[i].thread, NULL);
+	}
+
+	free(pool);
+
+	return started ? 0 : -1;
+}
+
+int pool_parse_threads(
+	const char *s,
+	unsigned int *out_threads)
+{
+	char *endptr = NULL;
+	unsigned long threads;
+
+	errno = 0;
+	threads = strtoul(s, &endptr, 10);
+	if(errno || !*s || *endptr || !threads || threads > POOL_MAX_THREADS) {
+		return -1;
+	}
+
+	*out_threads = (unsigned int) threads;
+
+	return 0;
+}
+
+unsigned int pool_default_threads(void)
+{
+	long cpus = -1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(cpus < 1) {
+		return 4;
+	}
+	else if(cpus > 32) {
+		return 32;
+	}
+
+	return (unsigned int) cpus;
+}
@@ -0,0 +1,52 @@
+/*-
+ * pool.h - Worker thread helpers.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_POOL_H
+#define _XATTRPROGS_POOL_H
+
+#define POOL_MAX_THREADS 256
+
+/**
+ * Run @fn in @threads threads and wait for all of them to finish. @fn gets
+ * the index of the thread and @arg.
+ *
+ * Returns 0 on success, or -1 if no thread could be started. If only some
+ * threads could be started, the work is done by those.
+ */
+int pool_run(
+	unsigned int threads,
+	void (*fn)(unsigned int index, void *arg),
+	void *arg);
+
+/**
+ * Parse a thread count option argument. Returns 0 on success, -1 if @s is not
+ * a valid thread count.
+ */
+int pool_parse_threads(
+	const char *s,
+	unsigned int *out_threads);
+
+/**
+ * The number of worker threads to use when the user didn't ask for a
+ * particular number.
+ */
+unsigned int pool_default_threads(void);
+
+#endif /* !defined(_XATTRPROGS_POOL_H) */
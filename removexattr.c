@@ -18,34 +18,94 @@
  * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-#include <fcntl.h>
-#include <unistd.h>
-#endif
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #include <sys/extattr.h>
 #endif
-#if defined(__APPLE__) || defined(__DARWIN__) || defined(__linux__)
-#include <sys/xattr.h>
+
+#include "checkpoint.h"
+#include "durable.h"
+#include "hooks.h"
+#include "xattrio.h"
+#include "xattrprogs.h"
+
+struct removexattr_options {
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	int namespace;
 #endif
+	int follow_links;
+	const char *attr_name;
+	/* Set with --durable, changes are flushed in bulk. */
+	struct durable *durable;
+};
 
-int main(int argc, char **argv)
+/**
+ * Remove the attribute from a single node.
+ */
+static int removexattr_one(
+	const struct removexattr_options *options,
+	const char *path)
 {
-	int ret = (EXIT_FAILURE);
-	int argp = 1;
+	int ret = -1;
+	const char *attr_name = options->attr_name;
+	const int follow_links = options->follow_links;
+
+	if(xattrio_remove(
+		path,
+		follow_links,
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	int namespace = EXTATTR_NAMESPACE_USER;
+		options->namespace,
+#else
+		XATTRIO_DEFAULT_NAMESPACE,
 #endif
-	int follow_links = 0;
+		attr_name))
+	{
+		fprintf(stderr, "Error while removing extended attribute "
+			"\"%s\" from \"%s\": %s (errno=%d)\n",
+			attr_name, path, strerror(errno), errno);
+		goto out;
+	}
+
+	if(options->durable) {
+		durable_note(options->durable, path, follow_links);
+	}
+
+	ret = 0;
+out:
+	return ret;
+}
+
+int removexattr_main(int argc, char **argv)
+{
+	int ret = (EXIT_FAILURE);
+	int argp = 1;
+	struct removexattr_options options;
 	const char *path = NULL;
-	const char *attr_name = NULL;
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	int attrdirfd = -1;
+	int failed = 0;
+	struct durable durable;
+	int durable_requested = 0;
+	unsigned long long sync_interval = 0;
+	const char *checkpoint_file = NULL;
+	const char *resume_file = NULL;
+	struct checkpoint checkpoint;
+	int have_checkpoint = 0;
+	struct hooks hooks;
+	int first;
+	int res;
+
+	hooks_init(&hooks);
+	memset(&options, 0, sizeof(options));
+	memset(&checkpoint, 0, sizeof(checkpoint));
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	options.namespace = EXTATTR_NAMESPACE_USER;
 #endif
 
 	while(argp < argc) {
@@ -54,28 +114,82 @@ int main(int argc, char **argv)
 			 * arguments. */
 			break;
 		}
-		else if(argv[argp][1] == '-') {
+		else if(!strcmp(argv[argp], "--durable")) {
+			durable_requested = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--sync-every")) {
+			if(argp + 1 >= argc || durable_parse_interval(
+				argv[argp + 1], &sync_interval))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an operation count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			durable_requested = 1;
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--checkpoint") ||
+			!strcmp(argv[argp], "--resume"))
+		{
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a file argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(argv[argp][2] == 'c') {
+				checkpoint_file = argv[argp + 1];
+			}
+			else {
+				resume_file = argv[argp + 1];
+			}
+
+			argp += 2;
+		}
+		else if((res = hooks_parse_option(&hooks, argc, argv,
+			&argp)))
+		{
+			if(res < 0) {
+				goto out;
+			}
+		}
+		else if(!strcmp(argv[argp], "--")) {
 			/* Stop parsing options when '--' is encountered. */
 			++argp;
 			break;
 		}
 		else if(argv[argp][1] == 'L') {
-			follow_links = 1;
+			options.follow_links = 1;
 			++argp;
 		}
+		else if(argv[argp][1] == 'n') {
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			options.attr_name = argv[argp + 1];
+			argp += 2;
+		}
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #ifdef EXTATTR_NAMESPACE_EMPTY
 		else if(argv[argp][1] == 'e') {
-			namespace = EXTATTR_NAMESPACE_EMPTY;
+			options.namespace = EXTATTR_NAMESPACE_EMPTY;
 			++argp;
 		}
 #endif
 		else if(argv[argp][1] == 'u') {
-			namespace = EXTATTR_NAMESPACE_USER;
+			options.namespace = EXTATTR_NAMESPACE_USER;
 			++argp;
 		}
 		else if(argv[argp][1] == 's') {
-			namespace = EXTATTR_NAMESPACE_SYSTEM;
+			options.namespace = EXTATTR_NAMESPACE_SYSTEM;
 			++argp;
 		}
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
@@ -86,10 +200,15 @@ int main(int argc, char **argv)
 		}
 	}
 
-	path = (argp < argc) ? argv[argp++] : NULL;
-	attr_name = (argp < argc) ? argv[argp++] : NULL;
+	if(!options.attr_name) {
+		/* Traditional form: <filename> <attribute name> */
+		path = (argp < argc) ? argv[argp++] : NULL;
+		options.attr_name = (argp < argc) ? argv[argp++] : NULL;
+	}
 
-	if(!path || !attr_name || argp < argc) {
+	if(!options.attr_name || (path && argp < argc) ||
+		(!path && argp >= argc))
+	{
 		fprintf(stderr, "usage: removexattr [-L"
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #ifdef EXTATTR_NAMESPACE_EMPTY
@@ -97,67 +216,146 @@ int main(int argc, char **argv)
 #endif
 			"|-u|-s"
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
-			"] <filename> <attribute name>\n");
+			"] <filename> <attribute name>\n"
+			"       removexattr [-L"
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#ifdef EXTATTR_NAMESPACE_EMPTY
+			"|-e"
+#endif
+			"|-u|-s"
+#endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
+			"] [--durable|--sync-every <n>]\n"
+			"                   [--checkpoint <file>] "
+			"[--resume <file>] [--trace <file>]\n"
+			"                   [--background] "
+			"[--max-rate <calls>]\n"
+			"                   [--max-bandwidth <bytes>] "
+			"-n <attribute name>\n"
+			"                   <filename>...\n");
+		goto out;
+	}
+
+	if(path && (checkpoint_file || resume_file)) {
+		fprintf(stderr, "Error: Checkpoints are only supported with "
+			"-n.\n");
 		goto out;
 	}
 
 #if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attr_name[0] == '/') {
+	if(options.attr_name[0] == '/') {
 		fprintf(stderr, "Invalid attribute name \"%s\" (cannot start "
-			"with '/').\n", attr_name);
+			"with '/').\n", options.attr_name);
 		goto out;
 	}
+#endif
 
-	attrdirfd = attropen(
-		path,
-		".",
-		O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
-	if(attrdirfd == -1) {
-		fprintf(stderr, "Error while opening \"%s\" node's attribute "
-			"directory: %s (%d)\n",
-			path,
-			strerror(errno),
-			errno);
+	if(xattrio_backend_init()) {
 		goto out;
 	}
-#endif
 
-#if defined(__APPLE__) || defined(__DARWIN__)
-	if(removexattr(
-		path,
-		attr_name,
-		follow_links ? 0 : XATTR_NOFOLLOW))
-#elif defined(__linux__)
-	if((follow_links ? removexattr : lremovexattr)(
-		path,
-		attr_name))
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-	if((follow_links ? extattr_delete_file : extattr_delete_link)(
-		path,
-		namespace,
-		attr_name))
-#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(unlinkat(
-		attrdirfd,
-		attr_name,
-		0))
-#else
-#error "Don't know how to handle extended attributes on this platform."
-#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
-	{
-		fprintf(stderr, "Error while removing extended attribute: %s "
-			"(errno=%d)\n",
-			strerror(errno), errno);
+	if(hooks_start(&hooks, "removexattr", 1)) {
 		goto out;
 	}
 
+	if(durable_requested) {
+		durable_init(&durable, "removexattr", sync_interval);
+		options.durable = &durable;
+	}
+
+	if(path) {
+		if(removexattr_one(&options, path)) {
+			goto out;
+		}
+	}
+	else {
+		first = argp;
+		if(checkpoint_file || resume_file) {
+			/* A resumed run keeps updating the checkpoint it was
+			 * resumed from, unless told otherwise. */
+			checkpoint_init(&checkpoint,
+				checkpoint_file ? checkpoint_file : resume_file,
+				"removexattr", "args");
+			have_checkpoint = 1;
+			if(resume_file &&
+				checkpoint_load(&checkpoint, resume_file))
+			{
+				goto out;
+			}
+
+			checkpoint_hash_args(&checkpoint, options.attr_name,
+				strlen(options.attr_name));
+			checkpoint_hash_arg_list(&checkpoint, &argv[first],
+				(size_t) (argc - first));
+			if(resume_file &&
+				checkpoint_check_args(&checkpoint, resume_file))
+			{
+				goto out;
+			}
+
+			if(checkpoint.position > (unsigned long long)
+				(argc - first))
+			{
+				fprintf(stderr, "Error: Checkpoint \"%s\" is "
+					"past the end of the file list.\n",
+					resume_file);
+				goto out;
+			}
+
+			argp = first + (int) checkpoint.position;
+		}
+
+		for(; argp < argc; ++argp) {
+			if(removexattr_one(&options, argv[argp])) {
+				failed = 1;
+				++checkpoint.errors;
+			}
+
+			++checkpoint.done;
+			checkpoint.position = (unsigned long long)
+				(argp + 1 - first);
+			if(!have_checkpoint || (!checkpoint_due(&checkpoint) &&
+				(!failed || argp + 1 != argc)))
+			{
+				continue;
+			}
+
+			/* With --durable, never record progress that isn't on
+			 * disk yet. */
+			if((options.durable &&
+				durable_flush_pending(options.durable)) ||
+				checkpoint_save(&checkpoint))
+			{
+				goto out;
+			}
+		}
+
+		if(failed) {
+			goto out;
+		}
+	}
+
 	ret = (EXIT_SUCCESS);
 out:
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attrdirfd != -1) {
-		close(attrdirfd);
+	if(hooks_finish(&hooks)) {
+		ret = (EXIT_FAILURE);
 	}
-#endif
+
+	if(options.durable && durable_finish(options.durable)) {
+		ret = (EXIT_FAILURE);
+	}
+
+	if(have_checkpoint) {
+		checkpoint_finish(&checkpoint, ret == (EXIT_SUCCESS));
+	}
+
+	xattrio_backend_cleanup();
 
 	return ret;
 }
+
+#ifndef XATTRPROGS_MULTICALL
+int main(int argc, char **argv)
+{
+	return removexattr_main(argc, argv);
+}
+#endif
@@ -0,0 +1,973 @@
+/*-
+ * restore.c - Bulk restore of extended attributes from a dump.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "codec.h"
+#include "dump.h"
+#include "fslimit.h"
+#include "pool.h"
+#include "restore.h"
+
+/* A batch is processed when it reaches either of these limits. */
+#define RESTORE_BATCH_NODES 65536
+#define RESTORE_BATCH_BYTES (64 * 1024 * 1024)
+
+/* The parent directory of a group is read in full to find the inode numbers
+ * of its nodes only if there's at least one node per this many bytes of the
+ * directory's size (roughly a tenth of the entries on most filesystems).
+ * Otherwise the nodes are looked up one by one. */
+#define RESTORE_READDIR_BYTES 256
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* Strings are stored in one growable arena per batch and referred to by
+ * offset, so that growing the arena doesn't invalidate them. */
+struct restore_attr {
+	size_t name_offset;
+	size_t value_offset;
+	size_t value_length;
+};
+
+struct restore_node {
+	size_t path_offset;
+	/* Length of the parent directory part of the path and offset of the
+	 * last path component. */
+	size_t dir_length;
+	size_t name_start;
+	size_t attrs_start;
+	size_t attrs_count;
+	/* Position in the input, keeps the order of repeated paths. */
+	unsigned long long seq;
+	unsigned long long ino;
+};
+
+struct restore_batch {
+	char *arena;
+	size_t arena_length;
+	size_t arena_size;
+
+	struct restore_node *nodes;
+	size_t nodes_count;
+	size_t nodes_size;
+
+	struct restore_attr *attrs;
+	size_t attrs_count;
+	size_t attrs_size;
+};
+
+/* Groups put aside because their filesystem was busy, linked through
+ * restore_state.group_next. */
+struct restore_fs_queue {
+	size_t head;
+	size_t tail;
+};
+
+struct restore_state {
+	const struct restore_options *options;
+	struct restore_batch *batch;
+
+	/* Start indices of the directory groups in batch->nodes. The last
+	 * element is the number of nodes. */
+	size_t *groups;
+	size_t groups_count;
+
+	pthread_mutex_t lock;
+	size_t next_group;
+	unsigned long long errors;
+
+	/* Concurrency limits per filesystem, and the groups that were put
+	 * aside because their filesystem was at its limit, in one list per
+	 * filesystem (indexed like the filesystems in @fslimit). Protected
+	 * by lock. Workers wait on @fs_free for a busy filesystem only when
+	 * there's nothing else left to do. */
+	struct fslimit fslimit;
+	pthread_cond_t fs_free;
+	size_t *group_next;
+	struct restore_fs_queue *fs_queues;
+	size_t fs_queues_size;
+	size_t deferred_count;
+};
+
+static int restore_grow(
+	void **array,
+	size_t *size,
+	size_t element_size,
+	size_t needed)
+{
+	size_t new_size;
+	void *new_array;
+
+	if(*size >= needed) {
+		return 0;
+	}
+
+	new_size = *size ? *size : 256;
+	while(new_size < needed) {
+		new_size *= 2;
+	}
+
+	new_array = realloc(*array, new_size * element_size);
+	if(!new_array) {
+		return -1;
+	}
+
+	*array = new_array;
+	*size = new_size;
+
+	return 0;
+}
+
+static int restore_arena_add(
+	struct restore_batch *batch,
+	const char *data,
+	size_t length,
+	size_t *out_offset)
+{
+	if(restore_grow((void**) &batch->arena, &batch->arena_size, 1,
+		batch->arena_length + length + 1))
+	{
+		return -1;
+	}
+
+	memcpy(&batch->arena[batch->arena_length], data, length);
+	batch->arena[batch->arena_length + length] = '\0';
+	*out_offset = batch->arena_length;
+	batch->arena_length += length + 1;
+
+	return 0;
+}
+
+static void restore_batch_reset(
+	struct restore_batch *batch)
+{
+	batch->arena_length = 0;
+	batch->nodes_count = 0;
+	batch->attrs_count = 0;
+}
+
+static void restore_batch_free(
+	struct restore_batch *batch)
+{
+	if(batch->arena) {
+		free(batch->arena);
+	}
+
+	if(batch->nodes) {
+		free(batch->nodes);
+	}
+
+	if(batch->attrs) {
+		free(batch->attrs);
+	}
+
+	memset(batch, 0, sizeof(*batch));
+}
+
+/* qsort has no context argument, so the comparators find the arena through
+ * this variable. Sorting only happens from one thread at a time per batch
+ * (the main thread for grouping, and then each worker only sorts within its
+ * own group using restore_node fields that don't need the arena). */
+static const char *restore_sort_arena;
+
+static int restore_compare_dir(
+	const void *a,
+	const void *b)
+{
+	const struct restore_node *node_a = a;
+	const struct restore_node *node_b = b;
+	const size_t min_length = node_a->dir_length < node_b->dir_length ?
+		node_a->dir_length : node_b->dir_length;
+	int res;
+
+	res = memcmp(&restore_sort_arena[node_a->path_offset],
+		&restore_sort_arena[node_b->path_offset], min_length);
+	if(res) {
+		return res;
+	}
+	else if(node_a->dir_length != node_b->dir_length) {
+		return node_a->dir_length < node_b->dir_length ? -1 : 1;
+	}
+
+	return node_a->seq < node_b->seq ? -1 : (node_a->seq > node_b->seq);
+}
+
+static int restore_compare_ino(
+	const void *a,
+	const void *b)
+{
+	const struct restore_node *node_a = a;
+	const struct restore_node *node_b = b;
+
+	if(node_a->ino != node_b->ino) {
+		return node_a->ino < node_b->ino ? -1 : 1;
+	}
+
+	return node_a->seq < node_b->seq ? -1 : (node_a->seq > node_b->seq);
+}
+
+struct restore_name_ref {
+	const char *name;
+	struct restore_node *node;
+};
+
+static int restore_compare_name_ref(
+	const void *a,
+	const void *b)
+{
+	return strcmp(((const struct restore_name_ref*) a)->name,
+		((const struct restore_name_ref*) b)->name);
+}
+
+/**
+ * Look up the inode numbers of the nodes in a group with a single pass over
+ * their parent directory @fd. Closes @fd.
+ */
+static void restore_read_inos(
+	const struct restore_batch *batch,
+	struct restore_node *nodes,
+	size_t count,
+	int fd)
+{
+	struct restore_name_ref *refs;
+	DIR *dirp;
+	struct dirent *de;
+	size_t i;
+
+	refs = malloc(count * sizeof(refs[0]));
+	if(!refs) {
+		close(fd);
+		return;
+	}
+
+	for(i = 0; i < count; ++i) {
+		refs[i].name = &batch->arena[nodes[i].path_offset +
+			nodes[i].name_start];
+		refs[i].node = &nodes[i];
+	}
+
+	qsort(refs, count, sizeof(refs[0]), restore_compare_name_ref);
+
+	dirp = fdopendir(fd);
+	if(!dirp) {
+		close(fd);
+		free(refs);
+		return;
+	}
+
+	while((de = readdir(dirp))) {
+		struct restore_name_ref key;
+		struct restore_name_ref *match;
+
+		key.name = de->d_name;
+		match = bsearch(&key, refs, count, sizeof(refs[0]),
+			restore_compare_name_ref);
+		if(!match) {
+			continue;
+		}
+
+		/* Repeated paths all get the inode number. */
+		while(match > refs && !strcmp(match[-1].name, de->d_name)) {
+			--match;
+		}
+
+		for(; match < &refs[count] && !strcmp(match->name, de->d_name);
+			++match)
+		{
+			match->node->ino = (unsigned long long) de->d_ino;
+		}
+	}
+
+	closedir(dirp);
+	free(refs);
+}
+
+/**
+ * Look up the inode numbers of the nodes in a group and sort the group by
+ * inode number. If the group makes up a good part of its parent directory,
+ * the directory is read once, otherwise the nodes are looked up one by one
+ * so that a few nodes in a huge directory don't cost a pass over all of it
+ * in every batch. Nodes that aren't found keep inode number 0 and thus end
+ * up first, in input order.
+ */
+static void restore_sort_group(
+	const struct restore_batch *batch,
+	struct restore_node *nodes,
+	size_t count)
+{
+	struct stat stbuf;
+	char *dir_path = NULL;
+	int fd;
+	size_t i;
+
+	if(count < 2) {
+		return;
+	}
+
+	if(!nodes[0].dir_length) {
+		dir_path = strdup(".");
+	}
+	else {
+		dir_path = strndup(&batch->arena[nodes[0].path_offset],
+			nodes[0].dir_length);
+	}
+
+	/* Not fatal if any of this fails, the nodes are just processed in
+	 * input order. Any real problem will be reported when setting the
+	 * attributes. */
+	if(!dir_path) {
+		return;
+	}
+
+	fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	free(dir_path);
+	if(fd == -1) {
+		return;
+	}
+	else if(fstat(fd, &stbuf)) {
+		close(fd);
+		return;
+	}
+
+	if((unsigned long long) stbuf.st_size <=
+		(unsigned long long) count * RESTORE_READDIR_BYTES)
+	{
+		restore_read_inos(batch, nodes, count, fd);
+	}
+	else {
+		for(i = 0; i < count; ++i) {
+			if(!fstatat(fd, &batch->arena[nodes[i].path_offset +
+				nodes[i].name_start], &stbuf,
+				AT_SYMLINK_NOFOLLOW))
+			{
+				nodes[i].ino =
+					(unsigned long long) stbuf.st_ino;
+			}
+		}
+
+		close(fd);
+	}
+
+	qsort(nodes, count, sizeof(nodes[0]), restore_compare_ino);
+}
+
+/**
+ * Find the filesystem of the nodes of a group, going by the node at @path.
+ * Called without the lock held. Returns FSLIMIT_NONE if it can't be found
+ * out, the error is then reported when setting the attributes.
+ */
+static size_t restore_group_fs(
+	struct restore_state *state,
+	const char *path)
+{
+	struct stat stbuf;
+	size_t fs;
+	int res;
+
+	if(lstat(path, &stbuf)) {
+		return FSLIMIT_NONE;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	res = fslimit_find(&state->fslimit, stbuf.st_dev, &fs);
+	pthread_mutex_unlock(&state->lock);
+	if(res) {
+		const int remote = fslimit_is_remote(-1, path);
+
+		pthread_mutex_lock(&state->lock);
+		res = fslimit_add(&state->fslimit, stbuf.st_dev, remote, &fs);
+		pthread_mutex_unlock(&state->lock);
+		if(res) {
+			return FSLIMIT_NONE;
+		}
+	}
+
+	return fs;
+}
+
+/**
+ * Put @group aside until filesystem @fs has a free slot. Called with the lock
+ * held. Returns -1 if out of memory.
+ */
+static int restore_defer_group(
+	struct restore_state *state,
+	size_t group,
+	size_t fs)
+{
+	struct restore_fs_queue *queue;
+
+	if(fs >= state->fs_queues_size) {
+		const size_t new_size = state->fslimit.count;
+		struct restore_fs_queue *new_queues;
+		size_t i;
+
+		new_queues = realloc(state->fs_queues,
+			new_size * sizeof(new_queues[0]));
+		if(!new_queues) {
+			return -1;
+		}
+
+		for(i = state->fs_queues_size; i < new_size; ++i) {
+			new_queues[i].head = new_queues[i].tail = SIZE_MAX;
+		}
+
+		state->fs_queues = new_queues;
+		state->fs_queues_size = new_size;
+	}
+
+	queue = &state->fs_queues[fs];
+	state->group_next[group] = SIZE_MAX;
+	if(queue->head == SIZE_MAX) {
+		queue->head = group;
+	}
+	else {
+		state->group_next[queue->tail] = group;
+	}
+	queue->tail = group;
+	++state->deferred_count;
+
+	return 0;
+}
+
+/**
+ * Take the oldest group that was put aside and whose filesystem has a free
+ * slot now. Called with the lock held. Returns 0 on success, -1 if there is
+ * none.
+ */
+static int restore_take_deferred(
+	struct restore_state *state,
+	size_t *out_group,
+	size_t *out_fs)
+{
+	size_t i;
+
+	if(!state->deferred_count) {
+		return -1;
+	}
+
+	for(i = 0; i < state->fs_queues_size; ++i) {
+		struct restore_fs_queue *queue = &state->fs_queues[i];
+
+		if(queue->head == SIZE_MAX ||
+			!fslimit_may_start(&state->fslimit, i))
+		{
+			continue;
+		}
+
+		*out_group = queue->head;
+		*out_fs = i;
+		queue->head = state->group_next[queue->head];
+		--state->deferred_count;
+
+		return 0;
+	}
+
+	return -1;
+}
+
+static void restore_worker(
+	unsigned int index,
+	void *arg)
+{
+	struct restore_state *state = arg;
+	const struct restore_options *options = state->options;
+	const struct restore_batch *batch = state->batch;
+	unsigned long long errors = 0;
+
+	(void) index;
+
+	pthread_mutex_lock(&state->lock);
+	while(1) {
+		size_t group;
+		size_t fs;
+		size_t i;
+		double start;
+		unsigned int calls = 0;
+
+		if(restore_take_deferred(state, &group, &fs)) {
+			if(state->next_group < state->groups_count) {
+				group = state->next_group++;
+				pthread_mutex_unlock(&state->lock);
+
+				restore_sort_group(batch,
+					&batch->nodes[state->groups[group]],
+					state->groups[group + 1] -
+					state->groups[group]);
+				fs = restore_group_fs(state, &batch->arena[
+					batch->nodes[state->groups[group]].
+					path_offset]);
+
+				pthread_mutex_lock(&state->lock);
+				if(!fslimit_may_start(&state->fslimit, fs) &&
+					!restore_defer_group(state, group, fs))
+				{
+					continue;
+				}
+			}
+			else if(state->deferred_count) {
+				pthread_cond_wait(&state->fs_free,
+					&state->lock);
+				continue;
+			}
+			else {
+				break;
+			}
+		}
+
+		fslimit_start(&state->fslimit, fs);
+		pthread_mutex_unlock(&state->lock);
+
+		start = fslimit_now();
+		for(i = state->groups[group]; i < state->groups[group + 1];
+			++i)
+		{
+			const struct restore_node *node = &batch->nodes[i];
+			size_t j;
+
+			for(j = 0; j < node->attrs_count; ++j) {
+				const struct restore_attr *attr =
+					&batch->attrs[node->attrs_start + j];
+
+				++calls;
+				if(options->set(options->arg,
+					&batch->arena[node->path_offset],
+					&batch->arena[attr->name_offset],
+					&batch->arena[attr->value_offset],
+					attr->value_length))
+				{
+					++errors;
+				}
+			}
+		}
+
+		pthread_mutex_lock(&state->lock);
+		if(fslimit_finish(&state->fslimit, fs, calls ? calls : 1,
+			fslimit_now() - start))
+		{
+			pthread_cond_broadcast(&state->fs_free);
+		}
+	}
+
+	state->errors += errors;
+	pthread_cond_broadcast(&state->fs_free);
+	pthread_mutex_unlock(&state->lock);
+}
+
+static int restore_batch_process(
+	struct restore_state *state,
+	struct restore_batch *batch,
+	unsigned int threads)
+{
+	size_t i;
+
+	if(!batch->nodes_count) {
+		return 0;
+	}
+
+	/* Group the nodes by parent directory. */
+	restore_sort_arena = batch->arena;
+	qsort(batch->nodes, batch->nodes_count, sizeof(batch->nodes[0]),
+		restore_compare_dir);
+
+	state->groups_count = 0;
+	for(i = 0; i < batch->nodes_count; ++i) {
+		const struct restore_node *cur = &batch->nodes[i];
+
+		if(i && batch->nodes[i - 1].dir_length == cur->dir_length &&
+			!memcmp(&batch->arena[batch->nodes[i - 1].path_offset],
+			&batch->arena[cur->path_offset], cur->dir_length))
+		{
+			/* Same directory as the previous node. */
+			continue;
+		}
+
+		state->groups[state->groups_count++] = i;
+	}
+
+	state->groups[state->groups_count] = batch->nodes_count;
+	state->batch = batch;
+	state->next_group = 0;
+
+	if(threads > state->groups_count) {
+		threads = (unsigned int) state->groups_count;
+	}
+
+	return pool_run(threads, restore_worker, state);
+}
+
+static int restore_add_node(
+	struct restore_batch *batch,
+	char *path,
+	size_t path_length,
+	unsigned long long seq)
+{
+	struct restore_node *node;
+	size_t name_start = path_length;
+
+	if(restore_grow((void**) &batch->nodes, &batch->nodes_size,
+		sizeof(batch->nodes[0]), batch->nodes_count + 1))
+	{
+		return -1;
+	}
+
+	node = &batch->nodes[batch->nodes_count];
+	memset(node, 0, sizeof(*node));
+
+	if(restore_arena_add(batch, path, path_length, &node->path_offset)) {
+		return -1;
+	}
+
+	/* Split into parent directory and name. Trailing slashes belong to the
+	 * name. */
+	while(name_start && path[name_start - 1] == '/') {
+		--name_start;
+	}
+	while(name_start && path[name_start - 1] != '/') {
+		--name_start;
+	}
+
+	node->name_start = name_start;
+
+	/* Strip the separating slashes, but keep the slash of the root
+	 * directory so that it isn't mistaken for the current directory. */
+	node->dir_length = name_start;
+	while(node->dir_length > 1 && path[node->dir_length - 1] == '/') {
+		--node->dir_length;
+	}
+
+	node->attrs_start = batch->attrs_count;
+	node->seq = seq;
+	++batch->nodes_count;
+
+	return 0;
+}
+
+static int restore_add_attr(
+	struct restore_batch *batch,
+	char *name,
+	size_t name_length,
+	char *value,
+	size_t value_length)
+{
+	struct restore_attr *attr;
+
+	if(restore_grow((void**) &batch->attrs, &batch->attrs_size,
+		sizeof(batch->attrs[0]), batch->attrs_count + 1))
+	{
+		return -1;
+	}
+
+	attr = &batch->attrs[batch->attrs_count];
+
+	if(restore_arena_add(batch, name, name_length, &attr->name_offset) ||
+		restore_arena_add(batch, value, value_length,
+		&attr->value_offset))
+	{
+		return -1;
+	}
+
+	attr->value_length = value_length;
+	++batch->attrs_count;
+	++batch->nodes[batch->nodes_count - 1].attrs_count;
+
+	return 0;
+}
+
+/**
+ * Parse an attribute line "name=value" in place. A value in double quotes is
+ * unescaped, values starting with 0x or 0s are decoded from hex or base64
+ * (as written by getfattr(1) -e and getxattr -E) and other values are taken
+ * literally (after unescaping).
+ */
+static int restore_parse_attr(
+	char *line,
+	size_t line_length,
+	char **out_name,
+	size_t *out_name_length,
+	char **out_value,
+	size_t *out_value_length)
+{
+	char *eq = memchr(line, '=', line_length);
+	char *value;
+	size_t value_length;
+
+	if(!eq) {
+		/* A name on its own means an empty value. */
+		*out_name = line;
+		*out_name_length = dump_unescape(line, line_length);
+		*out_value = &line[line_length];
+		*out_value_length = 0;
+		return 0;
+	}
+
+	*out_name = line;
+	*out_name_length = dump_unescape(line, (size_t) (eq - line));
+
+	value = eq + 1;
+	value_length = line_length - (size_t) (value - line);
+	if(value_length && value[0] == '"') {
+		if(value_length < 2 || value[value_length - 1] != '"') {
+			return -1;
+		}
+
+		++value;
+		value_length -= 2;
+	}
+	else if(value_length >= 2 && value[0] == '0' &&
+		(value[1] == 'x' || value[1] == 'X' ||
+		value[1] == 's' || value[1] == 'S'))
+	{
+		const enum codec_encoding encoding =
+			(value[1] == 'x' || value[1] == 'X') ?
+			CODEC_ENCODING_HEX : CODEC_ENCODING_BASE64;
+		ssize_t decoded_length;
+
+		decoded_length = codec_decode(encoding, &value[2],
+			value_length - 2, value);
+		if(decoded_length < 0) {
+			return -1;
+		}
+
+		*out_value = value;
+		*out_value_length = (size_t) decoded_length;
+		return 0;
+	}
+
+	*out_value = value;
+	*out_value_length = dump_unescape(value, value_length);
+
+	return 0;
+}
+
+int restore_run(
+	const struct restore_options *options,
+	struct compress_reader *input,
+	const char *input_name)
+{
+	int ret = -1;
+	struct restore_state state;
+	struct restore_batch batch;
+	unsigned int threads;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t line_length;
+	unsigned long long line_number = 0;
+	unsigned long long offset = 0;
+	unsigned long long seq = 0;
+	int in_node = 0;
+
+	memset(&state, 0, sizeof(state));
+	memset(&batch, 0, sizeof(batch));
+	state.options = options;
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.fs_free, NULL);
+
+	threads = options->threads ? options->threads : pool_default_threads();
+	fslimit_init(&state.fslimit, threads);
+
+	state.groups = malloc((RESTORE_BATCH_NODES + 1) *
+		sizeof(state.groups[0]));
+	state.group_next = malloc((RESTORE_BATCH_NODES + 1) *
+		sizeof(state.group_next[0]));
+	if(!state.groups || !state.group_next) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto out;
+	}
+
+	while((line_length = compress_reader_getline(input, &line,
+		&line_size)) >= 0)
+	{
+		const unsigned long long line_offset = offset;
+		size_t length = (size_t) line_length;
+
+		++line_number;
+		offset += (unsigned long long) line_length;
+		if(line_offset < options->start_offset) {
+			/* Restored by an earlier run. The lines are read
+			 * rather than seeked over so that the input may be a
+			 * pipe and line numbers stay right. */
+			if(offset > options->start_offset) {
+				fprintf(stderr, "%s:%llu: Resume offset %llu "
+					"is not at the start of a line.\n",
+					input_name, line_number,
+					options->start_offset);
+				goto out;
+			}
+
+			continue;
+		}
+
+		if(length && line[length - 1] == '\n') {
+			line[--length] = '\0';
+		}
+
+		if(length >= 8 && !memcmp(line, "# file: ", 8)) {
+			size_t path_length;
+
+			if(batch.nodes_count >= RESTORE_BATCH_NODES ||
+				batch.arena_length >= RESTORE_BATCH_BYTES)
+			{
+				if(restore_batch_process(&state, &batch,
+					threads))
+				{
+					goto out;
+				}
+
+				restore_batch_reset(&batch);
+				if(options->batch_done &&
+					options->batch_done(options->arg,
+					line_offset, seq, state.errors))
+				{
+					goto out;
+				}
+			}
+
+			path_length = dump_unescape(&line[8], length - 8);
+			if(!path_length) {
+				fprintf(stderr, "%s:%llu: Empty path.\n",
+					input_name, line_number);
+				++state.errors;
+				in_node = 0;
+				continue;
+			}
+
+			if(restore_add_node(&batch, &line[8], path_length,
+				seq++))
+			{
+				fprintf(stderr, "Error while allocating "
+					"memory: %s (errno=%d)\n",
+					strerror(errno), errno);
+				goto out;
+			}
+
+			in_node = 1;
+		}
+		else if(!length || line[0] == '#') {
+			/* Empty line (end of node) or comment. */
+			if(!length) {
+				in_node = 0;
+			}
+		}
+		else if(!in_node) {
+			fprintf(stderr, "%s:%llu: Attribute outside of a "
+				"\"# file:\" section.\n",
+				input_name, line_number);
+			++state.errors;
+		}
+		else {
+			char *name;
+			size_t name_length;
+			char *value;
+			size_t value_length;
+
+			if(restore_parse_attr(line, length, &name, &name_length,
+				&value, &value_length))
+			{
+				fprintf(stderr, "%s:%llu: Malformed attribute "
+					"value.\n",
+					input_name, line_number);
+				++state.errors;
+				continue;
+			}
+
+			if(restore_add_attr(&batch, name, name_length, value,
+				value_length))
+			{
+				fprintf(stderr, "Error while allocating "
+					"memory: %s (errno=%d)\n",
+					strerror(errno), errno);
+				goto out;
+			}
+		}
+	}
+
+	if(errno) {
+		fprintf(stderr, "Error while reading \"%s\": %s (errno=%d)\n",
+			input_name, strerror(errno), errno);
+		goto out;
+	}
+
+	if(offset < options->start_offset) {
+		fprintf(stderr, "Error: \"%s\" ends before the resume offset "
+			"%llu.\n",
+			input_name, options->start_offset);
+		goto out;
+	}
+
+	if(restore_batch_process(&state, &batch, threads)) {
+		goto out;
+	}
+
+	if(options->batch_done && options->batch_done(options->arg, offset,
+		seq, state.errors))
+	{
+		goto out;
+	}
+
+	if(!state.errors) {
+		ret = 0;
+	}
+out:
+	if(line) {
+		free(line);
+	}
+
+	if(state.groups) {
+		free(state.groups);
+	}
+
+	if(state.group_next) {
+		free(state.group_next);
+	}
+
+	if(state.fs_queues) {
+		free(state.fs_queues);
+	}
+
+	restore_batch_free(&batch);
+	fslimit_destroy(&state.fslimit);
+	pthread_cond_destroy(&state.fs_free);
+	pthread_mutex_destroy(&state.lock);
+
+	return ret;
+}
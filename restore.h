@@ -0,0 +1,75 @@
+/*-
+ * restore.h - Bulk restore of extended attributes from a dump.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_RESTORE_H
+#define _XATTRPROGS_RESTORE_H
+
+#include <stddef.h>
+
+#include "compress.h"
+
+struct restore_options {
+	/* Number of worker threads, 0 means pick a default. */
+	unsigned int threads;
+
+	/* Called from the worker threads to set one attribute. Reports its
+	 * own errors and returns -1 on failure. */
+	int (*set)(
+		void *arg,
+		const char *path,
+		const char *name,
+		const char *value,
+		size_t value_length);
+
+	void *arg;
+
+	/* Offset in the input to resume at, as reported to batch_done by an
+	 * earlier run. Everything before it is skipped. */
+	unsigned long long start_offset;
+
+	/* Called between batches, when every node before @offset in the input
+	 * has been processed. @nodes and @errors count the nodes read and the
+	 * errors reported so far (not counting anything before start_offset).
+	 * Returns -1 to stop the restore. Optional. */
+	int (*batch_done)(
+		void *arg,
+		unsigned long long offset,
+		unsigned long long nodes,
+		unsigned long long errors);
+};
+
+/**
+ * Set the attributes described by the dump read from @input (see dump.h),
+ * which decompresses it on the fly if it's compressed (see compress.h).
+ *
+ * The input is processed in batches. Within a batch the nodes are grouped by
+ * their parent directory and, as far as the directory can be read, sorted by
+ * inode number within each group. The groups are then handed out to the
+ * worker threads, so that each worker stays within one directory for a while
+ * and the inodes are visited in on-disk order instead of in input order.
+ *
+ * Returns 0 if everything was restored, or -1 if any error was reported.
+ */
+int restore_run(
+	const struct restore_options *options,
+	struct compress_reader *input,
+	const char *input_name);
+
+#endif /* !defined(_XATTRPROGS_RESTORE_H) */
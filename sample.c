@@ -0,0 +1,1121 @@
+/*-
+ * sample.c - Estimating xattr statistics from a sample of a tree.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "dump.h"
+#include "outbuf.h"
+#include "pool.h"
+#include "sample.h"
+#include "scan.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+/* Value sizes are counted in buckets of powers of two: 0, 1, 2-3, 4-7 and so
+ * on, the last bucket holding everything from 64 KiB. */
+#define SAMPLE_BUCKETS 18
+
+/* Most distinct attribute names that are counted, and how many of the most
+ * common ones are printed. */
+#define SAMPLE_MAX_NAMES 65536
+#define SAMPLE_TOP_NAMES 20
+
+/* Most directory entries kept in the cache of the random descents. Further
+ * directories are read again every time a descent passes them. */
+#define SAMPLE_CACHE_ENTRIES (4 * 1024 * 1024)
+
+/* Two-sided 95% quantile of the normal distribution. */
+#define SAMPLE_Z95 1.96
+
+/* The estimated quantities. */
+enum {
+	SAMPLE_NODES,
+	SAMPLE_NODES_WITH_ATTRS,
+	SAMPLE_ATTRS,
+	SAMPLE_VALUE_BYTES,
+	SAMPLE_SIZES,
+	SAMPLE_STATS = SAMPLE_SIZES + SAMPLE_BUCKETS,
+};
+
+static const char *const sample_labels[SAMPLE_SIZES] = {
+	"nodes",
+	"nodes with attributes",
+	"attributes",
+	"value bytes",
+};
+
+/* Contributions of one sampling unit (a descent, or a node in rate mode) to
+ * the estimates. The variance of an estimate is computed from the squared
+ * contributions of the units, so a unit is collected separately before it's
+ * added to the totals. */
+struct sample_unit_name {
+	char *name;
+	double value;
+};
+
+struct sample_unit {
+	double values[SAMPLE_STATS];
+	struct sample_unit_name *names;
+	size_t names_count;
+	size_t names_capacity;
+};
+
+/* Sum and sum of squares of the contributions to the number of nodes that
+ * carry an attribute with this name. */
+struct sample_name {
+	char *name;
+	double sum;
+	double sumsq;
+};
+
+struct sample_entry {
+	char *name;
+	int is_dir;
+};
+
+struct sample_dir {
+	char *path;
+	struct sample_entry *entries;
+	size_t count;
+};
+
+struct sample_worker {
+	struct xattrio_buf list;
+	unsigned long long random;
+	struct sample_unit unit;
+	/* Rate mode: the exactly counted nodes. */
+	struct sample_unit exact;
+};
+
+struct sample {
+	const struct sample_options *options;
+	char *const *roots;
+	size_t roots_count;
+
+	/* Everything below is protected by lock. */
+	pthread_mutex_t lock;
+	double sum[SAMPLE_STATS];
+	double sumsq[SAMPLE_STATS];
+	unsigned long long units;
+	unsigned long long examined;
+	unsigned long long errors;
+
+	/* Open addressing hash table, the capacity is a power of two. */
+	struct sample_name *names;
+	size_t names_count;
+	size_t names_capacity;
+	int names_full;
+
+	/* Random descents. The next descent to make, and the directory cache
+	 * (open addressing hash table of pointers). */
+	unsigned long long next_probe;
+	struct sample_dir **cache;
+	size_t cache_count;
+	size_t cache_capacity;
+	size_t cache_entries;
+};
+
+static unsigned long long sample_hash(
+	const char *s)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	while(*s) {
+		hash ^= (unsigned char) *s++;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Next number of a xorshift64* generator.
+ */
+static unsigned long long sample_random(
+	unsigned long long *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return *state * 2685821657736338717ULL;
+}
+
+static void sample_seed(
+	unsigned long long *state,
+	unsigned int index)
+{
+	*state = ((unsigned long long) time(NULL) << 20) ^
+		((unsigned long long) getpid() << 40) ^
+		((unsigned long long) (index + 1) * 0x9E3779B97F4A7C15ULL);
+	if(!*state) {
+		*state = 1;
+	}
+}
+
+static double sample_uniform(
+	unsigned long long *state)
+{
+	return (double) (sample_random(state) >> 11) / 9007199254740992.0;
+}
+
+static unsigned int sample_bucket(
+	size_t size)
+{
+	unsigned int bucket = 0;
+
+	while(size && bucket < SAMPLE_BUCKETS - 1) {
+		size >>= 1;
+		++bucket;
+	}
+
+	return bucket;
+}
+
+static int sample_unit_add_name(
+	struct sample_unit *unit,
+	const char *name,
+	size_t name_length,
+	double value)
+{
+	size_t i;
+
+	/* A descent rarely passes more than a few names. */
+	for(i = 0; i < unit->names_count; ++i) {
+		if(!strncmp(unit->names[i].name, name, name_length) &&
+			!unit->names[i].name[name_length])
+		{
+			unit->names[i].value += value;
+			return 0;
+		}
+	}
+
+	if(unit->names_count == unit->names_capacity) {
+		const size_t new_capacity =
+			unit->names_capacity ? unit->names_capacity * 2 : 16;
+		struct sample_unit_name *new_names;
+
+		new_names = realloc(unit->names,
+			new_capacity * sizeof(new_names[0]));
+		if(!new_names) {
+			return -1;
+		}
+
+		unit->names = new_names;
+		unit->names_capacity = new_capacity;
+	}
+
+	unit->names[unit->names_count].name = strndup(name, name_length);
+	if(!unit->names[unit->names_count].name) {
+		return -1;
+	}
+
+	unit->names[unit->names_count++].value = value;
+
+	return 0;
+}
+
+static void sample_unit_free(
+	struct sample_unit *unit)
+{
+	size_t i;
+
+	for(i = 0; i < unit->names_count; ++i) {
+		free(unit->names[i].name);
+	}
+
+	free(unit->names);
+	memset(unit, 0, sizeof(*unit));
+}
+
+/**
+ * Find the slot of @name in the name table, or the free slot where it
+ * belongs. Called with the lock held.
+ */
+static struct sample_name* sample_name_slot(
+	struct sample_name *names,
+	size_t capacity,
+	const char *name)
+{
+	size_t i = (size_t) sample_hash(name) & (capacity - 1);
+
+	while(names[i].name && strcmp(names[i].name, name)) {
+		i = (i + 1) & (capacity - 1);
+	}
+
+	return &names[i];
+}
+
+/**
+ * Count @value for @name. Called with the lock held. Names beyond
+ * SAMPLE_MAX_NAMES, or that can't be stored, are left out.
+ */
+static void sample_add_name(
+	struct sample *sample,
+	char *name,
+	double value,
+	double factor)
+{
+	struct sample_name *slot;
+
+	if(sample->names_count * 2 >= sample->names_capacity) {
+		const size_t new_capacity = sample->names_capacity ?
+			sample->names_capacity * 2 : 1024;
+		struct sample_name *new_names;
+		size_t i;
+
+		new_names = calloc(new_capacity, sizeof(new_names[0]));
+		if(!new_names) {
+			sample->names_full = 1;
+			free(name);
+			return;
+		}
+
+		for(i = 0; i < sample->names_capacity; ++i) {
+			if(sample->names[i].name) {
+				*sample_name_slot(new_names, new_capacity,
+					sample->names[i].name) =
+					sample->names[i];
+			}
+		}
+
+		free(sample->names);
+		sample->names = new_names;
+		sample->names_capacity = new_capacity;
+	}
+
+	slot = sample_name_slot(sample->names, sample->names_capacity, name);
+	if(slot->name) {
+		free(name);
+	}
+	else if(sample->names_count >= SAMPLE_MAX_NAMES) {
+		sample->names_full = 1;
+		free(name);
+		return;
+	}
+	else {
+		slot->name = name;
+		++sample->names_count;
+	}
+
+	slot->sum += value;
+	slot->sumsq += factor * value * value;
+}
+
+/**
+ * Add the contributions collected in @unit to the totals and empty it. The
+ * squared contributions are scaled by @factor for the variance estimate.
+ */
+static void sample_fold(
+	struct sample *sample,
+	struct sample_unit *unit,
+	double factor)
+{
+	size_t i;
+
+	pthread_mutex_lock(&sample->lock);
+	for(i = 0; i < SAMPLE_STATS; ++i) {
+		sample->sum[i] += unit->values[i];
+		sample->sumsq[i] += factor * unit->values[i] * unit->values[i];
+		unit->values[i] = 0;
+	}
+
+	for(i = 0; i < unit->names_count; ++i) {
+		/* The table takes over the name. */
+		sample_add_name(sample, unit->names[i].name,
+			unit->names[i].value, factor);
+	}
+	unit->names_count = 0;
+	pthread_mutex_unlock(&sample->lock);
+}
+
+static void sample_error(
+	struct sample *sample)
+{
+	pthread_mutex_lock(&sample->lock);
+	++sample->errors;
+	pthread_mutex_unlock(&sample->lock);
+}
+
+/**
+ * List the attributes of the node at @path, query the size of each and add
+ * them to @unit with weight @weight.
+ */
+static int sample_examine(
+	struct sample *sample,
+	struct sample_worker *worker,
+	const char *path,
+	double weight,
+	struct sample_unit *unit)
+{
+	const struct sample_options *options = sample->options;
+	const char *ns_prefix = xattrio_namespace_prefix(options->namespace);
+	const size_t ns_prefix_length = strlen(ns_prefix);
+	ssize_t list_size;
+	size_t pos = 0;
+	const char *name;
+	size_t name_length;
+	int attrs = 0;
+	char *qualified = NULL;
+
+	pthread_mutex_lock(&sample->lock);
+	++sample->examined;
+	pthread_mutex_unlock(&sample->lock);
+
+	list_size = xattrio_list_buf(path, options->follow_links,
+		options->namespace, &worker->list);
+	if(list_size == -1) {
+		if(errno == ENOENT || errno == ENOTSUP) {
+			/* Gone, or no extended attributes here. */
+			return 0;
+		}
+
+		fprintf(stderr, "Error while getting extended attribute list "
+			"for path \"%s\": %s (errno=%d)\n",
+			path, strerror(errno), errno);
+		return -1;
+	}
+
+	while((name = xattrio_list_next(worker->list.data, (size_t) list_size,
+		&pos, options->name_prefix, &name_length)))
+	{
+		ssize_t value_size;
+		char *new_qualified;
+
+		value_size = xattrio_get(path, options->follow_links,
+			options->namespace, name, NULL, 0);
+		if(value_size == -1) {
+			if(errno == ENOATTR) {
+				/* Removed since we listed it. */
+				continue;
+			}
+
+			fprintf(stderr, "Error while getting extended "
+				"attribute size for path \"%s\" and attribute "
+				"name \"%s\": %s (errno=%d)\n",
+				path, name, strerror(errno), errno);
+			free(qualified);
+			return -1;
+		}
+
+		++attrs;
+		unit->values[SAMPLE_ATTRS] += weight;
+		unit->values[SAMPLE_VALUE_BYTES] +=
+			weight * (double) value_size;
+		unit->values[SAMPLE_SIZES +
+			sample_bucket((size_t) value_size)] += weight;
+
+		new_qualified = realloc(qualified,
+			ns_prefix_length + name_length + 1);
+		if(new_qualified) {
+			qualified = new_qualified;
+			memcpy(qualified, ns_prefix, ns_prefix_length);
+			memcpy(&qualified[ns_prefix_length], name, name_length);
+		}
+
+		if(!new_qualified || sample_unit_add_name(unit, qualified,
+			ns_prefix_length + name_length, weight))
+		{
+			fprintf(stderr, "Error while allocating memory: %s "
+				"(errno=%d)\n",
+				strerror(errno), errno);
+			free(qualified);
+			return -1;
+		}
+	}
+
+	if(attrs) {
+		unit->values[SAMPLE_NODES_WITH_ATTRS] += weight;
+	}
+
+	free(qualified);
+
+	return 0;
+}
+
+static void sample_dir_free(
+	struct sample_dir *dir)
+{
+	size_t i;
+
+	for(i = 0; i < dir->count; ++i) {
+		free(dir->entries[i].name);
+	}
+
+	free(dir->entries);
+	free(dir->path);
+	free(dir);
+}
+
+static struct sample_dir* sample_read_dir(
+	const char *path)
+{
+	struct sample_dir *dir;
+	DIR *dirp;
+	struct dirent *de;
+	size_t capacity = 0;
+	int err = 0;
+
+	dir = calloc(1, sizeof(*dir));
+	if(!dir || !(dir->path = strdup(path))) {
+		free(dir);
+		return NULL;
+	}
+
+	dirp = opendir(path);
+	if(!dirp) {
+		sample_dir_free(dir);
+		return NULL;
+	}
+
+	errno = 0;
+	while((de = readdir(dirp))) {
+		struct sample_entry *entry;
+		int is_dir = -1;
+
+		if(de->d_name[0] == '.' && (!de->d_name[1] ||
+			(de->d_name[1] == '.' && !de->d_name[2])))
+		{
+			errno = 0;
+			continue;
+		}
+
+#ifdef DT_UNKNOWN
+		if(de->d_type != DT_UNKNOWN) {
+			is_dir = (de->d_type == DT_DIR);
+		}
+#endif
+		if(is_dir == -1) {
+			struct stat stbuf;
+
+			if(fstatat(dirfd(dirp), de->d_name, &stbuf,
+				AT_SYMLINK_NOFOLLOW))
+			{
+				/* Gone since it was read. */
+				errno = 0;
+				continue;
+			}
+
+			is_dir = S_ISDIR(stbuf.st_mode);
+		}
+
+		if(dir->count == capacity) {
+			const size_t new_capacity =
+				capacity ? capacity * 2 : 64;
+			struct sample_entry *new_entries;
+
+			new_entries = realloc(dir->entries,
+				new_capacity * sizeof(new_entries[0]));
+			if(!new_entries) {
+				err = errno;
+				break;
+			}
+
+			dir->entries = new_entries;
+			capacity = new_capacity;
+		}
+
+		entry = &dir->entries[dir->count];
+		entry->name = strdup(de->d_name);
+		if(!entry->name) {
+			err = errno;
+			break;
+		}
+		entry->is_dir = is_dir;
+		++dir->count;
+		errno = 0;
+	}
+
+	if(!de && !err) {
+		err = errno;
+	}
+
+	closedir(dirp);
+	if(err) {
+		sample_dir_free(dir);
+		errno = err;
+		return NULL;
+	}
+
+	return dir;
+}
+
+/**
+ * Get the entries of directory @path from the cache, reading and caching it
+ * if it isn't there. If the cache is full, the directory is returned without
+ * being cached and *@out_cached is cleared (the caller frees it).
+ */
+static struct sample_dir* sample_get_dir(
+	struct sample *sample,
+	const char *path,
+	int *out_cached)
+{
+	struct sample_dir *dir;
+	size_t i;
+
+	pthread_mutex_lock(&sample->lock);
+	if(sample->cache_capacity) {
+		i = (size_t) sample_hash(path) & (sample->cache_capacity - 1);
+		while((dir = sample->cache[i])) {
+			if(!strcmp(dir->path, path)) {
+				pthread_mutex_unlock(&sample->lock);
+				*out_cached = 1;
+				return dir;
+			}
+
+			i = (i + 1) & (sample->cache_capacity - 1);
+		}
+	}
+	pthread_mutex_unlock(&sample->lock);
+
+	/* Read it without holding the lock. Another thread may do the same
+	 * meanwhile, the first one to finish gets it cached. */
+	dir = sample_read_dir(path);
+	if(!dir) {
+		return NULL;
+	}
+
+	*out_cached = 0;
+	pthread_mutex_lock(&sample->lock);
+	if(sample->cache_entries + dir->count > SAMPLE_CACHE_ENTRIES) {
+		goto out;
+	}
+
+	if(sample->cache_count * 2 >= sample->cache_capacity) {
+		const size_t new_capacity = sample->cache_capacity ?
+			sample->cache_capacity * 2 : 1024;
+		struct sample_dir **new_cache;
+
+		new_cache = calloc(new_capacity, sizeof(new_cache[0]));
+		if(!new_cache) {
+			goto out;
+		}
+
+		for(i = 0; i < sample->cache_capacity; ++i) {
+			size_t j;
+
+			if(!sample->cache[i]) {
+				continue;
+			}
+
+			j = (size_t) sample_hash(sample->cache[i]->path) &
+				(new_capacity - 1);
+			while(new_cache[j]) {
+				j = (j + 1) & (new_capacity - 1);
+			}
+			new_cache[j] = sample->cache[i];
+		}
+
+		free(sample->cache);
+		sample->cache = new_cache;
+		sample->cache_capacity = new_capacity;
+	}
+
+	i = (size_t) sample_hash(path) & (sample->cache_capacity - 1);
+	while(sample->cache[i]) {
+		if(!strcmp(sample->cache[i]->path, path)) {
+			/* Cached by another thread meanwhile. */
+			sample_dir_free(dir);
+			dir = sample->cache[i];
+			*out_cached = 1;
+			goto out;
+		}
+
+		i = (i + 1) & (sample->cache_capacity - 1);
+	}
+
+	sample->cache[i] = dir;
+	++sample->cache_count;
+	sample->cache_entries += dir->count;
+	*out_cached = 1;
+out:
+	pthread_mutex_unlock(&sample->lock);
+
+	return dir;
+}
+
+/**
+ * Make one random descent from a random root, examining every node on the
+ * way. The contributions are collected in the worker's unit.
+ */
+static int sample_probe(
+	struct sample *sample,
+	struct sample_worker *worker)
+{
+	const size_t root = (size_t) (sample_random(&worker->random) %
+		sample->roots_count);
+	/* The roots are treated like the entries of one more directory. */
+	double weight = (double) sample->roots_count;
+	struct stat stbuf;
+	char *path;
+	int is_dir;
+	int res = 0;
+
+	if(lstat(sample->roots[root], &stbuf)) {
+		fprintf(stderr, "Error while getting status of \"%s\": %s "
+			"(errno=%d)\n",
+			sample->roots[root], strerror(errno), errno);
+		return -1;
+	}
+
+	is_dir = S_ISDIR(stbuf.st_mode);
+	path = strdup(sample->roots[root]);
+
+	while(path) {
+		struct sample_dir *dir;
+		const struct sample_entry *entry;
+		size_t path_length;
+		size_t name_length;
+		char *child;
+		int cached;
+
+		worker->unit.values[SAMPLE_NODES] += weight;
+		if(sample_examine(sample, worker, path, weight,
+			&worker->unit))
+		{
+			res = -1;
+		}
+
+		if(!is_dir) {
+			break;
+		}
+
+		dir = sample_get_dir(sample, path, &cached);
+		if(!dir) {
+			if(errno != ENOENT) {
+				fprintf(stderr, "Error while reading "
+					"directory \"%s\": %s (errno=%d)\n",
+					path, strerror(errno), errno);
+				res = -1;
+			}
+
+			break;
+		}
+		else if(!dir->count) {
+			if(!cached) {
+				sample_dir_free(dir);
+			}
+
+			break;
+		}
+
+		entry = &dir->entries[sample_random(&worker->random) %
+			dir->count];
+		weight *= (double) dir->count;
+		is_dir = entry->is_dir;
+
+		path_length = strlen(path);
+		name_length = strlen(entry->name);
+		child = malloc(path_length + name_length + 2);
+		if(child) {
+			memcpy(child, path, path_length);
+			child[path_length] = '/';
+			memcpy(&child[path_length + 1], entry->name,
+				name_length + 1);
+		}
+
+		if(!cached) {
+			sample_dir_free(dir);
+		}
+
+		free(path);
+		path = child;
+	}
+
+	if(!path) {
+		fprintf(stderr, "Error while allocating path: %s (errno=%d)\n",
+			strerror(errno), errno);
+		res = -1;
+	}
+
+	free(path);
+
+	return res;
+}
+
+static void sample_descent_worker(
+	unsigned int index,
+	void *arg)
+{
+	struct sample *sample = arg;
+	struct sample_worker worker;
+
+	memset(&worker, 0, sizeof(worker));
+	sample_seed(&worker.random, index);
+
+	while(1) {
+		pthread_mutex_lock(&sample->lock);
+		if(sample->next_probe >= sample->options->probes) {
+			pthread_mutex_unlock(&sample->lock);
+			break;
+		}
+		++sample->next_probe;
+		pthread_mutex_unlock(&sample->lock);
+
+		if(sample_probe(sample, &worker)) {
+			sample_error(sample);
+		}
+
+		/* Every descent is one observation of the totals. */
+		sample_fold(sample, &worker.unit, 1.0);
+		pthread_mutex_lock(&sample->lock);
+		++sample->units;
+		pthread_mutex_unlock(&sample->lock);
+	}
+
+	sample_unit_free(&worker.unit);
+	xattrio_buf_free(&worker.list);
+}
+
+static int sample_scan_worker_init(
+	struct scan_worker *scan_worker,
+	void *arg)
+{
+	struct sample_worker *worker;
+
+	(void) arg;
+
+	worker = calloc(1, sizeof(*worker));
+	if(!worker) {
+		fprintf(stderr, "Error while allocating worker state: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		return -1;
+	}
+
+	sample_seed(&worker->random, scan_worker->index);
+	scan_worker->priv = worker;
+
+	return 0;
+}
+
+static void sample_scan_worker_fini(
+	struct scan_worker *scan_worker,
+	void *arg)
+{
+	struct sample *sample = arg;
+	struct sample_worker *worker = scan_worker->priv;
+
+	/* Counted, not estimated, so it adds nothing to the variance. */
+	sample_fold(sample, &worker->exact, 0);
+
+	sample_unit_free(&worker->unit);
+	sample_unit_free(&worker->exact);
+	xattrio_buf_free(&worker->list);
+	free(worker);
+	scan_worker->priv = NULL;
+}
+
+static int sample_scan_visit(
+	struct scan_worker *scan_worker,
+	const char *path,
+	enum scan_type type,
+	void *arg)
+{
+	struct sample *sample = arg;
+	struct sample_worker *worker = scan_worker->priv;
+	const double rate = sample->options->rate;
+	int res;
+
+	(void) type;
+
+	worker->exact.values[SAMPLE_NODES] += 1;
+	if(sample_uniform(&worker->random) >= rate) {
+		return 0;
+	}
+
+	/* Poisson sampling: each node is an observation of its own, and the
+	 * variance of its contribution y / rate is (1 - rate) y^2 / rate^2. */
+	res = sample_examine(sample, worker, path, 1 / rate, &worker->unit);
+	sample_fold(sample, &worker->unit, 1 - rate);
+
+	return res;
+}
+
+/**
+ * Format an estimate and its 95% confidence interval from the sum and sum of
+ * squares of the contributions.
+ */
+static void sample_put_estimate(
+	struct outbuf *out,
+	const struct sample *sample,
+	const char *label,
+	double sum,
+	double sumsq)
+{
+	char line[512];
+	double estimate = sum;
+	double variance = sumsq;
+	const double n = (double) sample->units;
+
+	if(sample->options->probes) {
+		/* The mean of independent descents. */
+		estimate = n ? sum / n : 0;
+		variance = (n > 1) ? (sumsq - sum * sum / n) / (n * (n - 1)) :
+			0;
+	}
+
+	if(variance < 0) {
+		/* Rounding. */
+		variance = 0;
+	}
+
+	snprintf(line, sizeof(line), "  %-30s %15.0f +/- %.0f\n", label,
+		estimate, SAMPLE_Z95 * sqrt(variance));
+	outbuf_puts(out, line);
+}
+
+static int sample_compare_names(
+	const void *a,
+	const void *b)
+{
+	const struct sample_name *name_a =
+		*(const struct sample_name *const*) a;
+	const struct sample_name *name_b =
+		*(const struct sample_name *const*) b;
+
+	if(name_a->sum != name_b->sum) {
+		return (name_a->sum < name_b->sum) ? 1 : -1;
+	}
+
+	return strcmp(name_a->name, name_b->name);
+}
+
+static int sample_report(
+	const struct sample *sample)
+{
+	struct outbuf out;
+	struct sample_name **top = NULL;
+	char line[256];
+	size_t count = 0;
+	size_t i;
+	int ret = 0;
+
+	memset(&out, 0, sizeof(out));
+
+	if(sample->options->probes) {
+		snprintf(line, sizeof(line), "# %llu random descents, %llu "
+			"nodes examined\n", sample->units, sample->examined);
+	}
+	else {
+		snprintf(line, sizeof(line), "# %g%% sample, %llu nodes "
+			"examined\n", sample->options->rate * 100,
+			sample->examined);
+	}
+	outbuf_puts(&out, line);
+	outbuf_puts(&out, "# estimates with 95% confidence intervals\n");
+
+	for(i = 0; i < SAMPLE_SIZES; ++i) {
+		sample_put_estimate(&out, sample, sample_labels[i],
+			sample->sum[i], sample->sumsq[i]);
+	}
+
+	outbuf_puts(&out, "value sizes:\n");
+	for(i = 0; i < SAMPLE_BUCKETS; ++i) {
+		const size_t low = i ? (size_t) 1 << (i - 1) : 0;
+		const size_t high = i ? ((size_t) 1 << i) - 1 : 0;
+
+		if(i == SAMPLE_BUCKETS - 1) {
+			snprintf(line, sizeof(line), "%zu-", low);
+		}
+		else if(low == high) {
+			snprintf(line, sizeof(line), "%zu", low);
+		}
+		else {
+			snprintf(line, sizeof(line), "%zu-%zu", low, high);
+		}
+
+		sample_put_estimate(&out, sample, line,
+			sample->sum[SAMPLE_SIZES + i],
+			sample->sumsq[SAMPLE_SIZES + i]);
+	}
+
+	if(sample->names_count) {
+		top = malloc(sample->names_count * sizeof(top[0]));
+		if(!top) {
+			out.failed = errno;
+		}
+	}
+
+	for(i = 0; top && i < sample->names_capacity; ++i) {
+		if(sample->names[i].name) {
+			top[count++] = &sample->names[i];
+		}
+	}
+
+	if(top) {
+		qsort(top, count, sizeof(top[0]), sample_compare_names);
+	}
+
+	outbuf_puts(&out, sample->names_full ?
+		"most common names (nodes), not all names were counted:\n" :
+		"most common names (nodes):\n");
+	for(i = 0; i < count && i < SAMPLE_TOP_NAMES; ++i) {
+		struct outbuf name;
+
+		/* Names are escaped like in dumps and cut to fit. */
+		memset(&name, 0, sizeof(name));
+		dump_put_escaped(&name, top[i]->name, strlen(top[i]->name));
+		outbuf_putc(&name, '\0');
+		sample_put_estimate(&out, sample,
+			name.failed ? "?" : name.data, top[i]->sum,
+			top[i]->sumsq);
+		outbuf_free(&name);
+	}
+
+	if(outbuf_flush(&out, stdout)) {
+		fprintf(stderr, "Error while writing to standard output: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		ret = -1;
+	}
+
+	free(top);
+	outbuf_free(&out);
+
+	return ret;
+}
+
+int sample_run(
+	const struct sample_options *options,
+	char *const *roots,
+	size_t roots_count)
+{
+	struct sample sample;
+	size_t i;
+	int ret = -1;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.options = options;
+	sample.roots = roots;
+	sample.roots_count = roots_count;
+	pthread_mutex_init(&sample.lock, NULL);
+
+	if(options->probes) {
+		unsigned int threads = options->threads ? options->threads :
+			pool_default_threads();
+
+		if(threads > options->probes) {
+			threads = (unsigned int) options->probes;
+		}
+
+		if(pool_run(threads, sample_descent_worker, &sample)) {
+			goto out;
+		}
+	}
+	else {
+		struct scan_options scan_options;
+
+		memset(&scan_options, 0, sizeof(scan_options));
+		scan_options.threads = options->threads;
+		scan_options.worker_init = sample_scan_worker_init;
+		scan_options.worker_fini = sample_scan_worker_fini;
+		scan_options.visit = sample_scan_visit;
+		scan_options.arg = &sample;
+
+		/* Nodes that failed are reported and counted by the scan. */
+		if(scan_run(&scan_options, roots, roots_count)) {
+			++sample.errors;
+		}
+	}
+
+	if(sample_report(&sample) || sample.errors) {
+		goto out;
+	}
+
+	ret = 0;
+out:
+	for(i = 0; i < sample.names_capacity; ++i) {
+		free(sample.names[i].name);
+	}
+	free(sample.names);
+
+	for(i = 0; i < sample.cache_capacity; ++i) {
+		if(sample.cache[i]) {
+			sample_dir_free(sample.cache[i]);
+		}
+	}
+	free(sample.cache);
+
+	pthread_mutex_destroy(&sample.lock);
+
+	return ret;
+}
+
+int sample_parse(
+	const char *s,
+	unsigned long long *out_probes,
+	double *out_rate)
+{
+	char *end = NULL;
+
+	if(*s < '0' || *s > '9') {
+		return -1;
+	}
+
+	errno = 0;
+	if(strchr(s, '.') || strchr(s, '%')) {
+		double rate = strtod(s, &end);
+
+		if(*end == '%' && !end[1]) {
+			rate /= 100;
+		}
+		else if(*end) {
+			return -1;
+		}
+
+		if(errno || !(rate > 0 && rate <= 1)) {
+			return -1;
+		}
+
+		*out_probes = 0;
+		*out_rate = rate;
+	}
+	else {
+		const unsigned long long probes = strtoull(s, &end, 10);
+
+		if(errno || *end || !probes) {
+			return -1;
+		}
+
+		*out_probes = probes;
+		*out_rate = 0;
+	}
+
+	return 0;
+}
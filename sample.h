@@ -0,0 +1,82 @@
+/*-
+ * sample.h - Estimating xattr statistics from a sample of a tree.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_SAMPLE_H
+#define _XATTRPROGS_SAMPLE_H
+
+#include <stddef.h>
+
+#include "xattrio.h"
+
+struct sample_options {
+	/* Either the number of random descents to make, or (if @probes is 0)
+	 * the probability with which each node of a full traversal is
+	 * examined. */
+	unsigned long long probes;
+	double rate;
+
+	/* Number of worker threads, 0 means pick a default. */
+	unsigned int threads;
+
+	int follow_links;
+	int namespace;
+
+	/* Only count attributes whose name starts with this prefix.
+	 * Optional. */
+	const struct xattrio_prefix *name_prefix;
+};
+
+/**
+ * Estimate how many nodes the trees rooted at @roots have, how many of them
+ * carry extended attributes, the number and value sizes of the attributes
+ * and the most common names, by examining only a sample of the nodes, and
+ * print the estimates with 95% confidence intervals to standard output.
+ *
+ * With @options->probes, that many random descents are made from the roots:
+ * each one picks a uniformly random entry at every level until it reaches a
+ * leaf, and every node on the way is weighted with the product of the
+ * directory sizes above it (Knuth's estimator), which is unbiased. The
+ * directories read are cached across descents. Only the directories on the
+ * paths are read, so the cost doesn't depend on the size of the tree.
+ *
+ * With @options->rate, all directories are read (see scan.h) but only a
+ * random fraction of the nodes is examined, each with probability rate, and
+ * weighted with 1/rate. The node count is then exact.
+ *
+ * Values are never read, their sizes are queried.
+ *
+ * Returns 0 on success, or -1 if an error was reported.
+ */
+int sample_run(
+	const struct sample_options *options,
+	char *const *roots,
+	size_t roots_count);
+
+/**
+ * Parse the argument of --sample: a count of descents (a plain integer), or a
+ * rate given as a fraction with a decimal point or a percentage (0.01, 1%).
+ * Returns 0 on success, -1 if @s is not valid.
+ */
+int sample_parse(
+	const char *s,
+	unsigned long long *out_probes,
+	double *out_rate);
+
+#endif /* !defined(_XATTRPROGS_SAMPLE_H) */
@@ -0,0 +1,1666 @@
+/*-
+ * scan.c - Parallel filesystem tree scanning.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "bufpool.h"
+#include "checkpoint.h"
+#include "compress.h"
+#include "fslimit.h"
+#include "pool.h"
+#include "scan.h"
+#include "shard.h"
+
+/* Number of nodes that the directory reader may run ahead of the workers. */
+#define SCAN_QUEUE_SIZE 4096
+
+/* Number of queued nodes that a worker looks through for one on a
+ * filesystem that isn't busy before it waits. */
+#define SCAN_PICK_WINDOW 256
+
+/* Workers write their output to stdout when this much has been collected. */
+#define SCAN_OUTPUT_CHUNK (64 * 1024)
+
+/* Number of nodes that may be visited ahead of the oldest unfinished node in
+ * sorted mode, i.e. the number of node outputs that may be held back. */
+#define SCAN_REORDER_SIZE 1024
+
+/* Number of directories that may be waiting to be prefetched. When there are
+ * more, the ones that the directory reader will get to last are dropped. */
+#define SCAN_PREFETCH_SIZE 256
+
+#if defined(__linux__) && defined(SYS_getdents64)
+#define SCAN_HAVE_GETDENTS64 1
+
+/* Size of the buffer that directory entries are read into, enough for a few
+ * thousand entries per system call. */
+#define SCAN_DIRBUF_SIZE (256 * 1024)
+
+/* Layout of the records returned by getdents64(2). */
+struct scan_linux_dirent64 {
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+#endif /* defined(__linux__) && defined(SYS_getdents64) */
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* Worker buffers that have grown larger than this for an unusually large
+ * node are released afterwards instead of being kept for the next node. */
+#define SCAN_BUFFER_KEEP (1024 * 1024)
+
+struct scan_item {
+	char *path;
+	enum scan_type type;
+	unsigned long long seq;
+	size_t root;
+	/* Index of the node's filesystem in the scan's fslimit. */
+	size_t fs;
+};
+
+struct scan_dirent {
+	char *name;
+	enum scan_type type;
+};
+
+/* In sorted mode a directory is walked as a list of events, one for each
+ * entry and one more for the subtree of each subdirectory. */
+struct scan_event {
+	const struct scan_dirent *entry;
+	int subtree;
+};
+
+/* Directory waiting to be prefetched, with the filesystem of its root for
+ * one_filesystem. */
+struct scan_prefetch {
+	char *path;
+	dev_t dev;
+};
+
+/* Output of a node that finished before the nodes preceding it. */
+struct scan_slot {
+	char *data;
+	size_t len;
+	size_t capacity;
+	int done;
+
+	/* Checkpoint mode: path of the node and index of its root. */
+	char *path;
+	size_t root;
+};
+
+struct scan {
+	const struct scan_options *options;
+
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	struct scan_item queue[SCAN_QUEUE_SIZE];
+	size_t queue_head;
+	size_t queue_count;
+	int done;
+	int aborted;
+	unsigned long long next_seq;
+
+	/* Concurrency limits of the filesystems seen so far, protected by
+	 * lock. Workers skip queued nodes on filesystems that are at their
+	 * limit. */
+	struct fslimit fslimit;
+
+	/* Sorted mode. Node outputs are collected in @emit in enumeration
+	 * order, and @emit is swapped with @emit_spare to be written out. All
+	 * protected by lock, except @emit_spare which is protected by
+	 * output_lock. Held back outputs are stored in buffers from @pool,
+	 * and workers stop taking new nodes while the pool is over budget. */
+	struct bufpool pool;
+	struct scan_slot reorder[SCAN_REORDER_SIZE];
+	unsigned long long next_emit;
+	struct outbuf emit;
+	struct outbuf emit_spare;
+
+	/* Checkpoint mode. The last node collected in @emit and the number
+	 * of nodes emitted, protected by lock. The checkpoint itself is
+	 * protected by output_lock. */
+	char *emit_path;
+	size_t emit_root;
+	unsigned long long emitted;
+	time_t checkpoint_at;
+	unsigned long long resumed_done;
+	unsigned long long resumed_errors;
+
+	/* Used by the directory reader only. The root that is being walked
+	 * and, when resuming, the last node that was finished before. Nodes
+	 * up to and including it are skipped. */
+	size_t walk_root;
+	const char *resume_path;
+	/* The filesystem of the root being walked, for one_filesystem, and
+	 * the filesystem that was last looked up in fslimit. */
+	dev_t walk_dev;
+	dev_t last_dev;
+	size_t last_fs;
+#ifdef SCAN_HAVE_GETDENTS64
+	char *dirbuf;
+#endif
+
+	/* Prefetching, with prefetch_running threads (0 when it's off or none
+	 * could be started). The subdirectories that the directory reader will
+	 * read next, as a stack with the one it will get to first on top.
+	 * Protected by prefetch_lock. */
+	unsigned int prefetch_running;
+	pthread_mutex_t prefetch_lock;
+	pthread_cond_t prefetch_ready;
+	struct scan_prefetch prefetch[SCAN_PREFETCH_SIZE];
+	size_t prefetch_bottom;
+	size_t prefetch_count;
+	int prefetch_done;
+
+	pthread_mutex_t output_lock;
+
+	/* Sharded output, with options->shards files. */
+	struct shard_output shards;
+
+	/* Protected by lock. */
+	unsigned long long errors;
+};
+
+static enum scan_type scan_type_from_mode(
+	mode_t mode)
+{
+	if(S_ISREG(mode)) {
+		return SCAN_TYPE_REG;
+	}
+	else if(S_ISDIR(mode)) {
+		return SCAN_TYPE_DIR;
+	}
+	else if(S_ISLNK(mode)) {
+		return SCAN_TYPE_LNK;
+	}
+
+	return SCAN_TYPE_OTHER;
+}
+
+#ifdef DT_UNKNOWN
+static enum scan_type scan_type_from_dirent(
+	unsigned char d_type)
+{
+	switch(d_type) {
+	case DT_REG:
+		return SCAN_TYPE_REG;
+	case DT_DIR:
+		return SCAN_TYPE_DIR;
+	case DT_LNK:
+		return SCAN_TYPE_LNK;
+	case DT_UNKNOWN:
+		return SCAN_TYPE_UNKNOWN;
+	default:
+		return SCAN_TYPE_OTHER;
+	}
+}
+#endif /* defined(DT_UNKNOWN) */
+
+static void scan_error(
+	struct scan *scan)
+{
+	pthread_mutex_lock(&scan->lock);
+	++scan->errors;
+	pthread_mutex_unlock(&scan->lock);
+}
+
+static char* scan_join_path(
+	const char *dir,
+	const char *name)
+{
+	const size_t dir_len = strlen(dir);
+	const size_t name_len = strlen(name);
+	const int need_slash = dir_len && dir[dir_len - 1] != '/';
+	char *path;
+
+	path = malloc(dir_len + need_slash + name_len + 1);
+	if(!path) {
+		return NULL;
+	}
+
+	memcpy(path, dir, dir_len);
+	if(need_slash) {
+		path[dir_len] = '/';
+	}
+	memcpy(&path[dir_len + need_slash], name, name_len + 1);
+
+	return path;
+}
+
+/**
+ * Find the index of filesystem @dev in the scan's fslimit, adding it if it's
+ * new. @fd is an open file on it, or -1 to use @path. Only called from the
+ * directory reader.
+ */
+static int scan_lookup_fs(
+	struct scan *scan,
+	int fd,
+	const char *path,
+	dev_t dev,
+	size_t *out_fs)
+{
+	int remote;
+	int res;
+
+	if(scan->fslimit.count && dev == scan->last_dev) {
+		*out_fs = scan->last_fs;
+		return 0;
+	}
+
+	pthread_mutex_lock(&scan->lock);
+	res = fslimit_find(&scan->fslimit, dev, out_fs);
+	pthread_mutex_unlock(&scan->lock);
+	if(res) {
+		/* New filesystem, find out what kind it is without holding
+		 * the lock. */
+		remote = fslimit_is_remote(fd, path);
+
+		pthread_mutex_lock(&scan->lock);
+		res = fslimit_add(&scan->fslimit, dev, remote, out_fs);
+		pthread_mutex_unlock(&scan->lock);
+		if(res) {
+			return -1;
+		}
+	}
+
+	scan->last_dev = dev;
+	scan->last_fs = *out_fs;
+
+	return 0;
+}
+
+/**
+ * Hand a node on filesystem @fs over to the workers. Ownership of @path is
+ * transferred to the queue. Blocks while the queue is full.
+ */
+static int scan_enqueue(
+	struct scan *scan,
+	char *path,
+	enum scan_type type,
+	size_t fs)
+{
+	pthread_mutex_lock(&scan->lock);
+	while(scan->queue_count == SCAN_QUEUE_SIZE && !scan->aborted) {
+		pthread_cond_wait(&scan->not_full, &scan->lock);
+	}
+
+	if(scan->aborted) {
+		pthread_mutex_unlock(&scan->lock);
+		free(path);
+		return -1;
+	}
+
+	scan->queue[(scan->queue_head + scan->queue_count) % SCAN_QUEUE_SIZE] =
+		(struct scan_item) { path, type, scan->next_seq++,
+			scan->walk_root, fs };
+	++scan->queue_count;
+	pthread_cond_signal(&scan->not_empty);
+	pthread_mutex_unlock(&scan->lock);
+
+	return 0;
+}
+
+/**
+ * Find a node in the queue that a worker may take now, looking at the first
+ * SCAN_PICK_WINDOW nodes. Nodes on filesystems that are at their concurrency
+ * limit are passed over, so that a slow filesystem doesn't keep the workers
+ * from the nodes on other filesystems. Called with the lock held.
+ *
+ * Returns 1 and the position of the node relative to the head of the queue
+ * in @out_pos, or 0 if the worker has to wait.
+ */
+static int scan_pick(
+	struct scan *scan,
+	size_t *out_pos)
+{
+	size_t i;
+
+	for(i = 0; i < scan->queue_count && i < SCAN_PICK_WINDOW; ++i) {
+		const struct scan_item *item =
+			&scan->queue[(scan->queue_head + i) % SCAN_QUEUE_SIZE];
+
+		/* In sorted mode, don't run further ahead of the oldest
+		 * unfinished node than the reorder buffer can hold, or than
+		 * the memory budget allows. The oldest node itself never has
+		 * to be held back. Sequence numbers grow along the queue, so
+		 * no node after this one qualifies either. */
+		if(scan->options->sorted && item->seq != scan->next_emit &&
+			(item->seq >= scan->next_emit + SCAN_REORDER_SIZE ||
+			bufpool_over_budget(&scan->pool)))
+		{
+			break;
+		}
+
+		if(fslimit_may_start(&scan->fslimit, item->fs)) {
+			*out_pos = i;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int scan_dequeue(
+	struct scan *scan,
+	struct scan_item *item)
+{
+	size_t pos;
+
+	pthread_mutex_lock(&scan->lock);
+	while(1) {
+		if(scan->aborted || (!scan->queue_count && scan->done)) {
+			pthread_mutex_unlock(&scan->lock);
+			return -1;
+		}
+		else if(scan_pick(scan, &pos)) {
+			break;
+		}
+
+		pthread_cond_wait(&scan->not_empty, &scan->lock);
+	}
+
+	/* Close the gap left by the node, keeping the others in order. */
+	*item = scan->queue[(scan->queue_head + pos) % SCAN_QUEUE_SIZE];
+	for(; pos; --pos) {
+		scan->queue[(scan->queue_head + pos) % SCAN_QUEUE_SIZE] =
+			scan->queue[(scan->queue_head + pos - 1) %
+			SCAN_QUEUE_SIZE];
+	}
+
+	scan->queue_head = (scan->queue_head + 1) % SCAN_QUEUE_SIZE;
+	--scan->queue_count;
+	fslimit_start(&scan->fslimit, item->fs);
+	pthread_cond_signal(&scan->not_full);
+	pthread_mutex_unlock(&scan->lock);
+
+	return 0;
+}
+
+/**
+ * Account for the visit of @item, which made @calls xattr calls in @seconds,
+ * in the limit of its filesystem. A visit that made no calls still counts as
+ * one, it looked at the node in some other way.
+ */
+static void scan_finish_fs(
+	struct scan *scan,
+	const struct scan_item *item,
+	unsigned long long calls,
+	double seconds)
+{
+	pthread_mutex_lock(&scan->lock);
+	if(fslimit_finish(&scan->fslimit, item->fs,
+		calls ? (unsigned int) calls : 1, seconds))
+	{
+		/* Workers may be waiting for a node on this filesystem. */
+		pthread_cond_broadcast(&scan->not_empty);
+	}
+	pthread_mutex_unlock(&scan->lock);
+}
+
+static void scan_free_dirents(
+	struct scan_dirent *entries,
+	size_t count)
+{
+	size_t i;
+
+	for(i = 0; i < count; ++i) {
+		free(entries[i].name);
+	}
+
+	free(entries);
+}
+
+static int scan_is_dot(
+	const char *name)
+{
+	return name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]));
+}
+
+static int scan_add_dirent(
+	struct scan_dirent **entries,
+	size_t *count,
+	size_t *capacity,
+	const char *name,
+	enum scan_type type)
+{
+	if(scan_is_dot(name)) {
+		/* Ignore "." / "..". */
+		return 0;
+	}
+
+	if(*count == *capacity) {
+		const size_t new_capacity = *capacity ? *capacity * 2 : 64;
+		struct scan_dirent *new_entries;
+
+		new_entries = realloc(*entries,
+			new_capacity * sizeof((*entries)[0]));
+		if(!new_entries) {
+			return -1;
+		}
+
+		*entries = new_entries;
+		*capacity = new_capacity;
+	}
+
+	(*entries)[*count].name = strdup(name);
+	if(!(*entries)[*count].name) {
+		return -1;
+	}
+
+	(*entries)[*count].type = type;
+	++*count;
+
+	return 0;
+}
+
+/**
+ * Find the type of an entry whose type the directory didn't report, with the
+ * cheapest status call available (statx(2) asking for nothing but the type).
+ */
+static int scan_stat_type(
+	int dirfd,
+	const char *name,
+	enum scan_type *out_type)
+{
+#ifdef HAVE_STATX
+	struct statx stx;
+
+	if(statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+		STATX_TYPE, &stx))
+	{
+		return -1;
+	}
+
+	*out_type = scan_type_from_mode(stx.stx_mode);
+#else
+	struct stat stbuf;
+
+	if(fstatat(dirfd, name, &stbuf, AT_SYMLINK_NOFOLLOW)) {
+		return -1;
+	}
+
+	*out_type = scan_type_from_mode(stbuf.st_mode);
+#endif
+
+	return 0;
+}
+
+/**
+ * Read all entries of the directory @path. The directory is closed before we
+ * descend into any subdirectory so that deep trees don't exhaust the file
+ * descriptor table.
+ *
+ * On Linux the entries are read with getdents64(2) into a large buffer, and
+ * the types that it reports are trusted, so that no status calls are needed
+ * at all on filesystems that fill in d_type. Entries filtered out by the
+ * options are dropped here, and a directory on another filesystem than the
+ * root is returned empty with one_filesystem. The filesystem of the
+ * directory is returned in @out_fs.
+ */
+static int scan_read_dir(
+	struct scan *scan,
+	const char *path,
+	struct scan_dirent **out_entries,
+	size_t *out_count,
+	size_t *out_fs)
+{
+	const struct scan_options *options = scan->options;
+	struct stat stbuf;
+	int fd;
+#ifndef SCAN_HAVE_GETDENTS64
+	DIR *dirp;
+	struct dirent *de;
+#endif
+	struct scan_dirent *entries = NULL;
+	size_t count = 0;
+	size_t capacity = 0;
+	size_t i;
+	size_t kept;
+	int err = 0;
+
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1) {
+		return -1;
+	}
+
+	if(fstat(fd, &stbuf) ||
+		scan_lookup_fs(scan, fd, path, stbuf.st_dev, out_fs))
+	{
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	else if(options->one_filesystem && stbuf.st_dev != scan->walk_dev) {
+		/* The node itself is listed, but not what's mounted on it. */
+		close(fd);
+		*out_entries = NULL;
+		*out_count = 0;
+		return 0;
+	}
+
+#ifdef SCAN_HAVE_GETDENTS64
+	while(!err) {
+		long nread;
+		long pos;
+
+		nread = syscall(SYS_getdents64, fd, scan->dirbuf,
+			SCAN_DIRBUF_SIZE);
+		if(nread <= 0) {
+			if(nread < 0) {
+				err = errno;
+			}
+
+			break;
+		}
+
+		for(pos = 0; pos < nread && !err;) {
+			const struct scan_linux_dirent64 *d =
+				(const void*) &scan->dirbuf[pos];
+
+			if(scan_add_dirent(&entries, &count, &capacity,
+				d->d_name, scan_type_from_dirent(d->d_type)))
+			{
+				err = errno;
+			}
+
+			pos += d->d_reclen;
+		}
+	}
+#else
+	dirp = fdopendir(fd);
+	if(!dirp) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	errno = 0;
+	while((de = readdir(dirp))) {
+		if(scan_add_dirent(&entries, &count, &capacity, de->d_name,
+#ifdef DT_UNKNOWN
+			scan_type_from_dirent(de->d_type)
+#else
+			SCAN_TYPE_UNKNOWN
+#endif
+			))
+		{
+			err = errno;
+			break;
+		}
+
+		errno = 0;
+	}
+
+	if(!de && !err) {
+		err = errno;
+	}
+
+	/* The descriptor now belongs to the DIR, keep it open until the
+	 * types have been resolved below. */
+	fd = dirfd(dirp);
+#endif
+
+	/* Resolve the types that weren't reported and drop what the options
+	 * exclude. */
+	for(i = 0, kept = 0; i < count && !err; ++i) {
+		struct scan_dirent *entry = &entries[i];
+
+		if(entry->type == SCAN_TYPE_UNKNOWN &&
+			scan_stat_type(fd, entry->name, &entry->type))
+		{
+			if(errno != ENOENT) {
+				fprintf(stderr, "Error while getting status "
+					"of \"%s/%s\": %s (errno=%d)\n",
+					path, entry->name, strerror(errno),
+					errno);
+				scan_error(scan);
+			}
+
+			/* Gone, or can't be visited anyway. */
+			free(entry->name);
+			continue;
+		}
+
+		if((options->skip_symlinks && entry->type == SCAN_TYPE_LNK) ||
+			(options->skip_special &&
+			entry->type == SCAN_TYPE_OTHER))
+		{
+			free(entry->name);
+			continue;
+		}
+
+		entries[kept++] = *entry;
+	}
+
+	if(!err) {
+		count = kept;
+	}
+
+#ifdef SCAN_HAVE_GETDENTS64
+	close(fd);
+#else
+	closedir(dirp);
+#endif
+
+	if(err) {
+		scan_free_dirents(entries, count);
+		errno = err;
+		return -1;
+	}
+
+	*out_entries = entries;
+	*out_count = count;
+
+	return 0;
+}
+
+/**
+ * Order of the events of a directory in sorted mode: by entry name, where the
+ * subtree of a subdirectory sorts as if its name ended with a '/'. Walking
+ * the events in this order visits the nodes in byte-wise lexical order of
+ * their full paths.
+ */
+static int scan_compare_events(
+	const void *a,
+	const void *b)
+{
+	const struct scan_event *event_a = a;
+	const struct scan_event *event_b = b;
+	const char *name_a = event_a->entry->name;
+	const char *name_b = event_b->entry->name;
+	const size_t len_a = strlen(name_a);
+	const size_t len_b = strlen(name_b);
+	const size_t len = (len_a < len_b) ? len_a : len_b;
+	int next_a;
+	int next_b;
+	int res;
+
+	res = memcmp(name_a, name_b, len);
+	if(res) {
+		return res;
+	}
+
+	/* One name is a prefix of the other. Compare the character after
+	 * the common part, which for the shorter name is the '/' of a subtree
+	 * or the end of the key. */
+	next_a = (len < len_a) ? (unsigned char) name_a[len] :
+		event_a->subtree ? '/' : -1;
+	next_b = (len < len_b) ? (unsigned char) name_b[len] :
+		event_b->subtree ? '/' : -1;
+
+	return next_a - next_b;
+}
+
+/**
+ * Whether the subtree below directory @path contains nodes that sort after
+ * @resume_path, i.e. whether there's anything left to do in it when resuming
+ * after @resume_path. The subtree's nodes all start with @path + '/'.
+ */
+static int scan_resume_subtree(
+	const char *resume_path,
+	const char *path)
+{
+	const size_t len = strlen(path);
+	int res;
+
+	res = strncmp(resume_path, path, len);
+	if(res) {
+		return res < 0;
+	}
+
+	/* @resume_path is either inside the subtree or sorts before it. */
+	return (unsigned char) resume_path[len] <= '/';
+}
+
+/**
+ * Whether the node (or with @subtree, the subtree below directory) @path was
+ * finished before the scan was interrupted, when resuming.
+ */
+static int scan_resume_done(
+	struct scan *scan,
+	const char *path,
+	int subtree)
+{
+	if(!scan->resume_path) {
+		return 0;
+	}
+	else if(subtree) {
+		return !scan_resume_subtree(scan->resume_path, path);
+	}
+
+	return strcmp(path, scan->resume_path) <= 0;
+}
+
+/**
+ * Put directory @path on top of the prefetch stack, taking ownership of the
+ * path. Called by the directory reader only.
+ */
+static void scan_prefetch_push(
+	struct scan *scan,
+	char *path)
+{
+	struct scan_prefetch *entry;
+
+	pthread_mutex_lock(&scan->prefetch_lock);
+	if(scan->prefetch_count == SCAN_PREFETCH_SIZE) {
+		free(scan->prefetch[scan->prefetch_bottom].path);
+		scan->prefetch_bottom =
+			(scan->prefetch_bottom + 1) % SCAN_PREFETCH_SIZE;
+		--scan->prefetch_count;
+	}
+
+	entry = &scan->prefetch[(scan->prefetch_bottom + scan->prefetch_count) %
+		SCAN_PREFETCH_SIZE];
+	entry->path = path;
+	entry->dev = scan->walk_dev;
+	++scan->prefetch_count;
+	pthread_cond_signal(&scan->prefetch_ready);
+	pthread_mutex_unlock(&scan->prefetch_lock);
+}
+
+/**
+ * Called by the directory reader when it's about to read directory @path.
+ * If nobody has started to prefetch it yet, it's dropped from the prefetch
+ * stack along with everything above it, which is left over from the subtrees
+ * that the reader has walked since.
+ */
+static void scan_prefetch_claim(
+	struct scan *scan,
+	const char *path)
+{
+	size_t i;
+
+	pthread_mutex_lock(&scan->prefetch_lock);
+	for(i = scan->prefetch_count; i > 0; --i) {
+		if(strcmp(scan->prefetch[(scan->prefetch_bottom + i - 1) %
+			SCAN_PREFETCH_SIZE].path, path))
+		{
+			continue;
+		}
+
+		while(scan->prefetch_count >= i) {
+			--scan->prefetch_count;
+			free(scan->prefetch[(scan->prefetch_bottom +
+				scan->prefetch_count) %
+				SCAN_PREFETCH_SIZE].path);
+		}
+
+		break;
+	}
+	pthread_mutex_unlock(&scan->prefetch_lock);
+}
+
+static int scan_prefetch_stopped(
+	struct scan *scan)
+{
+	int done;
+
+	pthread_mutex_lock(&scan->prefetch_lock);
+	done = scan->prefetch_done;
+	pthread_mutex_unlock(&scan->prefetch_lock);
+
+	return done;
+}
+
+/**
+ * Read directory @entry and get the status of each of its entries, only to
+ * bring the directory's blocks and the entries' inodes into the cache.
+ * Errors are ignored, the directory reader reports them when it gets here.
+ */
+static void scan_prefetch_dir(
+	struct scan *scan,
+	const struct scan_prefetch *entry,
+	char *dirbuf)
+{
+	struct stat stbuf;
+	enum scan_type type;
+	int fd;
+#ifdef SCAN_HAVE_GETDENTS64
+	long nread;
+	long pos;
+#else
+	DIR *dirp;
+	struct dirent *de;
+#endif
+
+	fd = open(entry->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1) {
+		return;
+	}
+
+	if(scan->options->one_filesystem &&
+		(fstat(fd, &stbuf) || stbuf.st_dev != entry->dev))
+	{
+		close(fd);
+		return;
+	}
+
+#ifdef SCAN_HAVE_GETDENTS64
+	while(!scan_prefetch_stopped(scan) && (nread = syscall(SYS_getdents64,
+		fd, dirbuf, SCAN_DIRBUF_SIZE)) > 0)
+	{
+		for(pos = 0; pos < nread;) {
+			const struct scan_linux_dirent64 *d =
+				(const void*) &dirbuf[pos];
+
+			if(!scan_is_dot(d->d_name)) {
+				scan_stat_type(fd, d->d_name, &type);
+			}
+
+			pos += d->d_reclen;
+		}
+	}
+
+	close(fd);
+#else
+	(void) dirbuf;
+
+	dirp = fdopendir(fd);
+	if(!dirp) {
+		close(fd);
+		return;
+	}
+
+	while((de = readdir(dirp)) && !scan_prefetch_stopped(scan)) {
+		if(!scan_is_dot(de->d_name)) {
+			scan_stat_type(dirfd(dirp), de->d_name, &type);
+		}
+	}
+
+	closedir(dirp);
+#endif
+}
+
+/**
+ * Prefetch thread. Takes the directories from the top of the prefetch stack,
+ * the ones that the directory reader will get to first, so that while the
+ * reader and the workers wait for the metadata of one directory the next
+ * ones are already being read in.
+ */
+static void* scan_prefetch_thread(
+	void *arg)
+{
+	struct scan *scan = arg;
+	struct scan_prefetch entry;
+	char *dirbuf = NULL;
+
+#ifdef SCAN_HAVE_GETDENTS64
+	dirbuf = malloc(SCAN_DIRBUF_SIZE);
+	if(!dirbuf) {
+		return NULL;
+	}
+#endif
+
+	for(;;) {
+		pthread_mutex_lock(&scan->prefetch_lock);
+		while(!scan->prefetch_count && !scan->prefetch_done) {
+			pthread_cond_wait(&scan->prefetch_ready,
+				&scan->prefetch_lock);
+		}
+
+		if(scan->prefetch_done) {
+			pthread_mutex_unlock(&scan->prefetch_lock);
+			break;
+		}
+
+		--scan->prefetch_count;
+		entry = scan->prefetch[(scan->prefetch_bottom +
+			scan->prefetch_count) % SCAN_PREFETCH_SIZE];
+		pthread_mutex_unlock(&scan->prefetch_lock);
+
+		scan_prefetch_dir(scan, &entry, dirbuf);
+		free(entry.path);
+	}
+
+	free(dirbuf);
+
+	return NULL;
+}
+
+static int scan_walk_dir(
+	struct scan *scan,
+	const char *path)
+{
+	struct scan_dirent *entries = NULL;
+	struct scan_event *events = NULL;
+	size_t count = 0;
+	size_t events_count = 0;
+	size_t fs = FSLIMIT_NONE;
+	char *prefetch_next = NULL;
+	size_t i;
+	int res = 0;
+
+	if(scan->prefetch_running) {
+		scan_prefetch_claim(scan, path);
+	}
+
+	if(scan_read_dir(scan, path, &entries, &count, &fs)) {
+		fprintf(stderr, "Error while reading directory \"%s\": %s "
+			"(errno=%d)\n",
+			path, strerror(errno), errno);
+		scan_error(scan);
+		return 0;
+	}
+
+	events = malloc(2 * count * sizeof(events[0]) + 1);
+	if(!events) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		scan_free_dirents(entries, count);
+		return -1;
+	}
+
+	for(i = 0; i < count; ++i) {
+		events[events_count++] = (struct scan_event) { &entries[i], 0 };
+		if(entries[i].type == SCAN_TYPE_DIR) {
+			events[events_count++] =
+				(struct scan_event) { &entries[i], 1 };
+		}
+	}
+
+	if(scan->options->sorted) {
+		qsort(events, events_count, sizeof(events[0]),
+			scan_compare_events);
+	}
+
+	/* Queue the subdirectories for prefetching in reverse, so that the
+	 * ones that are walked first end up on top. The first one is left
+	 * out, the reader gets to it right away and would only end up reading
+	 * it alongside a prefetch thread. */
+	for(i = events_count; i > 0 && scan->prefetch_running; --i) {
+		char *child_path;
+
+		if(!events[i - 1].subtree) {
+			continue;
+		}
+
+		child_path = scan_join_path(path, events[i - 1].entry->name);
+		if(!child_path || scan_resume_done(scan, child_path, 1)) {
+			free(child_path);
+			continue;
+		}
+
+		if(prefetch_next) {
+			scan_prefetch_push(scan, prefetch_next);
+		}
+
+		prefetch_next = child_path;
+	}
+
+	free(prefetch_next);
+
+	for(i = 0; i < events_count && !res; ++i) {
+		const struct scan_dirent *entry = events[i].entry;
+		char *child_path;
+
+		child_path = scan_join_path(path, entry->name);
+		if(!child_path) {
+			fprintf(stderr, "Error while allocating path: %s "
+				"(errno=%d)\n",
+				strerror(errno), errno);
+			res = -1;
+			break;
+		}
+
+		if(scan_resume_done(scan, child_path, events[i].subtree)) {
+			/* Finished before the scan was interrupted. */
+			free(child_path);
+			continue;
+		}
+
+		if(events[i].subtree) {
+			res = scan_walk_dir(scan, child_path);
+			free(child_path);
+		}
+		else {
+			/* Everything from here on sorts after the resume
+			 * point. */
+			scan->resume_path = NULL;
+
+			/* The queue takes ownership of the path. */
+			res = scan_enqueue(scan, child_path, entry->type,
+				fs);
+		}
+	}
+
+	free(events);
+	scan_free_dirents(entries, count);
+
+	return res;
+}
+
+/**
+ * Write out @out to standard output, or through the compressor if there is
+ * one. Called with output_lock held.
+ */
+static int scan_write_output(
+	struct scan *scan,
+	struct outbuf *out)
+{
+	if(scan->options->compress) {
+		return compress_writer_flush(scan->options->compress, out);
+	}
+
+	return outbuf_flush(out, stdout);
+}
+
+/**
+ * Write out the output collected in sorted mode so far. In checkpoint mode
+ * the checkpoint is saved afterwards if it's due, or if @final is set.
+ */
+static void scan_reorder_flush(
+	struct scan *scan,
+	int final)
+{
+	struct checkpoint *const checkpoint = scan->options->checkpoint;
+	struct outbuf tmp;
+	char *path = NULL;
+	size_t root = 0;
+	unsigned long long done = 0;
+	unsigned long long errors = 0;
+	int save = 0;
+
+	pthread_mutex_lock(&scan->output_lock);
+
+	pthread_mutex_lock(&scan->lock);
+	tmp = scan->emit;
+	scan->emit = scan->emit_spare;
+	scan->emit_spare = tmp;
+	if(checkpoint) {
+		const time_t now = time(NULL);
+
+		path = scan->emit_path;
+		root = scan->emit_root;
+		scan->emit_path = NULL;
+		done = scan->resumed_done + scan->emitted;
+		errors = scan->resumed_errors + scan->errors;
+		if(final || now >= scan->checkpoint_at) {
+			scan->checkpoint_at = now + CHECKPOINT_INTERVAL;
+			save = 1;
+		}
+	}
+	pthread_mutex_unlock(&scan->lock);
+
+	if(scan_write_output(scan, &scan->emit_spare) ||
+		(save && fflush(stdout)))
+	{
+		fprintf(stderr, "Error while writing to standard output: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		scan_error(scan);
+		save = 0;
+	}
+
+	if(checkpoint) {
+		if(path) {
+			free(checkpoint->path);
+			checkpoint->path = path;
+			checkpoint->position = root;
+		}
+
+		checkpoint->done = done;
+		checkpoint->errors = errors;
+		if(save && checkpoint_save(checkpoint)) {
+			scan_error(scan);
+		}
+	}
+
+	if(scan->emit_spare.size > SCAN_BUFFER_KEEP) {
+		outbuf_free(&scan->emit_spare);
+	}
+
+	pthread_mutex_unlock(&scan->output_lock);
+}
+
+/**
+ * Hand over the output of node @item in sorted mode. It's emitted right away
+ * if all nodes before it have been, otherwise it's held back in the reorder
+ * buffer until they have. In checkpoint mode ownership of the node's path is
+ * transferred as well.
+ */
+static void scan_reorder_complete(
+	struct scan *scan,
+	struct scan_worker *worker,
+	struct scan_item *item)
+{
+	const unsigned long long seq = item->seq;
+	unsigned long long first;
+	struct scan_slot *slot;
+	int flush;
+
+	pthread_mutex_lock(&scan->lock);
+	first = scan->next_emit;
+	if(worker->out.failed) {
+		scan->emit.failed = worker->out.failed;
+	}
+
+	if(seq == scan->next_emit) {
+		outbuf_append(&scan->emit, worker->out.data, worker->out.len);
+		if(item->path) {
+			free(scan->emit_path);
+			scan->emit_path = item->path;
+			scan->emit_root = item->root;
+		}
+		++scan->emitted;
+		++scan->next_emit;
+	}
+	else {
+		slot = &scan->reorder[seq % SCAN_REORDER_SIZE];
+		slot->data = NULL;
+		slot->len = worker->out.len;
+		if(slot->len && !(slot->data = bufpool_get(&scan->pool,
+			slot->len, &slot->capacity)))
+		{
+			scan->emit.failed = ENOMEM;
+			slot->len = 0;
+		}
+		else if(slot->len) {
+			memcpy(slot->data, worker->out.data, slot->len);
+		}
+		slot->path = item->path;
+		slot->root = item->root;
+		slot->done = 1;
+	}
+
+	/* Emit the nodes that were only waiting for this one. */
+	while((slot = &scan->reorder[scan->next_emit % SCAN_REORDER_SIZE])->
+		done)
+	{
+		outbuf_append(&scan->emit, slot->data, slot->len);
+		if(slot->data) {
+			bufpool_put(&scan->pool, slot->data, slot->capacity);
+		}
+		slot->data = NULL;
+		if(slot->path) {
+			free(scan->emit_path);
+			scan->emit_path = slot->path;
+			scan->emit_root = slot->root;
+			slot->path = NULL;
+		}
+		slot->done = 0;
+		++scan->emitted;
+		++scan->next_emit;
+	}
+
+	if(scan->next_emit != first) {
+		/* Workers may be waiting for the window to move. */
+		pthread_cond_broadcast(&scan->not_empty);
+	}
+
+	flush = scan->emit.len >= SCAN_OUTPUT_CHUNK || scan->emit.failed ||
+		(scan->options->checkpoint &&
+		time(NULL) >= scan->checkpoint_at);
+	pthread_mutex_unlock(&scan->lock);
+
+	item->path = NULL;
+	worker->out.len = 0;
+	worker->out.failed = 0;
+
+	if(flush) {
+		scan_reorder_flush(scan, 0);
+	}
+}
+
+static void* scan_worker_thread(
+	void *arg)
+{
+	struct scan_worker *worker = arg;
+	struct scan *scan = worker->scan;
+	const struct scan_options *options = scan->options;
+	struct scan_item item;
+	unsigned long long calls = 0;
+
+	if(options->worker_init && options->worker_init(worker, options->arg)) {
+		pthread_mutex_lock(&scan->lock);
+		scan->aborted = 1;
+		++scan->errors;
+		pthread_cond_broadcast(&scan->not_full);
+		pthread_cond_broadcast(&scan->not_empty);
+		pthread_mutex_unlock(&scan->lock);
+		return NULL;
+	}
+
+	xattrio_count_calls(&calls);
+
+	while(!scan_dequeue(scan, &item)) {
+		const double start = fslimit_now();
+		const unsigned long long start_calls = calls;
+		struct shard_buf *shard_buf = NULL;
+		unsigned int shard = 0;
+
+		if(options->shards) {
+			/* Collect the output right in the worker's buffer for
+			 * the node's shard. */
+			shard = shard_output_pick(&scan->shards, item.path);
+			shard_buf = shard_output_buf(&scan->shards,
+				worker->index, shard);
+			worker->out = shard_buf->out;
+		}
+
+		if(options->visit(worker, item.path, item.type, options->arg)) {
+			scan_error(scan);
+		}
+
+		scan_finish_fs(scan, &item, calls - start_calls,
+			fslimit_now() - start);
+
+		if(shard_buf) {
+			if(worker->out.len != shard_buf->out.len) {
+				++shard_buf->nodes;
+			}
+
+			shard_buf->out = worker->out;
+			memset(&worker->out, 0, sizeof(worker->out));
+		}
+
+		/* In checkpoint mode the path is kept until the node's output
+		 * has been emitted. */
+		if(!options->checkpoint) {
+			free(item.path);
+			item.path = NULL;
+		}
+
+		/* Don't let one node with huge values pin memory for the
+		 * rest of the scan. */
+		if(worker->list.size > SCAN_BUFFER_KEEP) {
+			xattrio_buf_free(&worker->list);
+		}
+
+		if(worker->value.size > SCAN_BUFFER_KEEP) {
+			xattrio_buf_free(&worker->value);
+		}
+
+		if(options->sorted) {
+			scan_reorder_complete(scan, worker, &item);
+			if(worker->out.size > SCAN_BUFFER_KEEP) {
+				outbuf_free(&worker->out);
+			}
+
+			continue;
+		}
+
+		if(shard_buf) {
+			if((shard_buf->out.len >= scan->shards.chunk ||
+				shard_buf->out.failed) &&
+				shard_output_flush(&scan->shards, shard,
+				shard_buf))
+			{
+				scan_error(scan);
+			}
+
+			continue;
+		}
+
+		if(worker->out.len >= SCAN_OUTPUT_CHUNK || worker->out.failed) {
+			pthread_mutex_lock(&scan->output_lock);
+			if(scan_write_output(scan, &worker->out)) {
+				fprintf(stderr, "Error while writing to "
+					"standard output: %s (errno=%d)\n",
+					strerror(errno), errno);
+				scan_error(scan);
+			}
+			pthread_mutex_unlock(&scan->output_lock);
+
+			if(worker->out.size > SCAN_BUFFER_KEEP) {
+				outbuf_free(&worker->out);
+			}
+		}
+	}
+
+	if(options->shards) {
+		unsigned int i;
+
+		for(i = 0; i < options->shards; ++i) {
+			struct shard_buf *const shard_buf = shard_output_buf(
+				&scan->shards, worker->index, i);
+
+			if(shard_output_flush(&scan->shards, i, shard_buf)) {
+				scan_error(scan);
+			}
+		}
+	}
+
+	pthread_mutex_lock(&scan->output_lock);
+	if(scan_write_output(scan, &worker->out)) {
+		fprintf(stderr, "Error while writing to standard output: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		scan_error(scan);
+	}
+	pthread_mutex_unlock(&scan->output_lock);
+
+	xattrio_count_calls(NULL);
+
+	if(options->worker_fini) {
+		options->worker_fini(worker, options->arg);
+	}
+
+	return NULL;
+}
+
+int scan_parse_prefetch(
+	const char *s,
+	unsigned int *out_threads)
+{
+	if(!strcmp(s, "0")) {
+		*out_threads = 0;
+		return 0;
+	}
+
+	return pool_parse_threads(s, out_threads);
+}
+
+int scan_run(
+	const struct scan_options *options,
+	char *const *roots,
+	size_t roots_count)
+{
+	struct scan scan;
+	struct scan_worker *workers = NULL;
+	pthread_t *threads = NULL;
+	pthread_t *prefetch_threads = NULL;
+	unsigned int threads_count;
+	unsigned int started = 0;
+	unsigned int i;
+	size_t first_root = 0;
+	size_t j;
+	int have_shards = 0;
+	int res = 0;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.options = options;
+	scan.last_fs = FSLIMIT_NONE;
+	bufpool_init(&scan.pool, options->memory_budget);
+	pthread_mutex_init(&scan.lock, NULL);
+	pthread_mutex_init(&scan.output_lock, NULL);
+	pthread_mutex_init(&scan.prefetch_lock, NULL);
+	pthread_cond_init(&scan.not_empty, NULL);
+	pthread_cond_init(&scan.not_full, NULL);
+	pthread_cond_init(&scan.prefetch_ready, NULL);
+
+	if(options->checkpoint) {
+		scan.checkpoint_at = time(NULL) + CHECKPOINT_INTERVAL;
+		scan.resumed_done = options->checkpoint->done;
+		scan.resumed_errors = options->checkpoint->errors;
+		scan.resume_path = options->checkpoint->path;
+		if(scan.resume_path) {
+			first_root = options->checkpoint->position;
+		}
+	}
+
+	threads_count = options->threads ? options->threads :
+		pool_default_threads();
+	fslimit_init(&scan.fslimit, threads_count);
+
+#ifdef SCAN_HAVE_GETDENTS64
+	scan.dirbuf = malloc(SCAN_DIRBUF_SIZE);
+	if(!scan.dirbuf) {
+		fprintf(stderr, "Error while allocating directory buffer: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		res = -1;
+		goto out;
+	}
+#endif
+
+	if(options->shards) {
+		if(shard_output_open(&scan.shards, options->output_prefix,
+			options->shards, threads_count,
+			options->output_format))
+		{
+			res = -1;
+			goto out;
+		}
+
+		have_shards = 1;
+	}
+
+	workers = calloc(threads_count, sizeof(workers[0]));
+	threads = calloc(threads_count, sizeof(threads[0]));
+	if(!workers || !threads) {
+		fprintf(stderr, "Error while allocating worker state: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		res = -1;
+		goto out;
+	}
+
+	for(i = 0; i < threads_count; ++i) {
+		int err;
+
+		workers[i].scan = &scan;
+		workers[i].index = i;
+		err = pthread_create(&threads[i], NULL, scan_worker_thread,
+			&workers[i]);
+		if(err) {
+			fprintf(stderr, "Error while creating worker thread: "
+				"%s (errno=%d)\n",
+				strerror(err), err);
+			if(!started) {
+				res = -1;
+				goto out;
+			}
+
+			break;
+		}
+
+		++started;
+	}
+
+	if(options->prefetch) {
+		prefetch_threads = calloc(options->prefetch,
+			sizeof(prefetch_threads[0]));
+		if(!prefetch_threads) {
+			/* Prefetching is only an optimization, scan without
+			 * it. */
+			fprintf(stderr, "Error while allocating prefetch "
+				"threads: %s (errno=%d)\n",
+				strerror(errno), errno);
+		}
+	}
+
+	for(i = 0; prefetch_threads && i < options->prefetch; ++i) {
+		int err;
+
+		/* Go on with the threads that could be created. */
+		err = pthread_create(&prefetch_threads[i], NULL,
+			scan_prefetch_thread, &scan);
+		if(err) {
+			fprintf(stderr, "Error while creating prefetch thread: "
+				"%s (errno=%d)\n",
+				strerror(err), err);
+			break;
+		}
+
+		++scan.prefetch_running;
+	}
+
+	for(j = first_root; j < roots_count && !res; ++j) {
+		struct stat stbuf;
+		char *root_path;
+		enum scan_type type;
+		size_t fs;
+
+		scan.walk_root = j;
+		if(j != first_root) {
+			scan.resume_path = NULL;
+		}
+
+		if(lstat(roots[j], &stbuf)) {
+			fprintf(stderr, "Error while getting status of \"%s\": "
+				"%s (errno=%d)\n",
+				roots[j], strerror(errno), errno);
+			scan_error(&scan);
+			continue;
+		}
+
+		type = scan_type_from_mode(stbuf.st_mode);
+		scan.walk_dev = stbuf.st_dev;
+		if(scan_lookup_fs(&scan, -1, roots[j], stbuf.st_dev, &fs)) {
+			fprintf(stderr, "Error while allocating memory: %s "
+				"(errno=%d)\n",
+				strerror(errno), errno);
+			res = -1;
+			break;
+		}
+
+		root_path = strdup(roots[j]);
+		if(!root_path) {
+			res = -1;
+			break;
+		}
+
+		if(scan.resume_path) {
+			/* The root sorts before everything below it, so it was
+			 * finished before the scan was interrupted. */
+			free(root_path);
+		}
+		else {
+			res = scan_enqueue(&scan, root_path, type, fs);
+		}
+
+		if(!res && type == SCAN_TYPE_DIR) {
+			res = scan_walk_dir(&scan, roots[j]);
+		}
+	}
+
+	pthread_mutex_lock(&scan.prefetch_lock);
+	scan.prefetch_done = 1;
+	pthread_cond_broadcast(&scan.prefetch_ready);
+	pthread_mutex_unlock(&scan.prefetch_lock);
+
+	for(i = 0; i < scan.prefetch_running; ++i) {
+		pthread_join(prefetch_threads[i], NULL);
+	}
+
+	while(scan.prefetch_count) {
+		--scan.prefetch_count;
+		free(scan.prefetch[(scan.prefetch_bottom +
+			scan.prefetch_count) % SCAN_PREFETCH_SIZE].path);
+	}
+
+	pthread_mutex_lock(&scan.lock);
+	scan.done = 1;
+	if(res) {
+		scan.aborted = 1;
+	}
+	pthread_cond_broadcast(&scan.not_empty);
+	pthread_mutex_unlock(&scan.lock);
+
+	for(i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	if(options->sorted) {
+		scan_reorder_flush(&scan, 1);
+	}
+
+	/* Release anything left in the queue after an abort. */
+	while(scan.queue_count) {
+		free(scan.queue[scan.queue_head].path);
+		scan.queue_head = (scan.queue_head + 1) % SCAN_QUEUE_SIZE;
+		--scan.queue_count;
+	}
+
+	if(scan.errors) {
+		res = -1;
+	}
+out:
+	if(have_shards && shard_output_close(&scan.shards,
+		started && !scan.aborted, !res))
+	{
+		res = -1;
+	}
+
+	if(workers) {
+		for(i = 0; i < threads_count; ++i) {
+			xattrio_buf_free(&workers[i].list);
+			xattrio_buf_free(&workers[i].value);
+			outbuf_free(&workers[i].out);
+		}
+
+		free(workers);
+	}
+
+	if(threads) {
+		free(threads);
+	}
+
+	free(prefetch_threads);
+
+	/* Output held back in sorted mode after an abort. */
+	for(i = 0; i < SCAN_REORDER_SIZE; ++i) {
+		if(scan.reorder[i].data) {
+			bufpool_put(&scan.pool, scan.reorder[i].data,
+				scan.reorder[i].capacity);
+		}
+
+		free(scan.reorder[i].path);
+	}
+
+	free(scan.emit_path);
+
+#ifdef SCAN_HAVE_GETDENTS64
+	free(scan.dirbuf);
+#endif
+	bufpool_destroy(&scan.pool);
+	fslimit_destroy(&scan.fslimit);
+	outbuf_free(&scan.emit);
+	outbuf_free(&scan.emit_spare);
+
+	pthread_cond_destroy(&scan.prefetch_ready);
+	pthread_cond_destroy(&scan.not_full);
+	pthread_cond_destroy(&scan.not_empty);
+	pthread_mutex_destroy(&scan.prefetch_lock);
+	pthread_mutex_destroy(&scan.output_lock);
+	pthread_mutex_destroy(&scan.lock);
+
+	return res;
+}
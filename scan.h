@@ -0,0 +1,149 @@
+/*-
+ * scan.h - Parallel filesystem tree scanning.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_SCAN_H
+#define _XATTRPROGS_SCAN_H
+
+#include "checkpoint.h"
+#include "outbuf.h"
+#include "xattrio.h"
+
+struct compress_writer;
+struct scan;
+
+/* Node types as reported to the visit callback. */
+enum scan_type {
+	SCAN_TYPE_UNKNOWN = 0,
+	SCAN_TYPE_REG,
+	SCAN_TYPE_DIR,
+	SCAN_TYPE_LNK,
+	SCAN_TYPE_OTHER,
+};
+
+/**
+ * Per-thread state handed to the visit callback. The buffers are reused for
+ * every node that the worker visits, and anything appended to @out is
+ * written to standard output (or the node's shard file) as a unit (output
+ * of a single node is never interleaved with the output of other nodes).
+ */
+struct scan_worker {
+	struct scan *scan;
+	unsigned int index;
+	struct xattrio_buf list;
+	struct xattrio_buf value;
+	struct outbuf out;
+	void *priv;
+};
+
+struct scan_options {
+	/* Number of worker threads, 0 means pick a default. */
+	unsigned int threads;
+
+	/* Write the output of the nodes in byte-wise lexical order of their
+	 * paths (within each root, roots in the given order) instead of in
+	 * completion order. The workers still run in parallel, a bounded
+	 * reorder buffer holds back the output of nodes that finish early. */
+	int sorted;
+
+	/* Budget for output held back in sorted mode, 0 means the default
+	 * (see bufpool.h). Workers stop taking new nodes while it's used up,
+	 * except for the node that is next in line for output. */
+	size_t memory_budget;
+
+	/* Record the progress of the scan in this checkpoint (mode "scan"),
+	 * saved periodically after the output written so far has been
+	 * flushed. If the checkpoint already holds a path when the scan
+	 * starts, the scan resumes after that node. Requires sorted mode,
+	 * which makes the order of the nodes reproducible. Optional. */
+	struct checkpoint *checkpoint;
+
+	/* Don't visit symbolic links, or nodes other than regular files,
+	 * directories and symbolic links (devices, FIFOs, sockets), found
+	 * while descending. The roots are always visited. */
+	int skip_symlinks;
+	int skip_special;
+
+	/* Don't descend into directories on other filesystems than their
+	 * root, like find(1) -xdev. The mount points themselves are still
+	 * visited. */
+	int one_filesystem;
+
+	/* Number of threads that read the directories ahead of the directory
+	 * reader and get the status of their entries, so that on a cold cache
+	 * the metadata of the next directories is being read in while the
+	 * reader and the workers wait for the current one. Has no effect on
+	 * what is visited. 0 means no prefetching. */
+	unsigned int prefetch;
+
+	/* Write the output to this many files <output_prefix>.<n> instead of
+	 * standard output, each node's output going to the file picked by a
+	 * hash of its path (see shard.h), and describe them in
+	 * <output_prefix>.manifest with @output_format as the format once the
+	 * scan is done. 0 means standard output. Can't be combined with
+	 * sorted mode. */
+	unsigned int shards;
+	const char *output_prefix;
+	const char *output_format;
+
+	/* Write the output through this compressor instead of directly to
+	 * standard output (see compress.h). Optional, and not used with
+	 * shards. */
+	struct compress_writer *compress;
+
+	/* Called in each worker thread before it starts visiting nodes and
+	 * after it's done. Both are optional. worker_init may set up
+	 * @worker->priv and return -1 to abort the scan. */
+	int (*worker_init)(struct scan_worker *worker, void *arg);
+	void (*worker_fini)(struct scan_worker *worker, void *arg);
+
+	/* Called once for every node in the tree (including the roots) from
+	 * one of the worker threads. Returns 0 on success or -1 if an error
+	 * was reported for the node. Errors don't stop the scan but are
+	 * reflected in the return value of scan_run. */
+	int (*visit)(
+		struct scan_worker *worker,
+		const char *path,
+		enum scan_type type,
+		void *arg);
+
+	void *arg;
+};
+
+/**
+ * Scan the trees rooted at @roots. Symbolic links are never followed while
+ * descending into directories.
+ *
+ * Returns 0 if all nodes were scanned without errors, or -1 if any error was
+ * reported (the scan continues past errors).
+ */
+int scan_run(
+	const struct scan_options *options,
+	char *const *roots,
+	size_t roots_count);
+
+/**
+ * Parse the argument of a prefetch thread count option, where 0 turns
+ * prefetching off. Returns 0 on success, -1 if @s is not a valid count.
+ */
+int scan_parse_prefetch(
+	const char *s,
+	unsigned int *out_threads);
+
+#endif /* !defined(_XATTRPROGS_SCAN_H) */
@@ -18,50 +18,289 @@
  * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
 #include <fcntl.h>
-#endif
 #include <unistd.h>
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #include <sys/extattr.h>
 #endif
-#if defined(__APPLE__) || defined(__DARWIN__) || defined(__linux__)
+#if defined(__APPLE__) || defined(__DARWIN__)
 #include <sys/xattr.h>
 #endif
 
-int main(int argc, char **argv)
-{
-	int ret = (EXIT_FAILURE);
-	int argp = 1;
+#include "checkpoint.h"
+#include "codec.h"
+#include "compress.h"
+#include "durable.h"
+#include "hooks.h"
+#include "pool.h"
+#include "restore.h"
+#include "xattrio.h"
+#include "xattrprogs.h"
+
+struct setxattr_options {
 #if defined(__FreeBSD__) || defined(__NetBSD__)
-	int namespace = EXTATTR_NAMESPACE_USER;
+	int namespace;
 #endif
-	int follow_links = 0;
+	int follow_links;
 #if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
-	int create = 0;
-	int replace = 0;
+	int create;
+	int replace;
 #endif /* defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__) */
-	const char *path;
-	const char *attr_name = NULL;
-	const char *attr_data = NULL;
+	const char *attr_name;
 #if defined(__APPLE__) || defined(__DARWIN__)
-	const char *attr_offset_string = NULL;
-	unsigned long long attr_offset = 0;
+	unsigned long long attr_offset;
+#endif
+	/* Set with --durable, changes are flushed in bulk. */
+	struct durable *durable;
+	/* Set with --checkpoint or --resume, with the node and error counts
+	 * of the runs before this one. */
+	struct checkpoint *checkpoint;
+	unsigned long long resumed_done;
+	unsigned long long resumed_errors;
+};
+
+/**
+ * Read all of standard input into a newly allocated buffer.
+ */
+static int setxattr_read_stdin(
+	char **out_data,
+	size_t *out_data_size)
+{
+	size_t alloc_size = 4096;
+	char *attr_data_alloc = NULL;
+	size_t attr_data_size = 0;
+
+	while(1) {
+		char *new_attr_data;
+		ssize_t bytes_read;
+
+		new_attr_data = realloc(attr_data_alloc, alloc_size);
+		if(!new_attr_data) {
+			fprintf(stderr, "Error while %sallocating "
+				"attribute buffer to %zu bytes: %s "
+				"(errno=%d)\n",
+				attr_data_alloc ? "re" : "", alloc_size,
+				strerror(errno), errno);
+			goto err;
+		}
+
+		attr_data_alloc = new_attr_data;
+
+		bytes_read = read(STDIN_FILENO,
+			&attr_data_alloc[attr_data_size],
+			alloc_size - attr_data_size);
+		if(bytes_read < 0) {
+			fprintf(stderr, "Error while reading xattr "
+				"data from stdin: %s (errno=%d)\n",
+				strerror(errno), errno);
+			goto err;
+		}
+
+		if(!bytes_read) {
+			break;
+		}
+
+		attr_data_size += bytes_read;
+		if(attr_data_size > alloc_size / 2) {
+			alloc_size *= 2;
+		}
+	}
+
+	if(alloc_size != attr_data_size && attr_data_size) {
+		char *new_attr_data;
+
+		new_attr_data =
+			realloc(attr_data_alloc, attr_data_size);
+		if(!new_attr_data) {
+			fprintf(stderr, "Error while shrinking "
+				"attribute buffer from %zu to %zu "
+				"bytes: %s (errno=%d)\n",
+				alloc_size, attr_data_size,
+				strerror(errno), errno);
+			goto err;
+		}
+
+		attr_data_alloc = new_attr_data;
+	}
+
+	*out_data = attr_data_alloc;
+	*out_data_size = attr_data_size;
+
+	return 0;
+err:
+	if(attr_data_alloc) {
+		free(attr_data_alloc);
+	}
+
+	return -1;
+}
+
+/**
+ * Set the attribute for a single node.
+ */
+static int setxattr_one(
+	const struct setxattr_options *options,
+	const char *path,
+	const char *attr_name,
+	int namespace,
+	const char *attr_data,
+	size_t attr_data_size)
+{
+	int ret = -1;
+	const int follow_links = options->follow_links;
+	int flags = 0;
+	int res;
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
+	flags = (options->create ? XATTRIO_CREATE : 0) |
+		(options->replace ? XATTRIO_REPLACE : 0);
+#endif
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	if(options->attr_offset) {
+		/* Offsets into the resource fork are only supported by the
+		 * native backend. */
+		res = setxattr(
+			path,
+			attr_name,
+			attr_data,
+			attr_data_size,
+			options->attr_offset,
+			(follow_links ? 0 : XATTR_NOFOLLOW) |
+			(options->create ? XATTR_CREATE : 0) |
+			(options->replace ? XATTR_REPLACE : 0));
+	}
+	else
+#endif
+	{
+		res = xattrio_set(path, follow_links, namespace, attr_name,
+			attr_data, attr_data_size, flags);
+	}
+
+	if(res) {
+		fprintf(stderr, "Failed to set extended attribute \"%s\" for "
+			"node \"%s\": %s (errno=%d)\n",
+			attr_name, path, strerror(errno), errno);
+		goto out;
+	}
+
+	if(options->durable) {
+		durable_note(options->durable, path, follow_links);
+	}
+
+	ret = 0;
+out:
+	return ret;
+}
+
+/**
+ * restore_run callback. Names in a dump are qualified with their namespace on
+ * FreeBSD/NetBSD (see xattrio_namespace_prefix).
+ */
+static int setxattr_restore_set(
+	void *arg,
+	const char *path,
+	const char *name,
+	const char *value,
+	size_t value_length)
+{
+	const struct setxattr_options *options = arg;
+	int namespace;
+
+	name = xattrio_namespace_parse(name,
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+		options->namespace,
+#else
+		XATTRIO_DEFAULT_NAMESPACE,
 #endif
+		&namespace);
+
 #if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	int nodefd = -1;
-	int attrdirfd = -1;
-	int attrfd = -1;
-	ssize_t attr_bytes_written = 0;
+	if(name[0] == '/') {
+		fprintf(stderr, "Invalid attribute name \"%s\" for node "
+			"\"%s\" (cannot start with '/').\n", name, path);
+		return -1;
+	}
+#endif
+
+	return setxattr_one(options, path, name, namespace, value,
+		value_length);
+}
+
+/**
+ * Save the checkpoint. With --durable the changes made so far are flushed
+ * first, so that the checkpoint never gets ahead of what's on disk.
+ */
+static int setxattr_save_checkpoint(
+	const struct setxattr_options *options)
+{
+	if(options->durable && durable_flush_pending(options->durable)) {
+		return -1;
+	}
+
+	return checkpoint_save(options->checkpoint);
+}
+
+static int setxattr_restore_batch_done(
+	void *arg,
+	unsigned long long offset,
+	unsigned long long nodes,
+	unsigned long long errors)
+{
+	const struct setxattr_options *options = arg;
+	struct checkpoint *const checkpoint = options->checkpoint;
+
+	checkpoint->position = offset;
+	checkpoint->done = options->resumed_done + nodes;
+	checkpoint->errors = options->resumed_errors + errors;
+
+	return checkpoint_due(checkpoint) ?
+		setxattr_save_checkpoint(options) : 0;
+}
+
+int setxattr_main(int argc, char **argv)
+{
+	int ret = (EXIT_FAILURE);
+	int argp = 1;
+	struct setxattr_options options;
+	const char *path = NULL;
+	const char *attr_data = NULL;
+#if defined(__APPLE__) || defined(__DARWIN__)
+	const char *attr_offset_string = NULL;
 #endif
 	char *attr_data_alloc = NULL;
 	size_t attr_data_size = 0;
+	enum codec_encoding encoding = CODEC_ENCODING_NONE;
+	const char *restore_file = NULL;
+	unsigned int threads = 0;
+	int failed = 0;
+	int namespace = XATTRIO_DEFAULT_NAMESPACE;
+	struct durable durable;
+	int durable_requested = 0;
+	unsigned long long sync_interval = 0;
+	const char *checkpoint_file = NULL;
+	const char *resume_file = NULL;
+	struct checkpoint checkpoint;
+	struct hooks hooks;
+	int first;
+	int res;
+
+	hooks_init(&hooks);
+	memset(&options, 0, sizeof(options));
+	memset(&checkpoint, 0, sizeof(checkpoint));
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	options.namespace = EXTATTR_NAMESPACE_USER;
+#endif
 
 	while(argp < argc) {
 		if(argv[argp][0] != '-') {
@@ -69,42 +308,144 @@ int main(int argc, char **argv)
 			 * arguments. */
 			break;
 		}
-		else if(argv[argp][1] == '-') {
+#if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
+		else if(!strcmp(argv[argp], "--create")) {
+			options.create = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--replace")) {
+			options.replace = 1;
+			++argp;
+		}
+#endif /* defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__) */
+		else if(!strcmp(argv[argp], "--restore")) {
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			restore_file = argv[argp + 1];
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--durable")) {
+			durable_requested = 1;
+			++argp;
+		}
+		else if(!strcmp(argv[argp], "--sync-every")) {
+			if(argp + 1 >= argc || durable_parse_interval(
+				argv[argp + 1], &sync_interval))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an operation count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			durable_requested = 1;
+			argp += 2;
+		}
+		else if(!strcmp(argv[argp], "--checkpoint") ||
+			!strcmp(argv[argp], "--resume"))
+		{
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a file argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(argv[argp][2] == 'c') {
+				checkpoint_file = argv[argp + 1];
+			}
+			else {
+				resume_file = argv[argp + 1];
+			}
+
+			argp += 2;
+		}
+		else if((res = hooks_parse_option(&hooks, argc, argv,
+			&argp)))
+		{
+			if(res < 0) {
+				goto out;
+			}
+		}
+		else if(!strcmp(argv[argp], "--")) {
 			/* Stop parsing options when '--' is encountered. */
 			++argp;
 			break;
 		}
 		else if(argv[argp][1] == 'L') {
-			follow_links = 1;
+			options.follow_links = 1;
 			++argp;
 		}
+		else if(argv[argp][1] == 'j') {
+			if(argp + 1 >= argc ||
+				pool_parse_threads(argv[argp + 1], &threads))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"a thread count argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
+		else if(argv[argp][1] == 'n' || argv[argp][1] == 'v') {
+			if(argp + 1 >= argc) {
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an argument.\n",
+					argv[argp]);
+				goto out;
+			}
+
+			if(argv[argp][1] == 'n') {
+				options.attr_name = argv[argp + 1];
+			}
+			else {
+				attr_data = argv[argp + 1];
+			}
+
+			argp += 2;
+		}
+		else if(argv[argp][1] == 'E') {
+			if(argp + 1 >= argc || codec_parse_encoding(
+				argv[argp + 1], &encoding))
+			{
+				fprintf(stderr, "Error: Option '%s' requires "
+					"an encoding argument (hex or "
+					"base64).\n",
+					argv[argp]);
+				goto out;
+			}
+
+			argp += 2;
+		}
 #if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
-		else if(argv[argp][1] == 'c' ||
-			!strcmp(argv[argp], "--create"))
-		{
-			create = 1;
+		else if(argv[argp][1] == 'c') {
+			options.create = 1;
 			++argp;
 		}
-		else if(argv[argp][1] == 'r' ||
-			!strcmp(argv[argp], "--replace"))
-		{
-			replace = 1;
+		else if(argv[argp][1] == 'r') {
+			options.replace = 1;
 			++argp;
 		}
 #endif /* defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__) */
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #ifdef EXTATTR_NAMESPACE_EMPTY
 		else if(argv[argp][1] == 'e') {
-			namespace = EXTATTR_NAMESPACE_EMPTY;
+			options.namespace = EXTATTR_NAMESPACE_EMPTY;
 			++argp;
 		}
 #endif
 		else if(argv[argp][1] == 'u') {
-			namespace = EXTATTR_NAMESPACE_USER;
+			options.namespace = EXTATTR_NAMESPACE_USER;
 			++argp;
 		}
 		else if(argv[argp][1] == 's') {
-			namespace = EXTATTR_NAMESPACE_SYSTEM;
+			options.namespace = EXTATTR_NAMESPACE_SYSTEM;
 			++argp;
 		}
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
@@ -115,14 +456,110 @@ int main(int argc, char **argv)
 		}
 	}
 
-	path = (argp < argc) ? argv[argp++] : NULL;
-	attr_name = (argp < argc) ? argv[argp++] : NULL;
+	if(xattrio_backend_init()) {
+		goto out;
+	}
+
+	if(hooks_start(&hooks, "setxattr", restore_file ?
+		(threads ? threads : pool_default_threads()) : 1))
+	{
+		goto out;
+	}
+
+	if(durable_requested) {
+		/* Flush once per filesystem at the end (and every
+		 * --sync-every operations) instead of after each change. */
+		durable_init(&durable, "setxattr", sync_interval);
+		options.durable = &durable;
+	}
+
+	if(checkpoint_file || resume_file) {
+		/* A resumed run keeps updating the checkpoint it was resumed
+		 * from, unless told otherwise. */
+		checkpoint_init(&checkpoint,
+			checkpoint_file ? checkpoint_file : resume_file,
+			"setxattr", restore_file ? "input" : "args");
+		options.checkpoint = &checkpoint;
+		if(resume_file && checkpoint_load(&checkpoint, resume_file)) {
+			goto out;
+		}
+
+		options.resumed_done = checkpoint.done;
+		options.resumed_errors = checkpoint.errors;
+	}
+
+	if(restore_file) {
+		struct restore_options restore_options;
+		struct compress_reader input;
+		int input_fd = STDIN_FILENO;
+
+		if(argp < argc || options.attr_name || attr_data) {
+			fprintf(stderr, "Error: --restore can't be combined "
+				"with other attribute or file arguments.\n");
+			goto out;
+		}
+
+		if(strcmp(restore_file, "-") &&
+			(input_fd = open(restore_file, O_RDONLY)) < 0)
+		{
+			fprintf(stderr, "Error while opening \"%s\": %s "
+				"(errno=%d)\n",
+				restore_file, strerror(errno), errno);
+			goto out;
+		}
+
+		if(compress_reader_open(&input, input_fd, restore_file)) {
+			if(input_fd != STDIN_FILENO) {
+				close(input_fd);
+			}
+
+			goto out;
+		}
+
+		memset(&restore_options, 0, sizeof(restore_options));
+		restore_options.threads = threads;
+		restore_options.set = setxattr_restore_set;
+		restore_options.arg = &options;
+		if(options.checkpoint) {
+			restore_options.start_offset = checkpoint.position;
+			restore_options.batch_done =
+				setxattr_restore_batch_done;
+		}
+
+		if(restore_run(&restore_options, &input, restore_file)) {
+			failed = 1;
+			if(options.checkpoint) {
+				/* Record how far we got. */
+				setxattr_save_checkpoint(&options);
+			}
+		}
+
+		compress_reader_close(&input);
+		if(input_fd != STDIN_FILENO) {
+			close(input_fd);
+		}
+
+		if(!failed) {
+			ret = (EXIT_SUCCESS);
+		}
+
+		goto out;
+	}
+
+	if(!options.attr_name && !attr_data) {
+		/* Traditional form:
+		 * <filename> <attribute name> [<offset>] [<attribute data>] */
+		path = (argp < argc) ? argv[argp++] : NULL;
+		options.attr_name = (argp < argc) ? argv[argp++] : NULL;
 #if defined(__APPLE__) || defined(__DARWIN__)
-	attr_offset_string = (argp < argc) ? argv[argp++] : NULL;
+		attr_offset_string = (argp < argc) ? argv[argp++] : NULL;
 #endif
-	attr_data = (argp < argc) ? argv[argp++] : NULL;
+		attr_data = (argp < argc) ? argv[argp++] : NULL;
+	}
 
-	if(!path || !attr_name || argp < argc) {
+	if(!options.attr_name || (path && argp < argc) ||
+		(!path && argp >= argc))
+	{
 		fprintf(stderr, "usage: setxattr [-L"
 #if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
 			"|-c|-r"
@@ -133,11 +570,50 @@ int main(int argc, char **argv)
 #endif
 			"|-u|-s"
 #endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
-			"] <filename> <attribute name> "
+			"] [-E hex|base64] <filename> <attribute name> "
 #if defined(__APPLE__) || defined(__DARWIN__)
 			"[<attribute offset>] "
 #endif
-			"[<attribute data>]\n");
+			"[<attribute data>]\n"
+			"       setxattr [-L"
+#if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
+			"|-c|-r"
+#endif /* defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__) */
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#ifdef EXTATTR_NAMESPACE_EMPTY
+			"|-e"
+#endif
+			"|-u|-s"
+#endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
+			"] [-E hex|base64] [--durable|--sync-every <n>]\n"
+			"                [--checkpoint <file>] "
+			"[--resume <file>] [--trace <file>]\n"
+			"                [--background] [--max-rate <calls>] "
+			"[--max-bandwidth <bytes>]\n"
+			"                -n <attribute name> "
+			"[-v <attribute data>] <filename>...\n"
+			"       setxattr [-L"
+#if defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__)
+			"|-c|-r"
+#endif /* defined(__linux__) || defined(__APPLE__) || defined(__DARWIN__) */
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#ifdef EXTATTR_NAMESPACE_EMPTY
+			"|-e"
+#endif
+			"|-u|-s"
+#endif /* defined(__FreeBSD__) || defined(__NetBSD__) */
+			"] [-j <threads>] [--durable|--sync-every <n>]\n"
+			"                [--checkpoint <file>] "
+			"[--resume <file>] [--trace <file>]\n"
+			"                [--background] [--max-rate <calls>] "
+			"[--max-bandwidth <bytes>]\n"
+			"                --restore <dump file>\n");
+		goto out;
+	}
+
+	if(path && options.checkpoint) {
+		fprintf(stderr, "Error: Checkpoints are only supported with -n "
+			"or --restore.\n");
 		goto out;
 	}
 
@@ -146,8 +622,8 @@ int main(int argc, char **argv)
 		char *endptr = NULL;
 
 		errno = 0;
-		attr_offset = strtoull(attr_offset_string, &endptr, 0);
-		if(errno || ((*endptr || attr_offset > SIZE_MAX) &&
+		options.attr_offset = strtoull(attr_offset_string, &endptr, 0);
+		if(errno || ((*endptr || options.attr_offset > SIZE_MAX) &&
 			(errno = EILSEQ)))
 		{
 			fprintf(stderr, "Invalid offset: %s\n",
@@ -157,189 +633,153 @@ int main(int argc, char **argv)
 	}
 #endif
 
+#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+	if(options.attr_name[0] == '/') {
+		fprintf(stderr, "Invalid attribute name \"%s\" (cannot start "
+			"with '/').\n", options.attr_name);
+		goto out;
+	}
+#endif
+
 	if(attr_data) {
 		attr_data_size = strlen(attr_data);
 	}
 	else {
-		size_t alloc_size = 4096;
-
-		attr_data = NULL;
-		attr_data_size = 0;
-
-		while(1) {
-			char *new_attr_data;
-			ssize_t bytes_read;
-
-			new_attr_data = realloc(attr_data_alloc, alloc_size);
-			if(!new_attr_data) {
-				fprintf(stderr, "Error while %sallocating "
-					"attribute buffer to %zu bytes: %s "
-					"(errno=%d)\n",
-					attr_data ? "" : "re", alloc_size,
-					strerror(errno), errno);
-				goto out;
-			}
-
-			attr_data_alloc = new_attr_data;
-			attr_data = attr_data_alloc;
+		/* The data is read once and shared by all nodes. */
+		if(setxattr_read_stdin(&attr_data_alloc, &attr_data_size)) {
+			goto out;
+		}
 
-			bytes_read = read(STDIN_FILENO, 
-				&attr_data_alloc[attr_data_size],
-				alloc_size - attr_data_size);
-			if(bytes_read < 0) {
-				fprintf(stderr, "Error while reading xattr "
-					"data from stdin: %s (errno=%d)\n",
-					strerror(errno), errno);
-				goto out;
-			}
+		attr_data = attr_data_alloc;
+	}
 
-			if(!bytes_read) {
-				break;
-			}
+	if(encoding != CODEC_ENCODING_NONE) {
+		/* Decoded in place, in the stdin buffer or in the (writable)
+		 * argv string. */
+		char *encoded = attr_data_alloc ?
+			attr_data_alloc : (char*) attr_data;
+		size_t encoded_length = attr_data_size;
+		ssize_t decoded_length;
 
-			attr_data_size += bytes_read;
-			if(attr_data_size > alloc_size / 2) {
-				alloc_size *= 2;
-			}
+		/* Accept the trailing newline that getxattr -E, xxd and
+		 * base64 write, and hex values in the dump's 0x form. */
+		while(encoded_length && (encoded[encoded_length - 1] == '\n' ||
+			encoded[encoded_length - 1] == '\r'))
+		{
+			--encoded_length;
 		}
 
-		if(alloc_size != attr_data_size) {
-			char *new_attr_data;
-
-			new_attr_data =
-				realloc(attr_data_alloc, attr_data_size);
-			if(!new_attr_data) {
-				fprintf(stderr, "Error while shrinking "
-					"attribute buffer from %zu to %zu "
-					"bytes: %s (errno=%d)\n",
-					alloc_size, attr_data_size,
-					strerror(errno), errno);
-				goto out;
-			}
-
-			attr_data_alloc = new_attr_data;
-			attr_data = attr_data_alloc;
+		if(encoding == CODEC_ENCODING_HEX && encoded_length >= 2 &&
+			encoded[0] == '0' &&
+			(encoded[1] == 'x' || encoded[1] == 'X'))
+		{
+			encoded += 2;
+			encoded_length -= 2;
 		}
-	}
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attr_name[0] == '/') {
-		fprintf(stderr, "Invalid attribute name \"%s\" (cannot start "
-			"with '/').\n", attr_name);
-		goto out;
-	}
+		decoded_length = codec_decode(encoding, encoded,
+			encoded_length, encoded);
+		if(decoded_length < 0) {
+			fprintf(stderr, "Error: The attribute data is not "
+				"valid %s.\n",
+				(encoding == CODEC_ENCODING_HEX) ?
+				"hex" : "base64");
+			goto out;
+		}
 
-	nodefd = open(
-		path,
-		O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
-	if(nodefd == -1) {
-		fprintf(stderr, "Error while opening node \"%s\": %s (%d)\n",
-			path,
-			strerror(errno),
-			errno);
-		goto out;
+		attr_data = encoded;
+		attr_data_size = (size_t) decoded_length;
 	}
 
-	attrdirfd = openat(nodefd, ".", O_RDONLY | O_XATTR);
-	if(attrdirfd == -1) {
-		fprintf(stderr, "Error while opening \"%s\" node's attribute "
-			"directory: %s (%d)\n",
-			path,
-			strerror(errno),
-			errno);
-		goto out;
-	}
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	namespace = options.namespace;
 #endif
 
-#if defined(__APPLE__) || defined(__DARWIN__)
-	if(setxattr(
-		path,
-		attr_name,
-		attr_data,
-		attr_data_size,
-		attr_offset,
-		(follow_links ? 0 : XATTR_NOFOLLOW) |
-		(create ? XATTR_CREATE : 0) |
-		(replace ? XATTR_REPLACE : 0)))
-#elif defined(__linux__)
-	if((follow_links ? setxattr : lsetxattr)(
-		path,
-		attr_name,
-		attr_data,
-		attr_data_size,
-		(create ? XATTR_CREATE : 0) |
-		(replace ? XATTR_REPLACE : 0)))
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-	if((follow_links ? extattr_set_file : extattr_set_link)(
-		path,
-		namespace,
-		attr_name,
-		attr_data,
-		attr_data_size) < 0)
-#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	/* TODO: Solaris allows whole xattr directory hierarchies under a node.
-	 * To support creating attributes in xattr directory hierarchies we must
-	 * split any pathname components and create directories for them if they
-	 * do not exist. At the moment setting such xattrs will fail. */
-
-	/* If the attribute existed before, then we should remove it. */
-	if(unlinkat(attrdirfd, attr_name, 0) && errno != ENOENT) {
-		fprintf(stderr, "Error while removing existing extended "
-			"attribute  \"%s\" for node \"%s\": %s (%d)\n",
-			attr_name, path, strerror(errno), errno);
-		goto out;
+	if(path) {
+		if(setxattr_one(&options, path, options.attr_name, namespace,
+			attr_data, attr_data_size))
+		{
+			goto out;
+		}
 	}
+	else {
+		first = argp;
+		if(options.checkpoint) {
+			/* The value as it's set, decoded. */
+			checkpoint_hash_args(&checkpoint, options.attr_name,
+				strlen(options.attr_name));
+			checkpoint_hash_args(&checkpoint, attr_data,
+				attr_data_size);
+			checkpoint_hash_arg_list(&checkpoint, &argv[first],
+				(size_t) (argc - first));
+			if(resume_file &&
+				checkpoint_check_args(&checkpoint, resume_file))
+			{
+				goto out;
+			}
 
-	attrfd = openat(nodefd, attr_name,
-		O_WRONLY | O_CREAT | O_EXCL | O_XATTR, 0777);
-	if(attrfd == -1) {
-		fprintf(stderr, "Error while creating extended attribute "
-			"\"%s\" for node \"%s\": %s (%d)\n",
-			attr_name, path, strerror(errno), errno);
-		goto out;
-	}
+			if(checkpoint.position > (unsigned long long)
+				(argc - first))
+			{
+				fprintf(stderr, "Error: Checkpoint \"%s\" is "
+					"past the end of the file list.\n",
+					resume_file);
+				goto out;
+			}
 
-	/* Write out the attribute data. */
-	attr_bytes_written = write(attrfd, attr_data, attr_data_size);
-	if(attr_bytes_written >= 0 && attr_bytes_written != attr_data_size) {
-		fprintf(stderr, "Partial write while setting extended "
-			"attribute \"%s\" for node \"%s\": %zu / %zu bytes "
-			"written\n",
-			attr_name, path, attr_bytes_written, attr_data_size);
-		goto out;
-	}
-	else if(attr_bytes_written < 0)
-#else
-#error "Don't know how to handle extended attributes on this platform."
-#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
-	{
-		fprintf(stderr, "Failed to set extended attribute: %s "
-			"(errno=%d)\n",
-			strerror(errno), errno);
-		goto out;
+			argp = first + (int) checkpoint.position;
+		}
+
+		for(; argp < argc; ++argp) {
+			if(setxattr_one(&options, argv[argp], options.attr_name,
+				namespace, attr_data, attr_data_size))
+			{
+				failed = 1;
+				++checkpoint.errors;
+			}
+
+			++checkpoint.done;
+			checkpoint.position = (unsigned long long)
+				(argp + 1 - first);
+			if(options.checkpoint && (checkpoint_due(&checkpoint) ||
+				(failed && argp + 1 == argc)) &&
+				setxattr_save_checkpoint(&options))
+			{
+				goto out;
+			}
+		}
+
+		if(failed) {
+			goto out;
+		}
 	}
 
 	ret = (EXIT_SUCCESS);
 out:
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attrfd != -1) {
-		close(attrfd);
+	if(hooks_finish(&hooks)) {
+		ret = (EXIT_FAILURE);
 	}
-#endif
 
-	if(attr_data_alloc) {
-		free(attr_data_alloc);
+	if(options.durable && durable_finish(options.durable)) {
+		ret = (EXIT_FAILURE);
 	}
 
-#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
-	if(attrdirfd != -1) {
-		close(attrdirfd);
+	if(options.checkpoint) {
+		checkpoint_finish(&checkpoint, ret == (EXIT_SUCCESS));
 	}
 
-	if(nodefd != -1) {
-		close(nodefd);
+	if(attr_data_alloc) {
+		free(attr_data_alloc);
 	}
-#endif
+
+	xattrio_backend_cleanup();
 
 	return ret;
 }
+
+#ifndef XATTRPROGS_MULTICALL
+int main(int argc, char **argv)
+{
+	return setxattr_main(argc, argv);
+}
+#endif
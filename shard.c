@@ -0,0 +1,328 @@
+/*-
+ * shard.c - Output split over several files.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "shard.h"
+
+int shard_output_open(
+	struct shard_output *shards,
+	const char *prefix,
+	unsigned int count,
+	unsigned int workers,
+	const char *format)
+{
+	const size_t prefix_length = strlen(prefix);
+	unsigned int digits = 1;
+	unsigned int i;
+
+	memset(shards, 0, sizeof(*shards));
+	shards->prefix = prefix;
+	shards->format = format;
+	shards->count = count;
+	shards->workers = workers;
+
+	shards->chunk = SHARD_WORKER_BUFFERED / count;
+	if(shards->chunk < SHARD_MIN_CHUNK) {
+		shards->chunk = SHARD_MIN_CHUNK;
+	}
+	else if(shards->chunk > SHARD_MAX_CHUNK) {
+		shards->chunk = SHARD_MAX_CHUNK;
+	}
+
+	for(i = count - 1; i >= 10; i /= 10) {
+		++digits;
+	}
+
+	shards->fds = malloc(count * sizeof(shards->fds[0]));
+	if(!shards->fds) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto err;
+	}
+
+	/* Set before anything else can fail, shard_output_close() closes every
+	 * descriptor that isn't -1. */
+	for(i = 0; i < count; ++i) {
+		shards->fds[i] = -1;
+	}
+
+	shards->paths = calloc(count, sizeof(shards->paths[0]));
+	shards->bufs = calloc((size_t) count * workers,
+		sizeof(shards->bufs[0]));
+	if(!shards->paths || !shards->bufs) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto err;
+	}
+
+	for(i = 0; i < count; ++i) {
+		const size_t path_size = prefix_length + 1 + digits + 1;
+
+		shards->paths[i] = malloc(path_size);
+		if(!shards->paths[i]) {
+			fprintf(stderr, "Error while allocating memory: %s "
+				"(errno=%d)\n",
+				strerror(errno), errno);
+			goto err;
+		}
+
+		snprintf(shards->paths[i], path_size, "%s.%0*u", prefix,
+			(int) digits, i);
+		shards->fds[i] = open(shards->paths[i],
+			O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+		if(shards->fds[i] == -1) {
+			fprintf(stderr, "Error while creating \"%s\": %s "
+				"(errno=%d)\n",
+				shards->paths[i], strerror(errno), errno);
+			goto err;
+		}
+	}
+
+	return 0;
+err:
+	shard_output_close(shards, 0, 0);
+
+	return -1;
+}
+
+unsigned int shard_output_pick(
+	const struct shard_output *shards,
+	const char *path)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	while(*path) {
+		hash ^= (unsigned char) *path++;
+		hash *= 1099511628211ULL;
+	}
+
+	return (unsigned int) (hash % shards->count);
+}
+
+struct shard_buf* shard_output_buf(
+	struct shard_output *shards,
+	unsigned int worker,
+	unsigned int shard)
+{
+	return &shards->bufs[(size_t) worker * shards->count + shard];
+}
+
+int shard_output_flush(
+	struct shard_output *shards,
+	unsigned int shard,
+	struct shard_buf *buf)
+{
+	const char *data = buf->out.data;
+	size_t remaining = buf->out.len;
+
+	if(buf->out.failed) {
+		fprintf(stderr, "Error while collecting output for \"%s\": %s "
+			"(errno=%d)\n",
+			shards->paths[shard], strerror(buf->out.failed),
+			buf->out.failed);
+		buf->out.failed = 0;
+		buf->out.len = 0;
+		return -1;
+	}
+
+	while(remaining) {
+		const ssize_t written = write(shards->fds[shard], data,
+			remaining);
+
+		if(written < 0 && errno == EINTR) {
+			continue;
+		}
+		else if(written < 0) {
+			fprintf(stderr, "Error while writing to \"%s\": %s "
+				"(errno=%d)\n",
+				shards->paths[shard], strerror(errno), errno);
+			buf->out.len = 0;
+			return -1;
+		}
+
+		data += written;
+		remaining -= (size_t) written;
+		buf->bytes += (unsigned long long) written;
+	}
+
+	buf->out.len = 0;
+
+	return 0;
+}
+
+/**
+ * Write the manifest describing the closed files to <prefix>.manifest.
+ */
+static int shard_output_write_manifest(
+	const struct shard_output *shards,
+	int complete)
+{
+	int ret = -1;
+	const size_t prefix_length = strlen(shards->prefix);
+	char *manifest_path = NULL;
+	char *tmp_path = NULL;
+	struct outbuf out;
+	FILE *fp;
+	unsigned int i;
+	char buf[128];
+	int failed;
+	int err;
+
+	memset(&out, 0, sizeof(out));
+
+	manifest_path = malloc(prefix_length + sizeof(".manifest"));
+	tmp_path = malloc(prefix_length + sizeof(".manifest.tmp"));
+	if(!manifest_path || !tmp_path) {
+		fprintf(stderr, "Error while allocating memory: %s "
+			"(errno=%d)\n",
+			strerror(errno), errno);
+		goto out;
+	}
+
+	memcpy(manifest_path, shards->prefix, prefix_length);
+	memcpy(&manifest_path[prefix_length], ".manifest",
+		sizeof(".manifest"));
+	memcpy(tmp_path, shards->prefix, prefix_length);
+	memcpy(&tmp_path[prefix_length], ".manifest.tmp",
+		sizeof(".manifest.tmp"));
+
+	outbuf_puts(&out, "{\"format\":\"");
+	outbuf_puts(&out, shards->format);
+	snprintf(buf, sizeof(buf), "\",\"partition\":\"fnv1a64(path) %% %u\","
+		"\"complete\":%s,\"shards\":[\n",
+		shards->count, complete ? "true" : "false");
+	outbuf_puts(&out, buf);
+
+	for(i = 0; i < shards->count; ++i) {
+		unsigned long long nodes = 0;
+		unsigned long long bytes = 0;
+		unsigned int j;
+
+		for(j = 0; j < shards->workers; ++j) {
+			const struct shard_buf *const shard_buf =
+				&shards->bufs[(size_t) j * shards->count + i];
+
+			nodes += shard_buf->nodes;
+			bytes += shard_buf->bytes;
+		}
+
+		outbuf_putc(&out, '{');
+		json_put_member(&out, "file", "", shards->paths[i],
+			strlen(shards->paths[i]));
+		snprintf(buf, sizeof(buf),
+			",\"nodes\":%llu,\"bytes\":%llu}%s\n", nodes, bytes,
+			(i + 1 < shards->count) ? "," : "");
+		outbuf_puts(&out, buf);
+	}
+
+	outbuf_puts(&out, "]}\n");
+
+	fp = fopen(tmp_path, "w");
+	if(!fp) {
+		fprintf(stderr, "Error while creating \"%s\": %s (errno=%d)\n",
+			tmp_path, strerror(errno), errno);
+		goto out;
+	}
+
+	failed = outbuf_flush(&out, fp);
+	err = errno;
+	if(fclose(fp) && !failed) {
+		failed = -1;
+		err = errno;
+	}
+
+	if(failed) {
+		fprintf(stderr, "Error while writing \"%s\": %s (errno=%d)\n",
+			tmp_path, strerror(err), err);
+		unlink(tmp_path);
+		goto out;
+	}
+
+	if(rename(tmp_path, manifest_path)) {
+		fprintf(stderr, "Error while renaming \"%s\" to \"%s\": %s "
+			"(errno=%d)\n",
+			tmp_path, manifest_path, strerror(errno), errno);
+		unlink(tmp_path);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	outbuf_free(&out);
+	free(manifest_path);
+	free(tmp_path);
+
+	return ret;
+}
+
+int shard_output_close(
+	struct shard_output *shards,
+	int write_manifest,
+	int complete)
+{
+	int ret = 0;
+	unsigned int i;
+
+	for(i = 0; shards->fds && i < shards->count; ++i) {
+		if(shards->fds[i] != -1 && close(shards->fds[i])) {
+			fprintf(stderr, "Error while closing \"%s\": %s "
+				"(errno=%d)\n",
+				shards->paths[i], strerror(errno), errno);
+			ret = -1;
+		}
+	}
+
+	if(!ret && write_manifest &&
+		shard_output_write_manifest(shards, complete))
+	{
+		ret = -1;
+	}
+
+	if(shards->bufs) {
+		for(i = 0; i < shards->count * shards->workers; ++i) {
+			outbuf_free(&shards->bufs[i].out);
+		}
+	}
+
+	for(i = 0; shards->paths && i < shards->count; ++i) {
+		free(shards->paths[i]);
+	}
+
+	free(shards->paths);
+	free(shards->fds);
+	free(shards->bufs);
+	memset(shards, 0, sizeof(*shards));
+
+	return ret;
+}
@@ -0,0 +1,121 @@
+/*-
+ * shard.h - Output split over several files.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_SHARD_H
+#define _XATTRPROGS_SHARD_H
+
+#include "outbuf.h"
+
+/* Most output held per worker (over all its shard buffers) before it's
+ * written out, and the range of sizes that one buffer is written at. */
+#define SHARD_WORKER_BUFFERED (16 * 1024 * 1024)
+#define SHARD_MIN_CHUNK (64 * 1024)
+#define SHARD_MAX_CHUNK (1024 * 1024)
+
+/**
+ * The output that one worker has collected for one shard, and how much of it
+ * it has written.
+ */
+struct shard_buf {
+	struct outbuf out;
+	unsigned long long nodes;
+	unsigned long long bytes;
+};
+
+/**
+ * Output split over @count files <prefix>.<n>, with the node output of each
+ * path going to the file picked by its hash, so that the files can be loaded
+ * in parallel.
+ *
+ * Every worker has its own buffer for each file and appends it to the file
+ * with a single O_APPEND write once it's large enough. The workers never
+ * wait for each other: the output of a node is never split over writes, and
+ * appends to a file don't interleave (on local filesystems).
+ */
+struct shard_output {
+	const char *prefix;
+	const char *format;
+	unsigned int count;
+	unsigned int workers;
+	size_t chunk;
+	char **paths;
+	int *fds;
+
+	/* @count buffers for each worker, by worker index. */
+	struct shard_buf *bufs;
+};
+
+/**
+ * Create the @count files for @prefix (truncating existing ones) and buffers
+ * for @workers workers. @format describes the contents of the files in the
+ * manifest.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int shard_output_open(
+	struct shard_output *shards,
+	const char *prefix,
+	unsigned int count,
+	unsigned int workers,
+	const char *format);
+
+/**
+ * Get the index of the file that the output of @path goes to: the FNV-1a
+ * hash of the path modulo the number of files.
+ */
+unsigned int shard_output_pick(
+	const struct shard_output *shards,
+	const char *path);
+
+/**
+ * Get the buffer of @worker for file @shard.
+ */
+struct shard_buf* shard_output_buf(
+	struct shard_output *shards,
+	unsigned int worker,
+	unsigned int shard);
+
+/**
+ * Append the contents of @buf to file @shard and empty it. Called by the
+ * worker owning @buf only.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int shard_output_flush(
+	struct shard_output *shards,
+	unsigned int shard,
+	struct shard_buf *buf);
+
+/**
+ * Close the files and, if @write_manifest is set, describe them in the
+ * manifest <prefix>.manifest: a JSON object with the format, the number of
+ * files, how paths are partitioned, whether the output is @complete (every
+ * node was listed without errors) and each file's name, number of nodes and
+ * size. The manifest is written last, and replaced atomically, so its presence
+ * means that the files are done. Unflushed buffers are dropped.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int shard_output_close(
+	struct shard_output *shards,
+	int write_manifest,
+	int complete);
+
+#endif /* !defined(_XATTRPROGS_SHARD_H) */
@@ -0,0 +1,506 @@
+/*-
+ * snapshot.c - Snapshots of extended attributes for incremental scans.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "XASNAP01"
+#define SNAPSHOT_END_MAGIC "XASNAPND"
+#define SNAPSHOT_BYTE_ORDER 0x01020304U
+
+/* Size of the trailer: index offset, entry count and end magic. */
+#define SNAPSHOT_TRAILER_SIZE 24
+
+/* Marks an attribute without a value in a record. */
+#define SNAPSHOT_NO_VALUE UINT32_MAX
+
+int snapshot_stat(
+	const char *path,
+	int follow_links,
+	struct snapshot_key *out_key)
+{
+#ifdef HAVE_STATX
+	struct statx stx;
+
+	if(statx(AT_FDCWD, path, follow_links ? 0 : AT_SYMLINK_NOFOLLOW,
+		STATX_INO | STATX_CTIME, &stx))
+	{
+		return -1;
+	}
+
+	out_key->dev = ((unsigned long long) stx.stx_dev_major << 32) |
+		stx.stx_dev_minor;
+	out_key->ino = stx.stx_ino;
+	out_key->ctime_sec = stx.stx_ctime.tv_sec;
+	out_key->ctime_nsec = stx.stx_ctime.tv_nsec;
+#else
+	struct stat stbuf;
+
+	if(follow_links ? stat(path, &stbuf) : lstat(path, &stbuf)) {
+		return -1;
+	}
+
+	out_key->dev = (unsigned long long) stbuf.st_dev;
+	out_key->ino = stbuf.st_ino;
+	out_key->ctime_sec = stbuf.st_ctim.tv_sec;
+	out_key->ctime_nsec = stbuf.st_ctim.tv_nsec;
+#endif
+
+	return 0;
+}
+
+static int snapshot_compare_keys(
+	const struct snapshot_key *a,
+	const struct snapshot_key *b)
+{
+	if(a->dev != b->dev) {
+		return (a->dev < b->dev) ? -1 : 1;
+	}
+	else if(a->ino != b->ino) {
+		return (a->ino < b->ino) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static int snapshot_compare_entries(
+	const void *a,
+	const void *b)
+{
+	return snapshot_compare_keys(&((const struct snapshot_entry*) a)->key,
+		&((const struct snapshot_entry*) b)->key);
+}
+
+static size_t snapshot_header_size(
+	size_t options_length)
+{
+	return (16 + options_length + 7) & ~(size_t) 7;
+}
+
+int snapshot_open(
+	struct snapshot *snapshot,
+	const char *file,
+	const char *options)
+{
+	const size_t options_length = strlen(options);
+	const char *data;
+	const char *reason = NULL;
+	struct stat stbuf;
+	unsigned long long index_offset;
+	unsigned long long count;
+	uint32_t byte_order;
+	uint32_t length;
+	size_t i;
+	int fd;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if(fd == -1 || fstat(fd, &stbuf)) {
+		fprintf(stderr, "Error while opening snapshot \"%s\": %s "
+			"(errno=%d)\n", file, strerror(errno), errno);
+		if(fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	if((unsigned long long) stbuf.st_size <
+		snapshot_header_size(0) + SNAPSHOT_TRAILER_SIZE)
+	{
+		close(fd);
+		reason = "too short";
+		goto invalid;
+	}
+
+	snapshot->map_size = (size_t) stbuf.st_size;
+	snapshot->map = mmap(NULL, snapshot->map_size, PROT_READ, MAP_PRIVATE,
+		fd, 0);
+	close(fd);
+	if(snapshot->map == MAP_FAILED) {
+		snapshot->map = NULL;
+		fprintf(stderr, "Error while mapping snapshot \"%s\": %s "
+			"(errno=%d)\n", file, strerror(errno), errno);
+		return -1;
+	}
+
+	data = snapshot->map;
+	memcpy(&byte_order, &data[8], 4);
+	memcpy(&length, &data[12], 4);
+	if(memcmp(data, SNAPSHOT_MAGIC, 8) ||
+		memcmp(&data[snapshot->map_size - 8], SNAPSHOT_END_MAGIC, 8))
+	{
+		reason = "not a snapshot, or incomplete";
+		goto invalid;
+	}
+	else if(byte_order != SNAPSHOT_BYTE_ORDER) {
+		reason = "written on a machine with another byte order";
+		goto invalid;
+	}
+	else if(length != options_length || snapshot_header_size(length) +
+		SNAPSHOT_TRAILER_SIZE > snapshot->map_size ||
+		memcmp(&data[16], options, options_length))
+	{
+		reason = "taken with other options";
+		goto invalid;
+	}
+
+	memcpy(&index_offset, &data[snapshot->map_size - 24], 8);
+	memcpy(&count, &data[snapshot->map_size - 16], 8);
+	if(index_offset % 8 || index_offset > snapshot->map_size -
+		SNAPSHOT_TRAILER_SIZE || count > (snapshot->map_size -
+		SNAPSHOT_TRAILER_SIZE - index_offset) /
+		sizeof(struct snapshot_entry))
+	{
+		reason = "bad index";
+		goto invalid;
+	}
+
+	snapshot->index = (const void*) &data[index_offset];
+	snapshot->count = (size_t) count;
+
+	/* Check the records once here rather than on every lookup. */
+	for(i = 0; i < snapshot->count; ++i) {
+		const struct snapshot_entry *entry = &snapshot->index[i];
+
+		if(entry->offset > index_offset ||
+			entry->length > index_offset - entry->offset)
+		{
+			reason = "bad index";
+			goto invalid;
+		}
+	}
+
+	return 0;
+invalid:
+	fprintf(stderr, "Error: Snapshot \"%s\" can't be used: %s.\n", file,
+		reason);
+	snapshot_close(snapshot);
+
+	return -1;
+}
+
+void snapshot_close(
+	struct snapshot *snapshot)
+{
+	if(snapshot->map) {
+		munmap(snapshot->map, snapshot->map_size);
+	}
+
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+
+int snapshot_lookup(
+	const struct snapshot *snapshot,
+	const struct snapshot_key *key,
+	const char **out_data,
+	size_t *out_length)
+{
+	size_t lo = 0;
+	size_t hi = snapshot->count;
+
+	while(lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const struct snapshot_entry *entry = &snapshot->index[mid];
+		const int res = snapshot_compare_keys(key, &entry->key);
+
+		if(res < 0) {
+			hi = mid;
+		}
+		else if(res > 0) {
+			lo = mid + 1;
+		}
+		else if(entry->key.ctime_sec != key->ctime_sec ||
+			entry->key.ctime_nsec != key->ctime_nsec)
+		{
+			/* Changed since the snapshot was taken. */
+			return -1;
+		}
+		else {
+			*out_data = &((const char*) snapshot->map)[
+				entry->offset];
+			*out_length = (size_t) entry->length;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int snapshot_next_attr(
+	const char *data,
+	size_t length,
+	size_t *pos,
+	struct snapshot_attr *out_attr)
+{
+	int32_t namespace;
+	uint32_t name_length;
+	uint32_t value_length;
+
+	if(length - *pos < 12) {
+		return 0;
+	}
+
+	memcpy(&namespace, &data[*pos], 4);
+	memcpy(&name_length, &data[*pos + 4], 4);
+	memcpy(&value_length, &data[*pos + 8], 4);
+	*pos += 12;
+
+	if(name_length > length - *pos) {
+		*pos = length;
+		return 0;
+	}
+
+	out_attr->namespace = namespace;
+	out_attr->name = &data[*pos];
+	out_attr->name_length = name_length;
+	*pos += name_length;
+
+	if(value_length == SNAPSHOT_NO_VALUE) {
+		out_attr->value = NULL;
+		out_attr->value_length = 0;
+		return 1;
+	}
+	else if(value_length > length - *pos) {
+		*pos = length;
+		return 0;
+	}
+
+	out_attr->value = &data[*pos];
+	out_attr->value_length = value_length;
+	*pos += value_length;
+
+	return 1;
+}
+
+void snapshot_put_attr(
+	struct outbuf *record,
+	int namespace,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length)
+{
+	const int32_t ns = namespace;
+	const uint32_t name_length32 = (uint32_t) name_length;
+	const uint32_t value_length32 = value ? (uint32_t) value_length :
+		SNAPSHOT_NO_VALUE;
+
+	outbuf_append(record, &ns, 4);
+	outbuf_append(record, &name_length32, 4);
+	outbuf_append(record, &value_length32, 4);
+	outbuf_append(record, name, name_length);
+	if(value) {
+		outbuf_append(record, value, value_length);
+	}
+}
+
+int snapshot_writer_open(
+	struct snapshot_writer *writer,
+	const char *file,
+	const char *options)
+{
+	static const char padding[8];
+	const size_t file_length = strlen(file);
+	const uint32_t byte_order = SNAPSHOT_BYTE_ORDER;
+	const uint32_t options_length = (uint32_t) strlen(options);
+	size_t header_size;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->file = file;
+	pthread_mutex_init(&writer->lock, NULL);
+
+	writer->tmp_file = malloc(file_length + 5);
+	if(!writer->tmp_file) {
+		goto error;
+	}
+	memcpy(writer->tmp_file, file, file_length);
+	memcpy(&writer->tmp_file[file_length], ".tmp", 5);
+
+	writer->stream = fopen(writer->tmp_file, "wb");
+	if(!writer->stream) {
+		goto error;
+	}
+
+	header_size = snapshot_header_size(options_length);
+	if(fwrite(SNAPSHOT_MAGIC, 8, 1, writer->stream) != 1 ||
+		fwrite(&byte_order, 4, 1, writer->stream) != 1 ||
+		fwrite(&options_length, 4, 1, writer->stream) != 1 ||
+		fwrite(options, 1, options_length, writer->stream) !=
+		options_length ||
+		fwrite(padding, 1, header_size - 16 - options_length,
+		writer->stream) != header_size - 16 - options_length)
+	{
+		goto error;
+	}
+
+	writer->offset = header_size;
+
+	return 0;
+error:
+	fprintf(stderr, "Error while creating snapshot \"%s\": %s "
+		"(errno=%d)\n", file, strerror(errno), errno);
+	if(writer->stream) {
+		fclose(writer->stream);
+		unlink(writer->tmp_file);
+	}
+	free(writer->tmp_file);
+	pthread_mutex_destroy(&writer->lock);
+	memset(writer, 0, sizeof(*writer));
+
+	return -1;
+}
+
+void snapshot_writer_add(
+	struct snapshot_writer *writer,
+	const struct snapshot_key *key,
+	const char *data,
+	size_t length)
+{
+	struct snapshot_entry *entry;
+
+	pthread_mutex_lock(&writer->lock);
+	if(writer->failed) {
+		goto out;
+	}
+
+	if(writer->count == writer->capacity) {
+		const size_t new_capacity =
+			writer->capacity ? writer->capacity * 2 : 1024;
+		struct snapshot_entry *new_entries;
+
+		new_entries = realloc(writer->entries,
+			new_capacity * sizeof(new_entries[0]));
+		if(!new_entries) {
+			writer->failed = errno;
+			goto out;
+		}
+
+		writer->entries = new_entries;
+		writer->capacity = new_capacity;
+	}
+
+	if(length && fwrite(data, 1, length, writer->stream) != length) {
+		writer->failed = errno;
+		goto out;
+	}
+
+	entry = &writer->entries[writer->count++];
+	entry->key = *key;
+	entry->offset = writer->offset;
+	entry->length = length;
+	writer->offset += length;
+out:
+	pthread_mutex_unlock(&writer->lock);
+}
+
+int snapshot_writer_close(
+	struct snapshot_writer *writer,
+	int commit)
+{
+	static const char padding[8];
+	const size_t pad = (size_t) ((8 - writer->offset % 8) % 8);
+	unsigned long long index_offset;
+	unsigned long long count;
+	size_t i;
+	size_t kept;
+	int ret = -1;
+	int res;
+
+	if(!writer->stream) {
+		return 0;
+	}
+
+	if(!commit) {
+		fclose(writer->stream);
+		unlink(writer->tmp_file);
+		ret = 0;
+		goto out;
+	}
+
+	if(writer->failed) {
+		errno = writer->failed;
+		goto error;
+	}
+
+	/* Nodes seen more than once (hard links) keep their first record. */
+	qsort(writer->entries, writer->count, sizeof(writer->entries[0]),
+		snapshot_compare_entries);
+	for(i = 0, kept = 0; i < writer->count; ++i) {
+		if(kept && !snapshot_compare_keys(&writer->entries[i].key,
+			&writer->entries[kept - 1].key))
+		{
+			continue;
+		}
+
+		writer->entries[kept++] = writer->entries[i];
+	}
+
+	index_offset = writer->offset + pad;
+	count = kept;
+	if(fwrite(padding, 1, pad, writer->stream) != pad ||
+		(kept && fwrite(writer->entries, sizeof(writer->entries[0]),
+		kept, writer->stream) != kept) ||
+		fwrite(&index_offset, 8, 1, writer->stream) != 1 ||
+		fwrite(&count, 8, 1, writer->stream) != 1 ||
+		fwrite(SNAPSHOT_END_MAGIC, 8, 1, writer->stream) != 1 ||
+		fflush(writer->stream) || fsync(fileno(writer->stream)))
+	{
+		goto error;
+	}
+
+	res = fclose(writer->stream);
+	writer->stream = NULL;
+	if(res || rename(writer->tmp_file, writer->file)) {
+		goto error;
+	}
+
+	ret = 0;
+	goto out;
+error:
+	fprintf(stderr, "Error while writing snapshot \"%s\": %s "
+		"(errno=%d)\n", writer->file, strerror(errno), errno);
+	if(writer->stream) {
+		fclose(writer->stream);
+	}
+	unlink(writer->tmp_file);
+out:
+	free(writer->tmp_file);
+	free(writer->entries);
+	pthread_mutex_destroy(&writer->lock);
+	memset(writer, 0, sizeof(*writer));
+
+	return ret;
+}
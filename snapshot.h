@@ -0,0 +1,183 @@
+/*-
+ * snapshot.h - Snapshots of extended attributes for incremental scans.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_SNAPSHOT_H
+#define _XATTRPROGS_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "outbuf.h"
+
+/*
+ * A snapshot records the extended attributes that a recursive listing found
+ * on each node, together with the node's identity and status change time, so
+ * that the next run can skip the xattr calls for every node whose ctime
+ * hasn't moved (any change to a node's attributes updates its ctime). The
+ * file is binary, in native byte order, and is memory-mapped when read:
+ *
+ *   header:  "XASNAP01", u32 byte order mark, u32 length of the options
+ *            string, the options string padded to 8 bytes
+ *   records: one per node, see snapshot_put_attr
+ *   index:   struct snapshot_entry for every node, sorted by device and
+ *            inode number
+ *   trailer: u64 index offset, u64 index entries, "XASNAPND"
+ *
+ * The options string describes what the records contain (e.g. whether
+ * values are included) and has to match for a snapshot to be used.
+ */
+
+/* Identity and change time of a node. */
+struct snapshot_key {
+	unsigned long long dev;
+	unsigned long long ino;
+	long long ctime_sec;
+	unsigned long long ctime_nsec;
+};
+
+struct snapshot_entry {
+	struct snapshot_key key;
+	unsigned long long offset;
+	unsigned long long length;
+};
+
+/* One attribute of a record, as returned by snapshot_next_attr. The value
+ * is NULL if the record holds names only. */
+struct snapshot_attr {
+	int namespace;
+	const char *name;
+	size_t name_length;
+	const char *value;
+	size_t value_length;
+};
+
+/* A snapshot opened for reading. */
+struct snapshot {
+	void *map;
+	size_t map_size;
+	const struct snapshot_entry *index;
+	size_t count;
+};
+
+/* A snapshot being written, shared by the worker threads. */
+struct snapshot_writer {
+	const char *file;
+	char *tmp_file;
+	FILE *stream;
+	unsigned long long offset;
+	int failed;
+
+	pthread_mutex_t lock;
+	struct snapshot_entry *entries;
+	size_t count;
+	size_t capacity;
+};
+
+/**
+ * Get the key of the node at @path, following a symbolic link if
+ * @follow_links is set. Returns 0 on success, or -1 with errno set.
+ */
+int snapshot_stat(
+	const char *path,
+	int follow_links,
+	struct snapshot_key *out_key);
+
+/**
+ * Map the snapshot @file. Fails if it isn't a valid snapshot or was written
+ * with other options than @options.
+ *
+ * Returns 0 on success, or -1 after reporting an error.
+ */
+int snapshot_open(
+	struct snapshot *snapshot,
+	const char *file,
+	const char *options);
+
+void snapshot_close(
+	struct snapshot *snapshot);
+
+/**
+ * Find the record of the node with key @key, which matches only if the ctime
+ * is the same as well. Returns 0 and the record in @out_data and @out_length
+ * if found, -1 if not.
+ */
+int snapshot_lookup(
+	const struct snapshot *snapshot,
+	const struct snapshot_key *key,
+	const char **out_data,
+	size_t *out_length);
+
+/**
+ * Iterate over the attributes in a record. @pos starts at 0. Returns 1 and
+ * the next attribute in @out_attr, or 0 at the end (or if the record is
+ * malformed).
+ */
+int snapshot_next_attr(
+	const char *data,
+	size_t length,
+	size_t *pos,
+	struct snapshot_attr *out_attr);
+
+/**
+ * Append an attribute to a record being built in @record, which has to be
+ * emptied before a new record is started. @value is NULL for names only.
+ */
+void snapshot_put_attr(
+	struct outbuf *record,
+	int namespace,
+	const char *name,
+	size_t name_length,
+	const char *value,
+	size_t value_length);
+
+/**
+ * Start writing a new snapshot to a temporary file next to @file.
+ *
+ * Returns 0 on success, or -1 after reporting an error.
+ */
+int snapshot_writer_open(
+	struct snapshot_writer *writer,
+	const char *file,
+	const char *options);
+
+/**
+ * Add the record of the node with key @key. A record with no attributes
+ * (@length 0) is valid. Safe to call from several threads. Errors are
+ * reported when the snapshot is committed.
+ */
+void snapshot_writer_add(
+	struct snapshot_writer *writer,
+	const struct snapshot_key *key,
+	const char *data,
+	size_t length);
+
+/**
+ * Finish the snapshot. If @commit is set the index is written, the file
+ * flushed to disk and moved into place, otherwise the temporary file is
+ * removed.
+ *
+ * Returns 0 on success, or -1 after reporting an error.
+ */
+int snapshot_writer_close(
+	struct snapshot_writer *writer,
+	int commit);
+
+#endif /* !defined(_XATTRPROGS_SNAPSHOT_H) */
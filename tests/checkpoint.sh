@@ -0,0 +1,82 @@
+#!/bin/sh
+# checkpoint.sh - A resumed scan finishes what the interrupted one left.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+. "${srcdir:-.}/tests/common.sh"
+
+make_tree
+
+backend "fill=2x8"
+listxattr -R -v --sorted t > whole
+total=$(grep -c '^# file: ' whole)
+[ "$total" -gt 40 ] || fail "the tree is too small ($total nodes)"
+
+# A checkpoint as the scan saves it after the output of the first $done
+# nodes has been written.
+for done in 1 17 40 $((total - 1)); do
+	path=$(sed -n 's/^# file: //p' whole | sed -n "${done}p")
+	printf '# xattrprogs checkpoint\ntool=listxattr\nmode=scan\n' > ck
+	printf 'position=0\npath=%s\ndone=%s\nerrors=0\n' "$path" "$done" >> ck
+
+	awk -v n="$done" 'BEGIN { RS = ""; ORS = "\n\n" } NR <= n' \
+		whole > resumed
+	listxattr -R -v --sorted -j 4 --resume ck t >> resumed
+	cmp whole resumed || fail "resuming after node $done differs"
+	[ ! -f ck ] || fail "the checkpoint wasn't removed when done"
+done
+
+# Resuming after the last node has nothing left to do.
+path=$(sed -n 's/^# file: //p' whole | tail -n 1)
+printf '# xattrprogs checkpoint\ntool=listxattr\nmode=scan\n' > ck
+printf 'position=0\npath=%s\ndone=%s\nerrors=0\n' "$path" "$total" >> ck
+listxattr -R -v --sorted --resume ck t > rest
+[ ! -s rest ] || fail "resuming a finished scan listed nodes again"
+
+# Checkpoints of other tools are refused.
+printf '# xattrprogs checkpoint\ntool=setxattr\nmode=scan\nposition=0\n' > ck
+if listxattr -R -v --sorted --resume ck t > /dev/null 2>&1; then
+	fail "a checkpoint of another tool was accepted"
+fi
+
+# A checkpoint of a file list is only resumed with the same list and name.
+# removexattr fails on the file without the attribute and keeps the
+# checkpoint.
+rm -f store
+backend "file=store"
+: > f1
+: > f2
+setxattr -n user.x -v 1 f1 f2
+if removexattr -n user.x --checkpoint ck f1 none f2 2>/dev/null; then
+	fail "removing a missing attribute didn't fail"
+fi
+[ -f ck ] || fail "the failed run left no checkpoint"
+expect_status 1 removexattr -n user.x --resume ck none f1 f2
+expect_status 1 removexattr -n user.x --resume ck f1 none
+expect_status 1 removexattr -n user.y --resume ck f1 none f2
+expect_status 0 removexattr -n user.x --resume ck f1 none f2
+[ ! -f ck ] || fail "the finished run didn't remove the checkpoint"
+
+# Resuming after the first file of the same list skips it.
+if removexattr -n user.x --checkpoint ck none f1 f2 2>/dev/null; then
+	fail "removing a missing attribute didn't fail"
+fi
+setxattr -n user.x -v 1 f1 f2
+sed 's/^position=.*/position=1/' ck > ck.tmp
+mv ck.tmp ck
+expect_status 0 removexattr -n user.x --resume ck none f1 f2
+[ -z "$(listxattr f1 f2)" ] || fail "resuming didn't remove the attributes"
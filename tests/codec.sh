@@ -0,0 +1,61 @@
+#!/bin/sh
+# codec.sh - Hex and base64 values decode to what was encoded.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+. "${srcdir:-.}/tests/common.sh"
+
+: > f
+rm -f store
+backend "file=store"
+
+# A value with a NUL, a newline and bytes that need escaping in dumps.
+setxattr -E hex -n user.bin -v 00010a7f80ff225c41 f
+[ "$(getxattr -E hex -n user.bin f)" = 00010a7f80ff225c41 ] ||
+	fail "hex value didn't round-trip"
+[ "$(getxattr -E base64 -n user.bin f)" = AAEKf4D/IlxB ] ||
+	fail "hex value reads back wrong as base64"
+
+for value in "" Zg== Zm8= Zm9v AAEKf4D/IlxB; do
+	setxattr -E base64 -n user.b64 -v "$value" f
+	[ "$(getxattr -E base64 -n user.b64 f)" = "$value" ] ||
+		fail "base64 value \"$value\" didn't round-trip"
+done
+
+setxattr -n user.text -v hello f
+[ "$(getxattr -E hex -n user.text f)" = 68656c6c6f ] ||
+	fail "plain value reads back wrong as hex"
+
+# Invalid encodings are refused and leave the value alone.
+for value in 0 0g; do
+	if setxattr -E hex -n user.text -v "$value" f 2>/dev/null; then
+		fail "invalid hex \"$value\" was accepted"
+	fi
+done
+if setxattr -E base64 -n user.text -v 'Zm9v!' f 2>/dev/null; then
+	fail "invalid base64 was accepted"
+fi
+[ "$(getxattr -n user.text f)" = hello ] ||
+	fail "a rejected value changed the attribute"
+
+# Encoded values in a dump are decoded by --restore.
+printf '# file: f\nuser.x=0x68690a\nuser.y=0saGk=\n\n' > dump
+setxattr --restore dump
+[ "$(getxattr -E hex -n user.x f)" = 68690a ] ||
+	fail "0x value in a dump was restored wrong"
+[ "$(getxattr -n user.y f)" = hi ] ||
+	fail "0s value in a dump was restored wrong"
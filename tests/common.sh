@@ -0,0 +1,82 @@
+# common.sh - Shared setup for the tests, sourced by each test script.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+# The tests run the tools against the in-memory backend (see memxattr.h), so
+# they need no filesystem support for extended attributes. Only the directory
+# tree that recursive runs walk is real.
+
+set -e
+
+LC_ALL=C
+export LC_ALL
+
+top_builddir=$(cd "${top_builddir:-.}" && pwd)
+
+# Run a tool, either the separate program or through the multi-call binary.
+for tool in getxattr grepxattr listxattr mvxattr removexattr setxattr; do
+	if [ -x "$top_builddir/$tool" ]; then
+		eval "$tool() { \"\$top_builddir/$tool\" \"\$@\"; }"
+	else
+		eval "$tool() { \"\$top_builddir/xattrprogs\" $tool \"\$@\"; }"
+	fi
+done
+
+tmpdir=$(mktemp -d "${TMPDIR:-/tmp}/xattrprogs-test.XXXXXX")
+trap 'rm -rf "$tmpdir"' EXIT
+cd "$tmpdir"
+
+# Use the memory backend with the given options for the following runs.
+backend() {
+	XATTRPROGS_BACKEND="memory${1:+:$1}"
+	export XATTRPROGS_BACKEND
+}
+
+fail() {
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# Run a command and check its exit status.
+expect_status() {
+	expected=$1
+	shift
+	status=0
+	"$@" > /dev/null 2>&1 || status=$?
+	[ "$status" -eq "$expected" ] ||
+		fail "\"$*\" exited with $status instead of $expected"
+}
+
+# Build a tree below "t" with names that sort differently byte-wise than in
+# directory order and with some directories nested a few levels deep.
+make_tree() {
+	for d in b a a-b a.b 'x y' z0 z1 z2 z3 z4; do
+		mkdir -p "t/$d/sub/deeper"
+		for f in 9 10 1 _ '-' A a; do
+			: > "t/$d/$f"
+			: > "t/$d/sub/$f"
+		done
+		: > "t/$d/sub/deeper/leaf"
+	done
+	: > t/file
+}
+
+# Put each record of a dump on one line and sort the lines, for comparing
+# outputs whose records come in different orders.
+sort_records() {
+	awk 'BEGIN { RS = "" } { gsub(/\n/, "\\n"); print }' "$@" | sort
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# compress.sh - Compressed dumps restore to the same attributes.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+. "${srcdir:-.}/tests/common.sh"
+
+make_tree
+
+backend "fill=2x8"
+if ! listxattr --compress gzip t/file > /dev/null 2>&1; then
+	# Built without zlib.
+	exit 77
+fi
+
+listxattr -R -v --sorted t > plain
+listxattr -R -v --sorted --compress gzip t > dump.gz
+listxattr -R -v --compress gzip:9 -j 4 t > unsorted.gz
+
+# Restore into an empty store that is saved as a sorted dump, which must
+# then match the listing it came from.
+for input in dump.gz unsorted.gz; do
+	rm -f store
+	backend "file=store"
+	setxattr --restore "$input" || fail "restore from $input failed"
+	cmp plain store || fail "$input didn't restore the same attributes"
+done
+
+# Concatenated compressed streams are read one after the other.
+backend "fill=2x8"
+listxattr -v --compress gzip t/file > cat.gz
+listxattr -v --compress gzip t/a/1 >> cat.gz
+rm -f store
+backend "file=store"
+setxattr --restore cat.gz
+grep -c '^# file: ' store | grep -qx 2 ||
+	fail "concatenated streams weren't both restored"
@@ -0,0 +1,41 @@
+#!/bin/sh
+# exists.sh - Exit statuses of getxattr --exists.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+. "${srcdir:-.}/tests/common.sh"
+
+: > f
+backend "fill=2x8"
+
+expect_status 0 getxattr -q -n user.fake.0 f
+expect_status 0 getxattr -q -n user.fake.0 -n user.fake.1 f
+expect_status 1 getxattr -q -n user.missing f
+expect_status 1 getxattr -q -n user.fake.0 -n user.missing f
+expect_status 0 getxattr --exists --size -n user.fake.1 f
+
+printf '+\tuser.fake.0\tf\n-\tuser.missing\tf\n' > expected
+getxattr -q -n user.fake.0 -n user.missing f > lines || :
+cmp expected lines || fail "wrong lines for present and missing names"
+
+# Errors are told apart from missing attributes. With the native backend a
+# missing file is an error whatever the filesystem supports.
+XATTRPROGS_BACKEND=native
+expect_status 2 getxattr -q -n user.fake.0 missing
+backend "fill=2x8"
+if [ -w /dev/full ]; then
+	expect_status 2 getxattr -q -n user.missing --trace /dev/full f
+fi
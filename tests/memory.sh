@@ -0,0 +1,55 @@
+#!/bin/sh
+# memory.sh - The in-memory backend and its file= store.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+. "${srcdir:-.}/tests/common.sh"
+
+: > f
+
+# Generated attributes are there without being set.
+backend "fill=2x4"
+printf 'user.fake.0\nuser.fake.1\n' > expected
+listxattr f > names
+cmp expected names || fail "fill didn't generate the attributes"
+[ "$(getxattr -n user.fake.1 f)" = bbbb ] ||
+	fail "generated value is wrong"
+
+# Without file= nothing outlives the process.
+backend
+setxattr -n user.a -v 1 f
+if getxattr -n user.a f > /dev/null 2>&1; then
+	fail "attribute survived without file="
+fi
+
+# With file= each run sees the changes of the ones before it.
+rm -f store
+backend "file=store"
+setxattr -n user.a -v 1 f
+setxattr -n user.b -v 2 f
+removexattr -n user.a f
+printf 'user.b\n' > expected
+listxattr f > names
+cmp expected names || fail "store wasn't carried between runs"
+[ "$(getxattr -n user.b f)" = 2 ] || fail "stored value is wrong"
+grep -q '^# file: f$' store || fail "store isn't written as a dump"
+
+# A store that can't be parsed is an error and is left as it was.
+printf 'garbage\n' > store
+if getxattr -n user.b f > /dev/null 2>&1; then
+	fail "invalid store was accepted"
+fi
+[ "$(cat store)" = garbage ] || fail "invalid store was overwritten"
@@ -0,0 +1,36 @@
+#!/bin/sh
+# options.sh - Option parsing shared by the tools.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+. "${srcdir:-.}/tests/common.sh"
+
+: > f
+backend "fill=1x4"
+
+# A misspelt long option is an error, not the end of the options.
+expect_status 1 getxattr --exist -n user.fake.0 f
+expect_status 2 grepxattr --jsn aaaa f
+expect_status 1 listxattr --sortd f
+expect_status 1 mvxattr --prefech 2 user.fake.0 user.x f
+expect_status 1 removexattr --durabel f user.fake.0
+expect_status 1 setxattr --durabel f user.x y
+
+# Only "--" ends them.
+[ "$(getxattr -- f user.fake.0)" = aaaa ] || fail "\"--\" wasn't accepted"
+: > ./-f
+[ "$(getxattr -n user.fake.0 -- -f)" = aaaa ] ||
+	fail "a name after \"--\" was taken as an option"
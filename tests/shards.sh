@@ -0,0 +1,44 @@
+#!/bin/sh
+# shards.sh - Sharded output holds the same records as standard output.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+. "${srcdir:-.}/tests/common.sh"
+
+make_tree
+
+backend "fill=2x8"
+listxattr -R -v -j 4 t > whole
+listxattr -R -v -j 4 --shards 3 --output-prefix shard t
+
+[ -f shard.manifest ] || fail "no manifest was written"
+for i in 0 1 2; do
+	[ -f "shard.$i" ] || fail "shard $i is missing"
+done
+
+sort_records whole > whole.records
+sort_records shard.0 shard.1 shard.2 > shards.records
+cmp whole.records shards.records ||
+	fail "the shards don't add up to the unsharded output"
+
+# Each node goes to exactly one shard, the same one in every run.
+listxattr -R -v -j 1 --shards 3 --output-prefix again t
+for i in 0 1 2; do
+	sort_records "shard.$i" > a
+	sort_records "again.$i" > b
+	cmp a b || fail "shard $i differs between runs"
+done
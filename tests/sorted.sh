@@ -0,0 +1,39 @@
+#!/bin/sh
+# sorted.sh - Sorted output doesn't depend on the number of workers.
+#
+# Copyright (c) 2023 Erik Larsson
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 2 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 51
+# Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+. "${srcdir:-.}/tests/common.sh"
+
+make_tree
+
+# Latency and injected ERANGE retries make the workers finish out of order.
+backend "fill=3x8,latency=200,erange=0.05"
+listxattr -R -v --sorted -j 8 t > parallel
+listxattr -R -v --sorted -j 1 t > serial
+cmp serial parallel || fail "sorted output differs between -j 8 and -j 1"
+
+# Without --sorted the same records come out, in some order.
+listxattr -R -v -j 8 t > unsorted
+sort_records serial > serial.records
+sort_records unsorted > unsorted.records
+cmp serial.records unsorted.records ||
+	fail "sorted and unsorted runs list different records"
+
+# And the order is the byte-wise order of the paths.
+sed -n 's/^# file: //p' serial > paths
+sort paths | cmp - paths || fail "sorted output isn't in path order"
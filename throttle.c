@@ -0,0 +1,256 @@
+/*-
+ * throttle.c - Rate limiting for background operation.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "throttle.h"
+#include "units.h"
+
+/* Calls per latency measurement window. */
+#define THROTTLE_WINDOW_CALLS 64
+
+/* The in-flight limit is lowered when the average latency of a window is
+ * above THROTTLE_SLOW times the baseline, and raised when it's below
+ * THROTTLE_FAST times the baseline. */
+#define THROTTLE_SLOW 2.0
+#define THROTTLE_FAST 1.25
+
+#if defined(__linux__) && defined(SYS_ioprio_set)
+/* From linux/ioprio.h, which isn't always installed. */
+#define THROTTLE_IOPRIO_WHO_PROCESS 1
+#define THROTTLE_IOPRIO_CLASS_IDLE 3
+#define THROTTLE_IOPRIO_CLASS_SHIFT 13
+#endif
+
+static double throttle_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void throttle_sleep(
+	double seconds)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) seconds;
+	ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1e9);
+	while(nanosleep(&ts, &ts) && errno == EINTR) {
+		/* Sleep for the remaining time. */
+	}
+}
+
+void throttle_init(
+	struct throttle *throttle,
+	unsigned long long calls_per_second,
+	unsigned long long bytes_per_second,
+	unsigned int max_active)
+{
+	memset(throttle, 0, sizeof(*throttle));
+	pthread_mutex_init(&throttle->lock, NULL);
+	pthread_cond_init(&throttle->slot_free, NULL);
+
+	/* The buckets hold at most one second's worth of tokens. */
+	throttle->call_rate = (double) calls_per_second;
+	throttle->call_tokens = throttle->call_rate;
+	throttle->byte_rate = (double) bytes_per_second;
+	throttle->byte_tokens = throttle->byte_rate;
+	throttle->refilled = throttle_now();
+
+	throttle->max_active = max_active ? max_active : 1;
+	throttle->limit = throttle->max_active;
+}
+
+void throttle_destroy(
+	struct throttle *throttle)
+{
+	pthread_cond_destroy(&throttle->slot_free);
+	pthread_mutex_destroy(&throttle->lock);
+}
+
+static void throttle_refill(
+	struct throttle *throttle,
+	double now)
+{
+	const double elapsed = now - throttle->refilled;
+
+	throttle->refilled = now;
+	throttle->call_tokens += elapsed * throttle->call_rate;
+	if(throttle->call_tokens > throttle->call_rate) {
+		throttle->call_tokens = throttle->call_rate;
+	}
+
+	throttle->byte_tokens += elapsed * throttle->byte_rate;
+	if(throttle->byte_tokens > throttle->byte_rate) {
+		throttle->byte_tokens = throttle->byte_rate;
+	}
+}
+
+void throttle_begin(
+	struct throttle *throttle,
+	struct throttle_call *call)
+{
+	if(!throttle) {
+		return;
+	}
+
+	pthread_mutex_lock(&throttle->lock);
+	while(1) {
+		double wait = 0;
+
+		while(throttle->active >= throttle->limit) {
+			pthread_cond_wait(&throttle->slot_free,
+				&throttle->lock);
+		}
+
+		throttle_refill(throttle, throttle_now());
+		if(throttle->call_rate && throttle->call_tokens < 1) {
+			wait = (1 - throttle->call_tokens) /
+				throttle->call_rate;
+		}
+
+		if(throttle->byte_rate && throttle->byte_tokens < 0 &&
+			-throttle->byte_tokens / throttle->byte_rate > wait)
+		{
+			wait = -throttle->byte_tokens / throttle->byte_rate;
+		}
+
+		if(!wait) {
+			break;
+		}
+
+		pthread_mutex_unlock(&throttle->lock);
+		throttle_sleep(wait);
+		pthread_mutex_lock(&throttle->lock);
+	}
+
+	if(throttle->call_rate) {
+		throttle->call_tokens -= 1;
+	}
+
+	++throttle->active;
+	pthread_mutex_unlock(&throttle->lock);
+
+	call->start = throttle_now();
+}
+
+/**
+ * Adjust the in-flight limit at the end of a measurement window. Called with
+ * the lock held.
+ */
+static void throttle_adapt(
+	struct throttle *throttle)
+{
+	const double average = throttle->window_latency /
+		throttle->window_calls;
+
+	if(!throttle->baseline || average < throttle->baseline) {
+		throttle->baseline = average;
+	}
+	else {
+		/* Let the baseline follow slowly, so that a lasting change
+		 * of the storage doesn't keep the limit down forever. */
+		throttle->baseline += (average - throttle->baseline) / 1024;
+	}
+
+	if(average > THROTTLE_SLOW * throttle->baseline) {
+		throttle->limit -= (throttle->limit + 3) / 4;
+		if(!throttle->limit) {
+			throttle->limit = 1;
+		}
+	}
+	else if(average < THROTTLE_FAST * throttle->baseline &&
+		throttle->limit < throttle->max_active)
+	{
+		++throttle->limit;
+		pthread_cond_signal(&throttle->slot_free);
+	}
+
+	throttle->window_calls = 0;
+	throttle->window_latency = 0;
+}
+
+void throttle_end(
+	struct throttle *throttle,
+	const struct throttle_call *call,
+	size_t bytes)
+{
+	double now;
+
+	if(!throttle) {
+		return;
+	}
+
+	now = throttle_now();
+	pthread_mutex_lock(&throttle->lock);
+	if(throttle->byte_rate) {
+		throttle->byte_tokens -= (double) bytes;
+	}
+
+	throttle->window_latency += now - call->start;
+	if(++throttle->window_calls == THROTTLE_WINDOW_CALLS) {
+		throttle_adapt(throttle);
+	}
+
+	--throttle->active;
+	if(throttle->active < throttle->limit) {
+		pthread_cond_signal(&throttle->slot_free);
+	}
+	pthread_mutex_unlock(&throttle->lock);
+}
+
+void throttle_set_idle_io(
+	const char *progname)
+{
+#if defined(__linux__) && defined(SYS_ioprio_set)
+	if(syscall(SYS_ioprio_set, THROTTLE_IOPRIO_WHO_PROCESS, 0,
+		THROTTLE_IOPRIO_CLASS_IDLE << THROTTLE_IOPRIO_CLASS_SHIFT))
+	{
+		fprintf(stderr, "%s: Warning: Could not switch to the idle I/O "
+			"class: %s (errno=%d)\n",
+			progname, strerror(errno), errno);
+	}
+#else
+	(void) progname;
+#endif
+}
+
+int throttle_parse_rate(
+	const char *s,
+	unsigned long long *out_rate)
+{
+	return units_parse(s, ~0ULL, out_rate);
+}
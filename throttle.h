@@ -0,0 +1,116 @@
+/*-
+ * throttle.h - Rate limiting for background operation.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_THROTTLE_H
+#define _XATTRPROGS_THROTTLE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Limits used by --background unless given explicitly. */
+#define THROTTLE_DEFAULT_CALLS 1000
+#define THROTTLE_DEFAULT_BYTES (16 * 1024 * 1024)
+
+/**
+ * Keeps the xattr calls of a background operation from competing with other
+ * users of the storage. Calls are limited by two token buckets, one for the
+ * number of calls per second and one for the number of bytes transferred per
+ * second, and by a limit on the number of calls in flight that adapts to the
+ * measured call latency: it's lowered when calls get much slower than the
+ * fastest seen so far (a sign that the storage is busy) and raised again
+ * while they are fast, between 1 and the number of worker threads.
+ */
+struct throttle {
+	pthread_mutex_t lock;
+	pthread_cond_t slot_free;
+
+	/* Token buckets, in units and units per second. A rate of 0 means no
+	 * limit. The byte bucket may go negative since the size of a call's
+	 * result is only known afterwards. */
+	double call_rate;
+	double call_tokens;
+	double byte_rate;
+	double byte_tokens;
+	double refilled;
+
+	/* Calls in flight and their current and highest limit. */
+	unsigned int active;
+	unsigned int limit;
+	unsigned int max_active;
+
+	/* Latency of the calls finished in the current window, and the lowest
+	 * window average seen (slowly following the average upwards). */
+	unsigned int window_calls;
+	double window_latency;
+	double baseline;
+};
+
+/* Per call state, filled in by throttle_begin. */
+struct throttle_call {
+	double start;
+};
+
+/**
+ * Set up @throttle. @calls_per_second and @bytes_per_second are the bucket
+ * rates (0 for no limit), @max_active the number of worker threads.
+ */
+void throttle_init(
+	struct throttle *throttle,
+	unsigned long long calls_per_second,
+	unsigned long long bytes_per_second,
+	unsigned int max_active);
+
+void throttle_destroy(
+	struct throttle *throttle);
+
+/**
+ * Wait until another call may be made. Does nothing if @throttle is NULL.
+ */
+void throttle_begin(
+	struct throttle *throttle,
+	struct throttle_call *call);
+
+/**
+ * Account for a call started with throttle_begin that transferred @bytes
+ * bytes. Does nothing if @throttle is NULL.
+ */
+void throttle_end(
+	struct throttle *throttle,
+	const struct throttle_call *call,
+	size_t bytes);
+
+/**
+ * Move the calling process to the idle I/O scheduling class where the
+ * platform has one (Linux ioprio_set(2)), so that its I/O is only served when
+ * the disk is otherwise idle. Threads created afterwards inherit it. A
+ * failure is reported as a warning and otherwise ignored.
+ */
+void throttle_set_idle_io(
+	const char *progname);
+
+/**
+ * Parse the argument of a rate option: a positive number with an optional
+ * K, M or G (binary) suffix. Returns 0 on success, -1 if @s is not valid.
+ */
+int throttle_parse_rate(
+	const char *s,
+	unsigned long long *out_rate);
+
+#endif /* !defined(_XATTRPROGS_THROTTLE_H) */
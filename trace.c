@@ -0,0 +1,365 @@
+/*-
+ * trace.c - Latency traces of extended attribute calls.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "outbuf.h"
+#include "trace.h"
+
+/* Initial size of a thread's string buffer. */
+#define TRACE_THREAD_STRINGS (256 * 1024)
+
+unsigned long long trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long) ts.tv_sec * 1000000000ULL +
+		(unsigned long long) ts.tv_nsec;
+}
+
+/**
+ * Append a time in nanoseconds as the microseconds used by the format.
+ */
+static void trace_put_usec(
+	struct outbuf *out,
+	unsigned long long ns)
+{
+	char buf[48];
+
+	snprintf(buf, sizeof(buf), "%llu.%03llu", ns / 1000, ns % 1000);
+	outbuf_puts(out, buf);
+}
+
+/**
+ * Append a metadata event naming the process or a thread.
+ */
+static void trace_put_metadata(
+	struct outbuf *out,
+	const char *what,
+	int pid,
+	unsigned int tid,
+	const char *name)
+{
+	char buf[96];
+
+	snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"M\","
+		"\"pid\":%d,\"tid\":%u,\"args\":{", what, pid, tid);
+	outbuf_puts(out, buf);
+	json_put_member(out, "name", "", name, strlen(name));
+	outbuf_append(out, "}}", 2);
+}
+
+/**
+ * Write out and drop the buffered events of @thread. Called by the thread
+ * itself, or by trace_close once all threads are done.
+ */
+static void trace_thread_flush(
+	struct trace *trace,
+	struct trace_thread *thread)
+{
+	struct outbuf out;
+	size_t i;
+
+	memset(&out, 0, sizeof(out));
+
+	for(i = 0; i < thread->count; ++i) {
+		const struct trace_event *const event = &thread->events[i];
+		const char *const path = &thread->strings[event->path];
+		char buf[96];
+
+		outbuf_append(&out, ",\n{\"name\":\"", 11);
+		outbuf_puts(&out, event->op);
+		outbuf_append(&out, "\",\"cat\":\"xattr\",\"ph\":\"X\",\"ts\":",
+			30);
+		trace_put_usec(&out, event->start);
+		outbuf_append(&out, ",\"dur\":", 7);
+		trace_put_usec(&out, event->duration);
+		snprintf(buf, sizeof(buf), ",\"pid\":%d,\"tid\":%u,\"args\":{",
+			trace->pid, thread->tid);
+		outbuf_puts(&out, buf);
+		json_put_member(&out, "path", "", path, strlen(path));
+		if(event->name != (size_t) -1) {
+			const char *const name =
+				&thread->strings[event->name];
+
+			outbuf_putc(&out, ',');
+			json_put_member(&out, "name", "", name, strlen(name));
+		}
+
+		if(event->result == -1) {
+			snprintf(buf, sizeof(buf), ",\"result\":-1,"
+				"\"errno\":%d}}", event->err);
+		}
+		else {
+			snprintf(buf, sizeof(buf), ",\"result\":%lld}}",
+				event->result);
+		}
+
+		outbuf_puts(&out, buf);
+	}
+
+	thread->count = 0;
+	thread->strings_length = 0;
+
+	pthread_mutex_lock(&trace->lock);
+	if(outbuf_flush(&out, trace->file)) {
+		trace->failed = errno;
+	}
+	pthread_mutex_unlock(&trace->lock);
+
+	outbuf_free(&out);
+}
+
+/**
+ * Get the calling thread's buffer, creating it on the first call.
+ *
+ * Returns the buffer, or NULL if it can't be allocated.
+ */
+static struct trace_thread* trace_thread_get(
+	struct trace *trace)
+{
+	struct trace_thread *thread = pthread_getspecific(trace->key);
+
+	if(thread) {
+		return thread;
+	}
+
+	thread = calloc(1, sizeof(*thread));
+	if(thread) {
+		thread->events = malloc(TRACE_THREAD_EVENTS *
+			sizeof(thread->events[0]));
+		thread->strings = malloc(TRACE_THREAD_STRINGS);
+		thread->strings_size = TRACE_THREAD_STRINGS;
+	}
+
+	pthread_mutex_lock(&trace->lock);
+	if(!thread || !thread->events || !thread->strings) {
+		trace->failed = ENOMEM;
+		pthread_mutex_unlock(&trace->lock);
+		if(thread) {
+			free(thread->events);
+			free(thread->strings);
+			free(thread);
+		}
+
+		return NULL;
+	}
+
+	thread->tid = ++trace->threads_count;
+	thread->next = trace->threads;
+	trace->threads = thread;
+	pthread_mutex_unlock(&trace->lock);
+
+	pthread_setspecific(trace->key, thread);
+
+	return thread;
+}
+
+/**
+ * Copy @s into the string buffer of @thread.
+ *
+ * Returns its offset, or (size_t) -1 if the buffer can't be grown.
+ */
+static size_t trace_thread_string(
+	struct trace_thread *thread,
+	const char *s)
+{
+	const size_t size = strlen(s) + 1;
+	const size_t offset = thread->strings_length;
+
+	if(thread->strings_size - offset < size) {
+		size_t new_size = thread->strings_size * 2;
+		char *new_strings;
+
+		while(new_size - offset < size) {
+			new_size *= 2;
+		}
+
+		new_strings = realloc(thread->strings, new_size);
+		if(!new_strings) {
+			return (size_t) -1;
+		}
+
+		thread->strings = new_strings;
+		thread->strings_size = new_size;
+	}
+
+	memcpy(&thread->strings[offset], s, size);
+	thread->strings_length += size;
+
+	return offset;
+}
+
+void trace_add(
+	struct trace *trace,
+	const char *op,
+	const char *path,
+	const char *name,
+	unsigned long long start,
+	long long result)
+{
+	const int err = errno;
+	const unsigned long long end = trace_now();
+	struct trace_thread *thread;
+	struct trace_event *event;
+
+	thread = trace_thread_get(trace);
+	if(!thread) {
+		goto out;
+	}
+
+	if(thread->count == TRACE_THREAD_EVENTS ||
+		thread->strings_length >= TRACE_THREAD_STRINGS)
+	{
+		trace_thread_flush(trace, thread);
+	}
+
+	event = &thread->events[thread->count];
+	event->start = start - trace->origin;
+	event->duration = end - start;
+	event->op = op;
+	event->result = result;
+	event->err = (result == -1) ? err : 0;
+	event->path = trace_thread_string(thread, path);
+	event->name = name ? trace_thread_string(thread, name) : (size_t) -1;
+	if(event->path == (size_t) -1 || (name && event->name == (size_t) -1))
+	{
+		/* Dropped, strings added before the failure are just left
+		 * unused in the buffer. */
+		pthread_mutex_lock(&trace->lock);
+		trace->failed = ENOMEM;
+		pthread_mutex_unlock(&trace->lock);
+		goto out;
+	}
+
+	++thread->count;
+out:
+	errno = err;
+}
+
+int trace_open(
+	struct trace *trace,
+	const char *path,
+	const char *progname)
+{
+	struct outbuf out;
+	int err;
+
+	memset(trace, 0, sizeof(*trace));
+	trace->path = path;
+	trace->pid = (int) getpid();
+	trace->origin = trace_now();
+
+	trace->file = fopen(path, "w");
+	if(!trace->file) {
+		fprintf(stderr, "Error while creating trace file \"%s\": %s "
+			"(errno=%d)\n",
+			path, strerror(errno), errno);
+		return -1;
+	}
+
+	err = pthread_key_create(&trace->key, NULL);
+	if(err) {
+		fprintf(stderr, "Error while creating thread key: %s "
+			"(errno=%d)\n",
+			strerror(err), err);
+		fclose(trace->file);
+		return -1;
+	}
+
+	pthread_mutex_init(&trace->lock, NULL);
+
+	/* Every event is written with a separating ",\n" in front, so the
+	 * array starts with the process name. */
+	memset(&out, 0, sizeof(out));
+	outbuf_puts(&out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	trace_put_metadata(&out, "process_name", trace->pid, 0, progname);
+	if(outbuf_flush(&out, trace->file)) {
+		trace->failed = errno;
+	}
+
+	outbuf_free(&out);
+
+	return 0;
+}
+
+int trace_close(
+	struct trace *trace)
+{
+	int ret = 0;
+	struct trace_thread *thread;
+	struct outbuf out;
+
+	memset(&out, 0, sizeof(out));
+
+	for(thread = trace->threads; thread; thread = thread->next) {
+		char name[32];
+
+		trace_thread_flush(trace, thread);
+
+		snprintf(name, sizeof(name), "thread %u", thread->tid);
+		outbuf_append(&out, ",\n", 2);
+		trace_put_metadata(&out, "thread_name", trace->pid,
+			thread->tid, name);
+	}
+
+	outbuf_append(&out, "\n]}\n", 4);
+	if(outbuf_flush(&out, trace->file)) {
+		trace->failed = errno;
+	}
+
+	outbuf_free(&out);
+
+	if(fclose(trace->file) && !trace->failed) {
+		trace->failed = errno;
+	}
+
+	if(trace->failed) {
+		fprintf(stderr, "Error while writing trace file \"%s\": %s "
+			"(errno=%d)\n",
+			trace->path, strerror(trace->failed), trace->failed);
+		ret = -1;
+	}
+
+	while(trace->threads) {
+		thread = trace->threads;
+		trace->threads = thread->next;
+		free(thread->events);
+		free(thread->strings);
+		free(thread);
+	}
+
+	pthread_key_delete(trace->key);
+	pthread_mutex_destroy(&trace->lock);
+
+	return ret;
+}
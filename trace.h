@@ -0,0 +1,119 @@
+/*-
+ * trace.h - Latency traces of extended attribute calls.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_TRACE_H
+#define _XATTRPROGS_TRACE_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* Events buffered per thread before they are written out. */
+#define TRACE_THREAD_EVENTS 8192
+
+struct trace_event {
+	/* Start and duration in nanoseconds since the trace was opened. */
+	unsigned long long start;
+	unsigned long long duration;
+
+	/* Name of the call (a string constant), its result and errno if the
+	 * result was -1. */
+	const char *op;
+	long long result;
+	int err;
+
+	/* Offsets of the path and attribute name in the thread's string
+	 * buffer. The name offset is (size_t) -1 for calls without a name. */
+	size_t path;
+	size_t name;
+};
+
+/**
+ * Events recorded by one thread. Only the owning thread adds to it, without
+ * locking, until the buffer is full and the thread writes it out.
+ */
+struct trace_thread {
+	struct trace_thread *next;
+	unsigned int tid;
+	struct trace_event *events;
+	size_t count;
+	char *strings;
+	size_t strings_length;
+	size_t strings_size;
+};
+
+/**
+ * A trace of calls in the Chrome trace event format (the JSON format that
+ * chrome://tracing and Perfetto open), with one complete ("X") event per call
+ * on a track per thread. Events are collected in per-thread buffers and
+ * written out whenever a buffer fills up and when the trace is closed.
+ */
+struct trace {
+	const char *path;
+	FILE *file;
+	pthread_key_t key;
+	unsigned long long origin;
+	int pid;
+
+	/* Protects everything below. */
+	pthread_mutex_t lock;
+	struct trace_thread *threads;
+	unsigned int threads_count;
+	int failed;
+};
+
+/**
+ * Create the trace file @path and start the trace. @progname names the
+ * process in the trace.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int trace_open(
+	struct trace *trace,
+	const char *path,
+	const char *progname);
+
+/**
+ * Write out the events of all threads and finish the trace file. No thread
+ * may add events any more.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int trace_close(
+	struct trace *trace);
+
+/**
+ * Current time in nanoseconds on the clock used for the events.
+ */
+unsigned long long trace_now(void);
+
+/**
+ * Record a call started at @start (from trace_now) that ends now. @op must be
+ * a string constant. @name may be NULL. If @result is -1, errno is recorded
+ * with it. errno is left unchanged.
+ */
+void trace_add(
+	struct trace *trace,
+	const char *op,
+	const char *path,
+	const char *name,
+	unsigned long long start,
+	long long result);
+
+#endif /* !defined(_XATTRPROGS_TRACE_H) */
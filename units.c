@@ -0,0 +1,70 @@
+/*-
+ * units.c - Parsing of quantities with binary suffixes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "units.h"
+
+int units_parse(
+	const char *s,
+	unsigned long long max,
+	unsigned long long *out_value)
+{
+	char *endptr = NULL;
+	unsigned long long value;
+	unsigned int shift = 0;
+
+	errno = 0;
+	value = strtoull(s, &endptr, 10);
+	if(errno || endptr == s || s[0] == '-') {
+		return -1;
+	}
+
+	switch(*endptr) {
+	case 'k':
+	case 'K':
+		shift = 10;
+		++endptr;
+		break;
+	case 'm':
+	case 'M':
+		shift = 20;
+		++endptr;
+		break;
+	case 'g':
+	case 'G':
+		shift = 30;
+		++endptr;
+		break;
+	}
+
+	if(*endptr || !value || value > (max >> shift)) {
+		return -1;
+	}
+
+	*out_value = value << shift;
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+/*-
+ * units.h - Parsing of quantities with binary suffixes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_UNITS_H
+#define _XATTRPROGS_UNITS_H
+
+/**
+ * Parse a positive number with an optional K, M or G suffix (powers of 1024),
+ * like "64M". Returns 0 on success, -1 if @s isn't valid or the value is
+ * above @max.
+ */
+int units_parse(
+	const char *s,
+	unsigned long long max,
+	unsigned long long *out_value);
+
+#endif /* !defined(_XATTRPROGS_UNITS_H) */
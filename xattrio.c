@@ -0,0 +1,1123 @@
+/*-
+ * xattrio.c - Platform independent helpers for listing and reading extended
+ *             attributes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#include <sys/extattr.h>
+#endif
+#if defined(__APPLE__) || defined(__DARWIN__) || defined(__linux__)
+#include <sys/xattr.h>
+#endif
+
+#include "memxattr.h"
+#include "throttle.h"
+#include "trace.h"
+#include "xattrio.h"
+
+/* Set with xattrio_set_throttle, applied to every call. */
+static struct throttle *xattrio_throttle;
+
+/* Set with xattrio_set_trace, records every call. */
+static struct trace *xattrio_trace;
+
+/* Set with xattrio_set_backend, where every call is dispatched to. */
+static const struct xattrio_backend *xattrio_backend =
+	&xattrio_native_backend;
+
+/* Created by xattrio_backend_init for the "memory" backend. */
+static struct memxattr *xattrio_memxattr;
+
+/* Per thread counter set with xattrio_count_calls. */
+static pthread_key_t xattrio_calls_key;
+static pthread_once_t xattrio_calls_once = PTHREAD_ONCE_INIT;
+static int xattrio_calls_key_created;
+
+void xattrio_set_throttle(
+	struct throttle *throttle)
+{
+	xattrio_throttle = throttle;
+}
+
+static void xattrio_calls_key_create(void)
+{
+	xattrio_calls_key_created =
+		!pthread_key_create(&xattrio_calls_key, NULL);
+}
+
+void xattrio_count_calls(
+	unsigned long long *counter)
+{
+	pthread_once(&xattrio_calls_once, xattrio_calls_key_create);
+	if(xattrio_calls_key_created) {
+		pthread_setspecific(xattrio_calls_key, counter);
+	}
+}
+
+static void xattrio_count_call(void)
+{
+	unsigned long long *counter;
+
+	pthread_once(&xattrio_calls_once, xattrio_calls_key_create);
+	if(!xattrio_calls_key_created) {
+		return;
+	}
+
+	counter = pthread_getspecific(xattrio_calls_key);
+	if(counter) {
+		++*counter;
+	}
+}
+
+/* How many times we retry when an attribute or the attribute list grows
+ * between querying its size and reading it. */
+#define XATTRIO_MAX_RETRIES 8
+
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+/* The extattr API silently truncates the result instead of failing with
+ * ERANGE when the buffer is too small, so we can't read optimistically into
+ * the buffer that we already have and we must treat a completely filled
+ * buffer as a possibly truncated result. */
+#define XATTRIO_TRUNCATES 1
+#else
+#define XATTRIO_TRUNCATES 0
+#endif
+
+/* Whether the platform has calls that take a file descriptor instead of a
+ * path, used for nodes opened with xattrio_node_open. */
+#if defined(__APPLE__) || defined(__DARWIN__) || defined(__linux__) || \
+	defined(__FreeBSD__) || defined(__NetBSD__)
+#define XATTRIO_FD_CALLS 1
+#else
+#define XATTRIO_FD_CALLS 0
+#endif
+
+#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+static ssize_t xattrio_solaris_list(
+	const char *path,
+	int follow_links,
+	char *list,
+	size_t size)
+{
+	int attrdirfd = -1;
+	DIR *dirp = NULL;
+	struct dirent *de = NULL;
+	ssize_t list_size = 0;
+	int err = 0;
+
+	attrdirfd = attropen(
+		path,
+		".",
+		O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
+	if(attrdirfd == -1) {
+		return -1;
+	}
+
+	if(!(dirp = fdopendir(attrdirfd))) {
+		err = errno;
+		close(attrdirfd);
+		errno = err;
+		return -1;
+	}
+
+	errno = 0;
+	while((de = readdir(dirp))) {
+		const size_t name_length = strlen(de->d_name);
+
+		if(de->d_name[0] == '.' && (!de->d_name[1] ||
+			(de->d_name[1] == '.' && !de->d_name[2])))
+		{
+			/* Ignore "." / "..". */
+			continue;
+		}
+
+		if(size) {
+			if(size - list_size < name_length + 1) {
+				err = ERANGE;
+				break;
+			}
+
+			memcpy(&list[list_size], de->d_name, name_length + 1);
+		}
+
+		list_size += name_length + 1;
+		errno = 0;
+	}
+
+	if(!de && !err) {
+		err = errno;
+	}
+
+	if(closedir(dirp) && !err) {
+		err = errno;
+	}
+
+	if(err) {
+		errno = err;
+		return -1;
+	}
+
+	return list_size;
+}
+#endif /* (defined(sun) || defined(__sun)) && ... */
+
+static ssize_t xattrio_native_list(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	char *list,
+	size_t size)
+{
+	ssize_t res;
+
+	(void) ctx;
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	res = listxattr(
+		path,
+		size ? list : NULL,
+		size,
+		follow_links ? 0 : XATTR_NOFOLLOW);
+#elif defined(__linux__)
+	res = (follow_links ? listxattr : llistxattr)(
+		path,
+		size ? list : NULL,
+		size);
+#elif defined(__FreeBSD__) || defined(__NetBSD__)
+	res = (follow_links ? extattr_list_file : extattr_list_link)(
+		path,
+		namespace,
+		size ? list : NULL,
+		size);
+	if(res > 0 && size) {
+		/* Convert the length-prefixed list into a list of
+		 * NUL-terminated strings in place. Each name is moved one byte
+		 * towards the start of the buffer and the freed up byte at its
+		 * end is used for the terminator. */
+		ssize_t ptr = 0;
+
+		while(ptr < res) {
+			const unsigned char cur_len =
+				*((unsigned char*) &list[ptr]);
+
+			if(ptr + 1 + cur_len > res) {
+				/* Truncated list, report it like the other
+				 * platforms do for a too small buffer. */
+				errno = ERANGE;
+				return -1;
+			}
+
+			memmove(&list[ptr], &list[ptr + 1], cur_len);
+			list[ptr + cur_len] = '\0';
+			ptr += cur_len + 1;
+		}
+	}
+#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+	res = xattrio_solaris_list(
+		path,
+		follow_links,
+		list,
+		size);
+#else
+#error "Don't know how to handle extended attributes on this platform."
+#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
+
+	return res;
+}
+
+ssize_t xattrio_list(
+	const char *path,
+	int follow_links,
+	int namespace,
+	char *list,
+	size_t size)
+{
+	struct throttle_call call;
+	unsigned long long start;
+	ssize_t res;
+	int err;
+
+	throttle_begin(xattrio_throttle, &call);
+	xattrio_count_call();
+	start = xattrio_trace ? trace_now() : 0;
+	res = xattrio_backend->list(xattrio_backend->ctx, path, follow_links,
+		namespace, list, size);
+	err = errno;
+	if(xattrio_trace) {
+		trace_add(xattrio_trace, size ? "list" : "list size", path,
+			NULL, start, res);
+	}
+
+	throttle_end(xattrio_throttle, &call,
+		(res > 0 && size) ? (size_t) res : 0);
+	errno = err;
+
+	return res;
+}
+
+static ssize_t xattrio_native_get(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size)
+{
+	ssize_t res;
+
+	(void) ctx;
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	res = getxattr(
+		path,
+		name,
+		size ? value : NULL,
+		size,
+		0,
+		follow_links ? 0 : XATTR_NOFOLLOW);
+#elif defined(__linux__)
+	res = (follow_links ? getxattr : lgetxattr)(
+		path,
+		name,
+		size ? value : NULL,
+		size);
+#elif defined(__FreeBSD__) || defined(__NetBSD__)
+	res = (follow_links ? extattr_get_file : extattr_get_link)(
+		path,
+		namespace,
+		name,
+		size ? value : NULL,
+		size);
+#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+	{
+		int attrfd;
+		struct stat attrstat;
+		int err = 0;
+
+		if(name[0] == '/') {
+			errno = EINVAL;
+			return -1;
+		}
+
+		attrfd = attropen(
+			path,
+			name,
+			O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
+		if(attrfd == -1) {
+			return -1;
+		}
+
+		if(fstat(attrfd, &attrstat)) {
+			res = -1;
+		}
+		else if(!size) {
+			res = attrstat.st_size;
+		}
+		else if((size_t) attrstat.st_size > size) {
+			errno = ERANGE;
+			res = -1;
+		}
+		else {
+			res = read(attrfd, value, attrstat.st_size);
+		}
+
+		if(res == -1) {
+			err = errno;
+		}
+
+		close(attrfd);
+
+		if(err) {
+			errno = err;
+		}
+	}
+#else
+#error "Don't know how to handle extended attributes on this platform."
+#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
+
+	return res;
+}
+
+#if XATTRIO_FD_CALLS
+static ssize_t xattrio_native_fget(
+	int fd,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size)
+{
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	return fgetxattr(fd, name, size ? value : NULL, size, 0, 0);
+#elif defined(__linux__)
+	return fgetxattr(fd, name, size ? value : NULL, size);
+#else
+	return extattr_get_fd(fd, namespace, name, size ? value : NULL, size);
+#endif
+}
+#endif /* XATTRIO_FD_CALLS */
+
+ssize_t xattrio_get(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size)
+{
+	struct xattrio_node node;
+
+	xattrio_node_open(&node, path, follow_links, 0);
+
+	return xattrio_node_get(&node, namespace, name, value, size);
+}
+
+ssize_t xattrio_node_get(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size)
+{
+	struct throttle_call call;
+	unsigned long long start;
+	ssize_t res;
+	int err;
+
+	throttle_begin(xattrio_throttle, &call);
+	xattrio_count_call();
+	start = xattrio_trace ? trace_now() : 0;
+#if XATTRIO_FD_CALLS
+	if(node->fd != -1) {
+		res = xattrio_native_fget(node->fd, namespace, name, value,
+			size);
+	}
+	else
+#endif
+	{
+		res = xattrio_backend->get(xattrio_backend->ctx, node->path,
+			node->follow_links, namespace, name, value, size);
+	}
+	err = errno;
+	if(xattrio_trace) {
+		trace_add(xattrio_trace, size ? "get" : "get size",
+			node->path, name, start, res);
+	}
+
+	throttle_end(xattrio_throttle, &call,
+		(res > 0 && size) ? (size_t) res : 0);
+	errno = err;
+
+	return res;
+}
+
+#if (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+static int xattrio_solaris_set(
+	const char *path,
+	int follow_links,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags)
+{
+	int ret = -1;
+	int attrdirfd = -1;
+	int attrfd = -1;
+	ssize_t bytes_written;
+	int err;
+
+	/* TODO: Solaris allows whole xattr directory hierarchies under a node.
+	 * To support creating attributes in xattr directory hierarchies we must
+	 * split any pathname components and create directories for them if they
+	 * do not exist. At the moment setting such xattrs will fail. */
+	if(name[0] == '/') {
+		errno = EINVAL;
+		return -1;
+	}
+
+	attrdirfd = attropen(
+		path,
+		".",
+		O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
+	if(attrdirfd == -1) {
+		return -1;
+	}
+
+	/* If the attribute existed before, then we should remove it. */
+	if(!(flags & XATTRIO_CREATE) && unlinkat(attrdirfd, name, 0) &&
+		(errno != ENOENT || (flags & XATTRIO_REPLACE)))
+	{
+		goto out;
+	}
+
+	attrfd = openat(attrdirfd, name, O_WRONLY | O_CREAT | O_EXCL, 0777);
+	if(attrfd == -1) {
+		goto out;
+	}
+
+	bytes_written = write(attrfd, value, size);
+	if(bytes_written < 0) {
+		goto out;
+	}
+	else if((size_t) bytes_written != size) {
+		errno = EIO;
+		goto out;
+	}
+
+	ret = 0;
+out:
+	err = errno;
+	if(attrfd != -1) {
+		close(attrfd);
+	}
+
+	close(attrdirfd);
+	errno = err;
+
+	return ret;
+}
+#endif /* (defined(sun) || defined(__sun)) && ... */
+
+static int xattrio_native_set(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags)
+{
+	(void) ctx;
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	return setxattr(
+		path,
+		name,
+		value,
+		size,
+		0,
+		(follow_links ? 0 : XATTR_NOFOLLOW) |
+		((flags & XATTRIO_CREATE) ? XATTR_CREATE : 0) |
+		((flags & XATTRIO_REPLACE) ? XATTR_REPLACE : 0));
+#elif defined(__linux__)
+	return (follow_links ? setxattr : lsetxattr)(
+		path,
+		name,
+		value,
+		size,
+		((flags & XATTRIO_CREATE) ? XATTR_CREATE : 0) |
+		((flags & XATTRIO_REPLACE) ? XATTR_REPLACE : 0));
+#elif defined(__FreeBSD__) || defined(__NetBSD__)
+	(void) flags;
+
+	return ((follow_links ? extattr_set_file : extattr_set_link)(
+		path,
+		namespace,
+		name,
+		value,
+		size) < 0) ? -1 : 0;
+#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+	return xattrio_solaris_set(
+		path,
+		follow_links,
+		name,
+		value,
+		size,
+		flags);
+#else
+#error "Don't know how to handle extended attributes on this platform."
+#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
+}
+
+static int xattrio_native_remove(
+	void *ctx,
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name)
+{
+	(void) ctx;
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	return removexattr(
+		path,
+		name,
+		follow_links ? 0 : XATTR_NOFOLLOW);
+#elif defined(__linux__)
+	return (follow_links ? removexattr : lremovexattr)(
+		path,
+		name);
+#elif defined(__FreeBSD__) || defined(__NetBSD__)
+	return (follow_links ? extattr_delete_file : extattr_delete_link)(
+		path,
+		namespace,
+		name);
+#elif (defined(sun) || defined(__sun)) && (defined(__SVR4) || defined(__svr4__))
+	{
+		int attrdirfd;
+		int res;
+		int err;
+
+		attrdirfd = attropen(
+			path,
+			".",
+			O_RDONLY | (follow_links ? 0 : O_NOFOLLOW));
+		if(attrdirfd == -1) {
+			return -1;
+		}
+
+		res = unlinkat(attrdirfd, name, 0);
+		err = errno;
+		close(attrdirfd);
+		errno = err;
+
+		return res;
+	}
+#else
+#error "Don't know how to handle extended attributes on this platform."
+#endif /* defined(__APPLE__) || defined(__DARWIN__) ... */
+}
+
+const struct xattrio_backend xattrio_native_backend = {
+	"native",
+	xattrio_native_list,
+	xattrio_native_get,
+	xattrio_native_set,
+	xattrio_native_remove,
+	NULL
+};
+
+#if XATTRIO_FD_CALLS
+static int xattrio_native_fset(
+	int fd,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags)
+{
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	return fsetxattr(fd, name, value, size, 0,
+		((flags & XATTRIO_CREATE) ? XATTR_CREATE : 0) |
+		((flags & XATTRIO_REPLACE) ? XATTR_REPLACE : 0));
+#elif defined(__linux__)
+	return fsetxattr(fd, name, value, size,
+		((flags & XATTRIO_CREATE) ? XATTR_CREATE : 0) |
+		((flags & XATTRIO_REPLACE) ? XATTR_REPLACE : 0));
+#else
+	(void) flags;
+
+	return (extattr_set_fd(fd, namespace, name, value, size) < 0) ?
+		-1 : 0;
+#endif
+}
+
+static int xattrio_native_fremove(
+	int fd,
+	int namespace,
+	const char *name)
+{
+	(void) namespace;
+
+#if defined(__APPLE__) || defined(__DARWIN__)
+	return fremovexattr(fd, name, 0);
+#elif defined(__linux__)
+	return fremovexattr(fd, name);
+#else
+	return extattr_delete_fd(fd, namespace, name);
+#endif
+}
+#endif /* XATTRIO_FD_CALLS */
+
+int xattrio_set(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags)
+{
+	struct xattrio_node node;
+
+	xattrio_node_open(&node, path, follow_links, 0);
+
+	return xattrio_node_set(&node, namespace, name, value, size, flags);
+}
+
+int xattrio_node_set(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags)
+{
+	struct throttle_call call;
+	unsigned long long start;
+	int res;
+	int err;
+
+	throttle_begin(xattrio_throttle, &call);
+	xattrio_count_call();
+	start = xattrio_trace ? trace_now() : 0;
+#if XATTRIO_FD_CALLS
+	if(node->fd != -1) {
+		res = xattrio_native_fset(node->fd, namespace, name, value,
+			size, flags);
+	}
+	else
+#endif
+	{
+		res = xattrio_backend->set(xattrio_backend->ctx, node->path,
+			node->follow_links, namespace, name, value, size,
+			flags);
+	}
+	err = errno;
+	if(xattrio_trace) {
+		trace_add(xattrio_trace, "set", node->path, name, start,
+			res);
+	}
+
+	throttle_end(xattrio_throttle, &call, res ? 0 : size);
+	errno = err;
+
+	return res;
+}
+
+int xattrio_remove(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name)
+{
+	struct xattrio_node node;
+
+	xattrio_node_open(&node, path, follow_links, 0);
+
+	return xattrio_node_remove(&node, namespace, name);
+}
+
+int xattrio_node_remove(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name)
+{
+	struct throttle_call call;
+	unsigned long long start;
+	int res;
+	int err;
+
+	throttle_begin(xattrio_throttle, &call);
+	xattrio_count_call();
+	start = xattrio_trace ? trace_now() : 0;
+#if XATTRIO_FD_CALLS
+	if(node->fd != -1) {
+		res = xattrio_native_fremove(node->fd, namespace, name);
+	}
+	else
+#endif
+	{
+		res = xattrio_backend->remove(xattrio_backend->ctx,
+			node->path, node->follow_links, namespace, name);
+	}
+	err = errno;
+	if(xattrio_trace) {
+		trace_add(xattrio_trace, "remove", node->path, name, start,
+			res);
+	}
+
+	throttle_end(xattrio_throttle, &call, 0);
+	errno = err;
+
+	return res;
+}
+
+void xattrio_node_open(
+	struct xattrio_node *node,
+	const char *path,
+	int follow_links,
+	int open_fd)
+{
+	node->path = path;
+	node->follow_links = follow_links;
+	node->fd = -1;
+
+#if XATTRIO_FD_CALLS
+	/* Other backends only know about paths. */
+	if(open_fd && xattrio_backend == &xattrio_native_backend) {
+		do {
+			node->fd = open(path, O_RDONLY | O_NONBLOCK |
+				O_NOCTTY | (follow_links ? 0 : O_NOFOLLOW));
+		} while(node->fd == -1 && errno == EINTR);
+	}
+#else
+	(void) open_fd;
+#endif
+}
+
+void xattrio_node_close(
+	struct xattrio_node *node)
+{
+	if(node->fd != -1) {
+		close(node->fd);
+		node->fd = -1;
+	}
+}
+
+void xattrio_set_trace(
+	struct trace *trace)
+{
+	xattrio_trace = trace;
+}
+
+void xattrio_set_backend(
+	const struct xattrio_backend *backend)
+{
+	xattrio_backend = backend ? backend : &xattrio_native_backend;
+}
+
+int xattrio_backend_init(void)
+{
+	const char *spec = getenv("XATTRPROGS_BACKEND");
+
+	if(!spec || !*spec || !strcmp(spec, "native")) {
+		return 0;
+	}
+
+	if(strncmp(spec, "memory", 6) || (spec[6] && spec[6] != ':')) {
+		fprintf(stderr, "Unknown backend \"%s\" in XATTRPROGS_BACKEND, "
+			"expected \"native\" or \"memory[:<options>]\".\n",
+			spec);
+		return -1;
+	}
+
+	if(memxattr_create(spec[6] ? &spec[7] : "", &xattrio_memxattr)) {
+		return -1;
+	}
+
+	xattrio_set_backend(memxattr_backend(xattrio_memxattr));
+
+	return 0;
+}
+
+void xattrio_backend_cleanup(void)
+{
+	xattrio_set_backend(NULL);
+	if(xattrio_memxattr) {
+		memxattr_destroy(xattrio_memxattr);
+		xattrio_memxattr = NULL;
+	}
+}
+
+int xattrio_buf_reserve(
+	struct xattrio_buf *buf,
+	size_t size)
+{
+	size_t new_size;
+	char *new_data;
+
+	if(buf->data && buf->size >= size) {
+		return 0;
+	}
+
+	new_size = buf->size ? buf->size : 4096;
+	while(new_size < size) {
+		new_size *= 2;
+	}
+
+	new_data = realloc(buf->data, new_size);
+	if(!new_data) {
+		return -1;
+	}
+
+	buf->data = new_data;
+	buf->size = new_size;
+
+	return 0;
+}
+
+void xattrio_buf_free(
+	struct xattrio_buf *buf)
+{
+	if(buf->data) {
+		free(buf->data);
+	}
+
+	buf->data = NULL;
+	buf->size = 0;
+}
+
+ssize_t xattrio_list_buf(
+	const char *path,
+	int follow_links,
+	int namespace,
+	struct xattrio_buf *buf)
+{
+	int retries;
+
+	for(retries = 0; retries < XATTRIO_MAX_RETRIES; ++retries) {
+		ssize_t size;
+		ssize_t res;
+
+		/* Try the buffer that we already have first, this saves the
+		 * size query for the common case of small lists. */
+		if(!XATTRIO_TRUNCATES && buf->data) {
+			res = xattrio_list(path, follow_links, namespace,
+				buf->data, buf->size);
+			if(res >= 0 || errno != ERANGE) {
+				return res;
+			}
+		}
+
+		size = xattrio_list(path, follow_links, namespace, NULL, 0);
+		if(size <= 0) {
+			return size;
+		}
+
+		if(xattrio_buf_reserve(buf, (size_t) size + XATTRIO_TRUNCATES))
+		{
+			return -1;
+		}
+
+		res = xattrio_list(path, follow_links, namespace, buf->data,
+			buf->size);
+		if(XATTRIO_TRUNCATES && res == (ssize_t) buf->size) {
+			/* The list grew and may have been truncated. */
+			continue;
+		}
+		else if(res >= 0 || errno != ERANGE) {
+			return res;
+		}
+	}
+
+	errno = ERANGE;
+	return -1;
+}
+
+ssize_t xattrio_get_buf(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	struct xattrio_buf *buf)
+{
+	struct xattrio_node node;
+
+	xattrio_node_open(&node, path, follow_links, 0);
+
+	return xattrio_node_get_buf(&node, namespace, name, buf);
+}
+
+ssize_t xattrio_node_get_buf(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name,
+	struct xattrio_buf *buf)
+{
+	int retries;
+
+	for(retries = 0; retries < XATTRIO_MAX_RETRIES; ++retries) {
+		ssize_t size;
+		ssize_t res;
+
+		if(!XATTRIO_TRUNCATES && buf->data && buf->size > 1) {
+			res = xattrio_node_get(node, namespace, name, buf->data,
+				buf->size - 1);
+			if(res >= 0) {
+				buf->data[res] = '\0';
+				return res;
+			}
+			else if(errno != ERANGE) {
+				return res;
+			}
+		}
+
+		size = xattrio_node_get(node, namespace, name, NULL, 0);
+		if(size < 0) {
+			return size;
+		}
+
+		if(xattrio_buf_reserve(buf, (size_t) size + 1)) {
+			return -1;
+		}
+
+		if(!size) {
+			buf->data[0] = '\0';
+			return 0;
+		}
+
+		res = xattrio_node_get(node, namespace, name, buf->data,
+			buf->size - 1);
+		if(XATTRIO_TRUNCATES && res > size &&
+			res == (ssize_t) buf->size - 1)
+		{
+			/* The value grew and may have been truncated. */
+			continue;
+		}
+		else if(res >= 0) {
+			buf->data[res] = '\0';
+			return res;
+		}
+		else if(errno != ERANGE) {
+			return res;
+		}
+	}
+
+	errno = ERANGE;
+	return -1;
+}
+
+const char* xattrio_namespace_prefix(
+	int namespace)
+{
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	switch(namespace) {
+#ifdef EXTATTR_NAMESPACE_EMPTY
+	case EXTATTR_NAMESPACE_EMPTY:
+		return "";
+#endif
+	case EXTATTR_NAMESPACE_USER:
+		return "user.";
+	case EXTATTR_NAMESPACE_SYSTEM:
+		return "system.";
+	default:
+		return "";
+	}
+#else
+	(void) namespace;
+
+	return "";
+#endif
+}
+
+const char* xattrio_namespace_parse(
+	const char *qualified_name,
+	int default_namespace,
+	int *out_namespace)
+{
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+	if(!strncmp(qualified_name, "user.", 5)) {
+		*out_namespace = EXTATTR_NAMESPACE_USER;
+		return &qualified_name[5];
+	}
+	else if(!strncmp(qualified_name, "system.", 7)) {
+		*out_namespace = EXTATTR_NAMESPACE_SYSTEM;
+		return &qualified_name[7];
+	}
+#endif
+
+	*out_namespace = default_namespace;
+
+	return qualified_name;
+}
+
+int xattrio_prefix_init(
+	struct xattrio_prefix *filter,
+	const char *prefix)
+{
+	filter->prefix = prefix;
+	filter->length = strlen(prefix);
+	filter->needle = malloc(filter->length + 1);
+	if(!filter->needle) {
+		return -1;
+	}
+
+	filter->needle[0] = '\0';
+	memcpy(&filter->needle[1], prefix, filter->length);
+
+	return 0;
+}
+
+void xattrio_prefix_free(
+	struct xattrio_prefix *filter)
+{
+	if(filter->needle) {
+		free(filter->needle);
+	}
+
+	memset(filter, 0, sizeof(*filter));
+}
+
+const char* xattrio_list_next(
+	const char *list,
+	size_t list_size,
+	size_t *pos,
+	const struct xattrio_prefix *filter,
+	size_t *out_name_length)
+{
+	while(*pos < list_size) {
+		const char *cur = &list[*pos];
+		const size_t remaining = list_size - *pos;
+		const char *end;
+		size_t name_length;
+
+		if(filter && filter->length && (remaining < filter->length ||
+			memcmp(cur, filter->prefix, filter->length)))
+		{
+			/* Jump straight to the next name that starts with the
+			 * prefix instead of walking the list name by name. */
+			const char *hit = memmem(cur, remaining,
+				filter->needle, filter->length + 1);
+
+			if(!hit) {
+				*pos = list_size;
+				break;
+			}
+
+			*pos = (size_t) (hit + 1 - list);
+			continue;
+		}
+
+		end = memchr(cur, '\0', remaining);
+		name_length = end ? (size_t) (end - cur) : remaining;
+		*pos += name_length + 1;
+		*out_name_length = name_length;
+
+		return cur;
+	}
+
+	return NULL;
+}
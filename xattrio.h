@@ -0,0 +1,371 @@
+/*-
+ * xattrio.h - Platform independent helpers for listing and reading extended
+ *             attributes.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_XATTRIO_H
+#define _XATTRPROGS_XATTRIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#if defined(__FreeBSD__) || defined(__NetBSD__)
+#include <sys/extattr.h>
+#define XATTRIO_DEFAULT_NAMESPACE EXTATTR_NAMESPACE_USER
+#else
+#define XATTRIO_DEFAULT_NAMESPACE 0
+#endif
+
+/* Flags for xattrio_set. */
+#define XATTRIO_CREATE 0x1
+#define XATTRIO_REPLACE 0x2
+
+/**
+ * The functions that the xattrio_list, xattrio_get, xattrio_set and
+ * xattrio_remove calls are dispatched to. They take the same arguments as
+ * those calls (plus @ctx) and report errors the same way, with -1 and errno
+ * set. The backend must be safe to call from several threads at once.
+ */
+struct xattrio_backend {
+	const char *name;
+
+	ssize_t (*list)(
+		void *ctx,
+		const char *path,
+		int follow_links,
+		int namespace,
+		char *list,
+		size_t size);
+
+	ssize_t (*get)(
+		void *ctx,
+		const char *path,
+		int follow_links,
+		int namespace,
+		const char *name,
+		void *value,
+		size_t size);
+
+	int (*set)(
+		void *ctx,
+		const char *path,
+		int follow_links,
+		int namespace,
+		const char *name,
+		const void *value,
+		size_t size,
+		int flags);
+
+	int (*remove)(
+		void *ctx,
+		const char *path,
+		int follow_links,
+		int namespace,
+		const char *name);
+
+	void *ctx;
+};
+
+/**
+ * The backend that makes the platform's system calls, used unless another one
+ * is selected.
+ */
+extern const struct xattrio_backend xattrio_native_backend;
+
+struct throttle;
+struct trace;
+
+/**
+ * A growable buffer that is reused between calls so that scanning many nodes
+ * doesn't allocate once per attribute.
+ */
+struct xattrio_buf {
+	char *data;
+	size_t size;
+};
+
+/**
+ * A name prefix filter for attribute lists.
+ */
+struct xattrio_prefix {
+	const char *prefix;
+	size_t length;
+
+	/* A NUL byte followed by the prefix, i.e. what the start of a matching
+	 * name looks like in the middle of a list. */
+	char *needle;
+};
+
+/**
+ * Query or read the list of extended attribute names for @path.
+ *
+ * The list is always returned as a sequence of NUL-terminated names, also on
+ * FreeBSD/NetBSD where the native format is length-prefixed. Passing a @size
+ * of 0 returns the size needed for the list. @namespace is only used on
+ * FreeBSD/NetBSD.
+ *
+ * Returns the number of bytes in the list, or -1 with errno set on error.
+ */
+ssize_t xattrio_list(
+	const char *path,
+	int follow_links,
+	int namespace,
+	char *list,
+	size_t size);
+
+/**
+ * Query or read the value of the extended attribute @name of @path.
+ *
+ * Passing a @size of 0 returns the size of the value. @namespace is only used
+ * on FreeBSD/NetBSD.
+ *
+ * Returns the number of bytes in the value, or -1 with errno set on error.
+ */
+ssize_t xattrio_get(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size);
+
+/**
+ * Set the extended attribute @name of @path to the @size bytes at @value.
+ *
+ * @flags is a combination of XATTRIO_CREATE (fail with EEXIST if the
+ * attribute exists) and XATTRIO_REPLACE (fail if it doesn't). The flags are
+ * ignored on platforms that don't support them. @namespace is only used on
+ * FreeBSD/NetBSD.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+int xattrio_set(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags);
+
+/**
+ * Remove the extended attribute @name of @path. @namespace is only used on
+ * FreeBSD/NetBSD.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+int xattrio_remove(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name);
+
+/**
+ * A node that several calls are made on. If it could be opened, the calls
+ * are made through its file descriptor and @path is only looked up once;
+ * otherwise they go through @path like the calls above.
+ */
+struct xattrio_node {
+	const char *path;
+	int follow_links;
+	int fd;
+};
+
+/**
+ * Set up @node for @path. The node is only opened if @open_fd is set, which
+ * the caller must only do for regular files and directories (opening devices
+ * and FIFOs may have side effects, and symbolic links can't be opened), and
+ * only with the native backend on platforms that have file descriptor calls.
+ * Failing to open it isn't an error, the calls then use the path.
+ */
+void xattrio_node_open(
+	struct xattrio_node *node,
+	const char *path,
+	int follow_links,
+	int open_fd);
+
+void xattrio_node_close(
+	struct xattrio_node *node);
+
+/**
+ * Like xattrio_get, xattrio_set and xattrio_remove, but on @node.
+ */
+ssize_t xattrio_node_get(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name,
+	void *value,
+	size_t size);
+
+int xattrio_node_set(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name,
+	const void *value,
+	size_t size,
+	int flags);
+
+int xattrio_node_remove(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name);
+
+/**
+ * Read the attribute name list of @path into the reusable buffer @buf,
+ * growing it when needed and retrying if the list changes between the size
+ * query and the actual read.
+ *
+ * Returns the size of the list, or -1 with errno set on error.
+ */
+ssize_t xattrio_list_buf(
+	const char *path,
+	int follow_links,
+	int namespace,
+	struct xattrio_buf *buf);
+
+/**
+ * Read the value of attribute @name of @path into the reusable buffer @buf,
+ * growing it when needed. The value is always followed by a NUL byte that is
+ * not included in the returned size.
+ *
+ * Returns the size of the value, or -1 with errno set on error.
+ */
+ssize_t xattrio_get_buf(
+	const char *path,
+	int follow_links,
+	int namespace,
+	const char *name,
+	struct xattrio_buf *buf);
+
+/**
+ * Like xattrio_get_buf, but on @node.
+ */
+ssize_t xattrio_node_get_buf(
+	const struct xattrio_node *node,
+	int namespace,
+	const char *name,
+	struct xattrio_buf *buf);
+
+/**
+ * Get the prefix that qualifies names in @namespace when attributes are
+ * written out together with their namespace ("user.", "system." and so on on
+ * FreeBSD/NetBSD). Returns "" on platforms where the namespace is already part
+ * of the name.
+ */
+const char* xattrio_namespace_prefix(
+	int namespace);
+
+/**
+ * Split a qualified name as produced with xattrio_namespace_prefix into its
+ * namespace and name. On FreeBSD/NetBSD a "user." or "system." prefix selects
+ * the namespace, names without a known prefix get @default_namespace. On other
+ * platforms the name is returned unchanged.
+ *
+ * Returns the name without the namespace prefix.
+ */
+const char* xattrio_namespace_parse(
+	const char *qualified_name,
+	int default_namespace,
+	int *out_namespace);
+
+/**
+ * Set up @filter to match names starting with @prefix.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+int xattrio_prefix_init(
+	struct xattrio_prefix *filter,
+	const char *prefix);
+
+void xattrio_prefix_free(
+	struct xattrio_prefix *filter);
+
+/**
+ * Get the next name in the attribute list @list starting at offset *@pos and
+ * advance *@pos past it. If @filter is non-NULL, names that don't start with
+ * the filter's prefix are skipped without looking at them one by one.
+ *
+ * Returns the name (with its length in *@out_name_length), or NULL when the
+ * end of the list is reached.
+ */
+const char* xattrio_list_next(
+	const char *list,
+	size_t list_size,
+	size_t *pos,
+	const struct xattrio_prefix *filter,
+	size_t *out_name_length);
+
+/**
+ * Make sure that @buf can hold at least @size bytes.
+ *
+ * Returns 0 on success, or -1 with errno set on error.
+ */
+int xattrio_buf_reserve(
+	struct xattrio_buf *buf,
+	size_t size);
+
+void xattrio_buf_free(
+	struct xattrio_buf *buf);
+
+/**
+ * Record all following calls in @trace (see trace.h), or stop recording if
+ * it's NULL. Must be called before any worker threads are started.
+ */
+void xattrio_set_trace(
+	struct trace *trace);
+
+/**
+ * Dispatch all following calls to @backend, or to the native backend if it's
+ * NULL. Must be called before any worker threads are started.
+ */
+void xattrio_set_backend(
+	const struct xattrio_backend *backend);
+
+/**
+ * Select the backend named by the XATTRPROGS_BACKEND environment variable:
+ * "native" (the default when it's unset) or "memory[:<options>]" for the
+ * in-memory backend (see memxattr.h). Called once at startup by each tool.
+ *
+ * Returns 0 on success, or -1 after reporting the error.
+ */
+int xattrio_backend_init(void);
+
+/**
+ * Free the backend set up by xattrio_backend_init and go back to the native
+ * one.
+ */
+void xattrio_backend_cleanup(void);
+
+/**
+ * Throttle all following xattrio_list, xattrio_get, xattrio_set and
+ * xattrio_remove calls with @throttle (see throttle.h), or stop throttling if
+ * it's NULL. Must be called before any worker threads are started.
+ */
+void xattrio_set_throttle(
+	struct throttle *throttle);
+
+/**
+ * Count the xattrio_list, xattrio_get, xattrio_set and xattrio_remove calls
+ * made from now on by the calling thread in *@counter, or stop counting if
+ * it's NULL. @counter must stay valid until counting is stopped.
+ */
+void xattrio_count_calls(
+	unsigned long long *counter);
+
+#endif /* !defined(_XATTRPROGS_XATTRIO_H) */
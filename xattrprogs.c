@@ -0,0 +1,104 @@
+/*-
+ * xattrprogs.c - Multi-call binary running any of the tools.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xattrprogs.h"
+
+struct xattrprogs_tool {
+	const char *name;
+	int (*main)(int argc, char **argv);
+};
+
+static const struct xattrprogs_tool xattrprogs_tools[] = {
+	{ "getxattr", getxattr_main },
+	{ "grepxattr", grepxattr_main },
+	{ "listxattr", listxattr_main },
+	{ "mvxattr", mvxattr_main },
+	{ "removexattr", removexattr_main },
+	{ "setxattr", setxattr_main },
+};
+
+#define XATTRPROGS_TOOLS_COUNT \
+	(sizeof(xattrprogs_tools) / sizeof(xattrprogs_tools[0]))
+
+/**
+ * Find the tool called @name. A trailing ".exe" is ignored.
+ */
+static const struct xattrprogs_tool* xattrprogs_find(
+	const char *name)
+{
+	size_t name_length = strlen(name);
+	size_t i;
+
+	if(name_length > 4 && !strcmp(&name[name_length - 4], ".exe")) {
+		name_length -= 4;
+	}
+
+	for(i = 0; i < XATTRPROGS_TOOLS_COUNT; ++i) {
+		if(strlen(xattrprogs_tools[i].name) == name_length &&
+			!memcmp(xattrprogs_tools[i].name, name, name_length))
+		{
+			return &xattrprogs_tools[i];
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	const struct xattrprogs_tool *tool = NULL;
+	const char *progname;
+	size_t i;
+
+	/* Started through a link named after a tool, e.g. "getxattr ...". */
+	progname = argc > 0 ? strrchr(argv[0], '/') : NULL;
+	progname = progname ? progname + 1 : (argc > 0 ? argv[0] : "");
+	tool = xattrprogs_find(progname);
+	if(tool) {
+		return tool->main(argc, argv);
+	}
+
+	/* Started as "xattrprogs <tool> ...". */
+	if(argc > 1) {
+		tool = xattrprogs_find(argv[1]);
+		if(tool) {
+			return tool->main(argc - 1, &argv[1]);
+		}
+	}
+
+	fprintf(stderr, "usage: xattrprogs <tool> [<arguments>...]\n"
+		"\n"
+		"Tools:");
+	for(i = 0; i < XATTRPROGS_TOOLS_COUNT; ++i) {
+		fprintf(stderr, " %s", xattrprogs_tools[i].name);
+	}
+
+	fprintf(stderr, "\n");
+
+	return (EXIT_FAILURE);
+}
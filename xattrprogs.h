@@ -0,0 +1,37 @@
+/*-
+ * xattrprogs.h - Entry points of the tools.
+ *
+ * Copyright (c) 2023 Erik Larsson
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _XATTRPROGS_XATTRPROGS_H
+#define _XATTRPROGS_XATTRPROGS_H
+
+/*
+ * The main functions of the tools. Each tool is built as its own program, or
+ * with XATTRPROGS_MULTICALL defined all of them go into the single xattrprogs
+ * program, which runs the one named by its argv[0] or first argument.
+ */
+
+int getxattr_main(int argc, char **argv);
+int grepxattr_main(int argc, char **argv);
+int listxattr_main(int argc, char **argv);
+int mvxattr_main(int argc, char **argv);
+int removexattr_main(int argc, char **argv);
+int setxattr_main(int argc, char **argv);
+
+#endif /* !defined(_XATTRPROGS_XATTRPROGS_H) */